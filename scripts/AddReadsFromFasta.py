@@ -7,16 +7,17 @@ import sys
 # Read the config file.
 config = GetConfig.getConfig()
 
-helpMessage = "Invoke with one argument, the name of the Fasta file."
+helpMessage = "Invoke with one or more arguments, the names of the Fasta or Fastq files."
 
-if not len(sys.argv)==2:
+if len(sys.argv)<2:
     print(helpMessage)
     exit(1)
     
-fileName = sys.argv[1]
+fileNames = sys.argv[1:]
 
 a = shasta.Assembler()
-a.addReadsFromFasta(
-    fileName = fileName, 
-    minReadLength = int(config['Reads']['minReadLength']))
+a.addReads(
+    fileNames = fileNames, 
+    minReadLength = int(config['Reads']['minReadLength']),
+    targetBaseCount = int(config['Reads']['targetBaseCount']))
 
@@ -0,0 +1,44 @@
+#!/usr/bin/python3
+
+import ast
+import shasta
+import GetConfig
+import sys
+
+helpMessage = """
+This computes alignments for the first alignment candidates 
+using each of the available alignment methods,
+with and without a band if Align.bandHalfWidth is not zero,
+and writes timing and comparison information.
+No alignments are stored.
+
+Invoke with one optional argument: the number of alignment candidates
+to use (default 10000).
+"""
+
+# Get the arguments.
+if len(sys.argv) > 2:
+    print(helpMessage)
+    exit(1)
+candidateCount = 10000
+if len(sys.argv) == 2:
+    candidateCount = int(sys.argv[1]);
+
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+if ast.literal_eval(config['Kmers']['storeSortedMarkers']):
+    a.accessSortedMarkers()
+a.accessAlignmentCandidates()
+
+# Do the computation.
+a.compareAlignmentMethods(
+    maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+    maxSkip = int(config['Align']['maxSkip']),
+    bandHalfWidth = int(config['Align']['bandHalfWidth']),
+    candidateCount = candidateCount)
+
@@ -1,5 +1,6 @@
 #!/usr/bin/python3
 
+import ast
 import shasta
 import GetConfig
 import sys
@@ -11,6 +12,8 @@ config = GetConfig.getConfig()
 a = shasta.Assembler()
 a.accessKmers()
 a.accessMarkers()
+if ast.literal_eval(config['Kmers']['storeSortedMarkers']):
+    a.accessSortedMarkers()
 a.accessAlignmentCandidates()
 
 # Do the computation.
@@ -18,5 +21,9 @@ a.computeAlignments(
     maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
     maxSkip = int(config['Align']['maxSkip']),
     minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
-    maxTrim = int(config['Align']['maxTrim']))
+    maxTrim = int(config['Align']['maxTrim']),
+    alignMethod = int(config['Align']['alignMethod']),
+    bandHalfWidth = int(config['Align']['bandHalfWidth']),
+    storeAlignments = ast.literal_eval(config['Align']['storeAlignments']),
+    maxCandidatesPerRead = int(config['Align']['maxCandidatesPerRead']))
 
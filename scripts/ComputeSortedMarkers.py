@@ -0,0 +1,8 @@
+#!/usr/bin/python3
+
+import shasta
+
+a = shasta.Assembler()
+a.accessMarkers()
+a.computeSortedMarkers()
+
@@ -1,5 +1,6 @@
 #!/usr/bin/python3
 
+import ast
 import shasta
 import GetConfig
 import sys
@@ -11,6 +12,8 @@ config = GetConfig.getConfig()
 a = shasta.Assembler()
 a.accessKmers()
 a.accessMarkers()
+if ast.literal_eval(config['Kmers']['storeSortedMarkers']):
+    a.accessSortedMarkers()
 a.accessAlignmentData()
 a.accessReadGraph()
 a.accessReadFlags()
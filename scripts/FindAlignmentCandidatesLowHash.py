@@ -2,6 +2,7 @@
 
 import shasta
 import GetConfig
+import ast
 import sys
 
 helpMessage="""
@@ -29,5 +30,9 @@ a.findAlignmentCandidatesLowHash(
     hashFraction = float(config['MinHash']['hashFraction']),
     minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
     maxBucketSize = int(config['MinHash']['maxBucketSize']),
-    minFrequency = int(config['MinHash']['minFrequency']))
+    minFrequency = int(config['MinHash']['minFrequency']),
+    useRollingHash = ast.literal_eval(config['MinHash']['useRollingHash']),
+    maxDiagonalDelta = int(config['MinHash']['maxDiagonalDelta']),
+    bucketPassCount = int(config['MinHash']['bucketPassCount']),
+    targetCandidatesPerRead = float(config['MinHash']['targetCandidatesPerRead']))
 
@@ -1,5 +1,6 @@
 #!/usr/bin/python3
 
+import ast
 import shasta
 import GetConfig
 import sys
@@ -18,6 +19,8 @@ a = shasta.Assembler()
 a.accessKmers()
 a.accessReadFlags(readWriteAccess = True)
 a.accessMarkers()
+if ast.literal_eval(config['Kmers']['storeSortedMarkers']):
+    a.accessSortedMarkers()
 
 # Do the computation.
 a.flagPalindromicReads(
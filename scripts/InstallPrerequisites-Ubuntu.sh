@@ -8,6 +8,7 @@ apt install -y g++
 apt install -y cmake
 apt install -y libboost-all-dev
 apt install -y libpng-dev
+apt install -y zlib1g-dev
 apt install -y graphviz
 apt install -y ncbi-blast+
 apt install -y python3
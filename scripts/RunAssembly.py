@@ -46,12 +46,23 @@ def runAssembly(a, config, fastaFileNames):
     if useMarginPhase:
         a.setupMarginPhase()
     
-    # Read the input fasta files.
-    for fileName in fastaFileNames:  
-        print('Reading input file', fileName, flush=True) 
-        a.addReadsFromFasta(
-            fileName = fileName, 
-            minReadLength = int(config['Reads']['minReadLength']))
+    # If requested, use compact storage for read names.
+    # This is done before reading the input files,
+    # so the names are encoded as the reads are added.
+    if ast.literal_eval(config['Reads']['compressReadNames']):
+        a.compressReadNames()
+    
+    # Read the input fasta or fastq files.
+    # The files are processed concurrently.
+    print('Reading input files', fastaFileNames, flush=True) 
+    a.addReads(
+        fileNames = fastaFileNames, 
+        minReadLength = int(config['Reads']['minReadLength']),
+        targetBaseCount = int(config['Reads']['targetBaseCount']))
+    
+    # If requested, use compact storage for read repeat counts.
+    if ast.literal_eval(config['Reads']['compressRepeatCounts']):
+        a.compressReadRepeatCounts()
 
     # Initialize read flags.
     a.initializeReadFlags()            
@@ -60,12 +71,33 @@ def runAssembly(a, config, fastaFileNames):
     a.histogramReadLength(fileName="ReadLengthHistogram.csv")
     
     # Randomly select the k-mers that will be used as markers.
-    a.randomlySelectKmers(
-        k = int(config['Kmers']['k']), 
-        probability = float(config['Kmers']['probability']))
+    if ast.literal_eval(config['Kmers']['selectByHash']):
+        a.selectKmersByHash(
+            k = int(config['Kmers']['k']), 
+            probability = float(config['Kmers']['probability']))
+    else:
+        a.randomlySelectKmers(
+            k = int(config['Kmers']['k']), 
+            probability = float(config['Kmers']['probability']))
+    
+    # If requested, mask k-mers that are too rare or too frequent.
+    minKmerFrequency = int(config['Kmers']['minFrequency'])
+    maxKmerFrequency = int(config['Kmers']['maxFrequency'])
+    if minKmerFrequency!=0 or maxKmerFrequency!=0:
+        a.maskKmersByFrequency(
+            minFrequency = minKmerFrequency,
+            maxFrequency = maxKmerFrequency)
         
     # Find the markers in the reads.
-    a.findMarkers()
+    a.findMarkers(
+        storeMarkersForStrand0Only =
+        ast.literal_eval(config['Kmers']['storeMarkersForStrand0Only']),
+        compressMarkers =
+        ast.literal_eval(config['Kmers']['compressMarkers']))
+    
+    # If requested, store the markers of each read sorted by kmerId.
+    if ast.literal_eval(config['Kmers']['storeSortedMarkers']):
+        a.computeSortedMarkers()
     
     # Flag palindromic reads.
     # These wil be excluded from further processing.
@@ -76,13 +108,43 @@ def runAssembly(a, config, fastaFileNames):
         nearDiagonalFractionThreshold = float(config['Reads']['palindromicReads.nearDiagonalFractionThreshold']),
         deltaThreshold = int(config['Reads']['palindromicReads.deltaThreshold']))
         
+    # Find alignment candidates and compute alignments,
+    # without storing the alignment candidates.
+    streamCandidates = ast.literal_eval(config['Align']['streamCandidates'])
+    if streamCandidates and int(config['Align']['maxCandidatesPerRead']) != 0:
+        raise Exception('Align.maxCandidatesPerRead must be 0 when Align.streamCandidates is True.')
+    if streamCandidates:
+        a.findAlignmentCandidatesLowHashAndComputeAlignments(
+            m = int(config['MinHash']['m']), 
+            hashFraction = float(config['MinHash']['hashFraction']),
+            minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
+            maxBucketSize = int(config['MinHash']['maxBucketSize']),
+            minFrequency = int(config['MinHash']['minFrequency']),
+            useRollingHash = ast.literal_eval(config['MinHash']['useRollingHash']),
+            maxDiagonalDelta = int(config['MinHash']['maxDiagonalDelta']),
+            bucketPassCount = int(config['MinHash']['bucketPassCount']),
+            targetCandidatesPerRead = float(config['MinHash']['targetCandidatesPerRead']),
+            maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+            maxSkip = int(config['Align']['maxSkip']),
+            minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
+            maxTrim = int(config['Align']['maxTrim']),
+            alignMethod = int(config['Align']['alignMethod']),
+            bandHalfWidth = int(config['Align']['bandHalfWidth']),
+            storeAlignments = ast.literal_eval(config['Align']['storeAlignments']),
+            sendThreadCount = int(config['Align']['streamSendThreadCount']))
+        
     # Find alignment candidates.
-    a.findAlignmentCandidatesLowHash(
-        m = int(config['MinHash']['m']), 
-        hashFraction = float(config['MinHash']['hashFraction']),
-        minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
-        maxBucketSize = int(config['MinHash']['maxBucketSize']),
-        minFrequency = int(config['MinHash']['minFrequency']))
+    if not streamCandidates:
+        a.findAlignmentCandidatesLowHash(
+            m = int(config['MinHash']['m']), 
+            hashFraction = float(config['MinHash']['hashFraction']),
+            minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
+            maxBucketSize = int(config['MinHash']['maxBucketSize']),
+            minFrequency = int(config['MinHash']['minFrequency']),
+            useRollingHash = ast.literal_eval(config['MinHash']['useRollingHash']),
+            maxDiagonalDelta = int(config['MinHash']['maxDiagonalDelta']),
+            bucketPassCount = int(config['MinHash']['bucketPassCount']),
+            targetCandidatesPerRead = float(config['MinHash']['targetCandidatesPerRead']))
     """
     # Old MinHash code to find alignment candidates. 
     # If using this, make sure to set MinHash.minHashIterationCount
@@ -95,11 +157,16 @@ def runAssembly(a, config, fastaFileNames):
     """
     
     # Compute alignments.
-    a.computeAlignments(
-        maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
-        maxSkip = int(config['Align']['maxSkip']),
-        minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
-        maxTrim = int(config['Align']['maxTrim']))
+    if not streamCandidates:
+        a.computeAlignments(
+            maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+            maxSkip = int(config['Align']['maxSkip']),
+            minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
+            maxTrim = int(config['Align']['maxTrim']),
+            alignMethod = int(config['Align']['alignMethod']),
+            bandHalfWidth = int(config['Align']['bandHalfWidth']),
+            storeAlignments = ast.literal_eval(config['Align']['storeAlignments']),
+            maxCandidatesPerRead = int(config['Align']['maxCandidatesPerRead']))
         
     # Create the read graph.
     a.createReadGraph(
@@ -1,4 +1,22 @@
+set -e
+
 echo "Checking that the shasta exe was created: shasta-install/bin/shasta"
 [ -e shasta-install/bin/shasta ]
 echo "Checking that the shasta library was created: shasta-install/bin/shasta.so"
-[ -e shasta-install/bin/shasta.so ]
\ No newline at end of file
+[ -e shasta-install/bin/shasta.so ]
+
+echo "Running k-mer and marker tests"
+PYTHONPATH=shasta-install/bin python3 -c "import shasta; shasta.testKmerHashSelection(); shasta.testMarkers()"
+
+# Also build with -DLONG_KMERS=ON, which changes the KmerId type,
+# and run the same tests, which then also cover k > 16.
+echo "Building with -DLONG_KMERS=ON"
+mkdir ../shasta-build-long-kmers
+cd ../shasta-build-long-kmers
+cmake -DLONG_KMERS=ON ..
+make all
+make install
+echo "Checking that the shasta library was created with -DLONG_KMERS=ON"
+[ -e shasta-install/bin/shasta.so ]
+echo "Running k-mer and marker tests with -DLONG_KMERS=ON"
+PYTHONPATH=shasta-install/bin python3 -c "import shasta; shasta.testKmerHashSelection(); shasta.testMarkers()"
@@ -22,6 +22,22 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(10000),
         "Read length cutoff.")
 
+        ("Reads.targetBaseCount",
+        value<uint64_t>(&Reads.targetBaseCount)->
+        default_value(0),
+        "If not 0, only use the longest reads, up to this total number of bases. "
+        "Each input file is read once, so standard input can be used.")
+
+        ("Reads.compressRepeatCounts",
+        value<string>(&Reads.compressRepeatCounts)->
+        default_value("False"),
+        "Store read repeat counts using about 4 bits per base instead of 8.")
+
+        ("Reads.compressReadNames",
+        value<string>(&Reads.compressReadNames)->
+        default_value("False"),
+        "Store read names in a compact, tokenized representation.")
+
         ("Reads.palindromicReads.maxSkip",
         value<int>(&Reads.palindromicReads.maxSkip)->
         default_value(100),
@@ -57,6 +73,42 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(0.1, "0.1"),
         "Probability that a k-mer is used as a marker.")
 
+        ("Kmers.selectByHash",
+        value<string>(&Kmers.selectByHash)->
+        default_value("False"),
+        "Select marker k-mers using a hash instead of a k-mer table. "
+        "Required for k > 16.")
+
+        ("Kmers.minFrequency",
+        value<int>(&Kmers.minFrequency)->
+        default_value(0),
+        "Do not use as markers k-mers that occur less than this number of times in the reads.")
+
+        ("Kmers.maxFrequency",
+        value<int>(&Kmers.maxFrequency)->
+        default_value(0),
+        "Do not use as markers k-mers that occur more than this number of times in the reads "
+        "(0 means no limit).")
+
+        ("Kmers.storeMarkersForStrand0Only",
+        value<string>(&Kmers.storeMarkersForStrand0Only)->
+        default_value("False"),
+        "Only store markers for strand 0 of each read, to reduce memory.")
+
+        ("Kmers.compressMarkers",
+        value<string>(&Kmers.compressMarkers)->
+        default_value("False"),
+        "Only store markers for strand 0 of each read, packed in blocks, "
+        "using about 3.9 bytes per marker instead of 14. Requires k <= 20.")
+
+        ("Kmers.storeSortedMarkers",
+        value<string>(&Kmers.storeSortedMarkers)->
+        default_value("False"),
+        "Store the markers of each oriented read sorted by kmerId, "
+        "to avoid sorting them during alignment computations. "
+        "Uses 4 bytes for each marker of a read (2 on each strand), "
+        "adding about 30% to marker memory with the default marker storage.")
+
         ("MinHash.m",
         value<int>(&MinHash.m)->
         default_value(4),
@@ -83,6 +135,29 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         "The minimum number of times a pair of reads must be found by the MinHash/LowHash algorithm "
         "in order to be considered a candidate alignment.")
 
+        ("MinHash.useRollingHash",
+        value<string>(&MinHash.useRollingHash)->
+        default_value("False"),
+        "Hash LowHash features using a rolling hash, which is faster for large m.")
+
+        ("MinHash.maxDiagonalDelta",
+        value<int>(&MinHash.maxDiagonalDelta)->
+        default_value(0),
+        "If not zero, only keep pairs of reads with at least MinHash.minFrequency "
+        "LowHash hits on diagonals within this number of markers of each other.")
+
+        ("MinHash.bucketPassCount",
+        value<int>(&MinHash.bucketPassCount)->
+        default_value(1),
+        "The number of passes used to process LowHash buckets. "
+        "Increase to reduce memory usage for large numbers of reads.")
+
+        ("MinHash.targetCandidatesPerRead",
+        value<double>(&MinHash.targetCandidatesPerRead)->
+        default_value(0.),
+        "If not zero, MinHash.hashFraction and MinHash.maxBucketSize are adjusted "
+        "automatically to obtain approximately this number of alignment candidates per read.")
+
         ("Align.maxSkip",
         value<int>(&Align.maxSkip)->
         default_value(30),
@@ -103,6 +178,44 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(30),
         "The maximum number of trim markers tolerated at the beginning and end of an alignment.")
 
+        ("Align.streamCandidates",
+        value<string>(&Align.streamCandidates)->
+        default_value("False"),
+        "Send alignment candidates directly to the alignment computation, "
+        "without storing them.")
+
+        ("Align.streamSendThreadCount",
+        value<int>(&Align.streamSendThreadCount)->
+        default_value(0),
+        "If Align.streamCandidates is True, the number of threads used to send "
+        "candidates while the remaining threads compute alignments. "
+        "0 = one quarter of the threads, and at least one.")
+
+        ("Align.alignMethod",
+        value<int>(&Align.alignMethod)->
+        default_value(0),
+        "The method used to compute alignments: 0 = alignment graph with shortest path, "
+        "1 = the same shortest path without storing edges "
+        "(experimental, identical alignments).")
+
+        ("Align.bandHalfWidth",
+        value<int>(&Align.bandHalfWidth)->
+        default_value(0),
+        "If not zero, only use marker pairs within this number of markers "
+        "of the dominant alignment diagonal.")
+
+        ("Align.storeAlignments",
+        value<string>(&Align.storeAlignments)->
+        default_value("False"),
+        "Store the alignments found, so they don't have to be "
+        "computed again when creating marker graph vertices.")
+
+        ("Align.maxCandidatesPerRead",
+        value<int>(&Align.maxCandidatesPerRead)->
+        default_value(0),
+        "If not zero, rank the alignment candidates of each read by shared markers "
+        "and only compute alignments for this number of the best candidates per read.")
+
         ("ReadGraph.maxAlignmentCount",
         value<int>(&ReadGraph.maxAlignmentCount)->
         default_value(6),
@@ -201,6 +314,9 @@ void AssemblyOptions::ReadsOptions::write(ostream& s) const
 {
     s << "[Reads]\n";
     s << "minReadLength = " << minReadLength << "\n";
+    s << "targetBaseCount = " << targetBaseCount << "\n";
+    s << "compressRepeatCounts = " << compressRepeatCounts << "\n";
+    s << "compressReadNames = " << compressReadNames << "\n";
     palindromicReads.write(s);
 }
 
@@ -211,6 +327,12 @@ void AssemblyOptions::KmersOptions::write(ostream& s) const
     s << "[Kmers]\n";
     s << "k = " << k << "\n";
     s << "probability = " << probability << "\n";
+    s << "selectByHash = " << selectByHash << "\n";
+    s << "minFrequency = " << minFrequency << "\n";
+    s << "maxFrequency = " << maxFrequency << "\n";
+    s << "storeMarkersForStrand0Only = " << storeMarkersForStrand0Only << "\n";
+    s << "compressMarkers = " << compressMarkers << "\n";
+    s << "storeSortedMarkers = " << storeSortedMarkers << "\n";
 }
 
 
@@ -223,6 +345,10 @@ void AssemblyOptions::MinHashOptions::write(ostream& s) const
     s << "minHashIterationCount = " << minHashIterationCount << "\n";
     s << "maxBucketSize = " << maxBucketSize << "\n";
     s << "minFrequency = " << minFrequency << "\n";
+    s << "useRollingHash = " << useRollingHash << "\n";
+    s << "maxDiagonalDelta = " << maxDiagonalDelta << "\n";
+    s << "bucketPassCount = " << bucketPassCount << "\n";
+    s << "targetCandidatesPerRead = " << targetCandidatesPerRead << "\n";
 }
 
 
@@ -234,6 +360,12 @@ void AssemblyOptions::AlignOptions::write(ostream& s) const
     s << "maxMarkerFrequency = " << maxMarkerFrequency << "\n";
     s << "minAlignedMarkerCount = " << minAlignedMarkerCount << "\n";
     s << "maxTrim = " << maxTrim << "\n";
+    s << "streamCandidates = " << streamCandidates << "\n";
+    s << "streamSendThreadCount = " << streamSendThreadCount << "\n";
+    s << "alignMethod = " << alignMethod << "\n";
+    s << "bandHalfWidth = " << bandHalfWidth << "\n";
+    s << "storeAlignments = " << storeAlignments << "\n";
+    s << "maxCandidatesPerRead = " << maxCandidatesPerRead << "\n";
 }
 
 
@@ -5,6 +5,7 @@
 #include <boost/program_options.hpp>
 
 // Standard library.
+#include "cstdint.hpp"
 #include "iostream.hpp"
 #include "string.hpp"
 #include "vector.hpp"
@@ -27,6 +28,9 @@ public:
     class ReadsOptions {
     public:
         int minReadLength;
+        uint64_t targetBaseCount;
+        string compressRepeatCounts;    // False or True
+        string compressReadNames;       // False or True
         class PalindromicReadOptions {
         public:
             int maxSkip;
@@ -48,6 +52,12 @@ public:
     public:
         int k;
         double probability;
+        string selectByHash;            // False or True
+        int minFrequency;
+        int maxFrequency;
+        string storeMarkersForStrand0Only;  // False or True
+        string compressMarkers;             // False or True
+        string storeSortedMarkers;          // False or True
         void write(ostream&) const;
     };
     KmersOptions Kmers;
@@ -61,6 +71,10 @@ public:
         int minHashIterationCount;
         int maxBucketSize;
         int minFrequency;
+        string useRollingHash;          // False or True
+        int maxDiagonalDelta;
+        int bucketPassCount;
+        double targetCandidatesPerRead;
         void write(ostream&) const;
     };
     MinHashOptions MinHash;
@@ -73,6 +87,12 @@ public:
         int maxMarkerFrequency;
         int minAlignedMarkerCount;
         int maxTrim;
+        string streamCandidates;        // False or True
+        int streamSendThreadCount;
+        int alignMethod;
+        int bandHalfWidth;
+        string storeAlignments;         // False or True
+        int maxCandidatesPerRead;
         void write(ostream&) const;
     };
     AlignOptions Align;
@@ -82,7 +82,7 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
         "It provides limited Shasta functionality, "
         "at reduced performance when using the default options,"
         "but has no dependencies and requires no installation.\n\n"
-        "To run an assembly, use the \"--input\" option to specify the input Fasta files. "
+        "To run an assembly, use the \"--input\" option to specify the input Fasta or Fastq files. "
         "See below for a description of the other options and parameters.\n\n"
         "Default values of assembly parameters are optimized for an assembly "
         "at coverage 60x. If your data have significantly different coverage, "
@@ -114,7 +114,7 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
 
         ("input",
         value< vector<string> >(&inputFastaFileNames)->multitoken(),
-        "Names of input FASTA files. Specify at least one.")
+        "Names of input FASTA or FASTQ files. Specify at least one.")
 
         ("output",
         value<string>(&outputDirectory)->
@@ -252,8 +252,13 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
     // Find absolute paths of the input fasta files.
     // We will use them below after changing directory to the output directory.
     vector<string> inputFastaFileAbsolutePaths;
+    // A file name of "-" means standard input and is left unchanged.
     for(const string& inputFastaFileName: inputFastaFileNames) {
-        inputFastaFileAbsolutePaths.push_back(filesystem::getAbsolutePath(inputFastaFileName));
+        if(inputFastaFileName == "-") {
+            inputFastaFileAbsolutePaths.push_back(inputFastaFileName);
+        } else {
+            inputFastaFileAbsolutePaths.push_back(filesystem::getAbsolutePath(inputFastaFileName));
+        }
     }
 
     // If the output directory exists, stop.
@@ -422,19 +427,35 @@ void ChanZuckerberg::shasta::main::runAssembly(
     // at least for now.
     assembler.setupConsensusCaller("SimpleConsensusCaller");
 
-    // Add reads from the specified FASTA files.
-    for(const string& inputFastaFileName: inputFastaFileNames) {
-        assembler.addReadsFromFasta(
-            inputFastaFileName,
-            assemblyOptions.Reads.minReadLength,
-            2ULL * 1024ULL * 1024ULL * 1024ULL,
-            1,
-            0);
+    // If requested, use compact storage for read names.
+    // This is done before adding reads,
+    // so the names are encoded as the reads are added.
+    if(assemblyOptions.Reads.compressReadNames == "True") {
+        assembler.compressReadNames(0);
+    } else if(assemblyOptions.Reads.compressReadNames != "False") {
+        throw runtime_error("Reads.compressReadNames must be False or True.");
     }
+
+    // Add reads from the specified input files.
+    // The files are processed concurrently.
+    assembler.addReads(
+        inputFastaFileNames,
+        assemblyOptions.Reads.minReadLength,
+        2ULL * 1024ULL * 1024ULL * 1024ULL,
+        0,
+        0,
+        assemblyOptions.Reads.targetBaseCount);
     if(assembler.readCount() == 0) {
         throw runtime_error("There are no input reads.");
     }
 
+    // If requested, use compact storage for read repeat counts.
+    if(assemblyOptions.Reads.compressRepeatCounts == "True") {
+        assembler.compressReadRepeatCounts(0);
+    } else if(assemblyOptions.Reads.compressRepeatCounts != "False") {
+        throw runtime_error("Reads.compressRepeatCounts must be False or True.");
+    }
+
 
     // Initialize read flags.
     assembler.initializeReadFlags();
@@ -443,12 +464,50 @@ void ChanZuckerberg::shasta::main::runAssembly(
     assembler.histogramReadLength("ReadLengthHistogram.csv");
 
     // Randomly select the k-mers that will be used as markers.
-    assembler.randomlySelectKmers(
-        assemblyOptions.Kmers.k,
-        assemblyOptions.Kmers.probability, 231);
+    if(assemblyOptions.Kmers.selectByHash == "True") {
+        assembler.selectKmersByHash(
+            assemblyOptions.Kmers.k,
+            assemblyOptions.Kmers.probability, 231);
+    } else if(assemblyOptions.Kmers.selectByHash == "False") {
+        assembler.randomlySelectKmers(
+            assemblyOptions.Kmers.k,
+            assemblyOptions.Kmers.probability, 231);
+    } else {
+        throw runtime_error("Kmers.selectByHash must be False or True.");
+    }
+
+    // If requested, mask k-mers that are too rare or too frequent.
+    if(assemblyOptions.Kmers.minFrequency!=0 || assemblyOptions.Kmers.maxFrequency!=0) {
+        assembler.maskKmersByFrequency(
+            assemblyOptions.Kmers.minFrequency,
+            assemblyOptions.Kmers.maxFrequency, 0);
+    }
 
     // Find the markers in the reads.
-    assembler.findMarkers(0);
+    bool storeMarkersForStrand0Only;
+    if(assemblyOptions.Kmers.storeMarkersForStrand0Only == "True") {
+        storeMarkersForStrand0Only = true;
+    } else if(assemblyOptions.Kmers.storeMarkersForStrand0Only == "False") {
+        storeMarkersForStrand0Only = false;
+    } else {
+        throw runtime_error("Kmers.storeMarkersForStrand0Only must be False or True.");
+    }
+    bool compressMarkers;
+    if(assemblyOptions.Kmers.compressMarkers == "True") {
+        compressMarkers = true;
+    } else if(assemblyOptions.Kmers.compressMarkers == "False") {
+        compressMarkers = false;
+    } else {
+        throw runtime_error("Kmers.compressMarkers must be False or True.");
+    }
+    assembler.findMarkers(0, storeMarkersForStrand0Only, compressMarkers);
+
+    // If requested, store the markers of each read sorted by kmerId.
+    if(assemblyOptions.Kmers.storeSortedMarkers == "True") {
+        assembler.computeSortedMarkers(0);
+    } else if(assemblyOptions.Kmers.storeSortedMarkers != "False") {
+        throw runtime_error("Kmers.storeSortedMarkers must be False or True.");
+    }
 
     // Flag palindromic reads.
     // These wil be excluded from further processing.
@@ -461,23 +520,86 @@ void ChanZuckerberg::shasta::main::runAssembly(
         0);
 
     // Find alignment candidates.
-    assembler.findAlignmentCandidatesLowHash(
-        assemblyOptions.MinHash.m,
-        assemblyOptions.MinHash.hashFraction,
-        assemblyOptions.MinHash.minHashIterationCount,
-        0,
-        assemblyOptions.MinHash.maxBucketSize,
-        assemblyOptions.MinHash.minFrequency,
-        0);
+    bool useRollingHash;
+    if(assemblyOptions.MinHash.useRollingHash == "True") {
+        useRollingHash = true;
+    } else if(assemblyOptions.MinHash.useRollingHash == "False") {
+        useRollingHash = false;
+    } else {
+        throw runtime_error("MinHash.useRollingHash must be False or True.");
+    }
+    bool streamCandidates;
+    if(assemblyOptions.Align.streamCandidates == "True") {
+        streamCandidates = true;
+    } else if(assemblyOptions.Align.streamCandidates == "False") {
+        streamCandidates = false;
+    } else {
+        throw runtime_error("Align.streamCandidates must be False or True.");
+    }
+    bool storeAlignments;
+    if(assemblyOptions.Align.storeAlignments == "True") {
+        storeAlignments = true;
+    } else if(assemblyOptions.Align.storeAlignments == "False") {
+        storeAlignments = false;
+    } else {
+        throw runtime_error("Align.storeAlignments must be False or True.");
+    }
+    if(streamCandidates && assemblyOptions.Align.maxCandidatesPerRead != 0) {
+        throw runtime_error("Align.maxCandidatesPerRead must be 0 "
+            "when Align.streamCandidates is True.");
+    }
+    if(streamCandidates) {
+
+        // Find alignment candidates and compute alignments,
+        // without storing the alignment candidates.
+        assembler.findAlignmentCandidatesLowHashAndComputeAlignments(
+            assemblyOptions.MinHash.m,
+            assemblyOptions.MinHash.hashFraction,
+            assemblyOptions.MinHash.minHashIterationCount,
+            0,
+            assemblyOptions.MinHash.maxBucketSize,
+            assemblyOptions.MinHash.minFrequency,
+            useRollingHash,
+            assemblyOptions.MinHash.maxDiagonalDelta,
+            assemblyOptions.MinHash.bucketPassCount,
+            assemblyOptions.MinHash.targetCandidatesPerRead,
+            assemblyOptions.Align.maxMarkerFrequency,
+            assemblyOptions.Align.maxSkip,
+            assemblyOptions.Align.minAlignedMarkerCount,
+            assemblyOptions.Align.maxTrim,
+            assemblyOptions.Align.alignMethod,
+            assemblyOptions.Align.bandHalfWidth,
+            storeAlignments,
+            assemblyOptions.Align.streamSendThreadCount,
+            0);
 
+    } else {
+        assembler.findAlignmentCandidatesLowHash(
+            assemblyOptions.MinHash.m,
+            assemblyOptions.MinHash.hashFraction,
+            assemblyOptions.MinHash.minHashIterationCount,
+            0,
+            assemblyOptions.MinHash.maxBucketSize,
+            assemblyOptions.MinHash.minFrequency,
+            useRollingHash,
+            assemblyOptions.MinHash.maxDiagonalDelta,
+            assemblyOptions.MinHash.bucketPassCount,
+            assemblyOptions.MinHash.targetCandidatesPerRead,
+            0);
 
-    // Compute alignments.
-    assembler.computeAlignments(
-        assemblyOptions.Align.maxMarkerFrequency,
-        assemblyOptions.Align.maxSkip,
-        assemblyOptions.Align.minAlignedMarkerCount,
-        assemblyOptions.Align.maxTrim,
-        0);
+
+        // Compute alignments.
+        assembler.computeAlignments(
+            assemblyOptions.Align.maxMarkerFrequency,
+            assemblyOptions.Align.maxSkip,
+            assemblyOptions.Align.minAlignedMarkerCount,
+            assemblyOptions.Align.maxTrim,
+            assemblyOptions.Align.alignMethod,
+            assemblyOptions.Align.bandHalfWidth,
+            storeAlignments,
+            assemblyOptions.Align.maxCandidatesPerRead,
+            0);
+    }
 
     // Create the read graph.
     assembler.createReadGraph(
@@ -118,6 +118,14 @@ public:
             lastOrdinal  = markerCount - 1 - lastOrdinal;
         }
 
+        bool operator==(const Data& that) const
+        {
+            return
+                markerCount == that.markerCount &&
+                firstOrdinal == that.firstOrdinal &&
+                lastOrdinal == that.lastOrdinal;
+        }
+
     private:
 
         // The total number of markers in this oriented read.
@@ -180,6 +188,20 @@ public:
     }
     AlignmentInfo() : markerCount(0) {}
 
+    // Compare all the information stored.
+    // When markerCount is zero, the data are not set,
+    // so all such AlignmentInfo objects compare equal.
+    bool operator==(const AlignmentInfo& that) const
+    {
+        if(markerCount != that.markerCount) {
+            return false;
+        }
+        if(markerCount == 0) {
+            return true;
+        }
+        return data[0] == that.data[0] && data[1] == that.data[1];
+    }
+
 
 
     // Update to reflect a swap the two oriented reads.
@@ -1,6 +1,8 @@
 // shasta.
 #include "AlignmentGraph.hpp"
 #include "Alignment.hpp"
+#include "canPassAlignmentFilters.hpp"
+#include "findAlignmentDiagonal.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
@@ -44,6 +46,19 @@ void ChanZuckerberg::shasta::align(
     // Change to size_t when conversion completed.
     uint32_t maxMarkerFrequency,
 
+    // If not zero, only use pairs of markers
+    // with ordinal diagonal (ordinal1-ordinal0) within this
+    // distance of the dominant diagonal of the alignment
+    // (see findAlignmentDiagonal).
+    uint32_t bandHalfWidth,
+
+    // If the alignment cannot have at least minAlignedMarkerCount
+    // markers and left and right trim no more than maxTrim markers,
+    // the computation is abandoned as soon as that is
+    // known and the alignment returned is empty.
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+
     // Flag to control various types of debug output.
     bool debug,
 
@@ -59,7 +74,8 @@ void ChanZuckerberg::shasta::align(
     AlignmentInfo& alignmentInfo
     )
 {
-    graph.create(markers, maxMarkerFrequency, maxSkip, debug,
+    graph.create(markers, maxMarkerFrequency, maxSkip, bandHalfWidth,
+        minAlignedMarkerCount, maxTrim, debug,
         alignment, alignmentInfo);
 }
 
@@ -70,6 +86,9 @@ void AlignmentGraph::create(
     const array<vector<MarkerWithOrdinal>, 2>& markers,
     uint32_t maxMarkerFrequency,
     size_t maxSkip,
+    uint32_t bandHalfWidth,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
     bool debug,
     Alignment& alignment,
     AlignmentInfo& alignmentInfo)
@@ -85,7 +104,22 @@ void AlignmentGraph::create(
     }
 
     // Create the vertices - one for each pair of common markers.
-    createVertices(markers, maxMarkerFrequency);
+    createVertices(markers, maxMarkerFrequency, bandHalfWidth);
+
+    // If the alignment cannot pass the filters,
+    // don't bother computing it.
+    const AlignmentGraph& graph = *this;
+    if(!canPassAlignmentFilters(verticesBegin(), verticesEnd(), vertexCount(),
+        [&graph](vertex_descriptor v) -> const array<size_t, 2>& {return graph[v].ordinals;},
+        uint32_t(markers[0].size()), uint32_t(markers[1].size()),
+        minAlignedMarkerCount, maxTrim)) {
+        alignment.ordinals.clear();
+        alignmentInfo = AlignmentInfo();
+        if(debug) {
+            cout << "The alignment cannot have enough markers or has too much trim." << endl;
+        }
+        return;
+    }
     sortVertices();
 
     // Add the start and finish vertices.
@@ -167,7 +201,8 @@ void AlignmentGraph::writeMarkers(
 
 void AlignmentGraph::createVertices(
     const array<vector<MarkerWithOrdinal>, 2>& markers,
-    uint32_t maxMarkerFrequency)
+    uint32_t maxMarkerFrequency,
+    uint32_t bandHalfWidth)
 {
     // Some shorthands for readability.
     const vector<MarkerWithOrdinal>& markers0 = markers[0];
@@ -188,6 +223,11 @@ void AlignmentGraph::createVertices(
         isLowFrequencyMarker[i].resize(markers[i].size(), true);
     }
 
+    // For a banded alignment, find the dominant diagonal.
+    // We will only generate vertices near that diagonal.
+    const int32_t diagonal = (bandHalfWidth == 0) ? 0 :
+        findAlignmentDiagonal(markers, maxMarkerFrequency, bandHalfWidth, diagonalHistogram);
+
     // Joint loop over the markers, looking for common k-mer ids.
     auto it0 = begin0;
     auto it1 = begin1;
@@ -238,6 +278,13 @@ void AlignmentGraph::createVertices(
                 for(MarkerIterator jt0=it0Begin; jt0!=it0End; ++jt0) {
                     for(MarkerIterator jt1=it1Begin; jt1!=it1End; ++jt1) {
 
+                        // For a banded alignment, skip pairs
+                        // that are too far from the dominant diagonal.
+                        if(bandHalfWidth > 0 &&
+                            uint32_t(abs(int32_t(jt1->ordinal) - int32_t(jt0->ordinal) - diagonal)) > bandHalfWidth) {
+                            continue;
+                        }
+
                         // Generate a vertex corresponding to this pair
                         // of occurrences of this common k-mer.
                         AlignmentGraphVertex vertex;
@@ -60,6 +60,21 @@ namespace ChanZuckerberg {
             // Change to size_t when conversion completed.
             uint32_t maxMarkerFrequency,
 
+            // If not zero, only use pairs of markers
+            // with ordinal diagonal (ordinal1-ordinal0) within this
+            // distance of the dominant diagonal of the alignment
+            // (see findAlignmentDiagonal).
+            uint32_t bandHalfWidth,
+
+            // If the alignment cannot have at least minAlignedMarkerCount
+            // markers and left and right trim no more than maxTrim markers,
+            // the computation is abandoned as soon as that is
+            // known and the alignment returned is empty.
+            // Use 0 and std::numeric_limits<size_t>::max()
+            // to always compute the alignment.
+            size_t minAlignedMarkerCount,
+            size_t maxTrim,
+
             // Flag to control various types of debug output.
             bool debug,
 
@@ -132,10 +147,21 @@ public:
         const array<vector<MarkerWithOrdinal>, 2>&,
         uint32_t maxMarkerFrequency,
         size_t maxSkip,
+        uint32_t bandHalfWidth,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim,
         bool debug,
         Alignment&,
         AlignmentInfo&);
 
+    // Write an image representing the markers and an alignment
+    // in 2-D ordinal space.
+    void writeImage(
+        const vector<MarkerWithOrdinal>&,
+        const vector<MarkerWithOrdinal>&,
+        const Alignment&,
+        const string& fileName) const;
+
 private:
 
     // There is a vertex for each pair of markers with the same k-mer.
@@ -149,7 +175,8 @@ private:
         );
     void createVertices(
         const array<vector<MarkerWithOrdinal>, 2>&,
-        uint32_t maxMarkerFrequency);
+        uint32_t maxMarkerFrequency,
+        uint32_t bandHalfWidth);
     void writeVertices(const string& fileName) const;
     void createEdges(
         uint32_t markerCount0,
@@ -160,13 +187,6 @@ private:
     // Write in graphviz format, without the start and finish vertices.
     void writeGraphviz(const string& fileName) const;
 
-    // Write an image representing the markers and the computed alignment
-    // in 2-D ordinal space.
-    void writeImage(
-        const vector<MarkerWithOrdinal>&,
-        const vector<MarkerWithOrdinal>&,
-        const Alignment&,
-        const string& fileName) const;
 
     // Data members used to find the shortest path.
     vector<vertex_descriptor> shortestPath;
@@ -184,6 +204,9 @@ private:
     // Index by [01][ordinal].
     array<vector<uint32_t>, 2> correctedOrdinals;
 
+    // Work area used by findAlignmentDiagonal for banded alignments.
+    vector<uint32_t> diagonalHistogram;
+
 };
 
 #endif
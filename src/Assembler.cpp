@@ -42,12 +42,26 @@ Assembler::Assembler(
         largeDataPageSize = assemblerInfo->largeDataPageSize;
 
         reads.accessExistingReadWrite(largeDataName("Reads"));
-        readNames.accessExistingReadWrite(largeDataName("ReadNames"));
-        readRepeatCounts.accessExistingReadWrite(largeDataName("ReadRepeatCounts"));
+
+        // The read names and the repeat counts
+        // are each stored using one of two representations.
+        // See compressReadNames and compressReadRepeatCounts.
+        try {
+            readNames.accessExistingReadWrite(largeDataName("ReadNames"));
+        } catch(exception&) {
+            compressedReadNames.accessExistingReadOnly(largeDataName("CompressedReadNames"));
+        }
+        try {
+            readRepeatCounts.accessExistingReadWrite(largeDataName("ReadRepeatCounts"));
+        } catch(exception&) {
+            compressedReadRepeatCounts.accessExistingReadOnly(largeDataName("CompressedReadRepeatCounts"));
+        }
 
     }
 
-    // In both cases, assemblerInfo, reads, readNames, readRepeatCounts are all open for write.
+    // In both cases, assemblerInfo and reads are open for write.
+    // The read names and repeat counts are open for write unless the compressed
+    // representation is in use.
 
 #ifndef SHASTA_STATIC_EXECUTABLE
     fillServerFunctionTable();
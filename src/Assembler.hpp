@@ -5,16 +5,21 @@
 #include "Alignment.hpp"
 #include "AssembledSegment.hpp"
 #include "AssemblyGraph.hpp"
+#include "CompressedReadNames.hpp"
+#include "CompressedRepeatCounts.hpp"
 #include "Coverage.hpp"
 #include "dset64.hpp"
 #include "HttpServer.hpp"
 #include "Kmer.hpp"
 #include "LongBaseSequence.hpp"
+#include "LongestReadsFilter.hpp"
 #include "Marker.hpp"
 #include "MarkerGraph.hpp"
+#include "Markers.hpp"
 #include "MemoryMappedObject.hpp"
 #include "MultitreadedObject.hpp"
 #include "OrientedReadPair.hpp"
+#include "OrientedReadPairQueue.hpp"
 #include "ReadGraph.hpp"
 #include "ReadFlags.hpp"
 #include "ReadId.hpp"
@@ -38,6 +43,7 @@ namespace ChanZuckerberg {
 
         // Forward declarations of classes defined elsewhere.
         class Alignment;
+        class LazyAlignmentGraph;
         class AlignmentGraph;
         class AlignmentInfo;
         class AssembledSegment;
@@ -109,14 +115,44 @@ public:
     // Destructor.
     ~Assembler();
 
-    // Add reads from a fasta file.
+    // Add reads from a fasta or fastq file, possibly gzip-compressed.
+    // A file name of "-" reads from standard input.
     // The reads are added to those already previously present.
+    // If targetBaseCount is not zero, only the longest reads
+    // are kept, up to a total of at least targetBaseCount bases
+    // (see LongestReadsFilter.hpp). In that case the file
+    // is loaded in the same way as by addReads.
     void addReadsFromFasta(
         const string& fileName,
         size_t minReadLength,
         size_t blockSize,
         size_t threadCountForReading,
-        size_t threadCountForProcessing);
+        size_t threadCountForProcessing,
+        uint64_t targetBaseCount);
+
+    // Add reads from a list of fasta or fastq files, possibly gzip-compressed.
+    // Up to concurrentFileCount files are processed at the same time,
+    // each using its own share of the threads and of the block size.
+    // The reads of all files are added to those already present,
+    // in the order of the input files. To make this possible,
+    // each file is read once into temporary per-file data structures,
+    // and the reads are then copied to their final position
+    // by a multithreaded gather, one file at a time.
+    // If concurrentFileCount is zero, it is chosen automatically.
+    // If threadCount is zero, the number of threads is set equal
+    // to the number of virtual processors.
+    // If targetBaseCount is not zero, only the longest reads
+    // of all files are added, up to a total of at least targetBaseCount bases
+    // (see LongestReadsFilter.hpp). Most reads that are not kept
+    // are never stored. The selection is done in a single pass
+    // over each file, so standard input and pipes can be used.
+    void addReads(
+        const vector<string>& fileNames,
+        size_t minReadLength,
+        size_t blockSize,
+        size_t concurrentFileCount,
+        size_t threadCount,
+        uint64_t targetBaseCount);
 
     // Create a histogram of read lengths.
     void histogramReadLength(const string& fileName);
@@ -134,11 +170,40 @@ public:
         double probability, // The probability that a k-mer is selected as a marker.
         int seed            // For random number generator.
     );
+    void selectKmersByHash(
+        size_t k,           // k-mer length.
+        double probability, // The probability that a k-mer is selected as a marker.
+        int seed            // For the hash function.
+    );
+
+    // Count the number of occurrences of each marker k-mer in the reads,
+    // and stop using as markers the k-mers that occur less than
+    // minFrequency times or more than maxFrequency times
+    // (maxFrequency=0 means no upper limit).
+    // This must be called after randomlySelectKmers and before findMarkers.
+    // It writes a histogram of k-mer frequencies to
+    // MarkerKmerFrequencyHistogram.csv.
+    void maskKmersByFrequency(
+        uint64_t minFrequency,
+        uint64_t maxFrequency,
+        size_t threadCount);
 
     // Functions related to markers.
     // See the beginning of Marker.hpp for more information.
-    void findMarkers(size_t threadCount);
+    // If storeMarkersForStrand0Only is true, only the markers of strand 0
+    // are stored, and the markers of strand 1 are computed
+    // on the fly when needed. If compressMarkers is true,
+    // the markers of strand 0 are also packed in blocks,
+    // using less memory but slowing down access. See Markers.hpp.
+    void findMarkers(size_t threadCount, bool storeMarkersForStrand0Only,
+        bool compressMarkers = false);
     void accessMarkers();
+
+    // Store, for each oriented read, the ordinals of its markers
+    // sorted by kmerId. When this is available,
+    // getMarkersSortedByKmerId does not need to sort.
+    void computeSortedMarkers(size_t threadCount);
+    void accessSortedMarkers();
     void writeMarkers(ReadId, Strand, const string& fileName);
 
     // Use the minHash algorithm to find candidate alignments.
@@ -158,6 +223,27 @@ public:
         size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of lowHash hits for a pair to become a candidate.
+        bool useRollingHash,            // Hash features with a rolling hash instead of MurmurHash64A.
+        size_t maxDiagonalDelta,        // If not zero, require hits on a consistent diagonal.
+        size_t bucketPassCount,         // If greater than 1, process buckets in this number of passes.
+        double targetCandidatesPerRead, // If not zero, adjust hashFraction and maxBucketSize to get this.
+        size_t threadCount
+    );
+
+    // Choose hashFraction and maxBucketSize for LowHash so the number
+    // of alignment candidates per read is close to the target.
+    // This uses sampling runs of LowHash. On return, hashFraction and maxBucketSize
+    // are set to the chosen values.
+    void tuneLowHash(
+        size_t m,
+        double& hashFraction,
+        size_t minHashIterationCount,
+        size_t log2MinHashBucketCount,
+        size_t& maxBucketSize,
+        size_t minFrequency,
+        bool useRollingHash,
+        size_t maxDiagonalDelta,
+        double targetCandidatesPerRead,
         size_t threadCount
     );
     void accessAlignmentCandidates();
@@ -229,12 +315,86 @@ public:
         // Maximum left/right trim (in bases) for an alignment to be used.
         size_t maxTrim,
 
+        // The method used to compute alignments:
+        // 0 = shortest path in the AlignmentGraph (the default),
+        // 1 = the same shortest path computed by a LazyAlignmentGraph,
+        // without storing edges (experimental).
+        // The alignments found are identical
+        // (see LazyAlignmentGraph.hpp and testLazyAlignmentGraph).
+        size_t alignMethod,
+
+        // If not zero, compute banded alignments:
+        // only use pairs of markers with ordinal diagonal
+        // within this distance of the dominant diagonal
+        // (see findAlignmentDiagonal).
+        // This bounds the cost of alignments of long reads.
+        uint32_t bandHalfWidth,
+
+        // If true, also store the marker ordinals of each alignment
+        // in compressedAlignments, so createMarkerGraphVertices
+        // does not need to compute the alignments again.
+        bool storeAlignments,
+
+        // If not zero, rank the alignment candidates of each read
+        // by the number of marker pairs their alignment can use
+        // (see countAlignmentMarkerPairs), without computing alignments,
+        // and only compute alignments for candidates that are among the
+        // best maxCandidatesPerRead for at least one of their two reads.
+        // This bounds the number of alignments computed per read.
+        // It should be comfortably larger than
+        // ReadGraph.maxAlignmentCount used in createReadGraph.
+        size_t maxCandidatesPerRead,
+
         // Number of threads. If zero, a number of threads equal to
         // the number of virtual processors is used.
         size_t threadCount
     );
     void accessAlignmentData();
 
+    // Compute alignments of the first candidateCount alignment candidates
+    // using each of the alignment methods supported by computeAlignments,
+    // with and without a band if bandHalfWidth is not zero,
+    // and write timing and comparison information.
+    // This runs single-threaded and does not store any alignments.
+    void compareAlignmentMethods(
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        uint32_t bandHalfWidth,
+        size_t candidateCount);
+
+    // Pipelined equivalent of findAlignmentCandidatesLowHash
+    // followed by computeAlignments.
+    // The alignment candidates are not stored. Instead, LowHash
+    // sends them through a bounded queue to the threads that
+    // compute alignments, which start as soon as the first
+    // candidates are available.
+    void findAlignmentCandidatesLowHashAndComputeAlignments(
+        size_t m,                       // Number of consecutive k-mers that define a feature.
+        double hashFraction,            // Low hash threshold.
+        size_t minHashIterationCount,   // Number of lowHash iterations.
+        size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
+        size_t maxBucketSize,           // The maximum size for a bucket to be used.
+        size_t minFrequency,            // Minimum number of lowHash hits for a pair to become a candidate.
+        bool useRollingHash,            // Hash features with a rolling hash instead of MurmurHash64A.
+        size_t maxDiagonalDelta,        // If not zero, require hits on a consistent diagonal.
+        size_t bucketPassCount,         // If greater than 1, process buckets in this number of passes.
+        double targetCandidatesPerRead, // If not zero, adjust hashFraction and maxBucketSize to get this.
+        uint32_t maxMarkerFrequency,    // As in computeAlignments.
+        size_t maxSkip,                 // As in computeAlignments.
+        size_t minAlignedMarkerCount,   // As in computeAlignments.
+        size_t maxTrim,                 // As in computeAlignments.
+        size_t alignMethod,             // As in computeAlignments.
+        uint32_t bandHalfWidth,         // As in computeAlignments.
+        bool storeAlignments,           // As in computeAlignments.
+
+        // The number of threads LowHash uses to send candidates
+        // to the queue. The remaining threads compute alignments.
+        // If 0, one quarter of the threads, and at least one.
+        size_t sendThreadCount,
+
+        size_t threadCount
+    );
+
 
 
     // Loop over all alignments in the read graph
@@ -243,6 +403,9 @@ public:
     // less than minCoverage or more than maxCoverage.
     // Also throw away "bad" vertices - that is, vertices
     // with more than one marker on the same oriented read.
+    // If computeAlignments stored the alignments, they are used
+    // and maxMarkerFrequency and maxSkip are ignored.
+    // Otherwise, the alignments are computed again.
     void createMarkerGraphVertices(
 
         // The maximum frequency of marker k-mers to be used in
@@ -434,18 +597,43 @@ private:
     Run-length representations that are more economic in memory are possible,
     at the price of additional code complexity and performance cost
     in assembly phases that use the base repeat counts.
+    After all reads have been added, compressReadRepeatCounts
+    can be used to switch to such a representation,
+    which uses 2-bit codes plus a sparse exception table
+    for repeat counts greater than 3
+    (see CompressedRepeatCounts.hpp for details).
+    With typical nanopore data this uses about 3.2 bits per base instead of 8,
+    reducing the memory used by the repeat counts by about a factor of 2.5.
+    After that, readRepeatCounts is no longer available,
+    and no more reads can be added.
+    Code that uses repeat counts should access them via
+    getReadRepeatCounts, which works with both representations.
 
     ***************************************************************************/
 
     LongBaseSequences reads;
     MemoryMapped::VectorOfVectors<uint8_t, uint64_t> readRepeatCounts;
+    CompressedRepeatCounts compressedReadRepeatCounts;
+
+    // Return the repeat counts of a read, using
+    // whichever representation is available.
+    RepeatCountsView getReadRepeatCounts(ReadId readId) const
+    {
+        return ChanZuckerberg::shasta::getReadRepeatCounts(
+            readRepeatCounts, compressedReadRepeatCounts, readId);
+    }
 public:
+    // Switch to the compressed representation of the repeat counts.
+    void compressReadRepeatCounts(size_t threadCount);
     ReadId readCount() const
     {
         return ReadId(reads.size());
     }
 private:
+    void compressReadRepeatCountsThreadFunction1(size_t threadId);
+    void compressReadRepeatCountsThreadFunction2(size_t threadId);
     void checkReadsAreOpen() const;
+    void checkReadsCanBeAdded() const;
     void checkReadNamesAreOpen() const;
     void checkReadId(ReadId) const;
 
@@ -478,7 +666,7 @@ private:
 
         // Access the bases and repeat counts for this read.
         const auto& read = reads[readId];
-        const auto& counts = readRepeatCounts[readId];
+        const auto counts = getReadRepeatCounts(readId);
 
         // Compute the position as stored, depending on strand.
         uint32_t orientedPosition = position;
@@ -518,7 +706,24 @@ private:
     // We don't use read names to identify reads.
     // These names are only used as an aid in tracing each read
     // back to its origin.
+    // compressReadNames can be used to switch to a more compact
+    // representation (see CompressedReadNames.hpp for details).
+    // After that, readNames is no longer available.
+    // If this is done before reads are added, the names
+    // are encoded while the reads are added, by the ReadLoader threads.
+    // Reads cannot be added to an existing assembly
+    // that uses compressed names.
+    // Code that uses read names should access them via getReadName,
+    // which works with both representations.
     MemoryMapped::VectorOfVectors<char, uint64_t> readNames;
+    CompressedReadNames compressedReadNames;
+    string getReadName(ReadId) const;
+public:
+    // Switch to the compact representation of the read names.
+    void compressReadNames(size_t threadCount);
+private:
+    void compressReadNamesThreadFunction1(size_t threadId);
+    void compressReadNamesThreadFunction2(size_t threadId);
 
     // Function to write a read in Fasta format.
     void writeRead(ReadId, ostream&);
@@ -527,6 +732,58 @@ private:
 
 
 
+    // Private functions and data used by addReads.
+    // addReadsImplementation also allows using more than one thread
+    // to read each file, as requested by addReadsFromFasta.
+    void addReadsImplementation(
+        const vector<string>& fileNames,
+        size_t minReadLength,
+        size_t blockSize,
+        size_t concurrentFileCount,
+        size_t threadCountForReading,
+        size_t threadCount,
+        uint64_t targetBaseCount);
+    void addReadsThreadFunction1(size_t threadId);
+    void addReadsThreadFunction2(size_t threadId);
+    string addReadsDataNamePrefix(uint64_t fileIndex) const;
+    class AddReadsData {
+    public:
+
+        // Parameters.
+        vector<string> fileNames;
+        size_t minReadLength;
+        size_t blockSize;               // For each file.
+        size_t threadCountForReading;   // For each file.
+        size_t threadCountPerFile;      // For each file.
+
+        // Held while writing the messages of a file that was processed.
+        std::mutex mutex;
+
+        // Only used if we are keeping only the longest reads.
+        shared_ptr<LongestReadsFilter> longestReadsFilter;
+
+        // The temporary data structures where the reads
+        // of each file are stored. Indexed by file index.
+        // If read names are compressed, fileReadNames
+        // contains the encoded names.
+        // fileReadLengths contains the number of bases
+        // of each read before run-length encoding.
+        vector< shared_ptr<LongBaseSequences> > fileReads;
+        vector< shared_ptr<MemoryMapped::VectorOfVectors<char, uint64_t> > > fileReadNames;
+        vector< shared_ptr<MemoryMapped::VectorOfVectors<uint8_t, uint64_t> > > fileReadRepeatCounts;
+        vector< vector<uint64_t> > fileReadLengths;
+
+        // The file whose reads are being copied by addReadsThreadFunction2,
+        // the indexes of its reads that are kept, and the ReadId
+        // of its first read that is kept.
+        uint64_t fileIndex;
+        vector<uint64_t> keptReads;
+        ReadId firstReadId;
+    };
+    AddReadsData addReadsData;
+
+
+
     // Read flags.
     MemoryMapped::Vector<ReadFlags> readFlags;
 public:
@@ -547,19 +804,62 @@ private:
     // if (and only if) a k-mer is a marker, its reverse complement
     // is also a marker. That is, for all permitted values of i, 0 <= i < 4^k:
     // kmerTable[i].isMarker == kmerTable[kmerTable[i].reverseComplementKmerId].isMarker
+    // If markers were selected using selectKmersByHash,
+    // the k-mer table is empty and kmerHashSelection
+    // is used instead.
     MemoryMapped::Vector<KmerInfo> kmerTable;
     void checkKmersAreOpen() const;
 
+    // The parameters used by selectKmersByHash.
+    // This contains one element if markers were selected by hash,
+    // and is empty otherwise. It is stored separately rather than
+    // in AssemblerInfo, to keep the layout of AssemblerInfo
+    // unchanged for existing assemblies.
+    // It is not present for assemblies created before
+    // selectKmersByHash was available, which always use the k-mer table.
+    MemoryMapped::Vector<KmerHashSelection> kmerHashSelection;
+    bool useKmerHashSelection() const
+    {
+        return kmerHashSelection.isOpen && kmerHashSelection.size() == 1;
+    }
+
+    // Data used by maskKmersByFrequency.
+    void maskKmersByFrequencyThreadFunction(size_t threadId);
+    class MaskKmersByFrequencyData {
+    public:
+        // The number of times each k-mer occurs in the reads.
+        // Only computed for k-mers that are markers.
+        MemoryMapped::Vector<uint64_t> kmerFrequency;
+    };
+    MaskKmersByFrequencyData maskKmersByFrequencyData;
+
 
 
     // The markers on all oriented reads. Indexed by OrientedReadId::getValue().
-    MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t> markers;
+    Markers markers;
     void checkMarkersAreOpen() const;
 
+    // The ordinals of the markers of each oriented read, sorted by kmerId.
+    // Indexed by OrientedReadId::getValue().
+    // For each oriented read, only one of these is not empty:
+    // sortedMarkers16 if the ordinals fit in 16 bits, sortedMarkers32 otherwise.
+    // See computeSortedMarkers.
+    MemoryMapped::VectorOfVectors<uint16_t, uint64_t> sortedMarkers16;
+    MemoryMapped::VectorOfVectors<uint32_t, uint64_t> sortedMarkers32;
+    void computeSortedMarkersThreadFunction(size_t threadId);
+
     // Get markers sorted by KmerId for a given OrientedReadId.
+    // This uses sortedMarkers16 and sortedMarkers32 if available.
     void getMarkersSortedByKmerId(
         OrientedReadId,
         vector<MarkerWithOrdinal>&) const;
+    template<class Ordinals> static void getMarkersSortedByKmerId(
+        const Markers::View&,
+        const Ordinals&,
+        vector<MarkerWithOrdinal>&);
+    void sortMarkersByKmerId(
+        OrientedReadId,
+        vector<MarkerWithOrdinal>&) const;
 
     // Given a marker by its OrientedReadId and ordinal,
     // return the corresponding global marker id.
@@ -669,10 +969,33 @@ private:
     MemoryMapped::VectorOfVectors<uint32_t, uint32_t> alignmentTable;
     void computeAlignmentTable();
 
+    // The marker ordinals of each of the alignments in alignmentData,
+    // encoded by compressAlignment.
+    // Indexed by the same alignment id as alignmentData.
+    // This is only available if computeAlignments
+    // was called with storeAlignments set.
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> compressedAlignments;
+
+    // Get a stored alignment given its alignment id.
+    // The alignment is for the oriented reads with ids
+    // as stored in alignmentData, with the first one on strand 0.
+    void getStoredAlignment(uint64_t alignmentId, Alignment&) const;
+
+    // Get the stored alignment of two oriented reads,
+    // swapped and/or reverse complemented as necessary.
+    // Returns false if the stored alignments are not available
+    // or there is no stored alignment for these oriented reads.
+    bool getStoredAlignment(OrientedReadId, OrientedReadId, Alignment&) const;
+
 
 
     // Private functions and data used by computeAlignments.
     void computeAlignmentsThreadFunction(size_t threadId);
+    void rankAlignmentCandidates(size_t maxCandidatesPerRead, size_t threadCount);
+    void rankAlignmentCandidatesThreadFunction1(size_t threadId);
+    void rankAlignmentCandidatesThreadFunction2(size_t threadId);
+    void rankAlignmentCandidatesThreadFunction3(size_t threadId);
+    void computeAlignmentsFromQueueThreadFunction(size_t threadId);
     class ComputeAlignmentsData {
     public:
 
@@ -681,10 +1004,56 @@ private:
         size_t maxSkip;
         size_t minAlignedMarkerCount;
         size_t maxTrim;
+        size_t alignMethod;
+        uint32_t bandHalfWidth;
+        bool storeAlignments;
 
         // The AlignmentInfo found by each thread.
         vector< vector<AlignmentData> > threadAlignmentData;
+
+        // If storeAlignments is set, the compressed alignments
+        // found by each thread, in the same order as threadAlignmentData.
+        vector< shared_ptr< MemoryMapped::VectorOfVectors<uint8_t, uint64_t> > > threadCompressedAlignments;
+
+        // The queue used by findAlignmentCandidatesLowHashAndComputeAlignments.
+        shared_ptr<OrientedReadPairQueue> candidateQueue;
+
+        // Used by rankAlignmentCandidates.
+        // The ranking score of each alignment candidate,
+        // and flags for the candidates to be aligned, both indexed
+        // like alignmentCandidates. If the candidates
+        // were not ranked, keepCandidate is empty.
+        MemoryMapped::Vector<uint32_t> candidateScores;
+        vector<bool> keepCandidate;
+        size_t maxCandidatesPerRead;
+
+        // The indexes of the candidates of each read.
+        MemoryMapped::VectorOfVectors<uint64_t, uint64_t> candidateTable;
+
+        // The indexes of the candidates to be aligned found by each thread.
+        vector< vector<uint64_t> > threadKeepCandidates;
     };
+
+    // Compute the alignment for a candidate, and store it
+    // in the data of the calling thread if it is good enough.
+    // The other arguments are work areas owned by the calling thread.
+    void computeAlignment(
+        const OrientedReadPair&,
+        size_t threadId,
+        array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId,
+        AlignmentGraph&,
+        LazyAlignmentGraph&,
+        Alignment&,
+        AlignmentInfo&,
+        vector<uint8_t>& compressedAlignment);
+
+    // Create the vectors where a thread of computeAlignments
+    // stores its compressed alignments, if necessary.
+    void createThreadCompressedAlignments(size_t threadId);
+
+    // Store the alignments found by all threads of computeAlignments
+    // and create the alignment table.
+    void storeAlignmentData();
     ComputeAlignmentsData computeAlignmentsData;
 
 
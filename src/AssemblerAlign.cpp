@@ -1,6 +1,10 @@
 // shasta.
 #include "Assembler.hpp"
+#include "LazyAlignmentGraph.hpp"
 #include "AlignmentGraph.hpp"
+#include "compressAlignment.hpp"
+#include "findAlignmentDiagonal.hpp"
+#include "LowHash.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -8,6 +12,7 @@ using namespace shasta;
 // Standard libraries.
 #include "chrono.hpp"
 #include "iterator.hpp"
+#include <limits>
 #include "tuple.hpp"
 
 
@@ -103,8 +108,12 @@ void Assembler::alignOrientedReads(
     AlignmentInfo& alignmentInfo
 )
 {
+    const uint32_t bandHalfWidth = 0;
+    const size_t minAlignedMarkerCount = 0;
+    const size_t maxTrim = std::numeric_limits<size_t>::max();
     align(markersSortedByKmerId,
-        maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+        maxSkip, maxMarkerFrequency, bandHalfWidth, minAlignedMarkerCount, maxTrim,
+        debug, graph, alignment, alignmentInfo);
 }
 
 
@@ -207,11 +216,34 @@ void Assembler::computeAlignments(
     // Maximum left/right trim (in bases) for an alignment to be used.
     size_t maxTrim,
 
+    // The method used to compute alignments:
+    // 0 = shortest path in the AlignmentGraph (the default),
+    // 1 = the same shortest path computed by a LazyAlignmentGraph.
+    size_t alignMethod,
+
+    // If not zero, compute banded alignments:
+    // only use pairs of markers with ordinal diagonal
+    // within this distance of the dominant diagonal.
+    uint32_t bandHalfWidth,
+
+    // If true, also store the marker ordinals of each alignment.
+    bool storeAlignments,
+
+    // If not zero, only compute alignments for candidates
+    // that are among the best maxCandidatesPerRead for at least
+    // one of their two reads, as ranked by rankAlignmentCandidates.
+    size_t maxCandidatesPerRead,
+
     // Number of threads. If zero, a number of threads equal to
     // the number of virtual processors is used.
     size_t threadCount
 )
 {
+    if(alignMethod > 1) {
+        throw runtime_error("Invalid align method " + to_string(alignMethod) +
+            ". Must be 0 or 1.");
+    }
+
     const auto tBegin = steady_clock::now();
     cout << timestamp << "Begin computing alignments for ";
     cout << alignmentCandidates.size() << " alignment candidates." << endl;
@@ -228,6 +260,9 @@ void Assembler::computeAlignments(
     data.maxSkip = maxSkip;
     data.minAlignedMarkerCount = minAlignedMarkerCount;
     data.maxTrim = maxTrim;
+    data.alignMethod = alignMethod;
+    data.bandHalfWidth = bandHalfWidth;
+    data.storeAlignments = storeAlignments;
 
     // Adjust the numbers of threads, if necessary.
     if(threadCount == 0) {
@@ -235,54 +270,230 @@ void Assembler::computeAlignments(
     }
     cout << "Using " << threadCount << " threads." << endl;
 
+    // If requested, rank the candidates of each read
+    // and flag the ones to be aligned.
+    data.keepCandidate.clear();
+    if(maxCandidatesPerRead > 0) {
+        rankAlignmentCandidates(maxCandidatesPerRead, threadCount);
+    }
+
     // Compute the alignments.
+    data.threadAlignmentData.clear();
     data.threadAlignmentData.resize(threadCount);
+    data.threadCompressedAlignments.clear();
+    data.threadCompressedAlignments.resize(threadCount);
     cout << timestamp << "Alignment computation begins." << endl;
     size_t batchSize = 10000;
     setupLoadBalancing(alignmentCandidates.size(), batchSize);
     runThreads(&Assembler::computeAlignmentsThreadFunction, threadCount);
     cout << timestamp << "Alignment computation completed." << endl;
+    data.keepCandidate.clear();
+    data.keepCandidate.shrink_to_fit();
+
+
+
+    storeAlignmentData();
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Computation of alignments ";
+    cout << "completed in " << tTotal << " s." << endl;
+}
+
+
 
+// Pipelined equivalent of findAlignmentCandidatesLowHash
+// followed by computeAlignments.
+// The alignment threads are started first and wait on the queue.
+// LowHash sends the candidates of each read to the queue
+// once they are final, that is, after the last LowHash iteration.
+// The alignment threads then compute alignments while LowHash
+// is still gathering candidates for other reads, and the
+// alignment candidates are never stored.
+// LowHash releases its candidate tables as it sends them.
+void Assembler::findAlignmentCandidatesLowHashAndComputeAlignments(
+    size_t m,                       // Number of consecutive k-mers that define a feature.
+    double hashFraction,            // Low hash threshold.
+    size_t minHashIterationCount,   // Number of lowHash iterations.
+    size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
+    size_t maxBucketSize,           // The maximum size for a bucket to be used.
+    size_t minFrequency,            // Minimum number of lowHash hits for a pair to become a candidate.
+    bool useRollingHash,            // Hash features with a rolling hash instead of MurmurHash64A.
+    size_t maxDiagonalDelta,        // If not zero, require hits on a consistent diagonal.
+    size_t bucketPassCount,         // If greater than 1, process buckets in this number of passes.
+    double targetCandidatesPerRead, // If not zero, adjust hashFraction and maxBucketSize to get this.
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+    size_t alignMethod,
+    uint32_t bandHalfWidth,
+    bool storeAlignments,
+    size_t sendThreadCount,
+    size_t threadCount)
+{
+    if(alignMethod > 1) {
+        throw runtime_error("Invalid align method " + to_string(alignMethod) +
+            ". Must be 0 or 1.");
+    }
 
+    const auto tBegin = steady_clock::now();
+    cout << timestamp << "Begin finding alignment candidates and computing alignments." << endl;
+
+    // Check that we have what we need.
+    checkReadsAreOpen();
+    checkKmersAreOpen();
+    checkMarkersAreOpen();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // While LowHash sends candidates, the threads are split between
+    // LowHash and the alignment threads, so the total does not exceed threadCount.
+    // Before that, the alignment threads are waiting on the queue
+    // and LowHash uses all threads.
+    // With a single thread, one thread of each kind is needed.
+    if(sendThreadCount == 0) {
+        sendThreadCount = max(size_t(1), threadCount / 4);
+    }
+    sendThreadCount = min(sendThreadCount, threadCount);
+    const size_t alignmentThreadCount = max(size_t(1), threadCount - sendThreadCount);
+    cout << "While sending candidates, LowHash will use " << sendThreadCount <<
+        " threads and alignments will use " << alignmentThreadCount << " threads." << endl;
+
+    // If requested, choose hashFraction and maxBucketSize
+    // using sampling runs of LowHash.
+    if(targetCandidatesPerRead > 0.) {
+        tuneLowHash(m, hashFraction, minHashIterationCount, log2MinHashBucketCount,
+            maxBucketSize, minFrequency, useRollingHash, maxDiagonalDelta,
+            targetCandidatesPerRead, threadCount);
+    }
+
+    // Store parameters so they are accessible to the threads.
+    // The queue holds a few batches for each thread.
+    auto& data = computeAlignmentsData;
+    data.maxMarkerFrequency = maxMarkerFrequency;
+    data.maxSkip = maxSkip;
+    data.minAlignedMarkerCount = minAlignedMarkerCount;
+    data.maxTrim = maxTrim;
+    data.alignMethod = alignMethod;
+    data.bandHalfWidth = bandHalfWidth;
+    data.storeAlignments = storeAlignments;
+    data.threadAlignmentData.clear();
+    data.threadAlignmentData.resize(alignmentThreadCount);
+    data.threadCompressedAlignments.clear();
+    data.threadCompressedAlignments.resize(alignmentThreadCount);
+    data.candidateQueue = make_shared<OrientedReadPairQueue>(4 * alignmentThreadCount);
+
+    // Start the alignment threads.
+    // They wait until LowHash sends the first candidates.
+    startThreads(&Assembler::computeAlignmentsFromQueueThreadFunction, alignmentThreadCount);
+
+    // Run LowHash, sending the candidates to the queue.
+    // If LowHash throws, the queue must still be closed
+    // so the alignment threads terminate.
+    try {
+        MemoryMapped::Vector<OrientedReadPair> unusedCandidates;
+        LowHash lowHash(
+            m,
+            hashFraction,
+            minHashIterationCount,
+            log2MinHashBucketCount,
+            maxBucketSize,
+            minFrequency,
+            useRollingHash,
+            maxDiagonalDelta,
+            bucketPassCount,
+            0,
+            threadCount,
+            kmerTable,
+            readFlags,
+            markers,
+            unusedCandidates,
+            data.candidateQueue.get(),
+            sendThreadCount,
+            largeDataFileNamePrefix,
+            largeDataPageSize);
+    } catch(...) {
+        data.candidateQueue->close();
+        waitForThreads();
+        data.candidateQueue = 0;
+        throw;
+    }
+    data.candidateQueue->close();
+    waitForThreads();
+    data.candidateQueue = 0;
+    cout << timestamp << "Alignment computation completed." << endl;
+
+    storeAlignmentData();
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Finding alignment candidates and computing alignments ";
+    cout << "completed in " << tTotal << " s." << endl;
+}
+
+
+
+// Store the alignments found by all threads of computeAlignments
+// and create the alignment table.
+void Assembler::storeAlignmentData()
+{
+    auto& data = computeAlignmentsData;
 
     // Store alignmentInfos found by each thread in the global alignmentInfos.
     cout << "Storing the alignment info objects." << endl;
     alignmentData.createNew(largeDataName("AlignmentData"), largeDataPageSize);
-    for(size_t threadId=0; threadId<threadCount; threadId++) {
-        const vector<AlignmentData>& threadAlignmentData = data.threadAlignmentData[threadId];
+    for(const vector<AlignmentData>& threadAlignmentData: data.threadAlignmentData) {
         for(const AlignmentData& ad: threadAlignmentData) {
             alignmentData.push_back(ad);
         }
     }
+
+    // Stored alignments from a previous computation are no longer valid.
+    if(compressedAlignments.isOpen()) {
+        compressedAlignments.remove();
+    }
+
+    // If requested, store the compressed alignments, in the same order.
+    if(data.storeAlignments) {
+        cout << timestamp << "Storing the alignments." << endl;
+        compressedAlignments.createNew(largeDataName("CompressedAlignments"), largeDataPageSize);
+        for(size_t threadId=0; threadId<data.threadCompressedAlignments.size(); threadId++) {
+            if(!data.threadCompressedAlignments[threadId]) {
+                continue;
+            }
+            auto& threadCompressedAlignments = *data.threadCompressedAlignments[threadId];
+            CZI_ASSERT(threadCompressedAlignments.size() == data.threadAlignmentData[threadId].size());
+            for(size_t i=0; i<threadCompressedAlignments.size(); i++) {
+                const auto v = threadCompressedAlignments[i];
+                compressedAlignments.appendVector(v.begin(), v.end());
+            }
+            threadCompressedAlignments.remove();
+        }
+        data.threadCompressedAlignments.clear();
+        CZI_ASSERT(compressedAlignments.size() == alignmentData.size());
+        cout << "Stored " << compressedAlignments.size() << " alignments using " <<
+            compressedAlignments.totalSize() << " bytes." << endl;
+    }
     cout << timestamp << "Creating alignment table." << endl;
     computeAlignmentTable();
-
-    const auto tEnd = steady_clock::now();
-    const double tTotal = seconds(tEnd - tBegin);
-    cout << timestamp << "Computation of alignments ";
-    cout << "completed in " << tTotal << " s." << endl;
 }
 
 
 
 void Assembler::computeAlignmentsThreadFunction(size_t threadId)
 {
-
-    array<OrientedReadId, 2> orientedReadIds;
-    array<OrientedReadId, 2> orientedReadIdsOppositeStrand;
+    const vector<bool>& keepCandidate = computeAlignmentsData.keepCandidate;
     array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
     AlignmentGraph graph;
+    LazyAlignmentGraph lazyGraph;
     Alignment alignment;
     AlignmentInfo alignmentInfo;
-
-    const bool debug = false;
-    auto& data = computeAlignmentsData;
-    const uint32_t maxMarkerFrequency = data.maxMarkerFrequency;
-    const size_t maxSkip = data.maxSkip;
-    const size_t minAlignedMarkerCount = data.minAlignedMarkerCount;
-    const size_t maxTrim = data.maxTrim;
-
-    vector<AlignmentData>& threadAlignmentData = data.threadAlignmentData[threadId];
+    vector<uint8_t> compressedAlignment;
+    createThreadCompressedAlignments(threadId);
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
@@ -293,57 +504,390 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
         }
 
         for(size_t i=begin; i!=end; i++) {
+            if(!keepCandidate.empty() && !keepCandidate[i]) {
+                continue;
+            }
+            computeAlignment(alignmentCandidates[i], threadId,
+                markersSortedByKmerId, graph, lazyGraph, alignment, alignmentInfo, compressedAlignment);
+        }
+    }
+}
+
+
+
+// Rank the alignment candidates of each read without computing alignments,
+// and flag for alignment only the ones that are among the best
+// maxCandidatesPerRead for at least one of their two reads.
+// This mirrors the way createReadGraph keeps the best alignments
+// of each read, using as a score the number of marker pairs
+// available to the alignment (see countAlignmentMarkerPairs),
+// which is an upper bound on the number of aligned markers
+// that createReadGraph ranks alignments by.
+void Assembler::rankAlignmentCandidates(
+    size_t maxCandidatesPerRead,
+    size_t threadCount)
+{
+    auto& data = computeAlignmentsData;
+    cout << timestamp << "Ranking alignment candidates." << endl;
+    data.maxCandidatesPerRead = maxCandidatesPerRead;
+    const size_t batchSize = 10000;
+
+    // Compute the score of each candidate and count
+    // the candidates of each read.
+    data.candidateScores.createNew(largeDataName("tmp-CandidateScores"), largeDataPageSize);
+    data.candidateScores.reserveAndResize(alignmentCandidates.size());
+    data.candidateTable.createNew(largeDataName("tmp-CandidateTable"), largeDataPageSize);
+    data.candidateTable.beginPass1(reads.size());
+    setupLoadBalancing(alignmentCandidates.size(), batchSize);
+    runThreads(&Assembler::rankAlignmentCandidatesThreadFunction1, threadCount);
+
+    // Store the candidates of each read.
+    data.candidateTable.beginPass2();
+    setupLoadBalancing(alignmentCandidates.size(), batchSize);
+    runThreads(&Assembler::rankAlignmentCandidatesThreadFunction2, threadCount);
+    data.candidateTable.endPass2();
+
+    // For each read, find the best maxCandidatesPerRead candidates.
+    data.threadKeepCandidates.clear();
+    data.threadKeepCandidates.resize(threadCount);
+    setupLoadBalancing(reads.size(), batchSize);
+    runThreads(&Assembler::rankAlignmentCandidatesThreadFunction3, threadCount);
+    data.candidateTable.remove();
+    data.candidateScores.remove();
+
+    // Merge the candidates found by all threads.
+    data.keepCandidate.clear();
+    data.keepCandidate.resize(alignmentCandidates.size(), false);
+    for(vector<uint64_t>& v: data.threadKeepCandidates) {
+        for(const uint64_t i: v) {
+            data.keepCandidate[i] = true;
+        }
+        v.clear();
+        v.shrink_to_fit();
+    }
+    data.threadKeepCandidates.clear();
+
+    const size_t keepCount = count(data.keepCandidate.begin(), data.keepCandidate.end(), true);
+    cout << timestamp << "Ranking kept " << keepCount << " alignment candidates of ";
+    cout << alignmentCandidates.size() << "." << endl;
+}
+
+
+
+// Compute the score of each candidate and count
+// the candidates of each read.
+void Assembler::rankAlignmentCandidatesThreadFunction1(size_t threadId)
+{
+    auto& data = computeAlignmentsData;
+    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
+    vector<uint32_t> histogram;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
             const OrientedReadPair& candidate = alignmentCandidates[i];
-            CZI_ASSERT(candidate.readIds[0] < candidate.readIds[1]);
+            getMarkersSortedByKmerId(
+                OrientedReadId(candidate.readIds[0], 0), markersSortedByKmerId[0]);
+            getMarkersSortedByKmerId(
+                OrientedReadId(candidate.readIds[1], candidate.isSameStrand ? 0 : 1), markersSortedByKmerId[1]);
+            const uint64_t pairCount = countAlignmentMarkerPairs(
+                markersSortedByKmerId, data.maxMarkerFrequency, data.bandHalfWidth, histogram);
+            data.candidateScores[i] = uint32_t(min(pairCount,
+                uint64_t(std::numeric_limits<uint32_t>::max())));
+            data.candidateTable.incrementCountMultithreaded(candidate.readIds[0]);
+            data.candidateTable.incrementCountMultithreaded(candidate.readIds[1]);
+        }
+    }
+}
 
-            // Get the oriented read ids, with the first one on strand 0.
-            orientedReadIds[0] = OrientedReadId(candidate.readIds[0], 0);
-            orientedReadIds[1] = OrientedReadId(candidate.readIds[1], candidate.isSameStrand ? 0 : 1);
 
-            // Get the oriented read ids for the opposite strand.
-            orientedReadIdsOppositeStrand = orientedReadIds;
-            orientedReadIdsOppositeStrand[0].flipStrand();
-            orientedReadIdsOppositeStrand[1].flipStrand();
 
+// Store the candidates of each read.
+void Assembler::rankAlignmentCandidatesThreadFunction2(size_t threadId)
+{
+    auto& data = computeAlignmentsData;
 
-            // out << timestamp << "Working on " << i << " " << orientedReadIds[0] << " " << orientedReadIds[1] << endl;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const OrientedReadPair& candidate = alignmentCandidates[i];
+            data.candidateTable.storeMultithreaded(candidate.readIds[0], i);
+            data.candidateTable.storeMultithreaded(candidate.readIds[1], i);
+        }
+    }
+}
 
-            // Get the markers for the two oriented reads in this candidate.
-            for(size_t j=0; j<2; j++) {
-                getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
-            }
 
-            // Compute the Alignment.
-            const auto t0 = std::chrono::steady_clock::now();
-            alignOrientedReads(
-                markersSortedByKmerId,
-                maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
-            const auto t1 = std::chrono::steady_clock::now();
-            const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
-            if(t01 > 1.) {
-                std::lock_guard<std::mutex> lock(mutex);
-                cout << timestamp << "Slow alignment computation for oriented reads ";
-                cout << orientedReadIds[0] << " ";
-                cout << orientedReadIds[1] << ": ";
-                cout << t01 << " s.\n";
-            }
 
-            // If the alignment has too few markers skip it.
-            if(alignment.ordinals.size() < minAlignedMarkerCount) {
-                continue;
+// For each read, find the best maxCandidatesPerRead candidates.
+// The order of the candidates of each read depends on thread timing,
+// but the candidates found do not, because pairs (score, candidate index)
+// are all distinct.
+void Assembler::rankAlignmentCandidatesThreadFunction3(size_t threadId)
+{
+    auto& data = computeAlignmentsData;
+    const size_t maxCandidatesPerRead = data.maxCandidatesPerRead;
+    vector<uint64_t>& keepCandidates = data.threadKeepCandidates[threadId];
+
+    // Contains pairs(score, candidate index).
+    vector< pair<uint32_t, uint64_t> > readCandidates;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            readCandidates.clear();
+            for(const uint64_t i: data.candidateTable[readId]) {
+                readCandidates.push_back(make_pair(data.candidateScores[i], i));
+            }
+            if(readCandidates.size() > maxCandidatesPerRead) {
+                std::nth_element(
+                    readCandidates.begin(),
+                    readCandidates.begin() + maxCandidatesPerRead,
+                    readCandidates.end(),
+                    std::greater< pair<uint32_t, uint64_t> >());
+                readCandidates.resize(maxCandidatesPerRead);
             }
+            for(const auto& p: readCandidates) {
+                keepCandidates.push_back(p.second);
+            }
+        }
+    }
+}
 
-            // If the alignment has too much trim, skip it.
-            uint32_t leftTrim;
-            uint32_t rightTrim;
-            tie(leftTrim, rightTrim) = alignmentInfo.computeTrim();
-            if(leftTrim>maxTrim || rightTrim>maxTrim) {
-                continue;
+
+
+// Thread function used by findAlignmentCandidatesLowHashAndComputeAlignments.
+// Get batches of candidates from the queue until it is closed.
+void Assembler::computeAlignmentsFromQueueThreadFunction(size_t threadId)
+{
+    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
+    AlignmentGraph graph;
+    LazyAlignmentGraph lazyGraph;
+    Alignment alignment;
+    AlignmentInfo alignmentInfo;
+    vector<uint8_t> compressedAlignment;
+    createThreadCompressedAlignments(threadId);
+    OrientedReadPairQueue& candidateQueue = *computeAlignmentsData.candidateQueue;
+
+    vector<OrientedReadPair> batch;
+    while(candidateQueue.pop(batch)) {
+        for(const OrientedReadPair& candidate: batch) {
+            computeAlignment(candidate, threadId,
+                markersSortedByKmerId, graph, lazyGraph, alignment, alignmentInfo, compressedAlignment);
+        }
+    }
+}
+
+
+
+// Create the vectors where a thread of computeAlignments
+// stores its compressed alignments, if necessary.
+void Assembler::createThreadCompressedAlignments(size_t threadId)
+{
+    auto& data = computeAlignmentsData;
+    if(!data.storeAlignments) {
+        return;
+    }
+    data.threadCompressedAlignments[threadId] =
+        make_shared< MemoryMapped::VectorOfVectors<uint8_t, uint64_t> >();
+    data.threadCompressedAlignments[threadId]->createNew(
+        largeDataName("tmp-ThreadCompressedAlignments-" + to_string(threadId)),
+        largeDataPageSize);
+}
+
+
+
+// Compute the alignment for a candidate, and store it
+// in the data of the calling thread if it is good enough.
+void Assembler::computeAlignment(
+    const OrientedReadPair& candidate,
+    size_t threadId,
+    array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId,
+    AlignmentGraph& graph,
+    LazyAlignmentGraph& lazyGraph,
+    Alignment& alignment,
+    AlignmentInfo& alignmentInfo,
+    vector<uint8_t>& compressedAlignment)
+{
+    array<OrientedReadId, 2> orientedReadIds;
+    array<OrientedReadId, 2> orientedReadIdsOppositeStrand;
+
+    const bool debug = false;
+    auto& data = computeAlignmentsData;
+    const uint32_t maxMarkerFrequency = data.maxMarkerFrequency;
+    const size_t maxSkip = data.maxSkip;
+    const size_t minAlignedMarkerCount = data.minAlignedMarkerCount;
+    const size_t maxTrim = data.maxTrim;
+
+    CZI_ASSERT(candidate.readIds[0] < candidate.readIds[1]);
+
+    // Get the oriented read ids, with the first one on strand 0.
+    orientedReadIds[0] = OrientedReadId(candidate.readIds[0], 0);
+    orientedReadIds[1] = OrientedReadId(candidate.readIds[1], candidate.isSameStrand ? 0 : 1);
+
+    // Get the oriented read ids for the opposite strand.
+    orientedReadIdsOppositeStrand = orientedReadIds;
+    orientedReadIdsOppositeStrand[0].flipStrand();
+    orientedReadIdsOppositeStrand[1].flipStrand();
+
+
+    // out << timestamp << "Working on " << i << " " << orientedReadIds[0] << " " << orientedReadIds[1] << endl;
+
+    // Get the markers for the two oriented reads in this candidate.
+    for(size_t j=0; j<2; j++) {
+        getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+    }
+
+    // Compute the Alignment.
+    // The alignment engine abandons the computation early,
+    // returning an empty alignment, if it finds that the alignment
+    // cannot satisfy the minAlignedMarkerCount and maxTrim criteria below.
+    const auto t0 = std::chrono::steady_clock::now();
+    if(data.alignMethod == 0) {
+        align(
+            markersSortedByKmerId,
+            maxSkip, maxMarkerFrequency, data.bandHalfWidth, minAlignedMarkerCount, maxTrim,
+            debug, graph, alignment, alignmentInfo);
+    } else {
+        align(
+            markersSortedByKmerId,
+            maxSkip, maxMarkerFrequency, data.bandHalfWidth, minAlignedMarkerCount, maxTrim,
+            debug, lazyGraph, alignment, alignmentInfo);
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
+    if(t01 > 1.) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cout << timestamp << "Slow alignment computation for oriented reads ";
+        cout << orientedReadIds[0] << " ";
+        cout << orientedReadIds[1] << ": ";
+        cout << t01 << " s.\n";
+    }
+
+    // If the alignment is empty or has too few markers skip it.
+    if(alignment.ordinals.empty() || alignment.ordinals.size() < minAlignedMarkerCount) {
+        return;
+    }
+
+    // If the alignment has too much trim, skip it.
+    uint32_t leftTrim;
+    uint32_t rightTrim;
+    tie(leftTrim, rightTrim) = alignmentInfo.computeTrim();
+    if(leftTrim>maxTrim || rightTrim>maxTrim) {
+        return;
+    }
+
+    // If getting here, this is a good alignment.
+    data.threadAlignmentData[threadId].push_back(AlignmentData(candidate, alignmentInfo));
+    if(data.storeAlignments) {
+        compressAlignment(alignment, compressedAlignment);
+        data.threadCompressedAlignments[threadId]->appendVector(compressedAlignment);
+    }
+}
+
+
+
+// Compute alignments of the first candidateCount alignment candidates
+// using each of the alignment methods supported by computeAlignments,
+// with and without a band if bandHalfWidth is not zero,
+// and write timing and comparison information.
+// This runs single-threaded and does not store any alignments.
+void Assembler::compareAlignmentMethods(
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    uint32_t bandHalfWidth,
+    size_t candidateCount)
+{
+    // Check that we have what we need.
+    checkReadsAreOpen();
+    checkKmersAreOpen();
+    checkMarkersAreOpen();
+    checkAlignmentCandidatesAreOpen();
+
+    candidateCount = min(candidateCount, size_t(alignmentCandidates.size()));
+    cout << timestamp << "Comparing alignment methods for " << candidateCount;
+    cout << " alignment candidates." << endl;
+
+    // Get the markers of all the candidates first,
+    // so the timings only include the alignment computation.
+    vector< array<vector<MarkerWithOrdinal>, 2> > markersSortedByKmerId(candidateCount);
+    for(size_t i=0; i<candidateCount; i++) {
+        const OrientedReadPair& candidate = alignmentCandidates[i];
+        const OrientedReadId orientedReadId0(candidate.readIds[0], 0);
+        const OrientedReadId orientedReadId1(candidate.readIds[1], candidate.isSameStrand ? 0 : 1);
+        getMarkersSortedByKmerId(orientedReadId0, markersSortedByKmerId[i][0]);
+        getMarkersSortedByKmerId(orientedReadId1, markersSortedByKmerId[i][1]);
+    }
+
+    // The alignment methods to be compared, each with
+    // no band and, if requested, with the specified band.
+    // The first one, the unbanded alignment graph, is used as the reference.
+    vector< pair<size_t, uint32_t> > methods;
+    methods.push_back(make_pair(0, 0));
+    methods.push_back(make_pair(1, 0));
+    if(bandHalfWidth > 0) {
+        methods.push_back(make_pair(0, bandHalfWidth));
+        methods.push_back(make_pair(1, bandHalfWidth));
+    }
+
+    // Compute the alignments with each method.
+    // Alignments are always computed in full, without early exit.
+    const bool debug = false;
+    const size_t minAlignedMarkerCount = 0;
+    const size_t maxTrim = std::numeric_limits<size_t>::max();
+    AlignmentGraph graph;
+    LazyAlignmentGraph lazyGraph;
+    Alignment alignment;
+    vector< vector<AlignmentInfo> > alignmentInfos(methods.size(), vector<AlignmentInfo>(candidateCount));
+    vector<double> times(methods.size());
+    for(size_t k=0; k<methods.size(); k++) {
+        const size_t alignMethod = methods[k].first;
+        const uint32_t methodBandHalfWidth = methods[k].second;
+        const auto t0 = steady_clock::now();
+        for(size_t i=0; i<candidateCount; i++) {
+            AlignmentInfo& alignmentInfo = alignmentInfos[k][i];
+            if(alignMethod == 0) {
+                align(markersSortedByKmerId[i],
+                    maxSkip, maxMarkerFrequency, methodBandHalfWidth, minAlignedMarkerCount, maxTrim,
+                    debug, graph, alignment, alignmentInfo);
+            } else {
+                align(markersSortedByKmerId[i],
+                    maxSkip, maxMarkerFrequency, methodBandHalfWidth, minAlignedMarkerCount, maxTrim,
+                    debug, lazyGraph, alignment, alignmentInfo);
             }
+        }
+        const auto t1 = steady_clock::now();
+        times[k] = seconds(t1 - t0);
+        cout << timestamp << "Align method " << alignMethod << " with band half width " <<
+            methodBandHalfWidth << " took " << times[k] << " s." << endl;
+    }
 
-            // If getting here, this is a good alignment.
-            threadAlignmentData.push_back(AlignmentData(candidate, alignmentInfo));
+    // Compare the AlignmentInfo computed by each method
+    // with the one computed by the reference method.
+    // All fields are compared: the number of aligned markers
+    // and, for each oriented read, its number of markers and
+    // the ordinals of the first and last aligned marker.
+    for(size_t k=1; k<methods.size(); k++) {
+        size_t identicalCount = 0;
+        size_t differentMarkerCount = 0;
+        for(size_t i=0; i<candidateCount; i++) {
+            const AlignmentInfo& info0 = alignmentInfos[0][i];
+            const AlignmentInfo& info1 = alignmentInfos[k][i];
+            if(info0 == info1) {
+                ++identicalCount;
+            } else if(info0.markerCount != info1.markerCount) {
+                ++differentMarkerCount;
+            }
         }
+        cout << "Align method " << methods[k].first << " with band half width " << methods[k].second;
+        cout << " is " << times[0] / times[k] << " times faster than the reference." << endl;
+        cout << "The AlignmentInfo is identical for " << identicalCount;
+        cout << " of " << candidateCount << " alignment candidates." << endl;
+        cout << "The number of aligned markers is different for ";
+        cout << differentMarkerCount << " alignment candidates." << endl;
+        cout << "The number of aligned markers is the same but the first or last ";
+        cout << "aligned marker is different for ";
+        cout << candidateCount - identicalCount - differentMarkerCount << " alignment candidates." << endl;
     }
 }
 
@@ -420,6 +964,16 @@ void Assembler::accessAlignmentData()
 {
     alignmentData.accessExistingReadOnly(largeDataName("AlignmentData"));
     alignmentTable.accessExistingReadOnly(largeDataName("AlignmentTable"));
+
+    // The stored alignments are optional.
+    try {
+        compressedAlignments.accessExistingReadOnly(largeDataName("CompressedAlignments"));
+    } catch(const runtime_error&) {
+        return;
+    }
+    if(compressedAlignments.size() != alignmentData.size()) {
+        throw runtime_error("Stored alignments are inconsistent with alignment data.");
+    }
 }
 
 
@@ -479,6 +1033,77 @@ vector< pair<OrientedReadId, AlignmentInfo> >
 
 
 
+// Get a stored alignment given its alignment id.
+void Assembler::getStoredAlignment(uint64_t alignmentId, Alignment& alignment) const
+{
+    const auto v = compressedAlignments[alignmentId];
+    decompressAlignment(v.begin(), v.end(), alignment);
+}
+
+
+
+// Get the stored alignment of two oriented reads,
+// swapped and/or reverse complemented as necessary.
+bool Assembler::getStoredAlignment(
+    OrientedReadId orientedReadId0Argument,
+    OrientedReadId orientedReadId1Argument,
+    Alignment& alignment) const
+{
+    if(!compressedAlignments.isOpen() || !alignmentTable.isOpen()) {
+        return false;
+    }
+
+    // Loop over alignments involving the first oriented read,
+    // as stored in the alignment table.
+    const auto alignmentTable0 = alignmentTable[orientedReadId0Argument.getValue()];
+    for(const auto i: alignmentTable0) {
+        const AlignmentData& ad = alignmentData[i];
+
+        // Get the oriented read ids that the AlignmentData refers to.
+        OrientedReadId orientedReadId0(ad.readIds[0], 0);
+        OrientedReadId orientedReadId1(ad.readIds[1], ad.isSameStrand ? 0 : 1);
+
+        // Swap and reverse complement them as necessary,
+        // as in findOrientedAlignments.
+        const bool swapNeeded = (orientedReadId0.getReadId() != orientedReadId0Argument.getReadId());
+        if(swapNeeded) {
+            swap(orientedReadId0, orientedReadId1);
+        }
+        const bool reverseComplementNeeded = (orientedReadId0.getStrand() != orientedReadId0Argument.getStrand());
+        if(reverseComplementNeeded) {
+            orientedReadId0.flipStrand();
+            orientedReadId1.flipStrand();
+        }
+        CZI_ASSERT(orientedReadId0 == orientedReadId0Argument);
+        if(orientedReadId1 != orientedReadId1Argument) {
+            continue;
+        }
+
+        // Get the stored alignment and transform it the same way.
+        // Reverse complementing an oriented read with n markers
+        // changes marker ordinal i to n-1-i.
+        getStoredAlignment(i, alignment);
+        if(swapNeeded) {
+            for(auto& ordinals: alignment.ordinals) {
+                swap(ordinals[0], ordinals[1]);
+            }
+        }
+        if(reverseComplementNeeded) {
+            const uint32_t markerCount0 = uint32_t(markers.size(orientedReadId0.getValue()));
+            const uint32_t markerCount1 = uint32_t(markers.size(orientedReadId1.getValue()));
+            for(auto& ordinals: alignment.ordinals) {
+                ordinals[0] = markerCount0 - 1 - ordinals[0];
+                ordinals[1] = markerCount1 - 1 - ordinals[1];
+            }
+            std::reverse(alignment.ordinals.begin(), alignment.ordinals.end());
+        }
+        return true;
+    }
+    return false;
+}
+
+
+
 // Flag palindromic reads.
 void Assembler::flagPalindromicReads(
     uint32_t maxSkip,
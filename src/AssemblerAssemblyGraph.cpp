@@ -1210,7 +1210,7 @@ void Assembler::assembleAssemblyGraphEdge(
 
         // Get the sequence.
         const MarkerId firstMarkerId = markerGraph.vertices[assembledSegment.vertexIds[i]][0];
-        const CompressedMarker& firstMarker = markers.begin()[firstMarkerId];
+        const CompressedMarker& firstMarker = markers.getMarker(firstMarkerId);
         const KmerId kmerId = firstMarker.kmerId;
         const Kmer kmer(kmerId, assemblerInfo->k);
 
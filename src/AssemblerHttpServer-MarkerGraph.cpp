@@ -53,6 +53,7 @@ void Assembler::exploreMarkerGraph(
         uint32_t(assemblerInfo->k),
         reads,
         readRepeatCounts,
+        compressedReadRepeatCounts,
         markers,
         markerGraph.vertexTable,
         *consensusCaller);
@@ -952,8 +953,7 @@ void Assembler::showLocalMarkerGraphAlignments(
             const size_t rank0 = vertex0.rank;
             const KmerId kmerId0 = graph.getKmerId(v0);
             const Kmer kmer0(kmerId0, k);
-            const MarkerId markerId0 = getMarkerId(orientedReadId, ordinal0);
-            const CompressedMarker& marker0 = markers.begin()[markerId0];
+            const CompressedMarker marker0 = markers[orientedReadId.getValue()][ordinal0];
 
             // Write the k-mer.
             html << "<td style='text-align:right' title='Oriented read " << orientedReadId <<
@@ -986,8 +986,7 @@ void Assembler::showLocalMarkerGraphAlignments(
             const size_t rank1 = vertex1.rank;
 
             // Write the cell in between these two vertices.
-            const MarkerId markerId1 = getMarkerId(orientedReadId, ordinal1);
-            const CompressedMarker& marker1 = markers.begin()[markerId1];
+            const CompressedMarker marker1 = markers[orientedReadId.getValue()][ordinal1];
             const uint32_t position0 = marker0.position;
             const uint32_t position1 = marker1.position;
             html << "<td colspan=" << 2*(rank1-rank0)-1;
@@ -1067,7 +1066,7 @@ void Assembler::exploreMarkerGraphVertex(const vector<string>& request, ostream&
     CZI_ASSERT(markerCount > 0);
 
     // Get the marker sequence.
-    const KmerId kmerId = markers.begin()[markerIds[0]].kmerId;
+    const KmerId kmerId = markers.getMarker(markerIds[0]).kmerId;
     const size_t k = assemblerInfo->k;
     const Kmer kmer(kmerId, k);
 
@@ -1079,8 +1078,8 @@ void Assembler::exploreMarkerGraphVertex(const vector<string>& request, ostream&
     vector< vector<uint8_t> > repeatCounts(markerCount, vector<uint8_t>(k));
     for(size_t j=0; j<markerCount; j++) {
         const MarkerId markerId = markerIds[j];
-        const CompressedMarker& marker = markers.begin()[markerId];
         tie(orientedReadIds[j], ordinals[j]) = findMarkerId(markerId);
+        const CompressedMarker marker = markers[orientedReadIds[j].getValue()][ordinals[j]];
 
         // Get the repeat count for this marker at each of the k positions.
         for(size_t i=0; i<k; i++) {
@@ -299,11 +299,17 @@ void Assembler::accessAllSoft()
         allDataAreAvailable = false;
     }
 
+    // The sorted markers are optional (see computeSortedMarkers).
+    try {
+        accessSortedMarkers();
+    } catch(exception e) {
+    }
+
+    bool alignmentCandidatesAreAccessible = true;
     try {
         accessAlignmentCandidates();
     } catch(exception e) {
-        cout << "Alignment candidates are not accessible." << endl;
-        allDataAreAvailable = false;
+        alignmentCandidatesAreAccessible = false;
     }
 
     try {
@@ -313,6 +319,17 @@ void Assembler::accessAllSoft()
         allDataAreAvailable = false;
     }
 
+    // With Align.streamCandidates the alignment candidates
+    // are not stored, but the alignments are.
+    if(!alignmentCandidatesAreAccessible) {
+        if(alignmentData.isOpen) {
+            cout << "Alignment candidates were not stored." << endl;
+        } else {
+            cout << "Alignment candidates are not accessible." << endl;
+            allDataAreAvailable = false;
+        }
+    }
+
     try {
         accessReadGraph();
     } catch(exception e) {
@@ -388,12 +405,17 @@ void Assembler::exploreSummary(
 #endif
 
     // Compute the number of k-mers used as markers.
+    // If markers were selected by hash, there is no k-mer table,
+    // and we only know the fraction of k-mers used as markers.
     uint64_t markerKmerCount = 0;
     for(const auto& tableEntry: kmerTable) {
         if(tableEntry.isMarker) {
             ++ markerKmerCount;
         }
     }
+    const double markerFraction = useKmerHashSelection() ?
+        kmerHashSelection[0].probability() :
+        double(markerKmerCount) / double(kmerTable.size());
 
 
     html <<
@@ -417,13 +439,25 @@ void Assembler::exploreSummary(
         "<td class=right>" << assemblerInfo->k <<
 
         "<tr><td title='The total number of k-mers of length k'>Total k-mers"
-        "<td class=right>" << kmerTable.size() <<
+        "<td class=right>";
+    if(useKmerHashSelection()) {
+        html << "4<sup>" << assemblerInfo->k << "</sup>";
+    } else {
+        html << kmerTable.size();
+    }
+    html <<
 
         "<tr><td title='The number of k-mers of length k used as markers'>Marker k-mers"
-        "<td class=right>" << markerKmerCount <<
+        "<td class=right>";
+    if(useKmerHashSelection()) {
+        html << "Selected by hash";
+    } else {
+        html << markerKmerCount;
+    }
+    html <<
 
         "<tr><td title='The fraction of k-mers of length k used as markers'>Marker fraction"
-        "<td class=right>" << setprecision(3) << double(markerKmerCount) / double(kmerTable.size()) <<
+        "<td class=right>" << setprecision(3) << markerFraction <<
 
         "<tr><td title='Total number of markers on both strands'>Oriented markers"
         "<td class=right>" << markers.totalSize() <<
@@ -521,7 +555,7 @@ void Assembler::exploreRead(
     const OrientedReadId orientedReadId(readId, strand);
     const vector<Base> rawOrientedReadSequence = getOrientedReadRawSequence(orientedReadId);
     const auto readStoredSequence = reads[readId];
-    const auto readName = readNames[readId];
+    const string readName = getReadName(readId);
     const auto orientedReadMarkers = markers[orientedReadId.getValue()];
     if(!beginPositionIsPresent) {
         beginPosition = 0;
@@ -1495,6 +1529,15 @@ void Assembler::exploreAlignment(
     uint32_t maxMarkerFrequency = 10;
     getParameterValue(request, "maxMarkerFrequency", maxMarkerFrequency);
 
+    // If alignments were stored by computeAlignments, by default
+    // use the stored alignment, if there is one, instead of computing it.
+    // The checkbox is initially checked.
+    string useStoredAlignmentString;
+    getParameterValue(request, "useStoredAlignment", useStoredAlignmentString);
+    const bool useStoredAlignment =
+        compressedAlignments.isOpen() &&
+        ((useStoredAlignmentString == "on") || !readId0IsPresent);
+
     // Write the form.
     html <<
         "<form>"
@@ -1516,6 +1559,11 @@ void Assembler::exploreAlignment(
     html <<
         "<br>Maximum k-mer frequency: " <<
         "<input type=text name=maxMarkerFrequency required size=8 value=" << maxMarkerFrequency << ">";
+    if(compressedAlignments.isOpen()) {
+        html << "<br><input type=checkbox name=useStoredAlignment" <<
+            (useStoredAlignment ? " checked" : "") <<
+            "> Use the alignment stored by the assembly, if available.";
+    }
     html << "</form>";
 
     // If the readId's or strand's are missing, stop here.
@@ -1533,14 +1581,12 @@ void Assembler::exploreAlignment(
         "<a href='exploreRead?readId=" << readId0 << "&strand=" << strand0 << "'>" << orientedReadId0 << "</a>" <<
         " and " <<
         "<a href='exploreRead?readId=" << readId1 << "&strand=" << strand1 << "'>" << orientedReadId1 << "</a>" <<
-        "</h1>"
-        "<p>This alignment was computed allowing a skip of up to " << maxSkip << " markers "
-        "and considering only marker k-mers that appear up to " << maxMarkerFrequency <<
-        " times in each oriented read.";
+        "</h1>";
 
 
 
-    // Compute the alignment.
+    // Get the stored alignment, if requested and available,
+    // or compute the alignment.
     // This creates file Alignment.png.
     array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
     getMarkersSortedByKmerId(orientedReadId0, markersSortedByKmerId[0]);
@@ -1548,10 +1594,19 @@ void Assembler::exploreAlignment(
     AlignmentGraph graph;
     Alignment alignment;
     AlignmentInfo alignmentInfo;
-    const bool debug = true;
-    alignOrientedReads(
-        markersSortedByKmerId,
-        maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+    if(useStoredAlignment && getStoredAlignment(orientedReadId0, orientedReadId1, alignment)) {
+        html << "<p>This is the alignment stored by the assembly.";
+        graph.writeImage(markersSortedByKmerId[0], markersSortedByKmerId[1], alignment, "Alignment.png");
+    } else {
+        html <<
+            "<p>This alignment was computed allowing a skip of up to " << maxSkip << " markers "
+            "and considering only marker k-mers that appear up to " << maxMarkerFrequency <<
+            " times in each oriented read.";
+        const bool debug = true;
+        alignOrientedReads(
+            markersSortedByKmerId,
+            maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+    }
     if(alignment.ordinals.empty()) {
         html << "<p>The alignment is empty (it has no markers).";
         return;
@@ -2660,7 +2715,7 @@ void Assembler::exploreReadGraph(
         BGL_FORALL_VERTICES(v, graph, LocalReadGraph) {
             const LocalReadGraphVertex& vertex = graph[v];
             const vector<Base> sequence = getOrientedReadRawSequence(vertex.orientedReadId);
-            const auto readName = readNames[vertex.orientedReadId.getReadId()];
+            const string readName = getReadName(vertex.orientedReadId.getReadId());
             fastaFile << ">" << vertex.orientedReadId << " ";
             copy(readName.begin(), readName.end(), ostream_iterator<char>(fastaFile));
             fastaFile << "\n";
@@ -2,6 +2,9 @@
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+#include "filesystem.hpp"
+#include "timestamp.hpp"
+#include <map>
 #include <random>
 
 
@@ -9,7 +12,12 @@ using namespace shasta;
 void Assembler::accessKmers()
 {
     kmerTable.accessExistingReadOnly(largeDataName("Kmers"));
-    if(kmerTable.size() != (1ULL<< (2*assemblerInfo->k))) {
+    if(filesystem::exists(largeDataName("KmerHashSelection"))) {
+        kmerHashSelection.accessExistingReadOnly(largeDataName("KmerHashSelection"));
+    }
+    const uint64_t expectedSize = useKmerHashSelection() ?
+        0ULL : (1ULL<< (2*assemblerInfo->k));
+    if(kmerTable.size() != expectedSize) {
         throw runtime_error("Size of k-mer vector is inconsistent with stored value of k.");
     }
 }
@@ -34,6 +42,10 @@ void Assembler::randomlySelectKmers(
     if(k > Kmer::capacity) {
         throw runtime_error("K-mer capacity exceeded.");
     }
+    if(k > 16) {
+        throw runtime_error("The k-mer table cannot be used for k > 16. "
+            "Use selectKmersByHash instead.");
+    }
     assemblerInfo->k = k;
 
     // Sanity check on the requested fraction.
@@ -66,8 +78,10 @@ void Assembler::randomlySelectKmers(
 
 
 
-    // Create the kmer table with the necessary size.
+    // Create the kmer table with the necessary size,
+    // and record that markers are not selected by hash.
     kmerTable.createNew(largeDataName("Kmers"), largeDataPageSize);
+    kmerHashSelection.createNew(largeDataName("KmerHashSelection"), largeDataPageSize);
     const size_t kmerCount = 1ULL << (2ULL*k);
     kmerTable.resize(kmerCount);
 
@@ -116,9 +130,181 @@ void Assembler::randomlySelectKmers(
 
 
 
+// Select the k-mers to be used as markers using a hash
+// of their canonical id, without storing a table of 4^k k-mers.
+// This is used for large k. See class KmerHashSelection.
+void Assembler::selectKmersByHash(
+    size_t k,           // k-mer length.
+    double probability, // The probability that a k-mer is selected as a marker.
+    int seed            // For the hash function.
+)
+{
+    // Sanity check on the value of k, then store it.
+    if(k > Kmer::capacity) {
+        throw runtime_error("K-mer capacity exceeded.");
+    }
+    assemblerInfo->k = k;
+
+    // Sanity check on the requested fraction.
+    if(probability<0. || probability>1.) {
+        throw runtime_error("Invalid k-mer probability " +
+            to_string(probability) + " requested.");
+    }
+
+    // Store the selection parameters.
+    // Because the canonical k-mer id is hashed, a k-mer and its
+    // reverse complement are selected together, so we can use
+    // the requested probability directly.
+    kmerHashSelection.createNew(largeDataName("KmerHashSelection"), largeDataPageSize);
+    kmerHashSelection.resize(1);
+    kmerHashSelection[0].set(probability, uint64_t(seed));
+
+    // Create an empty k-mer table, so it can be accessed as usual.
+    kmerTable.createNew(largeDataName("Kmers"), largeDataPageSize);
+
+    cout << "Selecting " << k << "-mers by hash with probability ";
+    cout << probability << "." << endl;
+}
+
+
+
+// Count the number of occurrences of each marker k-mer in the reads,
+// and stop using as markers the k-mers that occur less than
+// minFrequency times or more than maxFrequency times
+// (maxFrequency=0 means no upper limit).
+// Very frequent k-mers are usually in repeats, and k-mers that
+// occur only once or twice are usually caused by errors.
+// Neither is useful as a marker, and both inflate
+// the work done in alignment and marker graph creation.
+void Assembler::maskKmersByFrequency(
+    uint64_t minFrequency,
+    uint64_t maxFrequency,
+    size_t threadCount)
+{
+    cout << timestamp << "Counting marker k-mers in " << reads.size() << " reads." << endl;
+    checkReadsAreOpen();
+    checkKmersAreOpen();
+    if(useKmerHashSelection()) {
+        throw runtime_error("Masking k-mers by frequency requires the k-mer table "
+            "and cannot be used when markers are selected by hash.");
+    }
+    if(!kmerTable.isOpenWithWriteAccess) {
+        throw runtime_error("Kmers are not accessible with write access.");
+    }
+    const size_t k = assemblerInfo->k;
+    const uint64_t kmerCount = kmerTable.size();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    cout << "Using " << threadCount << " threads." << endl;
+
+    // Count the k-mers in parallel.
+    auto& kmerFrequency = maskKmersByFrequencyData.kmerFrequency;
+    kmerFrequency.createNew(largeDataName("tmp-KmerFrequency"), largeDataPageSize);
+    kmerFrequency.resize(kmerCount);
+    fill(kmerFrequency.begin(), kmerFrequency.end(), 0ULL);
+    setupLoadBalancing(reads.size(), 1000);
+    runThreads(&Assembler::maskKmersByFrequencyThreadFunction, threadCount);
+
+    // Loop over k-mers to mask the ones that don't satisfy the requested
+    // frequency bounds. The frequency of a k-mer is the number of times
+    // it occurs in the reads on either strand, so a k-mer and its reverse
+    // complement have the same frequency and are masked together.
+    std::map<uint64_t, uint64_t> histogram;
+    std::map<uint64_t, uint64_t> maskedHistogram;
+    uint64_t markerKmerCount = 0;
+    uint64_t lowFrequencyCount = 0;
+    uint64_t highFrequencyCount = 0;
+    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        KmerInfo& info = kmerTable[kmerId];
+        if(!info.isMarker) {
+            continue;
+        }
+        const uint64_t frequency =
+            kmerFrequency[kmerId] + kmerFrequency[info.reverseComplementedKmerId];
+        ++histogram[frequency];
+        if(frequency < minFrequency) {
+            info.isMarker = false;
+            ++lowFrequencyCount;
+            ++maskedHistogram[frequency];
+        } else if(maxFrequency!=0 && frequency > maxFrequency) {
+            info.isMarker = false;
+            ++highFrequencyCount;
+            ++maskedHistogram[frequency];
+        } else {
+            ++markerKmerCount;
+        }
+    }
+    kmerFrequency.remove();
+
+    // Write the histogram.
+    ofstream csv("MarkerKmerFrequencyHistogram.csv");
+    csv << "Frequency,Kmers,MaskedKmers\n";
+    for(const auto& p: histogram) {
+        const auto it = maskedHistogram.find(p.first);
+        csv << p.first << "," << p.second << ",";
+        csv << (it==maskedHistogram.end() ? 0ULL : it->second) << "\n";
+    }
+
+    cout << timestamp << "Masked " << lowFrequencyCount <<
+        " marker k-mers with frequency less than " << minFrequency;
+    if(maxFrequency != 0) {
+        cout << " and " << highFrequencyCount <<
+            " with frequency greater than " << maxFrequency;
+    }
+    cout << "." << endl;
+    cout << "Kept " << markerKmerCount << " " << k << "-mers as markers out of ";
+    cout << kmerCount << " total." << endl;
+}
+
+
+
+// Thread function for maskKmersByFrequency.
+// This uses the same rolling computation of k-mer ids
+// as MarkerFinder::threadFunction1 (see LongBaseSequenceKmerIds).
+void Assembler::maskKmersByFrequencyThreadFunction(size_t threadId)
+{
+    const uint64_t k = assemblerInfo->k;
+    auto& kmerFrequency = maskKmersByFrequencyData.kmerFrequency;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over reads of this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            const LongBaseSequenceView read = reads[readId];
+            const uint64_t baseCount = read.baseCount;
+
+            // Loop over bases of this read.
+            LongBaseSequenceKmerIds kmerIds(read, k);
+            for(uint64_t position=0; position<baseCount; position++) {
+                kmerIds.addBase(position);
+                if(position+1 < k) {
+                    continue;
+                }
+
+                // Increment the frequency of this k-mer in a thread-safe way.
+                const KmerId kmerId = KmerId(kmerIds.kmerId());
+                if(kmerTable[kmerId].isMarker) {
+                    __sync_fetch_and_add(&kmerFrequency[kmerId], 1ULL);
+                }
+            }
+        }
+    }
+}
+
+
+
 void Assembler::writeKmers(const string& fileName) const
 {
     checkKmersAreOpen();
+    if(useKmerHashSelection()) {
+        throw runtime_error("There is no k-mer table to write "
+            "because markers were selected by hash.");
+    }
 
     // Get the k-mer length.
     const size_t k = assemblerInfo->k;
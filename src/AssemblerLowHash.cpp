@@ -1,8 +1,12 @@
 #include "Assembler.hpp"
 #include "LowHash.hpp"
+#include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard library.
+#include <cmath>
+
 
 
 
@@ -15,6 +19,10 @@ void Assembler::findAlignmentCandidatesLowHash(
     size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to become a candidate.
+    bool useRollingHash,            // Hash features with a rolling hash instead of MurmurHash64A.
+    size_t maxDiagonalDelta,        // If not zero, require hits on a consistent diagonal.
+    size_t bucketPassCount,         // If greater than 1, process buckets in this number of passes.
+    double targetCandidatesPerRead, // If not zero, adjust hashFraction and maxBucketSize to get this.
     size_t threadCount)
 {
 
@@ -24,6 +32,14 @@ void Assembler::findAlignmentCandidatesLowHash(
     const ReadId readCount = ReadId(markers.size() / 2);
     CZI_ASSERT(readCount > 0);
 
+    // If requested, choose hashFraction and maxBucketSize
+    // using sampling runs of LowHash.
+    if(targetCandidatesPerRead > 0.) {
+        tuneLowHash(m, hashFraction, minHashIterationCount, log2MinHashBucketCount,
+            maxBucketSize, minFrequency, useRollingHash, maxDiagonalDelta,
+            targetCandidatesPerRead, threadCount);
+    }
+
     // Create the alignment candidates.
     alignmentCandidates.createNew(largeDataName("AlignmentCandidates"), largeDataPageSize);
 
@@ -35,11 +51,173 @@ void Assembler::findAlignmentCandidatesLowHash(
         log2MinHashBucketCount,
         maxBucketSize,
         minFrequency,
+        useRollingHash,
+        maxDiagonalDelta,
+        bucketPassCount,
+        0,
         threadCount,
         kmerTable,
         readFlags,
         markers,
         alignmentCandidates,
+        0,
+        0,
         largeDataFileNamePrefix,
         largeDataPageSize);
 }
+
+
+
+// Choose hashFraction and maxBucketSize for LowHash so the number
+// of alignment candidates per read is close to the target.
+// Each trial is a sampling run of LowHash: the buckets are filled
+// using all reads, but candidates are only found for a sample of reads.
+// The first trial, with the given hashFraction and maxBucketSize,
+// is used to measure the bucket size distribution.
+// Most low hashes of features that occur once in the genome
+// fall in buckets of similar size, determined by coverage.
+// We set maxBucketSize to a multiple of the typical size
+// of a bucket containing more than one entry,
+// so buckets generated by repeats are skipped.
+// We then adjust hashFraction: the number of candidates per read
+// increases with hashFraction approximately as a power law,
+// and the exponent is estimated from the last two trials.
+// If the number of candidates no longer responds to hashFraction
+// (all overlaps are already found), we stop.
+// The trial closest to the target is used.
+void Assembler::tuneLowHash(
+    size_t m,
+    double& hashFraction,
+    size_t minHashIterationCount,
+    size_t log2MinHashBucketCount,
+    size_t& maxBucketSize,
+    size_t minFrequency,
+    bool useRollingHash,
+    size_t maxDiagonalDelta,
+    double targetCandidatesPerRead,
+    size_t threadCount)
+{
+    const size_t maxTrialCount = 6;
+    const double tolerance = 0.1;
+    const double maxBucketSizeFactor = 3.;
+    const uint64_t sampledReadCount = 10000;
+    const double maxHashFraction = 0.5;
+
+    const ReadId readCount = ReadId(markers.size() / 2);
+    const size_t readSampleStride = max(size_t(1), size_t(readCount / sampledReadCount));
+    cout << timestamp << "Tuning LowHash parameters for " << targetCandidatesPerRead <<
+        " alignment candidates per read, sampling one read every " <<
+        readSampleStride << "." << endl;
+
+    // Not used in sampling runs.
+    MemoryMapped::Vector<OrientedReadPair> unusedCandidates;
+
+    double previousHashFraction = 0.;
+    double previousCandidatesPerRead = 0.;
+    double bestHashFraction = hashFraction;
+    double bestError = std::numeric_limits<double>::max();
+    for(size_t trial=0; trial<maxTrialCount; trial++) {
+        cout << "LowHash tuning trial " << trial << " with hashFraction " << hashFraction <<
+            ", maxBucketSize " << maxBucketSize << "." << endl;
+        LowHash lowHash(
+            m,
+            hashFraction,
+            minHashIterationCount,
+            log2MinHashBucketCount,
+            maxBucketSize,
+            minFrequency,
+            useRollingHash,
+            maxDiagonalDelta,
+            1,
+            readSampleStride,
+            threadCount,
+            kmerTable,
+            readFlags,
+            markers,
+            unusedCandidates,
+            0,
+            0,
+            largeDataFileNamePrefix,
+            largeDataPageSize);
+        const double candidatesPerRead = lowHash.sampledCandidatesPerRead;
+
+        // After the first trial, choose maxBucketSize using the
+        // median bucket size of the low hashes that fall
+        // in buckets with more than one entry, then repeat the trial.
+        // The histogram already counts low hashes, not buckets.
+        if(trial == 0) {
+            const vector<uint64_t>& histogram = lowHash.bucketSizeHistogram;
+            uint64_t entryCount = 0;
+            for(uint64_t bucketSize=2; bucketSize<histogram.size(); bucketSize++) {
+                entryCount += histogram[bucketSize];
+            }
+            if(entryCount > 0) {
+                uint64_t cumulativeEntryCount = 0;
+                uint64_t medianBucketSize = 2;
+                for(uint64_t bucketSize=2; bucketSize<histogram.size(); bucketSize++) {
+                    cumulativeEntryCount += histogram[bucketSize];
+                    if(2 * cumulativeEntryCount >= entryCount) {
+                        medianBucketSize = bucketSize;
+                        break;
+                    }
+                }
+                const size_t newMaxBucketSize =
+                    size_t(std::ceil(maxBucketSizeFactor * double(medianBucketSize)));
+                cout << "Median size of buckets with more than one entry is " <<
+                    medianBucketSize << "." << endl;
+                if(newMaxBucketSize != maxBucketSize) {
+                    maxBucketSize = newMaxBucketSize;
+                    continue;
+                }
+            }
+        }
+
+        cout << "LowHash tuning trial " << trial << " found " << candidatesPerRead <<
+            " alignment candidates per read." << endl;
+        const double error = (candidatesPerRead == 0.) ? std::numeric_limits<double>::max() :
+            std::abs(std::log(candidatesPerRead / targetCandidatesPerRead));
+        if(error < bestError) {
+            bestError = error;
+            bestHashFraction = hashFraction;
+        }
+        if(std::abs(candidatesPerRead / targetCandidatesPerRead - 1.) < tolerance) {
+            break;
+        }
+        if(trial + 1 == maxTrialCount) {
+            break;
+        }
+
+        // Choose hashFraction for the next trial.
+        double exponent = 1.;
+        if(previousHashFraction > 0. && previousCandidatesPerRead > 0. && candidatesPerRead > 0. &&
+            hashFraction != previousHashFraction) {
+            exponent = std::log(candidatesPerRead / previousCandidatesPerRead) /
+                std::log(hashFraction / previousHashFraction);
+            if(exponent < 0.1) {
+                cout << "The number of alignment candidates does not depend on hashFraction." << endl;
+                break;
+            }
+        }
+        double newHashFraction;
+        if(candidatesPerRead == 0.) {
+            newHashFraction = 4. * hashFraction;
+        } else {
+            newHashFraction = hashFraction *
+                std::pow(targetCandidatesPerRead / candidatesPerRead, 1. / exponent);
+        }
+        newHashFraction = max(newHashFraction, 0.1 * hashFraction);
+        newHashFraction = min(newHashFraction, 10. * hashFraction);
+        newHashFraction = min(newHashFraction, maxHashFraction);
+        if(newHashFraction == hashFraction) {
+            break;
+        }
+        previousHashFraction = hashFraction;
+        previousCandidatesPerRead = candidatesPerRead;
+        hashFraction = newHashFraction;
+    }
+    hashFraction = bestHashFraction;
+
+    cout << timestamp << "LowHash tuning chose hashFraction " << hashFraction <<
+        ", maxBucketSize " << maxBucketSize <<
+        ", minHashIterationCount " << minHashIterationCount << "." << endl;
+}
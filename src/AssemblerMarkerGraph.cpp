@@ -102,7 +102,14 @@ void Assembler::createMarkerGraphVertices(
 
     // Update the disjoint set data structure for each alignment
     // in the read graph.
+    // If computeAlignments stored the alignments, use them.
+    // Otherwise, the alignments have to be computed again.
     cout << "Begin processing " << readGraph.edges.size() << " alignments in the read graph." << endl;
+    if(compressedAlignments.isOpen()) {
+        cout << "Using stored alignments." << endl;
+    } else {
+        cout << "Alignments are not stored and will be recomputed." << endl;
+    }
     cout << timestamp << "Disjoint set computation begins." << endl;
     size_t batchSize = 10000;
     setupLoadBalancing(readGraph.edges.size(), batchSize);
@@ -372,6 +379,7 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
     AlignmentGraph graph;
     Alignment alignment;
     AlignmentInfo alignmentInfo;
+    array<vector<CompressedMarker>, 2> markerBuffers;
 
     const bool debug = false;
     auto& data = createMarkerGraphVerticesData;
@@ -414,18 +422,40 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
                 continue;
             }
 
-            // Get the markers for the two oriented reads.
-            for(size_t j=0; j<2; j++) {
-                getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+            if(compressedAlignments.isOpen()) {
+
+                // Get the stored alignment.
+                // The read graph edge has the oriented read ids
+                // in the same order and orientation as the stored alignment.
+                getStoredAlignment(readGraphEdge.alignmentId, alignment);
+
+            } else {
+
+                // Get the markers for the two oriented reads.
+                for(size_t j=0; j<2; j++) {
+                    getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+                }
+
+                // Compute the Alignment.
+                // We already know that this is a good alignment, otherwise we
+                // would not have stored it.
+                alignOrientedReads(
+                    markersSortedByKmerId,
+                    maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
             }
 
-            // Compute the Alignment.
-            // We already know that this is a good alignment, otherwise we
-            // would not have stored it.
-            alignOrientedReads(
-                markersSortedByKmerId,
-                maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
 
+            // Get the markers of the two oriented reads.
+            // With Markers::storesStrand0Only, this computes
+            // the markers on strand 1 only once for each oriented read.
+            const auto markers0 = markers.getSpan(orientedReadIds[0].getValue(), markerBuffers[0]);
+            const auto markers1 = markers.getSpan(orientedReadIds[1].getValue(), markerBuffers[1]);
+            const uint32_t markerCount0 = uint32_t(markers0.size());
+            const uint32_t markerCount1 = uint32_t(markers1.size());
+            OrientedReadId reverseComplementedOrientedReadId0 = orientedReadIds[0];
+            OrientedReadId reverseComplementedOrientedReadId1 = orientedReadIds[1];
+            reverseComplementedOrientedReadId0.flipStrand();
+            reverseComplementedOrientedReadId1.flipStrand();
 
             // In the global marker graph, merge pairs
             // of aligned markers.
@@ -434,15 +464,17 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
                 const uint32_t ordinal1 = p[1];
                 const MarkerId markerId0 = getMarkerId(orientedReadIds[0], ordinal0);
                 const MarkerId markerId1 = getMarkerId(orientedReadIds[1], ordinal1);
-                CZI_ASSERT(markers.begin()[markerId0].kmerId == markers.begin()[markerId1].kmerId);
+                CZI_ASSERT(markers0[ordinal0].kmerId == markers1[ordinal1].kmerId);
                 disjointSetsPointer->unite(markerId0, markerId1);
 
                 // Also merge the reverse complemented markers.
                 // This guarantees that the marker graph remains invariant
                 // under strand swap.
+                // This is equivalent to using findReverseComplement,
+                // but does not require a binary search.
                 disjointSetsPointer->unite(
-                	findReverseComplement(markerId0),
-					findReverseComplement(markerId1));
+                    getMarkerId(reverseComplementedOrientedReadId0, markerCount0 - 1 - ordinal0),
+                    getMarkerId(reverseComplementedOrientedReadId1, markerCount1 - 1 - ordinal1));
             }
         }
     }
@@ -1384,10 +1416,9 @@ vector<Assembler::GlobalMarkerGraphEdgeInformation> Assembler::getGlobalMarkerGr
             info.ordinal1 = childInfo.ordinals[1];
 
             // Get the positions.
-            const MarkerId markerId0 = getMarkerId(childInfo.orientedReadId, info.ordinal0);
-            const MarkerId markerId1 = getMarkerId(childInfo.orientedReadId, info.ordinal1);
-            const auto& marker0 = markers.begin()[markerId0];
-            const auto& marker1 = markers.begin()[markerId1];
+            const auto orientedReadMarkers = markers[childInfo.orientedReadId.getValue()];
+            const CompressedMarker marker0 = orientedReadMarkers[info.ordinal0];
+            const CompressedMarker marker1 = orientedReadMarkers[info.ordinal1];
             info.position0 = marker0.position;
             info.position1 = marker1.position;
 
@@ -1506,6 +1537,7 @@ void Assembler::extractLocalMarkerGraph(
         uint32_t(assemblerInfo->k),
         reads,
         readRepeatCounts,
+        compressedReadRepeatCounts,
         markers,
         markerGraph.vertexTable,
         *consensusCaller);
@@ -2035,6 +2067,7 @@ vector<MarkerGraph::VertexId> Assembler::getLocalAssemblyPath(
         uint32_t(assemblerInfo->k),
         reads,
         readRepeatCounts,
+        compressedReadRepeatCounts,
         markers,
         markerGraph.vertexTable,
         *consensusCaller);
@@ -2981,8 +3014,9 @@ void Assembler::computeMarkerGraphVertexConsensusSequence(
     markerInfos.reserve(markerIds.size());
     markerPositions.reserve(markerIds.size());
     for(const MarkerId markerId: markerIds) {
-        markerInfos.push_back(findMarkerId(markerId));
-        markerPositions.push_back(markers.begin()[markerId].position);
+        const pair<OrientedReadId, uint32_t> markerInfo = findMarkerId(markerId);
+        markerInfos.push_back(markerInfo);
+        markerPositions.push_back(markers[markerInfo.first.getValue()][markerInfo.second].position);
     }
 
 
@@ -4537,8 +4571,9 @@ void Assembler::computeMarkerGraphVerticesCoverageDataThreadFunction(size_t thre
             markerInfos.clear();
             markerPositions.clear();
             for(const MarkerId markerId: markerIds) {
-                markerInfos.push_back(findMarkerId(markerId));
-                markerPositions.push_back(markers.begin()[markerId].position);
+                const pair<OrientedReadId, uint32_t> markerInfo = findMarkerId(markerId);
+                markerInfos.push_back(markerInfo);
+                markerPositions.push_back(markers[markerInfo.first.getValue()][markerInfo.second].position);
             }
 
             // Loop over the k base positions in this vertex.
@@ -2,20 +2,30 @@
 #include "Assembler.hpp"
 #include "findMarkerId.hpp"
 #include "MarkerFinder.hpp"
+#include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard library.
+#include "chrono.hpp"
+#include <limits>
 
 
-void Assembler::findMarkers(size_t threadCount)
+
+void Assembler::findMarkers(
+    size_t threadCount,
+    bool storeMarkersForStrand0Only,
+    bool compressMarkers)
 {
     checkReadsAreOpen();
     checkKmersAreOpen();
 
-    markers.createNew(largeDataName("Markers"), largeDataPageSize);
+    markers.createNew(largeDataName("Markers"), largeDataPageSize,
+        assemblerInfo->k, storeMarkersForStrand0Only, compressMarkers);
     MarkerFinder markerFinder(
         assemblerInfo->k,
         kmerTable,
+        useKmerHashSelection() ? &kmerHashSelection[0] : 0,
         reads,
         markers,
         threadCount);
@@ -26,7 +36,7 @@ void Assembler::findMarkers(size_t threadCount)
 
 void Assembler::accessMarkers()
 {
-    markers.accessExistingReadOnly(largeDataName("Markers"));
+    markers.accessExistingReadOnly(largeDataName("Markers"), assemblerInfo->k);
 }
 
 void Assembler::checkMarkersAreOpen() const
@@ -65,18 +75,147 @@ void Assembler::writeMarkers(ReadId readId, Strand strand, const string& fileNam
 
 
 
+// Store, for each oriented read, the ordinals of its markers
+// sorted by kmerId. This uses 2 bytes per marker on each strand
+// (4 for reads with more than 65535 markers)
+// and avoids sorting in getMarkersSortedByKmerId,
+// which is called for each alignment computed.
+// Both strands are stored, because the sorted order of strand 1
+// cannot be obtained from the sorted order of strand 0:
+// reverse complementing does not preserve the order of k-mer ids.
+void Assembler::computeSortedMarkers(size_t threadCount)
+{
+    const auto tBegin = steady_clock::now();
+    checkMarkersAreOpen();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // The number of entries for each oriented read is the same as its number of markers.
+    // They go to sortedMarkers16 if the ordinals fit in 16 bits,
+    // and to sortedMarkers32 otherwise.
+    const uint64_t orientedReadCount = markers.size();
+    sortedMarkers16.createNew(largeDataName("SortedMarkers16"), largeDataPageSize);
+    sortedMarkers32.createNew(largeDataName("SortedMarkers32"), largeDataPageSize);
+    sortedMarkers16.beginPass1(orientedReadCount);
+    sortedMarkers32.beginPass1(orientedReadCount);
+    for(uint64_t i=0; i<orientedReadCount; i++) {
+        const uint64_t markerCount = markers.size(i);
+        if(markerCount <= std::numeric_limits<uint16_t>::max()) {
+            sortedMarkers16.incrementCount(i, markerCount);
+        } else {
+            sortedMarkers32.incrementCount(i, markerCount);
+        }
+    }
+    sortedMarkers16.beginPass2();
+    sortedMarkers16.endPass2(false);
+    sortedMarkers32.beginPass2();
+    sortedMarkers32.endPass2(false);
+
+    // Sort the markers of each oriented read.
+    const size_t batchSize = 1000;
+    setupLoadBalancing(orientedReadCount, batchSize);
+    runThreads(&Assembler::computeSortedMarkersThreadFunction, threadCount);
+
+    const uint64_t byteCount =
+        (sortedMarkers16.size() + 1) * sizeof(uint64_t) + sortedMarkers16.totalSize() * sizeof(uint16_t) +
+        (sortedMarkers32.size() + 1) * sizeof(uint64_t) + sortedMarkers32.totalSize() * sizeof(uint32_t);
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << "Markers sorted by kmerId use " << byteCount << " bytes." << endl;
+    cout << timestamp << "Sorting markers by kmerId took " << tTotal << " s." << endl;
+}
+
+
+
+void Assembler::computeSortedMarkersThreadFunction(size_t threadId)
+{
+    vector<MarkerWithOrdinal> markersSortedByKmerId;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            sortMarkersByKmerId(OrientedReadId(ReadId(i)), markersSortedByKmerId);
+
+            if(sortedMarkers16.size(i) == markersSortedByKmerId.size()) {
+                uint16_t* pointer = sortedMarkers16.begin(i);
+                for(const MarkerWithOrdinal& marker: markersSortedByKmerId) {
+                    *pointer++ = uint16_t(marker.ordinal);
+                }
+            } else {
+                CZI_ASSERT(sortedMarkers32.size(i) == markersSortedByKmerId.size());
+                uint32_t* pointer = sortedMarkers32.begin(i);
+                for(const MarkerWithOrdinal& marker: markersSortedByKmerId) {
+                    *pointer++ = marker.ordinal;
+                }
+            }
+        }
+    }
+}
+
+
+
+void Assembler::accessSortedMarkers()
+{
+    sortedMarkers16.accessExistingReadOnly(largeDataName("SortedMarkers16"));
+    sortedMarkers32.accessExistingReadOnly(largeDataName("SortedMarkers32"));
+}
+
+
+
 // Get markers sorted by KmerId for a given OrientedReadId.
 void Assembler::getMarkersSortedByKmerId(
     OrientedReadId orientedReadId,
     vector<MarkerWithOrdinal>& markersSortedByKmerId) const
 {
-    const auto compressedMarkers = markers[orientedReadId.getValue()];
+    // If available, use the stored ordinals, so we don't have to sort.
+    if(sortedMarkers16.isOpen()) {
+        const uint64_t i = orientedReadId.getValue();
+        const Markers::View orientedReadMarkers = markers[i];
+        if(sortedMarkers16.size(i) == orientedReadMarkers.size()) {
+            getMarkersSortedByKmerId(orientedReadMarkers, sortedMarkers16[i], markersSortedByKmerId);
+        } else {
+            getMarkersSortedByKmerId(orientedReadMarkers, sortedMarkers32[i], markersSortedByKmerId);
+        }
+        return;
+    }
+
+    sortMarkersByKmerId(orientedReadId, markersSortedByKmerId);
+}
+
+
+
+// Fill markersSortedByKmerId from the stored ordinals.
+// The vector is reused by the caller, so this usually
+// does not allocate memory.
+template<class Ordinals> void Assembler::getMarkersSortedByKmerId(
+    const Markers::View& orientedReadMarkers,
+    const Ordinals& ordinals,
+    vector<MarkerWithOrdinal>& markersSortedByKmerId)
+{
+    CZI_ASSERT(ordinals.size() == orientedReadMarkers.size());
+    markersSortedByKmerId.resize(ordinals.size());
+    for(uint64_t i=0; i<ordinals.size(); i++) {
+        const uint32_t ordinal = ordinals[i];
+        markersSortedByKmerId[i] = MarkerWithOrdinal(orientedReadMarkers[ordinal], ordinal);
+    }
+}
+
+
+
+// Get markers sorted by KmerId for a given OrientedReadId,
+// without using the stored ordinals.
+void Assembler::sortMarkersByKmerId(
+    OrientedReadId orientedReadId,
+    vector<MarkerWithOrdinal>& markersSortedByKmerId) const
+{
+    const Markers::View orientedReadMarkers = markers[orientedReadId.getValue()];
     markersSortedByKmerId.clear();
-    markersSortedByKmerId.resize(compressedMarkers.size());
+    markersSortedByKmerId.resize(orientedReadMarkers.size());
 
-    for(uint32_t ordinal=0; ordinal<compressedMarkers.size(); ordinal++) {
-        const CompressedMarker& compressedMarker = compressedMarkers[ordinal];
-        markersSortedByKmerId[ordinal] = MarkerWithOrdinal(compressedMarker, ordinal);
+    for(uint32_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+        markersSortedByKmerId[ordinal] = MarkerWithOrdinal(orientedReadMarkers[ordinal], ordinal);
     }
 
     // Sort by kmerId.
@@ -90,9 +229,7 @@ void Assembler::getMarkersSortedByKmerId(
 MarkerId Assembler::getMarkerId(
     OrientedReadId orientedReadId, uint32_t ordinal) const
 {
-    return
-        (markers.begin(orientedReadId.getValue()) - markers.begin())
-        + ordinal;
+    return markers.getMarkerId(orientedReadId.getValue(), ordinal);
 }
 
 
@@ -887,14 +887,14 @@ void Assembler::writeLocalReadGraphReads(
     for(const ReadId readId: readsSet) {
 
         // Write the header line with the read name.
-        const auto readName = readNames[readId];
+        const string readName = getReadName(readId);
         fasta << ">" << readId << " ";
         copy(readName.begin(), readName.end(), ostream_iterator<char>(fasta));
         fasta << "\n";
 
         // Write the sequence.
         const auto& sequence = reads[readId];
-        const auto& counts = readRepeatCounts[readId];
+        const auto counts = getReadRepeatCounts(readId);
         const size_t n = sequence.baseCount;
         CZI_ASSERT(counts.size() == n);
         for(size_t i=0; i<n; i++) {
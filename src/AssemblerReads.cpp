@@ -1,11 +1,14 @@
 // shasta.
 #include "Assembler.hpp"
 #include "ReadLoader.hpp"
+#include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
 // Standard libraries.
+#include "chrono.hpp"
 #include "iterator.hpp"
+#include <sstream>
 
 
 
@@ -14,13 +17,23 @@ void Assembler::checkReadsAreOpen() const
     if(!reads.isOpen()) {
         throw runtime_error("Reads are not accessible.");
     }
-    if(!readRepeatCounts.isOpen()) {
+    if(!readRepeatCounts.isOpen() && !compressedReadRepeatCounts.isOpen()) {
         throw runtime_error("Read repeat counts are not accessible.");
     }
 }
+void Assembler::checkReadsCanBeAdded() const
+{
+    if(!readRepeatCounts.isOpen()) {
+        throw runtime_error("Reads cannot be added after read repeat counts are compressed.");
+    }
+    if(!readNames.isOpen() && !compressedReadNames.isOpenWithWriteAccess()) {
+        throw runtime_error("Reads cannot be added to an existing assembly "
+            "after read names are compressed.");
+    }
+}
 void Assembler::checkReadNamesAreOpen() const
 {
-    if(!readNames.isOpen()) {
+    if(!readNames.isOpen() && !compressedReadNames.isOpen()) {
         throw runtime_error("Read names are not accessible.");
     }
 }
@@ -35,17 +48,29 @@ void Assembler::checkReadId(ReadId readId) const
 
 
 
-// Add reads from a fasta file.
+// Add reads from a fasta or fastq file, possibly gzip-compressed.
+// A file name of "-" reads from standard input.
 // The reads are added to those already previously present.
 void Assembler::addReadsFromFasta(
     const string& fileName,
     size_t minReadLength,
     size_t blockSize,
     const size_t threadCountForReading,
-    const size_t threadCountForProcessing)
+    const size_t threadCountForProcessing,
+    uint64_t targetBaseCount)
 {
     checkReadsAreOpen();
     checkReadNamesAreOpen();
+    checkReadsCanBeAdded();
+
+    // If we are keeping only the longest reads,
+    // the reads must be stored temporarily until the
+    // final length cutoff is known. Let addReadsImplementation do that.
+    if(targetBaseCount) {
+        addReadsImplementation({fileName}, minReadLength, blockSize, 1,
+            threadCountForReading, threadCountForProcessing, targetBaseCount);
+        return;
+    }
 
     ReadLoader(
         fileName,
@@ -57,11 +82,486 @@ void Assembler::addReadsFromFasta(
         largeDataPageSize,
         reads,
         readNames,
+        compressedReadNames,
         readRepeatCounts);
 
 }
 
 
+// Add reads from a list of fasta or fastq files, possibly gzip-compressed.
+void Assembler::addReads(
+    const vector<string>& fileNames,
+    size_t minReadLength,
+    size_t blockSize,
+    size_t concurrentFileCount,
+    size_t threadCount,
+    uint64_t targetBaseCount)
+{
+    addReadsImplementation(fileNames, minReadLength, blockSize,
+        concurrentFileCount, 1, threadCount, targetBaseCount);
+}
+
+
+
+// Up to concurrentFileCount files are processed at the same time,
+// each by its own ReadLoader, which reads the file once
+// and stores its reads in temporary per-file data structures.
+// When all files have been processed, the reads that are kept
+// are copied to the global data structures in the order of the input files,
+// one file at a time, using all threads.
+// The temporary data structures of each file are removed
+// as soon as its reads are copied.
+// This way the ReadIds do not depend on the order in which
+// the files complete.
+// If files are processed one at a time and we are not keeping
+// only the longest reads, the order is already fixed,
+// so each ReadLoader stores its reads directly
+// in the global data structures instead.
+void Assembler::addReadsImplementation(
+    const vector<string>& fileNames,
+    size_t minReadLength,
+    size_t blockSize,
+    size_t concurrentFileCount,
+    size_t threadCountForReading,
+    size_t threadCount,
+    uint64_t targetBaseCount)
+{
+    const auto tBegin = steady_clock::now();
+    checkReadsAreOpen();
+    checkReadNamesAreOpen();
+    checkReadsCanBeAdded();
+    if(fileNames.empty()) {
+        throw runtime_error("No input files specified.");
+    }
+
+    // Adjust the numbers of threads, if necessary.
+    // By default, each file gets at least 4 threads,
+    // so block-level parallelism is still used within each file.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if(concurrentFileCount == 0) {
+        concurrentFileCount = max(size_t(1), threadCount / 4);
+    }
+    concurrentFileCount = min(concurrentFileCount, fileNames.size());
+
+    // Store parameters so they are accessible to the threads.
+    // Threads and block size are shared among the files
+    // being processed at the same time.
+    auto& data = addReadsData;
+    data.fileNames = fileNames;
+    data.minReadLength = minReadLength;
+    data.blockSize = max(size_t(1), blockSize / concurrentFileCount);
+    data.threadCountForReading = threadCountForReading;
+    data.threadCountPerFile = max(size_t(1), threadCount / concurrentFileCount);
+    cout << timestamp << "Adding reads from " << fileNames.size() << " files, processing " <<
+        concurrentFileCount << " files at a time using " << data.threadCountPerFile <<
+        " threads and a block size of " << data.blockSize << " bytes for each file." << endl;
+    const size_t fileCount = fileNames.size();
+    const ReadId oldReadCount = readCount();
+
+    // If files are processed one at a time and we are not keeping
+    // only the longest reads, append the reads of each file directly.
+    if(concurrentFileCount == 1 && targetBaseCount == 0) {
+        for(size_t fileIndex=0; fileIndex<fileCount; fileIndex++) {
+            ReadLoader(
+                fileNames[fileIndex],
+                minReadLength,
+                data.blockSize,
+                threadCountForReading,
+                data.threadCountPerFile,
+                addReadsDataNamePrefix(fileIndex),
+                largeDataPageSize,
+                reads,
+                readNames,
+                compressedReadNames,
+                readRepeatCounts);
+        }
+        const auto tEnd = steady_clock::now();
+        const double tTotal = seconds(tEnd - tBegin);
+        cout << timestamp << "Added " << readCount() - oldReadCount << " reads from " <<
+            fileCount << " files in " << tTotal << " s." << endl;
+        return;
+    }
+
+    // If requested, set up the filter that keeps only the longest reads.
+    data.longestReadsFilter.reset();
+    if(targetBaseCount) {
+        data.longestReadsFilter = make_shared<LongestReadsFilter>(targetBaseCount, minReadLength);
+        cout << "Only the longest reads totaling at least " << targetBaseCount <<
+            " bases will be kept." << endl;
+    }
+
+    // Load the reads of each file into its temporary data structures.
+    data.fileReads.clear();
+    data.fileReadNames.clear();
+    data.fileReadRepeatCounts.clear();
+    data.fileReadLengths.clear();
+    data.fileReads.resize(fileCount);
+    data.fileReadNames.resize(fileCount);
+    data.fileReadRepeatCounts.resize(fileCount);
+    data.fileReadLengths.resize(fileCount);
+    setupLoadBalancing(fileCount, 1);
+    runThreads(&Assembler::addReadsThreadFunction1, concurrentFileCount);
+    cout << timestamp << "Done processing input files." << endl;
+
+    // If keeping only the longest reads, get the final length cutoff.
+    // Reads shorter than this are not added.
+    uint64_t lengthCutoff = 0;
+    if(data.longestReadsFilter) {
+        lengthCutoff = data.longestReadsFilter->getLengthCutoff();
+        data.longestReadsFilter.reset();
+        cout << "Reads shorter than " << lengthCutoff << " bases will be discarded." << endl;
+    }
+
+    // Copy the reads that are kept to the global data structures,
+    // one file at a time, in the order of the input files.
+    cout << timestamp << "Storing reads." << endl;
+    uint64_t keptBaseCount = 0;
+    for(size_t fileIndex=0; fileIndex<fileCount; fileIndex++) {
+        LongBaseSequences& thisFileReads = *data.fileReads[fileIndex];
+        MemoryMapped::VectorOfVectors<char, uint64_t>& thisFileReadNames =
+            *data.fileReadNames[fileIndex];
+        MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& thisFileReadRepeatCounts =
+            *data.fileReadRepeatCounts[fileIndex];
+        const vector<uint64_t>& thisFileReadLengths = data.fileReadLengths[fileIndex];
+        const size_t n = thisFileReads.size();
+        CZI_ASSERT(thisFileReadNames.size() == n);
+        CZI_ASSERT(thisFileReadRepeatCounts.size() == n);
+        CZI_ASSERT(thisFileReadLengths.size() == n);
+
+        // Make space for the reads of this file that are kept.
+        data.fileIndex = fileIndex;
+        data.firstReadId = readCount();
+        data.keptReads.clear();
+        for(size_t i=0; i<n; i++) {
+            if(thisFileReadLengths[i] < lengthCutoff) {
+                continue;
+            }
+            keptBaseCount += thisFileReadLengths[i];
+            data.keptReads.push_back(i);
+            const uint64_t baseCount = thisFileReads[i].baseCount;
+            reads.append(size_t(baseCount));
+            readRepeatCounts.appendVector(baseCount);
+            if(compressedReadNames.isOpen()) {
+                compressedReadNames.appendEncoded(thisFileReadNames.size(i));
+            } else {
+                readNames.appendVector(thisFileReadNames.size(i));
+            }
+        }
+
+        // Copy them.
+        const size_t batchSize = 1000;
+        setupLoadBalancing(data.keptReads.size(), batchSize);
+        runThreads(&Assembler::addReadsThreadFunction2, threadCount);
+
+        // The temporary data structures of this file are no longer needed.
+        thisFileReads.remove();
+        thisFileReadNames.remove();
+        thisFileReadRepeatCounts.remove();
+        data.fileReads[fileIndex].reset();
+        data.fileReadNames[fileIndex].reset();
+        data.fileReadRepeatCounts[fileIndex].reset();
+        data.fileReadLengths[fileIndex].clear();
+        data.fileReadLengths[fileIndex].shrink_to_fit();
+    }
+    data.fileReads.clear();
+    data.fileReadNames.clear();
+    data.fileReadRepeatCounts.clear();
+    data.fileReadLengths.clear();
+    data.keptReads.clear();
+    if(targetBaseCount) {
+        cout << "Kept " << readCount() - oldReadCount << " reads with a total of " <<
+            keptBaseCount << " bases." << endl;
+    }
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Added " << readCount() - oldReadCount << " reads from " <<
+        fileCount << " files in " << tTotal << " s." << endl;
+}
+
+
+
+// Thread function used by addReads to process the input files.
+// Each thread processes one file at a time, storing its reads
+// in temporary per-file data structures.
+// The messages written while processing a file are
+// only written to cout when the file is done, so the
+// messages of different files are not mixed up.
+void Assembler::addReadsThreadFunction1(size_t threadId)
+{
+    auto& data = addReadsData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t fileIndex=begin; fileIndex!=end; fileIndex++) {
+            std::ostringstream out;
+
+            // Create the per-file data structures.
+            const string dataNamePrefix = addReadsDataNamePrefix(fileIndex);
+            const string readsName = dataNamePrefix.empty() ? "" : (dataNamePrefix + "Reads");
+            const string readNamesName = dataNamePrefix.empty() ? "" : (dataNamePrefix + "ReadNames");
+            const string readRepeatCountsName =
+                dataNamePrefix.empty() ? "" : (dataNamePrefix + "ReadRepeatCounts");
+            auto thisFileReads = make_shared<LongBaseSequences>();
+            thisFileReads->createNew(readsName, largeDataPageSize);
+            auto thisFileReadNames = make_shared< MemoryMapped::VectorOfVectors<char, uint64_t> >();
+            thisFileReadNames->createNew(readNamesName, largeDataPageSize);
+            auto thisFileReadRepeatCounts = make_shared< MemoryMapped::VectorOfVectors<uint8_t, uint64_t> >();
+            thisFileReadRepeatCounts->createNew(readRepeatCountsName, largeDataPageSize);
+
+            // Load the reads of this file.
+            // If names are compressed, the encoded names
+            // are stored in thisFileReadNames.
+            ReadLoader(
+                data.fileNames[fileIndex],
+                data.minReadLength,
+                data.blockSize,
+                data.threadCountForReading,
+                data.threadCountPerFile,
+                dataNamePrefix,
+                largeDataPageSize,
+                *thisFileReads,
+                *thisFileReadNames,
+                compressedReadNames,
+                *thisFileReadRepeatCounts,
+                data.longestReadsFilter.get(),
+                out,
+                &data.fileReadLengths[fileIndex]);
+            {
+                std::lock_guard<std::mutex> lock(data.mutex);
+                cout << out.str();
+            }
+
+            // Store them so the gather step can find them.
+            data.fileReads[fileIndex] = thisFileReads;
+            data.fileReadNames[fileIndex] = thisFileReadNames;
+            data.fileReadRepeatCounts[fileIndex] = thisFileReadRepeatCounts;
+        }
+    }
+}
+
+
+
+// Thread function used by addReads to copy the reads that are kept
+// from the temporary data structures of a file to the global data structures.
+// The load balancing index is an index into keptReads.
+void Assembler::addReadsThreadFunction2(size_t threadId)
+{
+    auto& data = addReadsData;
+    LongBaseSequences& thisFileReads = *data.fileReads[data.fileIndex];
+    const MemoryMapped::VectorOfVectors<char, uint64_t>& thisFileReadNames =
+        *data.fileReadNames[data.fileIndex];
+    const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& thisFileReadRepeatCounts =
+        *data.fileReadRepeatCounts[data.fileIndex];
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t j=begin; j!=end; j++) {
+            const uint64_t i = data.keptReads[j];
+            const ReadId readId = ReadId(data.firstReadId + j);
+
+            // Copy the read bases.
+            const LongBaseSequenceView source = thisFileReads[i];
+            const LongBaseSequenceView destination = reads[readId];
+            CZI_ASSERT(source.baseCount == destination.baseCount);
+            copy(
+                source.begin,
+                source.begin + LongBaseSequenceView::wordCount(source.baseCount),
+                destination.begin);
+
+            // Copy the repeat counts.
+            copy(
+                thisFileReadRepeatCounts.begin(i),
+                thisFileReadRepeatCounts.end(i),
+                readRepeatCounts.begin(readId));
+
+            // Copy the read name, which is already encoded
+            // if names are compressed.
+            if(compressedReadNames.isOpen()) {
+                compressedReadNames.storeEncoded(readId,
+                    reinterpret_cast<const uint8_t*>(thisFileReadNames.begin(i)),
+                    reinterpret_cast<const uint8_t*>(thisFileReadNames.end(i)));
+            } else {
+                copy(
+                    thisFileReadNames.begin(i),
+                    thisFileReadNames.end(i),
+                    readNames.begin(readId));
+            }
+        }
+    }
+}
+
+
+
+// The prefix for the names of the temporary data
+// used by the ReadLoader for a file.
+string Assembler::addReadsDataNamePrefix(uint64_t fileIndex) const
+{
+    return largeDataFileNamePrefix.empty() ? "" :
+        (largeDataFileNamePrefix + "tmp-AddReads-" + to_string(fileIndex) + "-");
+}
+
+
+
+// Replace the one byte per base representation of the read repeat counts
+// with the compact representation of class CompressedRepeatCounts.
+// After this, no more reads can be added.
+void Assembler::compressReadRepeatCounts(size_t threadCount)
+{
+    const auto tBegin = steady_clock::now();
+    checkReadsAreOpen();
+    if(!readRepeatCounts.isOpen()) {
+        throw runtime_error("Read repeat counts are already compressed.");
+    }
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    const uint64_t oldByteCount =
+        (readRepeatCounts.size() + 1) * sizeof(uint64_t) + readRepeatCounts.totalSize();
+    cout << timestamp << "Compressing repeat counts for " << readCount() << " reads." << endl;
+
+    // Pass 1: count the code words and exceptions for each read.
+    compressedReadRepeatCounts.createNew(
+        largeDataName("CompressedReadRepeatCounts"), largeDataPageSize);
+    compressedReadRepeatCounts.beginPass1(readCount());
+    const size_t batchSize = 1000;
+    setupLoadBalancing(readCount(), batchSize);
+    runThreads(&Assembler::compressReadRepeatCountsThreadFunction1, threadCount);
+
+    // Pass 2: store the code words and exceptions.
+    compressedReadRepeatCounts.beginPass2();
+    setupLoadBalancing(readCount(), batchSize);
+    runThreads(&Assembler::compressReadRepeatCountsThreadFunction2, threadCount);
+    compressedReadRepeatCounts.endPass2();
+
+    // The uncompressed repeat counts are no longer needed.
+    readRepeatCounts.remove();
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Read repeat counts now use " << compressedReadRepeatCounts.totalByteCount() <<
+        " bytes instead of " << oldByteCount << ". " <<
+        compressedReadRepeatCounts.exceptionCount() << " bases have a repeat count greater than 3." << endl;
+    cout << "Compressing read repeat counts took " << tTotal << " s." << endl;
+}
+
+
+
+void Assembler::compressReadRepeatCountsThreadFunction1(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            compressedReadRepeatCounts.count(readId,
+                readRepeatCounts.begin(readId), readRepeatCounts.end(readId));
+        }
+    }
+}
+
+
+
+void Assembler::compressReadRepeatCountsThreadFunction2(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            compressedReadRepeatCounts.store(readId,
+                readRepeatCounts.begin(readId), readRepeatCounts.end(readId));
+        }
+    }
+}
+
+
+
+// Replace the read names with the compact representation
+// of class CompressedReadNames, using multiple threads.
+// If this is called before any reads are added,
+// the names are encoded as the reads are added,
+// and the uncompressed names are never stored.
+void Assembler::compressReadNames(size_t threadCount)
+{
+    const auto tBegin = steady_clock::now();
+    if(!readNames.isOpen()) {
+        throw runtime_error("Read names are not accessible or are already compressed.");
+    }
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    const uint64_t oldByteCount =
+        (readNames.size() + 1) * sizeof(uint64_t) + readNames.totalSize();
+    cout << timestamp << "Compressing names of " << readNames.size() << " reads." << endl;
+
+    // Pass 1: encode the names to find the size of each encoded name.
+    // This also fills the dictionary.
+    compressedReadNames.createNew(largeDataName("CompressedReadNames"), largeDataPageSize);
+    compressedReadNames.beginPass1(readNames.size());
+    const size_t batchSize = 1000;
+    setupLoadBalancing(readNames.size(), batchSize);
+    runThreads(&Assembler::compressReadNamesThreadFunction1, threadCount);
+
+    // Pass 2: encode the names again and store them.
+    compressedReadNames.beginPass2();
+    setupLoadBalancing(readNames.size(), batchSize);
+    runThreads(&Assembler::compressReadNamesThreadFunction2, threadCount);
+    compressedReadNames.endPass2();
+
+    // The uncompressed read names are no longer needed.
+    readNames.remove();
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Read names now use " << compressedReadNames.totalByteCount() <<
+        " bytes instead of " << oldByteCount << "." << endl;
+    cout << "Compressing read names took " << tTotal << " s." << endl;
+}
+
+
+
+void Assembler::compressReadNamesThreadFunction1(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            compressedReadNames.count(readId,
+                readNames.begin(readId), readNames.end(readId));
+        }
+    }
+}
+
+
+
+void Assembler::compressReadNamesThreadFunction2(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            compressedReadNames.store(readId,
+                readNames.begin(readId), readNames.end(readId));
+        }
+    }
+}
+
+
+
+// Return the name of a read, using
+// whichever representation is available.
+string Assembler::getReadName(ReadId readId) const
+{
+    if(compressedReadNames.isOpen()) {
+        return compressedReadNames[readId];
+    } else {
+        return string(readNames.begin(readId), readNames.end(readId));
+    }
+}
+
 // Create a histogram of read lengths.
 void Assembler::histogramReadLength(const string& fileName)
 {
@@ -175,7 +675,7 @@ void Assembler::writeRead(ReadId readId, ostream& file)
     checkReadId(readId);
 
     const auto readSequence = reads[readId];
-    const auto readName = readNames[readId];
+    const string readName = getReadName(readId);
 
     file << ">" << readId;
     file << " " << readSequence.baseCount << " ";
@@ -220,7 +720,7 @@ void Assembler::writeOrientedRead(OrientedReadId orientedReadId, ostream& file)
     checkReadId(readId);
     const Strand strand = orientedReadId.getStrand();
     const auto readSequence = reads[readId];
-    const auto readName = readNames[readId];
+    const string readName = getReadName(readId);
 
     file << ">" << readId << "-" << strand;
     file << " " << readSequence.baseCount << " ";
@@ -270,7 +770,7 @@ size_t Assembler::getReadRawSequenceLength(ReadId readId)
         // the repeat counts.
         // Don't use std::accumulate to compute the sum,
         // otherwise the sum is computed using uint8_t!
-        const auto& counts = readRepeatCounts[readId];
+        const auto counts = getReadRepeatCounts(readId);
         size_t sum = 0;;
         for(uint8_t count: counts) {
             sum += count;
@@ -288,7 +788,7 @@ vector<uint32_t> Assembler::getRawPositions(OrientedReadId orientedReadId) const
 {
     const ReadId readId = orientedReadId.getReadId();
     const ReadId strand = orientedReadId.getStrand();
-    const auto repeatCounts = readRepeatCounts[readId];
+    const auto repeatCounts = getReadRepeatCounts(readId);
     const size_t n = repeatCounts.size();
 
     vector<uint32_t> v;
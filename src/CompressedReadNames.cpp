@@ -0,0 +1,376 @@
+#include "CompressedReadNames.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "iostream.hpp"
+#include "stdexcept.hpp"
+#include <thread>
+
+
+
+void CompressedReadNames::createNew(
+    const string& name,
+    size_t pageSize)
+{
+    if(name.empty()) {
+        encodedNames.createNew("", pageSize);
+        dictionary.createNew("", pageSize);
+    } else {
+        encodedNames.createNew(name + "-Encoded", pageSize);
+        dictionary.createNew(name + "-Dictionary", pageSize);
+    }
+    dictionaryMap.clear();
+}
+
+
+
+void CompressedReadNames::accessExistingReadOnly(const string& name)
+{
+    encodedNames.accessExistingReadOnly(name + "-Encoded");
+    dictionary.accessExistingReadOnly(name + "-Dictionary");
+}
+
+
+
+void CompressedReadNames::remove()
+{
+    encodedNames.remove();
+    dictionary.remove();
+    dictionaryMap.clear();
+}
+
+
+
+// Return true if the given characters are a UUID
+// in canonical lower case form.
+bool CompressedReadNames::isUuid(const char* begin, const char* end)
+{
+    if(end - begin < 36) {
+        return false;
+    }
+    for(int i=0; i<36; i++) {
+        const char c = begin[i];
+        if(i==8 || i==13 || i==18 || i==23) {
+            if(c != '-') {
+                return false;
+            }
+        } else {
+            if(!((c>='0' && c<='9') || (c>='a' && c<='f'))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+
+// Variable length integers use 7 bits per byte,
+// with the high bit set in all bytes except the last one.
+void CompressedReadNames::appendInteger(vector<uint8_t>& v, uint64_t x)
+{
+    while(x >= 128) {
+        v.push_back(uint8_t((x & 127ULL) | 128ULL));
+        x >>= 7ULL;
+    }
+    v.push_back(uint8_t(x));
+}
+uint64_t CompressedReadNames::getInteger(const uint8_t*& p)
+{
+    uint64_t x = 0;
+    for(uint64_t shift=0; ; shift+=7) {
+        const uint64_t byte = *p++;
+        x |= (byte & 127ULL) << shift;
+        if(byte < 128) {
+            return x;
+        }
+    }
+}
+
+
+
+// Encode a name and store it at the end.
+void CompressedReadNames::append(const char* begin, const char* end)
+{
+    encode(begin, end, encodedName);
+    encodedNames.appendVector(encodedName.begin(), encodedName.end());
+}
+
+
+
+// Store an encoded name in the space made by appendEncoded.
+void CompressedReadNames::storeEncoded(uint64_t i, const uint8_t* begin, const uint8_t* end)
+{
+    if(uint64_t(end - begin) != encodedNames.size(i)) {
+        throw runtime_error("Encoded read name has an unexpected size.");
+    }
+    copy(begin, end, encodedNames.begin(i));
+}
+
+
+
+void CompressedReadNames::beginPass1(uint64_t nameCount)
+{
+    encodedNames.beginPass1(nameCount);
+}
+
+
+
+void CompressedReadNames::count(uint64_t i, const char* begin, const char* end)
+{
+    vector<uint8_t> encodedName;
+    encode(begin, end, encodedName);
+    encodedNames.incrementCount(i, encodedName.size());
+}
+
+
+
+void CompressedReadNames::beginPass2()
+{
+    encodedNames.beginPass2();
+}
+
+
+
+// All the strings of the names are now in the dictionary
+// (or the dictionary is full), so the encoded names
+// have the same size as in pass 1.
+void CompressedReadNames::store(uint64_t i, const char* begin, const char* end)
+{
+    vector<uint8_t> encodedName;
+    encode(begin, end, encodedName);
+    storeEncoded(i, encodedName.data(), encodedName.data() + encodedName.size());
+}
+
+
+
+void CompressedReadNames::endPass2()
+{
+    encodedNames.endPass2(false);
+}
+
+
+
+// Look up a string in the dictionary, adding it if possible.
+// Returns false if the string is not in the dictionary
+// and the dictionary is full.
+bool CompressedReadNames::findOrAddToDictionary(
+    const char* begin, const char* end, uint64_t& index)
+{
+    const string token(begin, end);
+    std::lock_guard<std::mutex> lock(dictionaryMutex);
+    auto it = dictionaryMap.find(token);
+    if(it == dictionaryMap.end()) {
+        if(dictionary.size() >= maxDictionarySize) {
+            return false;
+        }
+        it = dictionaryMap.insert(make_pair(token, dictionary.size())).first;
+        dictionary.appendVector(begin, end);
+    }
+    index = it->second;
+    return true;
+}
+
+
+
+// Encode a name without storing it.
+void CompressedReadNames::encode(
+    const char* begin,
+    const char* end,
+    vector<uint8_t>& encodedName)
+{
+    encodedName.clear();
+
+    const auto hexValue = [](char c)
+    {
+        return uint8_t((c <= '9') ? (c - '0') : (c - 'a' + 10));
+    };
+
+    const char* p = begin;
+    while(p != end) {
+
+        // UUID.
+        if(isUuid(p, end)) {
+            appendInteger(encodedName, uuidToken);
+            for(int i=0; i<36; ) {
+                if(p[i] == '-') {
+                    ++i;
+                    continue;
+                }
+                encodedName.push_back(uint8_t((hexValue(p[i]) << 4) | hexValue(p[i+1])));
+                i += 2;
+            }
+            p += 36;
+            continue;
+        }
+
+        // Find the end of this token, which is a string of digits
+        // or a string of non-digits.
+        const bool isNumber = (*p>='0' && *p<='9');
+        const char* q = p + 1;
+        if(isNumber) {
+            while(q!=end && *q>='0' && *q<='9') {
+                ++q;
+            }
+        } else {
+            while(q!=end && !(*q>='0' && *q<='9') && !isUuid(q, end)) {
+                ++q;
+            }
+        }
+        const uint64_t length = uint64_t(q - p);
+
+        // Number.
+        if(isNumber && length<=18 && (length==1 || *p!='0')) {
+            uint64_t value = 0;
+            for(const char* r=p; r!=q; ++r) {
+                value = 10 * value + uint64_t(*r - '0');
+            }
+            appendInteger(encodedName, (value << 2ULL) | numberToken);
+            p = q;
+            continue;
+        }
+
+        // String in the dictionary, or that can be added to the dictionary.
+        uint64_t dictionaryIndex;
+        if(!isNumber && findOrAddToDictionary(p, q, dictionaryIndex)) {
+            appendInteger(encodedName, (dictionaryIndex << 2ULL) | dictionaryToken);
+            p = q;
+            continue;
+        }
+
+        // Any other string is stored as is.
+        appendInteger(encodedName, (length << 2ULL) | stringToken);
+        encodedName.insert(encodedName.end(), p, q);
+        p = q;
+    }
+}
+
+
+
+// Decode a name.
+string CompressedReadNames::operator[](uint64_t i) const
+{
+    string name;
+    const uint8_t* p = encodedNames.begin(i);
+    const uint8_t* end = encodedNames.end(i);
+    while(p != end) {
+        const uint64_t x = getInteger(p);
+        const uint64_t value = x >> 2ULL;
+        switch(x & 3ULL) {
+
+        case uuidToken:
+            for(int j=0; j<16; j++) {
+                if(j==4 || j==6 || j==8 || j==10) {
+                    name.push_back('-');
+                }
+                const uint8_t byte = *p++;
+                name.push_back("0123456789abcdef"[byte >> 4]);
+                name.push_back("0123456789abcdef"[byte & 15]);
+            }
+            break;
+
+        case numberToken:
+            name += to_string(value);
+            break;
+
+        case dictionaryToken:
+            name.append(dictionary.begin(value), dictionary.end(value));
+            break;
+
+        case stringToken:
+            name.append(reinterpret_cast<const char*>(p), value);
+            p += value;
+            break;
+        }
+    }
+    return name;
+}
+
+
+
+// Return the total number of bytes used.
+uint64_t CompressedReadNames::totalByteCount() const
+{
+    return
+        (encodedNames.size() + 1) * sizeof(uint64_t) +
+        encodedNames.totalSize() +
+        (dictionary.size() + 1) * sizeof(uint64_t) +
+        dictionary.totalSize();
+}
+
+
+
+void ChanZuckerberg::shasta::testCompressedReadNames()
+{
+    const vector<string> names = {
+        "",
+        "0",
+        "00",
+        "007",
+        "1234567890123456789012",
+        "d3b9e1a4-5f2c-4a8e-9b1d-0c7e6f5a4b3c",
+        "D3B9E1A4-5F2C-4A8E-9B1D-0C7E6F5A4B3C",
+        "d3b9e1a4-5f2c-4a8e-9b1d-0c7e6f5a4b3",
+        "read_d3b9e1a4-5f2c-4a8e-9b1d-0c7e6f5a4b3c_ch12",
+        "d3b9e1a4-5f2c-4a8e-9b1d-0c7e6f5a4b3cd3b9e1a4-5f2c-4a8e-9b1d-0c7e6f5a4b3c",
+        "SRR1234567.1",
+        "SRR1234567.2",
+        "SRR1234567.123456",
+        "m54006_160504_020705/4194370/ccs",
+        "m54006_160504_020705/4194371/ccs",
+        "a-b:c|d/e",
+    };
+
+    CompressedReadNames compressedNames;
+    compressedNames.createNew("", 4096);
+    for(const string& name: names) {
+        compressedNames.append(name.data(), name.data() + name.size());
+    }
+    CZI_ASSERT(compressedNames.size() == names.size());
+    uint64_t totalLength = 0;
+    for(size_t i=0; i<names.size(); i++) {
+        const string name = compressedNames[i];
+        if(name != names[i]) {
+            throw runtime_error("CompressedReadNames test failed for " + names[i] + ", got " + name);
+        }
+        totalLength += names[i].size();
+    }
+    cout << "Stored " << names.size() << " read names of total length " << totalLength <<
+        " using " << compressedNames.totalByteCount() << " bytes." << endl;
+    compressedNames.remove();
+
+    // Same, using the two pass functions and one thread per name.
+    compressedNames.createNew("", 4096);
+    compressedNames.beginPass1(names.size());
+    vector<std::thread> threads;
+    for(size_t i=0; i<names.size(); i++) {
+        threads.push_back(std::thread([&compressedNames, &names, i]()
+        {
+            compressedNames.count(i, names[i].data(), names[i].data() + names[i].size());
+        }));
+    }
+    for(std::thread& t: threads) {
+        t.join();
+    }
+    threads.clear();
+    compressedNames.beginPass2();
+    for(size_t i=0; i<names.size(); i++) {
+        threads.push_back(std::thread([&compressedNames, &names, i]()
+        {
+            compressedNames.store(i, names[i].data(), names[i].data() + names[i].size());
+        }));
+    }
+    for(std::thread& t: threads) {
+        t.join();
+    }
+    compressedNames.endPass2();
+    for(size_t i=0; i<names.size(); i++) {
+        const string name = compressedNames[i];
+        if(name != names[i]) {
+            throw runtime_error("CompressedReadNames two pass test failed for " + names[i] + ", got " + name);
+        }
+    }
+    compressedNames.remove();
+}
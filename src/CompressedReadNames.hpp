@@ -0,0 +1,159 @@
+#ifndef CZI_SHASTA_COMPRESSED_READ_NAMES_HPP
+#define CZI_SHASTA_COMPRESSED_READ_NAMES_HPP
+
+/*******************************************************************************
+
+Compact storage for read names.
+
+Nanopore read names are typically a UUID, stored as 36 characters,
+and other read names typically consist of a few fields
+that are the same for many reads plus a read number
+(for example, SRR1234567.89).
+
+Here, each name is split into tokens of the following types:
+- A UUID, in the canonical lower case form 8-4-4-4-12 hexadecimal digits.
+  It is stored as its 16 binary bytes.
+- A number: a string of up to 18 decimal digits without leading zeros.
+  It is stored as its binary value.
+- Any other string of characters not containing digits.
+  If it was seen before, it is stored as an index into a dictionary,
+  which contains at most maxDictionarySize strings.
+  Otherwise it is added to the dictionary if possible,
+  or else stored as is.
+
+Each token is stored as a variable length integer
+(7 bits per byte, with the high bit set in all bytes except the last one)
+whose 2 least significant bits are the token type.
+The remaining bits contain the value of a number,
+the dictionary index of a dictionary string,
+or the length of a string stored as is, followed by its characters.
+A UUID is followed by its 16 bytes.
+
+As a result, a UUID name is stored using 17 bytes instead of 36.
+
+Names are decoded on demand, which is only done when
+writing out reads or displaying them in the http server.
+
+Names can be encoded concurrently by multiple threads.
+Only the dictionary is shared, and it is protected by a mutex.
+A string gets the next available dictionary index when it is
+first seen, so the encoded names can depend on the order in
+which threads see new strings, but they always decode
+to the original names. Once a string is in the dictionary,
+its index never changes, so encoding the same name again
+always gives the same number of bytes.
+
+*******************************************************************************/
+
+// Shasta.
+#include "MemoryMappedVectorOfVectors.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+#include <mutex>
+#include <unordered_map>
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompressedReadNames;
+
+        void testCompressedReadNames();
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompressedReadNames {
+public:
+
+    void createNew(const string& name, size_t pageSize);
+    void accessExistingReadOnly(const string& name);
+    void remove();
+
+    bool isOpen() const
+    {
+        return encodedNames.isOpen() && dictionary.isOpen();
+    }
+    bool isOpenWithWriteAccess() const
+    {
+        return encodedNames.isOpenWithWriteAccess() && dictionary.isOpenWithWriteAccess();
+    }
+
+    // Return the number of names stored.
+    uint64_t size() const
+    {
+        return encodedNames.size();
+    }
+
+    // Encode a name and store it at the end.
+    void append(const char* begin, const char* end);
+
+    // Encode a name without storing it.
+    // This can be called by multiple threads at the same time.
+    void encode(const char* begin, const char* end, vector<uint8_t>& encodedName);
+
+    // Make space at the end for an encoded name of the given size,
+    // then store an encoded name in that space.
+    // Different threads can store different names at the same time.
+    void appendEncoded(uint64_t encodedSize)
+    {
+        encodedNames.appendVector(encodedSize);
+    }
+    uint64_t encodedSize(uint64_t i) const
+    {
+        return encodedNames.size(i);
+    }
+    void storeEncoded(uint64_t i, const uint8_t* begin, const uint8_t* end);
+
+    // Functions used to encode a large number of names using multiple threads.
+    // In pass 1, count() must be called once for each name.
+    // In pass 2, store() must be called once for each name.
+    // Different threads can process different names at the same time.
+    void beginPass1(uint64_t nameCount);
+    void count(uint64_t i, const char* begin, const char* end);
+    void beginPass2();
+    void store(uint64_t i, const char* begin, const char* end);
+    void endPass2();
+
+    // Decode a name.
+    string operator[](uint64_t i) const;
+
+    // Return the total number of bytes used.
+    uint64_t totalByteCount() const;
+
+    static const uint64_t maxDictionarySize = 1ULL << 16ULL;
+
+private:
+
+    // The encoded names.
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> encodedNames;
+
+    // The dictionary of strings.
+    MemoryMapped::VectorOfVectors<char, uint64_t> dictionary;
+
+    // Map used to look up strings in the dictionary.
+    // Only used while adding names.
+    // The mutex protects the dictionary and the map.
+    std::unordered_map<string, uint64_t> dictionaryMap;
+    std::mutex dictionaryMutex;
+    bool findOrAddToDictionary(const char* begin, const char* end, uint64_t& index);
+
+    enum TokenType : uint64_t {
+        uuidToken = 0,
+        numberToken = 1,
+        dictionaryToken = 2,
+        stringToken = 3
+    };
+
+    // Functions used to encode and decode tokens.
+    static bool isUuid(const char* begin, const char* end);
+    static void appendInteger(vector<uint8_t>&, uint64_t);
+    static uint64_t getInteger(const uint8_t*&);
+
+    // Work area used by append.
+    vector<uint8_t> encodedName;
+};
+
+#endif
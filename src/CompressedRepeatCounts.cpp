@@ -0,0 +1,236 @@
+#include "CompressedRepeatCounts.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+#include "iostream.hpp"
+#include <random>
+
+
+
+void CompressedRepeatCounts::createNew(
+    const string& name,
+    size_t pageSize)
+{
+    if(name.empty()) {
+        baseCount.createNew("", pageSize);
+        codes.createNew("", pageSize);
+        exceptions.createNew("", pageSize);
+        blockExceptionsBegin.createNew("", pageSize);
+    } else {
+        baseCount.createNew(name + "-BaseCount", pageSize);
+        codes.createNew(name + "-Codes", pageSize);
+        exceptions.createNew(name + "-Exceptions", pageSize);
+        blockExceptionsBegin.createNew(name + "-Blocks", pageSize);
+    }
+}
+
+
+
+void CompressedRepeatCounts::accessExistingReadOnly(const string& name)
+{
+    baseCount.accessExistingReadOnly(name + "-BaseCount");
+    codes.accessExistingReadOnly(name + "-Codes");
+    exceptions.accessExistingReadOnly(name + "-Exceptions");
+    blockExceptionsBegin.accessExistingReadOnly(name + "-Blocks");
+    CZI_ASSERT(codes.size() == baseCount.size());
+    CZI_ASSERT(exceptions.size() == baseCount.size());
+    CZI_ASSERT(blockExceptionsBegin.size() == baseCount.size());
+}
+
+
+
+void CompressedRepeatCounts::remove()
+{
+    baseCount.remove();
+    codes.remove();
+    exceptions.remove();
+    blockExceptionsBegin.remove();
+}
+
+
+
+// Append the repeat counts for a read.
+void CompressedRepeatCounts::append(const uint8_t* begin, const uint8_t* end)
+{
+    const uint64_t n = uint64_t(end - begin);
+    const uint64_t m = uint64_t(std::count_if(begin, end, [](uint8_t r) {return r > 3;}));
+
+    baseCount.push_back(n);
+    codes.appendVector(codeWordCount(n));
+    exceptions.appendVector(m);
+    blockExceptionsBegin.appendVector(blockEntryCount(n));
+    const uint64_t readId = baseCount.size() - 1;
+    encode(begin, end, codes.begin(readId), exceptions.begin(readId),
+        blockExceptionsBegin.begin(readId));
+}
+
+
+
+void CompressedRepeatCounts::beginPass1(uint64_t readCount)
+{
+    baseCount.resize(readCount);
+    codes.beginPass1(readCount);
+    exceptions.beginPass1(readCount);
+    blockExceptionsBegin.beginPass1(readCount);
+}
+
+
+
+void CompressedRepeatCounts::count(uint64_t readId, const uint8_t* begin, const uint8_t* end)
+{
+    const uint64_t n = uint64_t(end - begin);
+    baseCount[readId] = n;
+    codes.incrementCount(readId, codeWordCount(n));
+    exceptions.incrementCount(readId,
+        uint64_t(std::count_if(begin, end, [](uint8_t r) {return r > 3;})));
+    blockExceptionsBegin.incrementCount(readId, blockEntryCount(n));
+}
+
+
+
+void CompressedRepeatCounts::beginPass2()
+{
+    codes.beginPass2();
+    exceptions.beginPass2();
+    blockExceptionsBegin.beginPass2();
+}
+
+
+
+void CompressedRepeatCounts::store(uint64_t readId, const uint8_t* begin, const uint8_t* end)
+{
+    CZI_ASSERT(baseCount[readId] == uint64_t(end - begin));
+    encode(begin, end, codes.begin(readId), exceptions.begin(readId),
+        blockExceptionsBegin.begin(readId));
+}
+
+
+
+// We don't use VectorOfVectors::store during pass 2,
+// so the counts are not decremented and cannot be checked.
+void CompressedRepeatCounts::endPass2()
+{
+    codes.endPass2(false);
+    exceptions.endPass2(false);
+    blockExceptionsBegin.endPass2(false);
+}
+
+
+
+// Encode the repeat counts of a read into
+// pre-allocated space for its codes, exceptions, and blocks.
+void CompressedRepeatCounts::encode(
+    const uint8_t* begin,
+    const uint8_t* end,
+    uint64_t* codesPointer,
+    Exception* exceptionsPointer,
+    uint32_t* blockExceptionsBeginPointer)
+{
+    const uint64_t n = uint64_t(end - begin);
+    fill(codesPointer, codesPointer + codeWordCount(n), 0ULL);
+    const uint64_t blockMask = (1ULL << log2BlockSize) - 1ULL;
+
+    uint32_t exceptionCount = 0;
+    for(uint64_t position=0; position<n; position++) {
+
+        // At the beginning of each block except the first,
+        // store the index of its first exception.
+        if(position != 0 && (position & blockMask) == 0) {
+            *blockExceptionsBeginPointer++ = exceptionCount;
+        }
+
+        const uint8_t repeatCount = begin[position];
+        CZI_ASSERT(repeatCount > 0);
+        uint64_t code;
+        if(repeatCount > 3) {
+            code = 3ULL;
+            exceptionsPointer->offset = uint16_t(position & blockMask);
+            exceptionsPointer->repeatCount = repeatCount;
+            ++exceptionsPointer;
+            ++exceptionCount;
+        } else {
+            code = uint64_t(repeatCount - 1);
+        }
+        codesPointer[position >> 5ULL] |= (code << ((position & 31ULL) << 1ULL));
+    }
+}
+
+
+
+// Return the total number of bytes used.
+uint64_t CompressedRepeatCounts::totalByteCount() const
+{
+    return
+        baseCount.size() * sizeof(uint64_t) +
+        (codes.size() + 1) * sizeof(uint64_t) +
+        codes.totalSize() * sizeof(uint64_t) +
+        (exceptions.size() + 1) * sizeof(uint64_t) +
+        exceptions.totalSize() * sizeof(Exception) +
+        (blockExceptionsBegin.size() + 1) * sizeof(uint64_t) +
+        blockExceptionsBegin.totalSize() * sizeof(uint32_t);
+}
+
+
+
+void ChanZuckerberg::shasta::testCompressedRepeatCounts()
+{
+    // Generate random repeat counts with a distribution
+    // similar to the one seen in nanopore reads.
+    std::mt19937 randomSource(231);
+    std::geometric_distribution<int> distribution(0.7);
+    // The last few reads span several blocks.
+    vector< vector<uint8_t> > repeatCounts(100);
+    for(size_t i=0; i<repeatCounts.size(); i++) {
+        repeatCounts[i].resize((i < 95) ? (i * 13) : (i * 3001));
+        for(uint8_t& r: repeatCounts[i]) {
+            r = uint8_t(min(255, 1 + distribution(randomSource)));
+        }
+    }
+
+    // Store them, using both construction methods.
+    CompressedRepeatCounts compressed1;
+    compressed1.createNew("", 4096);
+    for(const vector<uint8_t>& v: repeatCounts) {
+        compressed1.append(v.data(), v.data() + v.size());
+    }
+    CompressedRepeatCounts compressed2;
+    compressed2.createNew("", 4096);
+    compressed2.beginPass1(repeatCounts.size());
+    for(size_t i=0; i<repeatCounts.size(); i++) {
+        const vector<uint8_t>& v = repeatCounts[i];
+        compressed2.count(i, v.data(), v.data() + v.size());
+    }
+    compressed2.beginPass2();
+    for(size_t i=0; i<repeatCounts.size(); i++) {
+        const vector<uint8_t>& v = repeatCounts[i];
+        compressed2.store(i, v.data(), v.data() + v.size());
+    }
+    compressed2.endPass2();
+
+    // Check that we get back what we stored.
+    CZI_ASSERT(compressed1.size() == repeatCounts.size());
+    CZI_ASSERT(compressed2.size() == repeatCounts.size());
+    uint64_t totalBaseCount = 0;
+    for(size_t i=0; i<repeatCounts.size(); i++) {
+        const vector<uint8_t>& v = repeatCounts[i];
+        const CompressedRepeatCounts::View view1 = compressed1[i];
+        const CompressedRepeatCounts::View view2 = compressed2[i];
+        CZI_ASSERT(view1.size() == v.size());
+        CZI_ASSERT(view2.size() == v.size());
+        size_t j = 0;
+        for(const uint8_t r: view1) {
+            CZI_ASSERT(r == v[j]);
+            CZI_ASSERT(view2[j] == v[j]);
+            ++j;
+        }
+        totalBaseCount += v.size();
+    }
+    cout << "Stored " << totalBaseCount << " repeat counts with " <<
+        compressed1.exceptionCount() << " exceptions using " <<
+        compressed1.totalByteCount() << " bytes, " <<
+        double(8 * compressed1.totalByteCount()) / double(totalBaseCount) <<
+        " bits per base." << endl;
+
+    compressed1.remove();
+    compressed2.remove();
+}
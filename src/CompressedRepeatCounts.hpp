@@ -0,0 +1,330 @@
+#ifndef CZI_SHASTA_COMPRESSED_REPEAT_COUNTS_HPP
+#define CZI_SHASTA_COMPRESSED_REPEAT_COUNTS_HPP
+
+/*******************************************************************************
+
+Compact storage for the repeat counts of the run-length representation
+of the reads.
+
+The uncompressed representation uses one byte per run-length base.
+However, the overwhelming majority of repeat counts are small,
+so here we store each repeat count as a 2-bit code:
+- Codes 0, 1, 2 represent repeat counts 1, 2, 3.
+- Code 3 is an escape code for repeat counts 4 or more.
+  The actual repeat count is stored in a sparse exception table,
+  sorted by position in the read.
+
+Codes are packed 32 to a 64-bit word, with position 0 in the
+least significant bits of the first word.
+
+The read is divided in blocks of 2^16 bases, and each exception
+stores its position as a 16-bit offset in its block,
+plus a 1-byte repeat count, for a total of 24 bits.
+For each block except the first, we also store the index
+of its first exception, so reads of up to 2^16 run-length bases
+(nearly all reads) need no block information.
+Random access to a repeat count requires a shift and a mask,
+plus a binary search in the exceptions of its block
+if the escape code is found.
+
+Each base uses 2 bits, plus 24 bits for each exception.
+With typical nanopore data, about 5% of the run-length bases
+have a repeat count of 4 or more, and as a result this
+uses about 3.2 bits per base, instead of 8.
+testCompressedRepeatCounts, with about 2.7% exceptions,
+measures 2.67 bits per base (the previous layout, with
+a 4-byte position per exception, used 3.08).
+
+*******************************************************************************/
+
+// Shasta.
+#include "MemoryMappedVectorOfVectors.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompressedRepeatCounts;
+        class RepeatCountsView;
+
+        // Return a view of the repeat counts of a read,
+        // using the compressed representation if it is available.
+        inline RepeatCountsView getReadRepeatCounts(
+            const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+            const CompressedRepeatCounts& compressedReadRepeatCounts,
+            uint64_t readId);
+
+        void testCompressedRepeatCounts();
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompressedRepeatCounts {
+public:
+
+    // The base 2 log of the number of bases in a block.
+    static const uint64_t log2BlockSize = 16;
+
+    // An entry of the exception table.
+    class Exception {
+    public:
+        // The position of the base in its block.
+        uint16_t offset __attribute__ ((packed));
+        uint8_t repeatCount;
+
+        bool operator<(const Exception& that) const
+        {
+            return offset < that.offset;
+        }
+    };
+
+    // Read-only view of the repeat counts of a single read.
+    class View {
+    public:
+        uint64_t size() const
+        {
+            return baseCount;
+        }
+
+        uint8_t operator[](uint64_t position) const
+        {
+            const uint64_t code = (codes[position >> 5ULL] >> ((position & 31ULL) << 1ULL)) & 3ULL;
+            if(code != 3ULL) {
+                return uint8_t(code + 1ULL);
+            }
+
+            // Escape code. Look up the exceptions of this block.
+            const uint64_t block = position >> log2BlockSize;
+            const Exception* blockBegin = exceptionsBegin +
+                ((block == 0) ? 0 : blockExceptionsBegin[block - 1]);
+            const Exception* blockEnd = (block < blockEntryCount(baseCount)) ?
+                (exceptionsBegin + blockExceptionsBegin[block]) : exceptionsEnd;
+            Exception exception;
+            exception.offset = uint16_t(position);
+            const Exception* it = std::lower_bound(blockBegin, blockEnd, exception);
+            return it->repeatCount;
+        }
+
+        // Minimal iterator support, so a View can be used
+        // in a range-based for loop.
+        class const_iterator {
+        public:
+            const_iterator(const View& view, uint64_t position) :
+                view(view), position(position) {}
+            uint8_t operator*() const
+            {
+                return view[position];
+            }
+            const_iterator& operator++()
+            {
+                ++position;
+                return *this;
+            }
+            bool operator!=(const const_iterator& that) const
+            {
+                return position != that.position;
+            }
+        private:
+            const View& view;
+            uint64_t position;
+        };
+        const_iterator begin() const
+        {
+            return const_iterator(*this, 0);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(*this, baseCount);
+        }
+
+    private:
+        const uint64_t* codes;
+        const Exception* exceptionsBegin;
+        const Exception* exceptionsEnd;
+        const uint32_t* blockExceptionsBegin;
+        uint64_t baseCount;
+        friend class CompressedRepeatCounts;
+    };
+
+    void createNew(const string& name, size_t pageSize);
+    void accessExistingReadOnly(const string& name);
+    void remove();
+
+    bool isOpen() const
+    {
+        return baseCount.isOpen && codes.isOpen() && exceptions.isOpen() &&
+            blockExceptionsBegin.isOpen();
+    }
+
+    // Return the number of reads stored.
+    uint64_t size() const
+    {
+        return baseCount.size();
+    }
+
+    // Return a view of the repeat counts of a read.
+    View operator[](uint64_t readId) const
+    {
+        View view;
+        view.codes = codes.begin(readId);
+        view.exceptionsBegin = exceptions.begin(readId);
+        view.exceptionsEnd = exceptions.end(readId);
+        view.blockExceptionsBegin = blockExceptionsBegin.begin(readId);
+        view.baseCount = baseCount[readId];
+        return view;
+    }
+
+    // Append the repeat counts for a read.
+    void append(const uint8_t* begin, const uint8_t* end);
+
+    // Functions for two-pass, possibly multithreaded, construction.
+    // In pass 1, count() must be called once for each read.
+    // In pass 2, store() must be called once for each read.
+    // Different threads can process different reads.
+    void beginPass1(uint64_t readCount);
+    void count(uint64_t readId, const uint8_t* begin, const uint8_t* end);
+    void beginPass2();
+    void store(uint64_t readId, const uint8_t* begin, const uint8_t* end);
+    void endPass2();
+
+    // Return the total number of bytes used.
+    uint64_t totalByteCount() const;
+
+    // Return the total number of exceptions
+    // (bases with a repeat count of 4 or more).
+    uint64_t exceptionCount() const
+    {
+        return exceptions.totalSize();
+    }
+
+private:
+
+    // The number of run-length bases of each read.
+    MemoryMapped::Vector<uint64_t> baseCount;
+
+    // The 2-bit codes for each read.
+    MemoryMapped::VectorOfVectors<uint64_t, uint64_t> codes;
+
+    // The exceptions for each read, sorted by position.
+    MemoryMapped::VectorOfVectors<Exception, uint64_t> exceptions;
+
+    // For each read, and for each block except the first,
+    // the index of the first exception of the block
+    // in the exceptions of the read.
+    MemoryMapped::VectorOfVectors<uint32_t, uint64_t> blockExceptionsBegin;
+
+    static uint64_t codeWordCount(uint64_t baseCount)
+    {
+        return (baseCount + 31ULL) >> 5ULL;
+    }
+
+    // The number of blocks of a read, excluding the first.
+    static uint64_t blockEntryCount(uint64_t baseCount)
+    {
+        return (baseCount == 0) ? 0 : ((baseCount - 1) >> log2BlockSize);
+    }
+
+    // Encode the repeat counts of a read into
+    // pre-allocated space for its codes, exceptions, and blocks.
+    static void encode(
+        const uint8_t* begin,
+        const uint8_t* end,
+        uint64_t* codesPointer,
+        Exception* exceptionsPointer,
+        uint32_t* blockExceptionsBeginPointer);
+};
+static_assert(sizeof(ChanZuckerberg::shasta::CompressedRepeatCounts::Exception) == 3,
+    "Unexpected size of class CompressedRepeatCounts::Exception.");
+
+
+
+// View of the repeat counts of a read that works
+// with both the uncompressed (one byte per base)
+// and the compressed representation.
+class ChanZuckerberg::shasta::RepeatCountsView {
+public:
+
+    // Construct from the uncompressed representation.
+    RepeatCountsView(const MemoryAsContainer<const uint8_t>& counts) :
+        uncompressedCounts(counts.begin()),
+        baseCount(counts.size())
+    {}
+
+    // Construct from the compressed representation.
+    RepeatCountsView(const CompressedRepeatCounts::View& view) :
+        compressedView(view),
+        baseCount(view.size())
+    {}
+
+    uint64_t size() const
+    {
+        return baseCount;
+    }
+
+    uint8_t operator[](uint64_t position) const
+    {
+        if(uncompressedCounts) {
+            return uncompressedCounts[position];
+        } else {
+            return compressedView[position];
+        }
+    }
+
+    // Minimal iterator support, so a RepeatCountsView can be used
+    // in a range-based for loop.
+    class const_iterator {
+    public:
+        const_iterator(const RepeatCountsView& view, uint64_t position) :
+            view(view), position(position) {}
+        uint8_t operator*() const
+        {
+            return view[position];
+        }
+        const_iterator& operator++()
+        {
+            ++position;
+            return *this;
+        }
+        bool operator!=(const const_iterator& that) const
+        {
+            return position != that.position;
+        }
+    private:
+        const RepeatCountsView& view;
+        uint64_t position;
+    };
+    const_iterator begin() const
+    {
+        return const_iterator(*this, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(*this, baseCount);
+    }
+
+private:
+    const uint8_t* uncompressedCounts = 0;
+    CompressedRepeatCounts::View compressedView;
+    uint64_t baseCount;
+};
+
+
+
+inline ChanZuckerberg::shasta::RepeatCountsView
+    ChanZuckerberg::shasta::getReadRepeatCounts(
+    const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+    const CompressedRepeatCounts& compressedReadRepeatCounts,
+    uint64_t readId)
+{
+    if(compressedReadRepeatCounts.isOpen()) {
+        return RepeatCountsView(compressedReadRepeatCounts[readId]);
+    } else {
+        return RepeatCountsView(readRepeatCounts[readId]);
+    }
+}
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef CZI_SHASTA_KMER_HPP
 #define CZI_SHASTA_KMER_HPP
 
+#include "MurmurHash2.hpp"
 #include "ShortBaseSequence.hpp"
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 namespace ChanZuckerberg {
@@ -10,8 +13,16 @@ namespace ChanZuckerberg {
 
         // Types used to represent a k-mer and a k-mer id.
         // These limit the maximum k-mer length that can be used.
+        // When building with -DLONG_KMERS=ON, k-mers of up to
+        // 32 bases are supported, at the cost of 4 more bytes
+        // per marker, 11 instead of 7 (see class CompressedMarker).
+#ifdef SHASTA_LONG_KMERS
+        using Kmer = ShortBaseSequence32;
+        using KmerId = uint64_t;
+#else
         using Kmer = ShortBaseSequence16;
         using KmerId = uint32_t;
+#endif
 
         // Check for consistency of these two types.
         static_assert(
@@ -19,15 +30,88 @@ namespace ChanZuckerberg {
             "Kmer and KmerId types are inconsistent.");
 
         class KmerInfo;
+        class KmerHashSelection;
+
+        inline uint64_t reverseBits(uint64_t);
+        inline KmerId reverseComplementKmerId(uint64_t kmerId, uint64_t k);
+
+        void testKmerHashSelection();
     }
 }
 
 
 
+// Reverse the order of the bits of a 64-bit integer.
+inline uint64_t ChanZuckerberg::shasta::reverseBits(uint64_t x)
+{
+    x = ((x >> 1ULL) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1ULL);
+    x = ((x >> 2ULL) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2ULL);
+    x = ((x >> 4ULL) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4ULL);
+    return __builtin_bswap64(x);
+}
+
+
+
+// Return the id of the reverse complement of a k-mer, given its id.
+// This gives the same result as
+// Kmer(kmerId, k).reverseComplement(k).id(k)
+// but works directly on the two k-bit halves of the id:
+// complementing a base flips both of its bits,
+// and reversing the k-mer reverses the bits of each half.
+inline ChanZuckerberg::shasta::KmerId
+    ChanZuckerberg::shasta::reverseComplementKmerId(uint64_t kmerId, uint64_t k)
+{
+    const uint64_t mask = (1ULL << k) - 1ULL;
+    const uint64_t shift = 64ULL - k;
+    const uint64_t lsb = reverseBits(~kmerId & mask) >> shift;
+    const uint64_t msb = reverseBits(~(kmerId >> k) & mask) >> shift;
+    return KmerId((msb << k) | lsb);
+}
+
+
+
 class ChanZuckerberg::shasta::KmerInfo {
 public:
     KmerId reverseComplementedKmerId;
     bool isMarker;
 };
 
+
+
+// Hashed marker selection, used instead of the k-mer table
+// when k is too large for a table with 4^k entries.
+// A k-mer is a marker if a hash of its canonical id
+// (the lesser of its id and the id of its reverse complement)
+// does not exceed a threshold. This guarantees that a k-mer
+// is a marker if and only if its reverse complement is also a marker,
+// and selects a fraction of k-mers approximately
+// equal to the requested probability.
+class ChanZuckerberg::shasta::KmerHashSelection {
+public:
+    uint64_t threshold;
+    uint64_t seed;
+
+    void set(double probability, uint64_t seedArgument)
+    {
+        seed = seedArgument;
+        if(probability >= 1.) {
+            threshold = std::numeric_limits<uint64_t>::max();
+        } else {
+            threshold = uint64_t(std::ldexp(probability, 64));
+        }
+    }
+
+    // The approximate fraction of k-mers that are markers.
+    double probability() const
+    {
+        return std::ldexp(double(threshold), -64);
+    }
+
+    bool isMarker(KmerId kmerId, KmerId reverseComplementedKmerId) const
+    {
+        const uint64_t canonicalKmerId = std::min(kmerId, reverseComplementedKmerId);
+        return MurmurHash64A(&canonicalKmerId, int(sizeof(canonicalKmerId)), seed) <= threshold;
+    }
+};
+
 #endif
@@ -0,0 +1,464 @@
+// shasta.
+#include "LazyAlignmentGraph.hpp"
+#include "Alignment.hpp"
+#include "AlignmentGraph.hpp"
+#include "canPassAlignmentFilters.hpp"
+#include "findAlignmentDiagonal.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "iostream.hpp"
+#include "stdexcept.hpp"
+#include <chrono>
+#include <random>
+
+
+
+// Compute an alignment of the markers of two oriented reads
+// using a LazyAlignmentGraph.
+void ChanZuckerberg::shasta::align(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    size_t maxSkip,
+    uint32_t maxMarkerFrequency,
+    uint32_t bandHalfWidth,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+    bool debug,
+    LazyAlignmentGraph& lazyGraph,
+    Alignment& alignment,
+    AlignmentInfo& alignmentInfo
+    )
+{
+    lazyGraph.align(markers, maxMarkerFrequency, maxSkip, bandHalfWidth,
+        minAlignedMarkerCount, maxTrim, debug,
+        alignment, alignmentInfo);
+}
+
+
+
+void LazyAlignmentGraph::align(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    uint32_t bandHalfWidth,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+    bool debug,
+    Alignment& alignment,
+    AlignmentInfo& alignmentInfo)
+{
+    const int markerCount0 = int(markers[0].size());
+    const int markerCount1 = int(markers[1].size());
+
+    // Create the vertices, sorted in the same order as in AlignmentGraph.
+    createVertices(markers, maxMarkerFrequency, bandHalfWidth);
+    if(debug) {
+        cout << "The alignment lazyGraph has " << vertices.size() << " vertices." << endl;
+    }
+
+    // If the alignment cannot pass the filters,
+    // don't bother computing it.
+    if(!canPassAlignmentFilters(vertices.begin(), vertices.end(), vertices.size(),
+        [](const Vertex& vertex) -> const array<uint32_t, 2>& {return vertex.ordinals;},
+        uint32_t(markerCount0), uint32_t(markerCount1),
+        minAlignedMarkerCount, maxTrim)) {
+        alignment.ordinals.clear();
+        alignmentInfo = AlignmentInfo();
+        if(debug) {
+            cout << "The alignment cannot have enough markers or has too much trim." << endl;
+        }
+        return;
+    }
+
+    // Find the shortest path.
+    if(!findShortestPath(uint32_t(markerCount0), uint32_t(markerCount1), maxSkip)) {
+        alignment.ordinals.clear();
+        if(debug) {
+            cout << "The shortest path is empty." << endl;
+        }
+        return;
+    }
+    if(debug) {
+        cout << "The shortest path has " << shortestPath.size();
+        cout << " k-mer vertices." << endl;
+    }
+
+    // Store the alignment.
+    alignment.ordinals.clear();
+    for(const uint32_t i: shortestPath) {
+        alignment.ordinals.push_back(vertices[i].ordinals);
+    }
+
+    // Store the alignment info.
+    alignmentInfo.create(alignment, uint32_t(markerCount0), uint32_t(markerCount1));
+}
+
+
+
+// Find the shortest path between the start and finish vertices.
+// This does the same computation as findShortestPath (see shortestPath.hpp)
+// on the AlignmentGraph, with the edges generated as needed
+// in the same order as they are stored by the CompactUndirectedGraph.
+// The edge weights are the same as in AlignmentGraph::createEdges.
+// Returns false if there is no path.
+bool LazyAlignmentGraph::findShortestPath(
+    uint32_t markerCount0,
+    uint32_t markerCount1,
+    size_t maxSkip)
+{
+    const int skip = int(maxSkip);
+    const uint32_t vertexCount = uint32_t(vertices.size());
+    const uint32_t vStart = vertexCount;
+    const uint32_t vFinish = vertexCount + 1;
+
+    // Initialize.
+    for(Vertex& vertex: vertices) {
+        vertex.distance = std::numeric_limits<uint32_t>::max();
+        vertex.predecessor = std::numeric_limits<uint32_t>::max();
+        vertex.color = 0;
+    }
+    uint64_t finishDistance = std::numeric_limits<uint64_t>::max();
+    uint32_t finishPredecessor = std::numeric_limits<uint32_t>::max();
+    while(!queue.empty()) {
+        queue.pop();
+    }
+
+    // The start vertex is dequeued first. Its edges go to all
+    // marker vertices, in order, and reach all of them.
+    for(uint32_t i=0; i<vertexCount; i++) {
+        Vertex& vertex = vertices[i];
+        vertex.distance = vertex.correctedOrdinals[0] + vertex.correctedOrdinals[1];
+        vertex.predecessor = vStart;
+        queue.push(make_pair(uint64_t(vertex.distance), i));
+    }
+
+
+
+    // Main loop.
+    while(!queue.empty()) {
+
+        // Dequeue the closest vertex in the queue.
+        const auto p0 = queue.top();
+        queue.pop();
+        const uint64_t distance0 = p0.first;
+        const uint32_t i0 = p0.second;
+
+        // If we found the finish vertex, construct the path and be done.
+        if(i0 == vFinish) {
+            shortestPath.clear();
+            for(uint32_t i=finishPredecessor; i!=vStart; i=vertices[i].predecessor) {
+                shortestPath.push_back(i);
+            }
+            std::reverse(shortestPath.begin(), shortestPath.end());
+            while(!queue.empty()) {
+                queue.pop();
+            }
+            return true;
+        }
+
+        // If already encountered, skip (lazy deletion).
+        Vertex& vertex0 = vertices[i0];
+        if(vertex0.color == 1) {
+            continue;
+        }
+        vertex0.color = 1;
+        const int correctedOrdinal00 = int(vertex0.correctedOrdinals[0]);
+        const int correctedOrdinal01 = int(vertex0.correctedOrdinals[1]);
+
+        // Function to process an edge to vertex i1 with the given weight.
+        auto processEdge = [&](uint32_t i1, int weight) {
+            Vertex& vertex1 = vertices[i1];
+            if(vertex1.color == 1) {
+                return;
+            }
+            const uint64_t distance1 = distance0 + uint64_t(weight);
+            if(distance1 < vertex1.distance) {
+                queue.push(make_pair(distance1, i1));
+                vertex1.predecessor = i0;
+                vertex1.distance = uint32_t(distance1);
+            }
+        };
+
+        // Edges from the preceding vertices that are close enough
+        // on the first oriented read, in increasing order.
+        // The vertices are sorted by ordinal on the first oriented read,
+        // so we find the first one, then loop forward.
+        uint32_t iBegin = i0;
+        while(iBegin > 0 &&
+            correctedOrdinal00 <= int(vertices[iBegin-1].correctedOrdinals[0]) + skip) {
+            --iBegin;
+        }
+        for(uint32_t i1=iBegin; i1!=i0; i1++) {
+            const int correctedOrdinal11 = int(vertices[i1].correctedOrdinals[1]);
+            if(correctedOrdinal01 < correctedOrdinal11) {
+                continue;
+            }
+            if(correctedOrdinal01 - correctedOrdinal11 > skip) {
+                continue;
+            }
+            const int delta0 = correctedOrdinal00 - int(vertices[i1].correctedOrdinals[0]);
+            const int delta1 = correctedOrdinal01 - correctedOrdinal11;
+            processEdge(i1, abs(delta0-1) + abs(delta1-1));
+        }
+
+        // Edges to the following vertices.
+        for(uint32_t i1=i0+1; i1<vertexCount; i1++) {
+            const int correctedOrdinal10 = int(vertices[i1].correctedOrdinals[0]);
+            if(correctedOrdinal10 > correctedOrdinal00 + skip) {
+                break;
+            }
+            const int correctedOrdinal11 = int(vertices[i1].correctedOrdinals[1]);
+            if(correctedOrdinal11 < correctedOrdinal01) {
+                continue;
+            }
+            if(correctedOrdinal11 - correctedOrdinal01 > skip) {
+                continue;
+            }
+            const int delta0 = correctedOrdinal10 - correctedOrdinal00;
+            const int delta1 = correctedOrdinal11 - correctedOrdinal01;
+            processEdge(i1, abs(delta0-1) + abs(delta1-1));
+        }
+
+        // The edge to the start vertex is skipped because
+        // the start vertex was already dequeued.
+        // Process the edge to the finish vertex.
+        const uint64_t distance1 = distance0 +
+            uint64_t(int(markerCount0) - correctedOrdinal00) +
+            uint64_t(int(markerCount1) - correctedOrdinal01);
+        if(distance1 < finishDistance) {
+            queue.push(make_pair(distance1, vFinish));
+            finishPredecessor = i0;
+            finishDistance = distance1;
+        }
+    }
+
+    // If getting here, there is no path between
+    // the start and finish vertices.
+    shortestPath.clear();
+    return false;
+}
+
+
+
+// This creates the same vertices as AlignmentGraph::createVertices,
+// and sorts them the same way.
+void LazyAlignmentGraph::createVertices(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    uint32_t bandHalfWidth)
+{
+    // Some shorthands for readability.
+    const vector<MarkerWithOrdinal>& markers0 = markers[0];
+    const vector<MarkerWithOrdinal>& markers1 = markers[1];
+
+    // Some iterators we will need.
+    using MarkerIterator = vector<MarkerWithOrdinal>::const_iterator;
+    const MarkerIterator end0   = markers0.end();
+    const MarkerIterator end1   = markers1.end();
+
+    // Initialize isLowFrequencyMarker flags to all true.
+    for(size_t i=0; i<2; i++) {
+        isLowFrequencyMarker[i].clear();
+        isLowFrequencyMarker[i].resize(markers[i].size(), true);
+    }
+
+    // For a banded alignment, find the dominant diagonal.
+    const int32_t diagonal = (bandHalfWidth == 0) ? 0 :
+        findAlignmentDiagonal(markers, maxMarkerFrequency, bandHalfWidth, diagonalHistogram);
+
+    // Joint loop over the markers, looking for common k-mer ids.
+    vertices.clear();
+    auto it0 = markers0.begin();
+    auto it1 = markers1.begin();
+    while(it0!=end0 && it1!=end1) {
+        if(it0->kmerId < it1->kmerId) {
+            ++it0;
+        } else if(it1->kmerId < it0->kmerId) {
+            ++it1;
+        } else {
+
+            // We found a common k-mer id.
+            // Find the streak of this k-mer in each of the oriented reads.
+            const KmerId kmerId = it0->kmerId;
+            MarkerIterator it0End = it0;
+            MarkerIterator it1End = it1;
+            while(it0End!=end0 && it0End->kmerId==kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->kmerId==kmerId) {
+                ++it1End;
+            }
+            const size_t streakLength0 = it0End - it0;
+            const size_t streakLength1 = it1End - it1;
+
+            if(streakLength0>maxMarkerFrequency || streakLength1>maxMarkerFrequency) {
+
+                // At least one of these streaks is too long.
+                // Flag these markers as high frequency markers.
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    isLowFrequencyMarker[0][jt0->ordinal]= false;
+                }
+                for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                    isLowFrequencyMarker[1][jt1->ordinal]= false;
+                }
+
+            } else {
+
+                // Both streaks are short enough.
+                // Generate a vertex for each pair in the streaks,
+                // skipping pairs outside the band for a banded alignment.
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                        if(bandHalfWidth > 0 &&
+                            uint32_t(abs(int32_t(jt1->ordinal) - int32_t(jt0->ordinal) - diagonal)) > bandHalfWidth) {
+                            continue;
+                        }
+                        Vertex vertex;
+                        vertex.ordinals[0] = jt0->ordinal;
+                        vertex.ordinals[1] = jt1->ordinal;
+                        vertices.push_back(vertex);
+                    }
+                }
+            }
+
+            // Continue joint loop over k-mers.
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+
+
+    // Compute correctedOrdinals, the ordinals keeping into account
+    // only low frequency markers.
+    for(size_t i=0; i<2; i++) {
+        correctedOrdinals[i].resize(markers[i].size());
+        uint32_t correctedOrdinal = 0;
+        for(size_t j=0; j<markers[i].size(); j++) {
+            if(isLowFrequencyMarker[i][j]) {
+                correctedOrdinals[i][j] = correctedOrdinal++;
+            } else {
+                correctedOrdinals[i][j] =  std::numeric_limits<uint32_t>::max();
+            }
+        }
+    }
+
+    // Sort the vertices by ordinal on the first oriented read.
+    // This uses the same comparisons as AlignmentGraph::sortVertices,
+    // so vertices with the same ordinal end up in the same order.
+    sort(vertices.begin(), vertices.end());
+    for(Vertex& vertex: vertices) {
+        for(size_t i=0; i<2; i++) {
+            vertex.correctedOrdinals[i] = correctedOrdinals[i][vertex.ordinals[i]];
+        }
+    }
+}
+
+
+
+// Check that LazyAlignmentGraph and AlignmentGraph compute
+// identical alignments on random pairs of overlapping
+// oriented reads with errors and repeated k-mers.
+void ChanZuckerberg::shasta::testLazyAlignmentGraph()
+{
+    const uint64_t pairCount = 1000;
+    const uint64_t genomeMarkerCount = 20000;
+    const uint64_t maxReadMarkerCount = 2000;
+
+    // Create a random genome of markers.
+    // Some k-mers are drawn from a small set, to create repeats
+    // and high frequency k-mers.
+    std::mt19937 randomSource(231);
+    std::uniform_real_distribution<double> uniformDistribution;
+    std::uniform_int_distribution<KmerId> kmerIdDistribution(0, 100000);
+    std::uniform_int_distribution<KmerId> repeatKmerIdDistribution(0, 30);
+    vector<KmerId> genome(genomeMarkerCount);
+    for(KmerId& kmerId: genome) {
+        kmerId = (uniformDistribution(randomSource) < 0.1) ?
+            repeatKmerIdDistribution(randomSource) : kmerIdDistribution(randomSource);
+    }
+
+    // Function to create the markers of a read, with errors, sorted by KmerId.
+    std::uniform_int_distribution<uint64_t> lengthDistribution(10, maxReadMarkerCount);
+    std::uniform_int_distribution<uint64_t> startDistribution(0, genomeMarkerCount - maxReadMarkerCount);
+    // The ordinals and positions are set after all markers are added.
+    auto addMarker = [](KmerId kmerId, vector<MarkerWithOrdinal>& markers) {
+        Marker marker;
+        marker.kmerId = kmerId;
+        marker.position = 0;
+        markers.push_back(MarkerWithOrdinal(marker, 0));
+    };
+    auto createRead = [&](uint64_t begin, uint64_t end, vector<MarkerWithOrdinal>& markers) {
+        markers.clear();
+        for(uint64_t i=begin; i!=end; i++) {
+            const double r = uniformDistribution(randomSource);
+            if(r < 0.04) {
+                continue;
+            }
+            if(r < 0.08) {
+                addMarker(kmerIdDistribution(randomSource), markers);
+            }
+            addMarker((r < 0.12) ? kmerIdDistribution(randomSource) : genome[i], markers);
+        }
+        for(uint32_t ordinal=0; ordinal<uint32_t(markers.size()); ordinal++) {
+            markers[ordinal].ordinal = ordinal;
+            markers[ordinal].position = 10 * ordinal;
+        }
+        sort(markers.begin(), markers.end());
+    };
+
+    // Create the pairs.
+    vector< array<vector<MarkerWithOrdinal>, 2> > markers(pairCount);
+    for(array<vector<MarkerWithOrdinal>, 2>& m: markers) {
+        const uint64_t begin0 = startDistribution(randomSource);
+        const uint64_t end0 = begin0 + lengthDistribution(randomSource);
+        const uint64_t begin1 = begin0 + lengthDistribution(randomSource) / 2;
+        const uint64_t end1 = min(genomeMarkerCount, begin1 + lengthDistribution(randomSource));
+        createRead(begin0, end0, m[0]);
+        createRead(begin1, end1, m[1]);
+    }
+
+    // Compare the alignments for some combinations of parameters.
+    // Alignments are always computed in full, without early exit.
+    const bool debug = false;
+    const size_t minAlignedMarkerCount = 0;
+    const size_t maxTrim = std::numeric_limits<size_t>::max();
+    AlignmentGraph graph;
+    LazyAlignmentGraph lazyGraph;
+    Alignment alignment0;
+    Alignment alignment1;
+    AlignmentInfo alignmentInfo0;
+    AlignmentInfo alignmentInfo1;
+    for(const size_t maxSkip: {10, 30}) {
+        for(const uint32_t maxMarkerFrequency: {2, 10}) {
+            for(const uint32_t bandHalfWidth: {0, 50}) {
+                double t0 = 0.;
+                double t1 = 0.;
+                for(uint64_t i=0; i<pairCount; i++) {
+                    const auto tBegin = std::chrono::steady_clock::now();
+                    align(markers[i], maxSkip, maxMarkerFrequency, bandHalfWidth,
+                        minAlignedMarkerCount, maxTrim, debug, graph, alignment0, alignmentInfo0);
+                    const auto tMiddle = std::chrono::steady_clock::now();
+                    align(markers[i], maxSkip, maxMarkerFrequency, bandHalfWidth,
+                        minAlignedMarkerCount, maxTrim, debug, lazyGraph, alignment1, alignmentInfo1);
+                    const auto tEnd = std::chrono::steady_clock::now();
+                    t0 += std::chrono::duration<double>(tMiddle - tBegin).count();
+                    t1 += std::chrono::duration<double>(tEnd - tMiddle).count();
+
+                    if(alignment1.ordinals != alignment0.ordinals ||
+                        !(alignmentInfo1 == alignmentInfo0)) {
+                        throw runtime_error("LazyAlignmentGraph test failed for pair " + to_string(i) +
+                            ", maxSkip " + to_string(maxSkip) +
+                            ", maxMarkerFrequency " + to_string(maxMarkerFrequency) +
+                            ", bandHalfWidth " + to_string(bandHalfWidth));
+                    }
+                }
+                cout << "maxSkip " << maxSkip << ", maxMarkerFrequency " << maxMarkerFrequency <<
+                    ", bandHalfWidth " << bandHalfWidth << ": " << pairCount <<
+                    " identical alignments. AlignmentGraph " << t0 << " s, LazyAlignmentGraph " <<
+                    t1 << " s." << endl;
+            }
+        }
+    }
+}
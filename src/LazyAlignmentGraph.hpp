@@ -0,0 +1,173 @@
+#ifndef CZI_SHASTA_LAZY_ALIGNMENT_GRAPH_HPP
+#define CZI_SHASTA_LAZY_ALIGNMENT_GRAPH_HPP
+
+/*******************************************************************************
+
+Class LazyAlignmentGraph computes the same marker alignment
+of two oriented reads as class AlignmentGraph,
+without storing the edges of the alignment graph.
+It is not a chaining algorithm: it uses the same graph
+and the same shortest path computation, and only differs
+in how the edges of each vertex are obtained.
+
+The AlignmentGraph creates a vertex for each pair of markers
+with the same k-mer in the two oriented reads, explicitly stores
+an edge between each pair of vertices that are sufficiently close
+on both oriented reads, and then finds a shortest path
+using Dijkstra's algorithm with a priority queue (see shortestPath.hpp).
+
+Here we use the same vertices, stored as compact POD records,
+sorted in the same order. Because the vertices are sorted by ordinal
+on the first oriented read, the edges of each vertex can be
+generated when needed by looking at the vertices that precede
+and follow it within the maxSkip range, so no edges are stored.
+The shortest path is then found with the same version of
+Dijkstra's algorithm, using a priority queue of the same type.
+
+To guarantee that the alignment is identical to the one
+computed by AlignmentGraph, and not just of the same cost,
+everything that affects tie breaking is reproduced exactly:
+- The vertices are sorted with the same comparisons.
+- The edges of each vertex are visited in the same order as
+  in the CompactUndirectedGraph used by AlignmentGraph: edges
+  from preceding vertices, edges to following vertices,
+  then the edges to the start and finish vertices.
+- Edges can be used in both directions, like the undirected
+  edges of the AlignmentGraph.
+- The priority queue compares pairs by distance only, so
+  vertices with the same distance are popped in the same order.
+testLazyAlignmentGraph checks that the alignments are identical.
+
+*******************************************************************************/
+
+// shasta
+#include "Marker.hpp"
+#include "orderPairs.hpp"
+
+// Standard library.
+#include "array.hpp"
+#include "cstdint.hpp"
+#include <limits>
+#include <queue>
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        class Alignment;
+        class LazyAlignmentGraph;
+        class AlignmentInfo;
+
+        // Top level function to compute the marker alignment
+        // using a LazyAlignmentGraph. The arguments
+        // are the same as for align (see AlignmentGraph.hpp).
+        void align(
+            const array<vector<MarkerWithOrdinal>, 2>& markers,
+            size_t maxSkip,
+            uint32_t maxMarkerFrequency,
+            uint32_t bandHalfWidth,
+            size_t minAlignedMarkerCount,
+            size_t maxTrim,
+            bool debug,
+
+            // The LazyAlignmentGraph can be reused.
+            // For performance, it should be reused when doing many alignments.
+            LazyAlignmentGraph&,
+
+            Alignment&,
+            AlignmentInfo&
+            );
+
+        // Check that LazyAlignmentGraph and AlignmentGraph
+        // compute identical alignments.
+        void testLazyAlignmentGraph();
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::LazyAlignmentGraph {
+public:
+
+    // Compute the alignment.
+    void align(
+        const array<vector<MarkerWithOrdinal>, 2>&,
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        uint32_t bandHalfWidth,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim,
+        bool debug,
+        Alignment&,
+        AlignmentInfo&);
+
+    // There is a vertex for each pair of markers with the same k-mer
+    // that is not a high frequency k-mer, as in AlignmentGraph.
+    // This is a POD record of 28 bytes.
+    class Vertex {
+    public:
+
+        // The ordinals of this marker in each of the oriented reads.
+        array<uint32_t, 2> ordinals;
+
+        // The ordinals keeping into account only low frequency markers.
+        // These are the ones used to compute edge weights.
+        array<uint32_t, 2> correctedOrdinals;
+
+        // Data members used to find the shortest path.
+        // The predecessor is the index of the previous vertex
+        // in the shortest path, or vertices.size() for the start vertex.
+        uint32_t distance;
+        uint32_t predecessor;
+        uint8_t color;
+
+        // Order by ordinal in the first sequence, as in AlignmentGraph.
+        bool operator<(const Vertex& that) const
+        {
+            return ordinals[0] < that.ordinals[0];
+        }
+    };
+
+private:
+
+    vector<Vertex> vertices;
+    void createVertices(
+        const array<vector<MarkerWithOrdinal>, 2>&,
+        uint32_t maxMarkerFrequency,
+        uint32_t bandHalfWidth);
+
+    // Flags that are set for markers whose k-mers
+    // have frequency maxMarkerFrequency or less in
+    // both oriented reads being aligned.
+    // Indexed by [0 or 1][ordinal].
+    array<vector<bool>, 2> isLowFrequencyMarker;
+
+    // The corrected ordinals, keeping into account only low frequency markers.
+    // Index by [01][ordinal].
+    array<vector<uint32_t>, 2> correctedOrdinals;
+
+    // Work area used by findAlignmentDiagonal for banded alignments.
+    vector<uint32_t> diagonalHistogram;
+
+    // The priority queue used to find the shortest path.
+    // It contains pairs (distance, vertex index) and has the
+    // same ordering as FindShortestPathQueue (see shortestPath.hpp),
+    // so vertices at the same distance come out in the same order.
+    // The start and finish vertices have indexes equal to
+    // vertices.size() and vertices.size()+1, as in AlignmentGraph.
+    using Queue = std::priority_queue<
+        pair<uint64_t, uint32_t>,
+        vector< pair<uint64_t, uint32_t> >,
+        OrderPairsByFirstOnlyGreater<uint64_t, uint32_t> >;
+    Queue queue;
+    bool findShortestPath(
+        uint32_t markerCount0,
+        uint32_t markerCount1,
+        size_t maxSkip);
+
+    // The marker vertices of the shortest path,
+    // excluding the start and finish vertices.
+    vector<uint32_t> shortestPath;
+};
+
+#endif
@@ -240,8 +240,7 @@ void LocalMarkerGraph::assembleDominantSequence(ostream& html) const
         const uint32_t position = p.second;
         const LocalMarkerGraphVertex& vertex = graph[v];
         for(const MarkerInfo& markerInfo: vertex.markerInfos) {
-            const MarkerId markerId = markerInfo.markerId;
-            const CompressedMarker& marker = markers.begin()[markerId];
+            const CompressedMarker marker = getMarker(markerInfo);
             const vector<uint8_t> counts = getRepeatCounts(markerInfo);
             for(uint32_t i=0; i<k; i++) {
                 repeatCountTable[position+i].insert(
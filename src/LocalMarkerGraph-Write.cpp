@@ -209,7 +209,7 @@ void LocalMarkerGraph::Writer::operator()(std::ostream& s, vertex_descriptor v)
 
         // A row for each marker of this vertex.
         for(const auto& markerInfo: vertex.markerInfos) {
-            const CompressedMarker& marker = graph.markers.begin()[markerInfo.markerId];
+            const CompressedMarker marker = graph.getMarker(markerInfo);
 
             // OrientedReadId
             s << "<tr><td align=\"right\"";
@@ -32,13 +32,15 @@ LocalMarkerGraph::LocalMarkerGraph(
     uint32_t k,
     LongBaseSequences& reads,
     const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const CompressedRepeatCounts& compressedReadRepeatCounts,
+    const Markers& markers,
     const MemoryMapped::Vector<MarkerGraph::CompressedVertexId>& globalMarkerGraphVertex,
     const ConsensusCaller& consensusCaller
     ) :
     k(k),
     reads(reads),
     readRepeatCounts(readRepeatCounts),
+    compressedReadRepeatCounts(compressedReadRepeatCounts),
     markers(markers),
     globalMarkerGraphVertex(globalMarkerGraphVertex),
     consensusCaller(consensusCaller)
@@ -95,19 +97,30 @@ LocalMarkerGraph::vertex_descriptor
 
 
 
+// Get the marker corresponding to a MarkerInfo of a vertex.
+// This uses the oriented read and ordinal stored in the MarkerInfo,
+// so it does not require a binary search, even
+// with Markers::storesStrand0Only.
+CompressedMarker LocalMarkerGraph::getMarker(
+    const LocalMarkerGraphVertex::MarkerInfo& markerInfo) const
+{
+    return markers[markerInfo.orientedReadId.getValue()][markerInfo.ordinal];
+}
+
+
+
 // Get the KmerId for a vertex.
 KmerId LocalMarkerGraph::getKmerId(vertex_descriptor v) const
 {
     const LocalMarkerGraphVertex& vertex = (*this)[v];
     CZI_ASSERT(!vertex.markerInfos.empty());
-    const MarkerId firstMarkerId = vertex.markerInfos.front().markerId;
-    const CompressedMarker& firstMarker = markers.begin()[firstMarkerId];
+    const CompressedMarker firstMarker = getMarker(vertex.markerInfos.front());
     const KmerId kmerId = firstMarker.kmerId;
 
     // Sanity check that all markers have the same kmerId.
     // At some point this can be removed.
     for(const auto& markerInfo: vertex.markerInfos){
-        const CompressedMarker& marker = markers.begin()[markerInfo.markerId];
+        const CompressedMarker marker = getMarker(markerInfo);
         CZI_ASSERT(marker.kmerId == kmerId);
     }
 
@@ -123,9 +136,10 @@ vector<uint8_t> LocalMarkerGraph::getRepeatCounts(
     const OrientedReadId orientedReadId = markerInfo.orientedReadId;
     const ReadId readId = orientedReadId.getReadId();
     const Strand strand = orientedReadId.getStrand();
-    const CompressedMarker& marker = markers.begin()[markerInfo.markerId];
+    const CompressedMarker marker = getMarker(markerInfo);
 
-    const auto& counts = readRepeatCounts[readId];
+    const auto counts = getReadRepeatCounts(
+        readRepeatCounts, compressedReadRepeatCounts, readId);
 
     vector<uint8_t> v(k);
     for(size_t i=0; i<k; i++) {
@@ -195,15 +209,16 @@ void LocalMarkerGraph::storeEdgeInfo(
     // Map to store the oriented read ids and ordinals, grouped by sequence.
     std::map<LocalMarkerGraphEdge::Sequence, vector<MarkerIntervalWithRepeatCounts> > sequenceTable;
     for(const MarkerInterval& interval: intervals) {
-        const CompressedMarker& marker0 = markers.begin(interval.orientedReadId.getValue())[interval.ordinals[0]];
-        const CompressedMarker& marker1 = markers.begin(interval.orientedReadId.getValue())[interval.ordinals[1]];
+        const CompressedMarker& marker0 = markers[interval.orientedReadId.getValue()][interval.ordinals[0]];
+        const CompressedMarker& marker1 = markers[interval.orientedReadId.getValue()][interval.ordinals[1]];
 
         // Fill in the sequence information and, if necessary, the base repeat counts.
         LocalMarkerGraphEdge::Sequence sequence;
         MarkerIntervalWithRepeatCounts intervalWithRepeatCounts(interval);
         if(marker1.position <= marker0.position + k) {
             sequence.overlappingBaseCount = uint8_t(marker0.position + k - marker1.position);
-            const auto& repeatCounts = readRepeatCounts[interval.orientedReadId.getReadId()];
+            const auto repeatCounts = getReadRepeatCounts(
+                readRepeatCounts, compressedReadRepeatCounts, interval.orientedReadId.getReadId());
             for(uint32_t i=0; i<sequence.overlappingBaseCount; i++) {
                 uint32_t position = marker1.position + i;
                 uint8_t repeatCount = 0;
@@ -228,7 +243,8 @@ void LocalMarkerGraph::storeEdgeInfo(
                 }
                 sequence.sequence.push_back(base);
             }
-            const auto repeatCounts = readRepeatCounts[interval.orientedReadId.getReadId()];
+            const auto repeatCounts = getReadRepeatCounts(
+                readRepeatCounts, compressedReadRepeatCounts, interval.orientedReadId.getReadId());
             for(uint32_t position=marker0.position+k;  position!=marker1.position; position++) {
                 uint8_t repeatCount;
                 if(interval.orientedReadId.getStrand() == 0) {
@@ -18,10 +18,12 @@ a group of aligned markers.
 
 // Shasta.
 #include "AssemblyGraph.hpp"
+#include "CompressedRepeatCounts.hpp"
 #include "Coverage.hpp"
 #include "Kmer.hpp"
 #include "MarkerGraph.hpp"
 #include "MarkerInterval.hpp"
+#include "Markers.hpp"
 #include "MemoryAsContainer.hpp"
 #include "ReadId.hpp"
 
@@ -242,7 +244,8 @@ public:
         uint32_t k,
         LongBaseSequences& reads,
         const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
-        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        const CompressedRepeatCounts& compressedReadRepeatCounts,
+        const Markers& markers,
         const MemoryMapped::Vector<MarkerGraph::CompressedVertexId>& globalMarkerGraphVertex,
         const ConsensusCaller&
         );
@@ -267,6 +270,9 @@ public:
     // Get the KmerId for a vertex.
     KmerId getKmerId(vertex_descriptor) const;
 
+    // Get the marker corresponding to a MarkerInfo of a vertex.
+    CompressedMarker getMarker(const LocalMarkerGraphVertex::MarkerInfo&) const;
+
     // Get the repeat counts for a MarkerInfo of a vertex.
     vector<uint8_t> getRepeatCounts(const LocalMarkerGraphVertex::MarkerInfo&) const;
 
@@ -406,7 +412,8 @@ private:
     // (not just those in this local marker graph).
     LongBaseSequences& reads;
     const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts;
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
+    const CompressedRepeatCounts& compressedReadRepeatCounts;
+    const Markers& markers;
 
     // A reference to the vector containing the global marker graph vertex id
     // corresponding to each marker.
@@ -23,6 +23,9 @@ namespace ChanZuckerberg {
         // Many long sequences of bases
         class LongBaseSequences;
 
+        // Rolling computation of the k-mer ids of a LongBaseSequenceView.
+        class LongBaseSequenceKmerIds;
+
         // Reverse complement a vector of bases.
         inline void reverseComplement(vector<Base>&);
 
@@ -173,6 +176,75 @@ inline std::ostream& ChanZuckerberg::shasta::operator<<(
 
 
 
+// Rolling computation of the ids of the k-mers of a LongBaseSequenceView
+// and of their reverse complements, with k <= 32.
+// Instead of calling Kmer::set and shiftLeft for each base,
+// this keeps the two halves of the k-mer id in two registers
+// and feeds them one bit at a time from the two words
+// that store each group of 64 bases,
+// which use the same bit order as the KmerId.
+// Usage:
+//     LongBaseSequenceKmerIds kmerIds(sequence, k);
+//     for(uint64_t position=0; position<sequence.baseCount; position++) {
+//         kmerIds.addBase(position);
+//         if(position+1 < k) continue;
+//         ... use kmerIds.kmerId() for the k-mer ending at position ...
+//     }
+// Callers that don't use reverseComplementedKmerId
+// pay nothing for it, because everything is inlined.
+class ChanZuckerberg::shasta::LongBaseSequenceKmerIds {
+public:
+    LongBaseSequenceKmerIds(const LongBaseSequenceView& sequence, uint64_t k) :
+        words(sequence.begin), k(k), mask((1ULL << k) - 1ULL), km1(k - 1ULL) {}
+
+    // Add the base at this position.
+    // Must be called for positions 0, 1, 2, ... in order.
+    void addBase(uint64_t position)
+    {
+        // Every 64 bases, get the next two words.
+        if((position & 63ULL) == 0) {
+            const uint64_t* p = words + ((position >> 6ULL) << 1ULL);
+            word0 = p[0];
+            word1 = p[1];
+        }
+
+        // Update the k-mer and its reverse complement.
+        const uint64_t bit0 = word0 >> 63ULL;
+        const uint64_t bit1 = word1 >> 63ULL;
+        kmerLsb = ((kmerLsb << 1ULL) | bit0) & mask;
+        kmerMsb = ((kmerMsb << 1ULL) | bit1) & mask;
+        reverseComplementedKmerLsb = (reverseComplementedKmerLsb >> 1ULL) | ((bit0 ^ 1ULL) << km1);
+        reverseComplementedKmerMsb = (reverseComplementedKmerMsb >> 1ULL) | ((bit1 ^ 1ULL) << km1);
+        word0 <<= 1ULL;
+        word1 <<= 1ULL;
+    }
+
+    // The id of the k-mer ending at the last position added,
+    // and of its reverse complement.
+    uint64_t kmerId() const
+    {
+        return (kmerMsb << k) | kmerLsb;
+    }
+    uint64_t reverseComplementedKmerId() const
+    {
+        return (reverseComplementedKmerMsb << k) | reverseComplementedKmerLsb;
+    }
+
+private:
+    const uint64_t* words;
+    uint64_t k;
+    uint64_t mask;
+    uint64_t km1;
+    uint64_t kmerLsb = 0;
+    uint64_t kmerMsb = 0;
+    uint64_t reverseComplementedKmerLsb = 0;
+    uint64_t reverseComplementedKmerMsb = 0;
+    uint64_t word0 = 0;
+    uint64_t word1 = 0;
+};
+
+
+
 // Class that uses a vector of uint64_t values
 // to represent a sequence of bases as a LongBaseSequence.
 class ChanZuckerberg::shasta::LongBaseSequence : public  LongBaseSequenceView {
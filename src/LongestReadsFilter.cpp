@@ -0,0 +1,51 @@
+#include "LongestReadsFilter.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+
+
+
+LongestReadsFilter::LongestReadsFilter(
+    uint64_t targetBaseCount,
+    uint64_t minReadLength) :
+    targetBaseCount(targetBaseCount),
+    minReadLength(minReadLength),
+    lengthCutoff(minReadLength)
+{
+}
+
+
+
+void LongestReadsFilter::add(const vector<uint64_t>& readLengths)
+{
+    if(readLengths.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Update the histogram.
+    for(const uint64_t readLength: readLengths) {
+        const uint64_t bin = readLength / binWidth;
+        if(bin >= histogram.size()) {
+            histogram.resize(bin + 1, 0);
+        }
+        histogram[bin] += readLength;
+    }
+
+    // Find the longest bin such that the reads in that bin and
+    // all longer bins contain at least targetBaseCount bases.
+    uint64_t baseCount = 0;
+    for(uint64_t bin=histogram.size()-1; ; bin--) {
+        baseCount += histogram[bin];
+        if(baseCount >= targetBaseCount) {
+            lengthCutoff.store(max(minReadLength, bin * binWidth), std::memory_order_relaxed);
+            break;
+        }
+        if(bin == 0) {
+            break;
+        }
+    }
+}
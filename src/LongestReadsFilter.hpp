@@ -0,0 +1,84 @@
+#ifndef CZI_SHASTA_LONGEST_READS_FILTER_HPP
+#define CZI_SHASTA_LONGEST_READS_FILTER_HPP
+
+/*******************************************************************************
+
+Class LongestReadsFilter is used while loading reads
+to keep only the longest reads, up to a target total number of bases
+(for example, the longest 60x of reads of a sample
+sequenced at much higher coverage).
+
+It keeps a histogram of the total number of bases in reads
+of each length, binned in bins of binWidth bases, so its size
+is bounded by the maximum read length divided by binWidth.
+Only reads that were kept are entered in the histogram.
+From the histogram, it computes the length cutoff: the lower end
+of the longest bin such that the reads in that bin and all
+longer bins contain at least the target number of bases.
+
+Adding reads can only increase the number of bases above
+any given length, so the length cutoff never decreases.
+It is therefore safe to discard, as soon as they are seen,
+reads shorter than the current cutoff. This way, most reads
+that will not be kept are never stored.
+Reads that were stored before the cutoff reached its final
+value must be discarded at the end, using the final cutoff.
+The reads that are kept at the end are exactly the reads
+with length at least equal to the final cutoff.
+Their total number of bases is at least equal to the target,
+exceeding it by at most the number of bases in one bin.
+
+The member functions can be called concurrently from multiple threads.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstdint.hpp"
+#include "vector.hpp"
+#include <atomic>
+#include <mutex>
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class LongestReadsFilter;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::LongestReadsFilter {
+public:
+
+    // Reads shorter than minReadLength are never kept.
+    LongestReadsFilter(uint64_t targetBaseCount, uint64_t minReadLength);
+
+    // Return the current length cutoff.
+    // Reads shorter than this can be discarded.
+    uint64_t getLengthCutoff() const
+    {
+        return lengthCutoff.load(std::memory_order_relaxed);
+    }
+
+    // Enter in the histogram the lengths of reads that were kept,
+    // then update the length cutoff.
+    void add(const vector<uint64_t>& readLengths);
+
+    uint64_t getTargetBaseCount() const
+    {
+        return targetBaseCount;
+    }
+
+    static const uint64_t binWidth = 100;
+
+private:
+    uint64_t targetBaseCount;
+    uint64_t minReadLength;
+    std::atomic<uint64_t> lengthCutoff;
+
+    // The total number of bases in the reads of each length bin.
+    // Protected by the mutex.
+    vector<uint64_t> histogram;
+    std::mutex mutex;
+};
+
+#endif
@@ -8,6 +8,7 @@ using namespace shasta;
 // Standard library.
 #include "chrono.hpp"
 #include <numeric>
+#include <random>
 
 
 
@@ -24,11 +25,17 @@ LowHash::LowHash(
     size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for minHash.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
+    bool useRollingHash,            // Use RollingFeatureHash instead of MurmurHash64A.
+    size_t maxDiagonalDelta,        // If not zero, require hits on a consistent diagonal.
+    size_t bucketPassCountArgument, // If greater than 1, process buckets in this number of passes.
+    size_t readSampleStride,        // If not zero, only measure candidates for one read in this many.
     size_t threadCountArgument,
     const MemoryMapped::Vector<KmerInfo>& kmerTable,
     const MemoryMapped::Vector<ReadFlags>& readFlags,
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const Markers& markers,
     MemoryMapped::Vector<OrientedReadPair>& candidateAlignments,
+    OrientedReadPairQueue* candidateQueue,
+    size_t queueThreadCount,
     const string& largeDataFileNamePrefix,
     size_t largeDataPageSize
     ) :
@@ -37,10 +44,16 @@ LowHash::LowHash(
     hashFraction(hashFraction),
     maxBucketSize(maxBucketSize),
     minFrequency(minFrequency),
+    useRollingHash(useRollingHash),
+    maxDiagonalDelta(maxDiagonalDelta),
+    bucketPassCount(bucketPassCountArgument),
+    readSampleStride(readSampleStride),
     threadCount(threadCountArgument),
     kmerTable(kmerTable),
     readFlags(readFlags),
     markers(markers),
+    candidateQueue(candidateQueue),
+    queueThreadCount(queueThreadCount),
     largeDataFileNamePrefix(largeDataFileNamePrefix),
     largeDataPageSize(largeDataPageSize)
 
@@ -53,6 +66,9 @@ LowHash::LowHash(
         threadCount = std::thread::hardware_concurrency();
     }
     cout << "Using " << threadCount << " threads." << endl;
+    if(queueThreadCount == 0 || queueThreadCount > threadCount) {
+        queueThreadCount = threadCount;
+    }
 
 
     // Estimate the total number of low hashes and its base 2 log.
@@ -81,18 +97,50 @@ LowHash::LowHash(
             " to maximum allowed value 31."  << endl;
         log2MinHashBucketCount = 31;
     }
-    const uint32_t bucketCount = 1 << log2MinHashBucketCount;
+    const uint64_t bucketCount = uint64_t(1) << log2MinHashBucketCount;
     mask = bucketCount - 1;
+
+    // The partitions store bucket ids as 32-bit integers.
+    // This is guaranteed by the limit on log2MinHashBucketCount above.
+    CZI_ASSERT(mask <= uint64_t(std::numeric_limits<uint32_t>::max()));
     cout << "LowHash algorithm will use 2^" << log2MinHashBucketCount;
     cout << " = " << bucketCount << " buckets. "<< endl;
 
+    // Each partition covers at least 2^16 buckets, so the bucket counts
+    // it uses during pass 2 fit in the L2 cache when possible,
+    // but there are no more than maxPartitionCount partitions.
+    const uint64_t log2PartitionBucketCount = 16;
+    partitionShift = min(uint64_t(log2MinHashBucketCount), log2PartitionBucketCount);
+    while((uint64_t(bucketCount) >> partitionShift) > maxPartitionCount) {
+        ++partitionShift;
+    }
+    partitionCount = uint64_t(bucketCount) >> partitionShift;
+    cout << "Buckets are filled using " << partitionCount << " partitions." << endl;
+
+    // If using more than one bucket pass, each pass
+    // processes a contiguous range of partitions.
+    if(bucketPassCount == 0 || readSampleStride != 0) {
+        bucketPassCount = 1;
+    }
+    if(bucketPassCount > partitionCount) {
+        cout << "Number of bucket passes reduced from " << bucketPassCount <<
+            " to the number of partitions, " << partitionCount << "." << endl;
+        bucketPassCount = partitionCount;
+    }
+    if(bucketPassCount > 1) {
+        cout << "LowHash will process buckets in " << bucketPassCount << " passes." << endl;
+    }
+
 
 
 
     // Create vectors containing only the k-mer ids of all markers.
     // This is used to speed up the computation of hash functions.
-    cout << timestamp << "Creating kmer ids for oriented reads." << endl;
-    createKmerIds();
+    // It is not done when using more than one bucket pass, to reduce memory.
+    if(bucketPassCount == 1) {
+        cout << timestamp << "Creating kmer ids for oriented reads." << endl;
+        createKmerIds();
+    }
 
     // Compute the threshold for a hash value to be considered low.
     hashThreshold = uint64_t(double(hashFraction) * double(std::numeric_limits<uint64_t>::max()));
@@ -106,79 +154,275 @@ LowHash::LowHash(
 
 
     // Set up work areas.
-    buckets.createNew(
-            largeDataFileNamePrefix + "tmp-LowHash-Buckets",
-            largeDataPageSize);
     lowHashes.resize(orientedReadCount);
+    iterationCount = minHashIterationCount;
+    if(useRollingHash) {
+        rollingLowHashes.resize(orientedReadCount);
+    }
+    if(maxDiagonalDelta != 0) {
+        lowHashOrdinals.resize(orientedReadCount);
+        allLowHashes.resize(orientedReadCount);
+    }
     candidates.resize(readCount);
+    if(readSampleStride != 0) {
+        sampledReadMutexes = vector<std::mutex>((readCount + readSampleStride - 1) / readSampleStride);
+    }
+    arenas.resize(threadCount);
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        Arena& arena = arenas[threadId];
+        arena.name = largeDataFileNamePrefix.empty() ? "" :
+            (largeDataFileNamePrefix + "tmp-LowHash-Arena-" + to_string(threadId));
+        arena.pageSize = largeDataPageSize;
+    }
     threadStatistics.resize(threadCount);
+    if(readSampleStride == 0) {
+        partitions.resize(partitionCount);
+        partitionMutexes = vector<std::mutex>(partitionCount);
+        partitionStaging.resize(threadCount);
+        for(PartitionStaging& staging: partitionStaging) {
+            staging.entries.resize(partitionCount * partitionStagingSize);
+            staging.sizes.resize(partitionCount, 0);
+        }
+    }
 
 
 
-    // LowHash iteration loop.
-    for(iteration=0; iteration<minHashIterationCount; iteration++) {
-        cout << timestamp << "LowHash iteration " << iteration << " begins." << endl;
+    // Loop over bucket passes.
+    // With a single bucket pass (the default), all buckets are processed
+    // at each iteration, and the candidate tables are kept in memory
+    // until the end.
+    size_t batchSize = 10000;
+    for(bucketPass=0; bucketPass<bucketPassCount; bucketPass++) {
+        partitionBegin = (bucketPass * partitionCount) / bucketPassCount;
+        partitionEnd = ((bucketPass + 1) * partitionCount) / bucketPassCount;
+        passBucketBegin = partitionBegin << partitionShift;
+        const uint64_t passBucketCount = (partitionEnd - partitionBegin) << partitionShift;
+        if(bucketPassCount > 1) {
+            cout << timestamp << "LowHash bucket pass " << bucketPass << " begins." << endl;
+        }
+        if(readSampleStride == 0) {
+            buckets.createNew(
+                largeDataFileNamePrefix.empty() ? "" :
+                    (largeDataFileNamePrefix + "tmp-LowHash-Buckets"),
+                largeDataPageSize);
+        }
 
-        // Pass1: compute the low hashes for each oriented read
-        // and prepare the buckets for filling.
-        buckets.clear();
-        buckets.beginPass1(bucketCount);
-        size_t batchSize = 10000;
-        setupLoadBalancing(readCount, batchSize);
-        runThreads(&LowHash::pass1ThreadFunction, threadCount);
+        // If using the rolling hash, compute the low hashes
+        // for all iterations in a single roll.
+        if(useRollingHash) {
+            setupLoadBalancing(readCount, batchSize);
+            runThreads(&LowHash::computeRollingLowHashes, threadCount);
+        }
 
-        // Pass 2: fill the buckets.
-        buckets.beginPass2();
-        batchSize = 10000;
-        setupLoadBalancing(readCount, batchSize);
-        runThreads(&LowHash::pass2ThreadFunction, threadCount);
-        buckets.endPass2(false, false);
+        // LowHash iteration loop.
+        for(iteration=0; iteration<minHashIterationCount; iteration++) {
+            cout << timestamp << "LowHash iteration " << iteration << " begins." << endl;
+
+            // Pass1: compute the low hashes for each oriented read
+            // and store them in the partitions.
+            setupLoadBalancing(readCount, batchSize);
+            runThreads(&LowHash::pass1ThreadFunction, threadCount);
+
+            // If sampling, only the sampled reads are stored in buckets.
+            // The low hashes of all reads are looked up in these buckets,
+            // first to count bucket sizes, then to find candidates.
+            if(readSampleStride != 0) {
+                createSampledBuckets();
+                setupLoadBalancing(readCount, batchSize);
+                runThreads(&LowHash::countSampledBucketsThreadFunction, threadCount);
+                updateSampledBucketSizeHistogram();
+                setupLoadBalancing(readCount, batchSize);
+                runThreads(&LowHash::findSampledCandidatesThreadFunction, threadCount);
+            } else {
 
-        // Pass 3: inspect the buckets to find candidates.
-        batchSize = 10000;
-        setupLoadBalancing(readCount, batchSize);
-        runThreads(&LowHash::pass3ThreadFunction, threadCount);
+                // Pass 2: count the entries of each bucket.
+                buckets.clear();
+                buckets.beginPass1(passBucketCount);
+                setupLoadBalancing(partitionEnd - partitionBegin, 1);
+                runThreads(&LowHash::pass2ThreadFunction, threadCount);
+
+                // Pass 3: fill the buckets.
+                buckets.beginPass2();
+                setupLoadBalancing(partitionEnd - partitionBegin, 1);
+                runThreads(&LowHash::pass3ThreadFunction, threadCount);
+                buckets.endPass2(false, false);
+                freePartitions();
+
+                // Pass 4: inspect the buckets to find candidates.
+                setupLoadBalancing(readCount, batchSize);
+                runThreads(&LowHash::pass4ThreadFunction, threadCount);
+            }
 
-        // Write a summary for this iteration.
-        uint64_t highFrequency = 0;
-        uint64_t total = 0;
-        uint64_t capacity = 0;
-        for(const auto& s: threadStatistics) {
-            highFrequency += s.highFrequency;
-            total += s.total;
-            capacity += s.capacity;
+            // Write a summary for this iteration.
+            // The thread statistics accumulate over all iterations.
+            uint64_t highFrequency = 0;
+            uint64_t total = 0;
+            uint64_t capacity = 0;
+            for(const auto& s: threadStatistics) {
+                highFrequency += s.highFrequency;
+                total += s.total;
+                capacity += s.capacity;
+            }
+            cout << "Alignment candidates after iteration " << iteration;
+            cout << ": high frequency " << highFrequency;
+            cout << ", total " << total;
+            cout << ", capacity " << capacity << "." << endl;
+        }
+
+        // Free the data used only by this pass.
+        freePassData();
+
+        // If using more than one bucket pass, move the candidates
+        // found during this pass out of memory.
+        if(bucketPassCount > 1) {
+            spillCandidates();
         }
-        cout << "Alignment candidates after iteration " << iteration;
-        cout << ": high frequency " << highFrequency;
-        cout << ", total " << total;
-        cout << ", capacity " << capacity << "." << endl;
     }
 
 
 
-    // Create the candidate alignments.
-    cout << timestamp << "Storing candidate alignments." << endl;
+    // If using the diagonal consistency filter, sort the
+    // low hashes from all iterations of each oriented read.
+    // With more than one bucket pass, this was already done
+    // when spilling them.
+    if(maxDiagonalDelta != 0 && bucketPassCount == 1) {
+        setupLoadBalancing(orientedReadCount, batchSize);
+        runThreads(&LowHash::sortAllLowHashesThreadFunction, threadCount);
+    }
+
+
+
+    // Count the candidates with sufficient frequency for each readId0.
     CZI_ASSERT(orientedReadCount == 2*readCount);
-    for(ReadId readId0=0; readId0<readCount; readId0++) {
-        const auto& candidates0 = candidates[readId0];
-        for(const Candidate& candidate: candidates0) {
-            if(candidate.frequency >= minFrequency) {
-                const ReadId readId1 = candidate.readId1;
-                CZI_ASSERT(readId0 < readId1);
-                candidateAlignments.push_back(
-                    OrientedReadPair(readId0, readId1, candidate.strand==0));
-            }
+    candidateAlignmentsOffset.resize(readCount + 1);
+    setupLoadBalancing(readCount, batchSize);
+    runThreads(&LowHash::storeCandidatesPass1, threadCount);
+
+    // If sampling, just compute the average number of candidates
+    // for the sampled reads. The candidate table of each sampled read
+    // contains all of its partners, so each pair contributes
+    // to two reads in a complete run, and we divide by 2 to estimate
+    // the number of candidate pairs per read.
+    if(readSampleStride != 0) {
+        uint64_t sampledReadCount = 0;
+        uint64_t sampledCandidateCount = 0;
+        for(ReadId readId0=0; readId0<readCount; readId0+=ReadId(readSampleStride)) {
+            ++sampledReadCount;
+            sampledCandidateCount += candidateAlignmentsOffset[readId0];
+        }
+        sampledCandidatesPerRead = double(sampledCandidateCount) / double(2 * sampledReadCount);
+        cout << "Found " << sampledCandidateCount << " alignment candidates for " <<
+            sampledReadCount << " sampled reads, " << sampledCandidatesPerRead <<
+            " candidate pairs per read." << endl;
+    }
+
+    // If a queue was specified, pass 2 sends the candidates of each read
+    // to the queue as soon as they are gathered, without storing them.
+    // Sending waits while the queue is full, so first free the data
+    // that pass 2 does not need. With a single bucket pass,
+    // pass 2 also removes each arena chunk as soon as the candidates
+    // of all tables it contains have been sent.
+    // The caller is responsible for closing the queue.
+    else if(candidateQueue) {
+        if(kmerIds.isOpen()) {
+            kmerIds.remove();
+        }
+        partitions.clear();
+        partitions.shrink_to_fit();
+        partitionStaging.clear();
+        partitionStaging.shrink_to_fit();
+        lowHashOrdinals.clear();
+        lowHashOrdinals.shrink_to_fit();
+        allLowHashes.clear();
+        allLowHashes.shrink_to_fit();
+        for(const auto& v: spilledLowHashes) {
+            v->remove();
+        }
+        spilledLowHashes.clear();
+        rollingLowHashes.clear();
+        rollingLowHashes.shrink_to_fit();
+        lowHashes.clear();
+        lowHashes.shrink_to_fit();
+        if(bucketPassCount == 1) {
+            prepareArenaChunkRelease();
+        }
+
+        cout << timestamp << "Sending candidate alignments to the queue using " <<
+            queueThreadCount << " threads." << endl;
+        const uint64_t pushedPairCountBegin = candidateQueue->pushedPairCount();
+        setupLoadBalancing(readCount, batchSize);
+        runThreads(&LowHash::storeCandidatesPass2, queueThreadCount);
+        const uint64_t candidateCount = candidateQueue->pushedPairCount() - pushedPairCountBegin;
+        cout << "Found " << candidateCount << " alignment candidates."<< endl;
+        cout << "Average number of alignment candidates per oriented read is ";
+        cout << (2.* double(candidateCount)) / double(orientedReadCount)  << "." << endl;
+    }
+
+    // Otherwise, store the candidate alignments.
+    // Pass 2 stores them, sorted, at the appropriate offset.
+    else {
+        cout << timestamp << "Storing candidate alignments." << endl;
+        candidateAlignmentsPointer = &candidateAlignments;
+        uint64_t offset = candidateAlignments.size();
+        for(ReadId readId0=0; readId0<readCount; readId0++) {
+            const uint64_t n = candidateAlignmentsOffset[readId0];
+            candidateAlignmentsOffset[readId0] = offset;
+            offset += n;
         }
+        candidateAlignmentsOffset[readCount] = offset;
+        candidateAlignments.resize(offset);
+        setupLoadBalancing(readCount, batchSize);
+        runThreads(&LowHash::storeCandidatesPass2, threadCount);
+        cout << "Found " << candidateAlignments.size() << " alignment candidates."<< endl;
+        cout << "Average number of alignment candidates per oriented read is ";
+        cout << (2.* double(candidateAlignments.size())) / double(orientedReadCount)  << "." << endl;
+    }
+    if(maxDiagonalDelta != 0) {
+        uint64_t diagonalFilterDiscarded = 0;
+        for(const auto& s: threadStatistics) {
+            diagonalFilterDiscarded += s.diagonalFilterDiscarded;
+        }
+        cout << "The diagonal consistency filter discarded " << diagonalFilterDiscarded <<
+            " candidates." << endl;
     }
-    cout << "Found " << candidateAlignments.size() << " alignment candidates."<< endl;
-    cout << "Average number of alignment candidates per oriented read is ";
-    cout << (2.* double(candidateAlignments.size())) / double(orientedReadCount)  << "." << endl;
 
 
 
     // Clean up work areas.
-    buckets.remove();
-    kmerIds.remove();
+    if(kmerIds.isOpen()) {
+        kmerIds.remove();
+    }
+    for(const auto& v: spilledCandidates) {
+        v->remove();
+    }
+    spilledCandidates.clear();
+    for(const auto& v: spilledLowHashes) {
+        v->remove();
+    }
+    spilledLowHashes.clear();
+    partitions.clear();
+    partitions.shrink_to_fit();
+    partitionStaging.clear();
+    partitionStaging.shrink_to_fit();
+    candidates.clear();
+    candidates.shrink_to_fit();
+    for(Arena& arena: arenas) {
+        arena.remove();
+    }
+    arenas.clear();
+    arenas.shrink_to_fit();
+    arenaChunks.clear();
+    arenaChunks.shrink_to_fit();
+    candidateAlignmentsOffset.clear();
+    candidateAlignmentsOffset.shrink_to_fit();
+    lowHashOrdinals.clear();
+    lowHashOrdinals.shrink_to_fit();
+    allLowHashes.clear();
+    allLowHashes.shrink_to_fit();
+    rollingLowHashes.clear();
+    rollingLowHashes.shrink_to_fit();
+    lowHashes.clear();
+    lowHashes.shrink_to_fit();
 
 
 
@@ -226,13 +470,13 @@ void LowHash::createKmerIds(size_t threadId)
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
             for(Strand strand=0; strand<2; strand++) {
                 const OrientedReadId orientedReadId(readId, strand);
-                const auto orientedReadMarkers = markers[orientedReadId.getValue()];
+                const Markers::View orientedReadMarkers = markers[orientedReadId.getValue()];
 
                 CZI_ASSERT(kmerIds.size(orientedReadId.getValue()) == orientedReadMarkers.size());
 
                 auto pointer = kmerIds.begin(orientedReadId.getValue());
-                for(const CompressedMarker& marker: orientedReadMarkers) {
-                    *pointer++ = marker.kmerId;
+                for(uint64_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+                    *pointer++ = orientedReadMarkers[ordinal].kmerId;
                 }
             }
         }
@@ -241,12 +485,117 @@ void LowHash::createKmerIds(size_t threadId)
 
 
 
+// Return the k-mer ids of the markers of an oriented read.
+// If kmerIds was created, this points to its entries.
+// Otherwise, the k-mer ids are extracted from the markers
+// into the given buffer.
+const KmerId* LowHash::getKmerIds(
+    OrientedReadId::Int orientedReadIdInt,
+    vector<KmerId>& buffer) const
+{
+    if(kmerIds.isOpen()) {
+        return kmerIds.begin(orientedReadIdInt);
+    }
+    const Markers::View orientedReadMarkers = markers[orientedReadIdInt];
+    buffer.resize(orientedReadMarkers.size());
+    for(uint64_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+        buffer[ordinal] = orientedReadMarkers[ordinal].kmerId;
+    }
+    return buffer.data();
+}
+
+
+
+uint64_t LowHash::getMarkerCount(OrientedReadId::Int orientedReadIdInt) const
+{
+    return markers.size(orientedReadIdInt);
+}
+
+
+
+// Free the data used only by the current bucket pass:
+// the buckets and the low hashes of the last iteration.
+// The candidate tables and allLowHashes accumulate over all iterations.
+// When using more than one bucket pass, spillCandidates
+// then moves them out of memory.
+void LowHash::freePassData()
+{
+    if(buckets.isOpen()) {
+        buckets.remove();
+    }
+    sampledBuckets.clear();
+    sampledBuckets.shrink_to_fit();
+    sampledBucketEntries.clear();
+    sampledBucketEntries.shrink_to_fit();
+    for(auto& v: lowHashes) {
+        v.clear();
+        v.shrink_to_fit();
+    }
+    for(auto& v: lowHashOrdinals) {
+        v.clear();
+        v.shrink_to_fit();
+    }
+    for(auto& r: rollingLowHashes) {
+        r = RollingLowHashes();
+    }
+}
+
+
+
+// Free the partitions, once pass 3 has stored their entries in the buckets.
+void LowHash::freePartitions()
+{
+    for(vector<PartitionEntry>& partition: partitions) {
+        partition.clear();
+        partition.shrink_to_fit();
+    }
+}
+
+
+
+// Store a partition entry in the staging area of this thread,
+// moving the staged entries to the partition when it is full.
+inline void LowHash::addPartitionEntry(
+    size_t threadId,
+    uint64_t partitionId,
+    const PartitionEntry& entry)
+{
+    PartitionStaging& staging = partitionStaging[threadId];
+    uint32_t& size = staging.sizes[partitionId];
+    staging.entries[partitionId * partitionStagingSize + size] = entry;
+    if(++size == partitionStagingSize) {
+        flushPartitionStaging(threadId, partitionId);
+    }
+}
+
+
+
+// Move the entries in the staging area of this thread to the partition.
+void LowHash::flushPartitionStaging(size_t threadId, uint64_t partitionId)
+{
+    PartitionStaging& staging = partitionStaging[threadId];
+    uint32_t& size = staging.sizes[partitionId];
+    if(size == 0) {
+        return;
+    }
+    const auto begin = staging.entries.begin() + partitionId * partitionStagingSize;
+    {
+        std::lock_guard<std::mutex> lock(partitionMutexes[partitionId]);
+        vector<PartitionEntry>& partition = partitions[partitionId];
+        partition.insert(partition.end(), begin, begin + size);
+    }
+    size = 0;
+}
+
+
+
 // Pass1: compute the low hashes for each oriented read
-// and prepare the buckets for filling.
+// and store them in the partitions.
 void LowHash::pass1ThreadFunction(size_t threadId)
 {
     const int featureByteCount = int(m * sizeof(KmerId));
     const uint64_t seed = iteration * 37;
+    vector<KmerId> kmerIdsBuffer;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -262,7 +611,10 @@ void LowHash::pass1ThreadFunction(size_t threadId)
 
                 vector<uint64_t>& orientedReadLowHashes = lowHashes[orientedReadId.getValue()];
                 orientedReadLowHashes.clear();
-                const size_t markerCount = kmerIds.size(orientedReadId.getValue());
+                if(maxDiagonalDelta != 0) {
+                    lowHashOrdinals[orientedReadId.getValue()].clear();
+                }
+                const size_t markerCount = getMarkerCount(orientedReadId.getValue());
 
                 // Handle the pathological case where there are fewer than m markers.
                 // This oriented read ends up in no bucket.
@@ -270,9 +622,28 @@ void LowHash::pass1ThreadFunction(size_t threadId)
                     continue;
                 }
 
+                // Rolling hash version. The low hashes for this iteration
+                // were already computed by computeRollingLowHashes.
+                if(useRollingHash) {
+                    const RollingLowHashes& r = rollingLowHashes[orientedReadId.getValue()];
+                    for(uint32_t i=r.iterationBegin[iteration]; i!=r.iterationBegin[iteration+1]; i++) {
+                        const uint64_t hash = r.hashes[i];
+                        const uint64_t bucketId = hash & mask;
+                        const uint64_t partitionId = bucketId >> partitionShift;
+                        orientedReadLowHashes.push_back(hash);
+                        if(maxDiagonalDelta != 0) {
+                            lowHashOrdinals[orientedReadId.getValue()].push_back(r.ordinals[i]);
+                        }
+                        if(readSampleStride == 0) {
+                            addPartitionEntry(threadId, partitionId,
+                                {uint32_t(bucketId), BucketEntry(orientedReadId, hash)});
+                        }
+                    }
+                    continue;
+                }
 
                 // Get the markers for this oriented read.
-                KmerId* kmerIdsPointer = kmerIds.begin(orientedReadId.getValue());
+                const KmerId* kmerIdsPointer = getKmerIds(orientedReadId.getValue(), kmerIdsBuffer);
                 const size_t featureCount = markerCount - m + 1;
 
                 // Loop over features of this oriented read.
@@ -280,22 +651,50 @@ void LowHash::pass1ThreadFunction(size_t threadId)
                 for(size_t j=0; j<featureCount; j++, kmerIdsPointer++) {
                     const uint64_t hash = MurmurHash64A(kmerIdsPointer, featureByteCount, seed);
                     if(hash < hashThreshold) {
-                        orientedReadLowHashes.push_back(hash);
                         const uint64_t bucketId = hash & mask;
-                        buckets.incrementCountMultithreaded(bucketId);
+                        const uint64_t partitionId = bucketId >> partitionShift;
+                        if(partitionId < partitionBegin || partitionId >= partitionEnd) {
+                            continue;   // Not in the bucket range of this pass.
+                        }
+                        orientedReadLowHashes.push_back(hash);
+                        if(maxDiagonalDelta != 0) {
+                            lowHashOrdinals[orientedReadId.getValue()].push_back(uint32_t(j));
+                        }
+                        if(readSampleStride == 0) {
+                            addPartitionEntry(threadId, partitionId,
+                                {uint32_t(bucketId), BucketEntry(orientedReadId, hash)});
+                        }
                     }
                 }
             }
         }
     }
 
+    // Move to the partitions the entries left in the staging area of this thread.
+    if(readSampleStride == 0) {
+        for(uint64_t partitionId=partitionBegin; partitionId!=partitionEnd; partitionId++) {
+            flushPartitionStaging(threadId, partitionId);
+        }
+    }
 }
 
 
 
-// Pass 2: fill the buckets.
-void LowHash::pass2ThreadFunction(size_t threadId)
+// Compute the low hashes of each oriented read for all iterations
+// in a single roll of the RollingFeatureHash over its features.
+// Only the low hashes in the bucket range of the current pass are kept.
+void LowHash::computeRollingLowHashes(size_t threadId)
 {
+    vector<uint64_t> seeds(iterationCount);
+    for(size_t i=0; i<iterationCount; i++) {
+        seeds[i] = rollingHashSeed(i);
+    }
+
+    // The low hashes found for each iteration,
+    // for the oriented read being processed.
+    vector< vector<uint64_t> > iterationHashes(iterationCount);
+    vector< vector<uint32_t> > iterationOrdinals(iterationCount);
+    vector<KmerId> kmerIdsBuffer;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -308,12 +707,51 @@ void LowHash::pass2ThreadFunction(size_t threadId)
             }
             for(Strand strand=0; strand<2; strand++) {
                 const OrientedReadId orientedReadId(readId, strand);
-                const vector<uint64_t>& orientedReadLowHashes = lowHashes[orientedReadId.getValue()];
+                RollingLowHashes& r = rollingLowHashes[orientedReadId.getValue()];
+                r = RollingLowHashes();
+                const size_t markerCount = getMarkerCount(orientedReadId.getValue());
+                if(markerCount < m) {
+                    continue;
+                }
+                for(size_t i=0; i<iterationCount; i++) {
+                    iterationHashes[i].clear();
+                    iterationOrdinals[i].clear();
+                }
 
-                for(const uint64_t hash: orientedReadLowHashes) {
-                    const uint64_t bucketId = hash & mask;
-                    buckets.storeMultithreaded(bucketId, BucketEntry(orientedReadId, hash));
+                // Roll over the features, computing the hash for all seeds.
+                const KmerId* kmerIdsPointer = getKmerIds(orientedReadId.getValue(), kmerIdsBuffer);
+                const size_t featureCount = markerCount - m + 1;
+                RollingFeatureHash rollingHash(m);
+                for(size_t j=0; j<m; j++) {
+                    rollingHash.add(kmerIdsPointer[j]);
+                }
+                for(size_t j=0; ; j++) {
+                    for(size_t i=0; i<iterationCount; i++) {
+                        const uint64_t hash = rollingHash.get(seeds[i]);
+                        if(hash < hashThreshold) {
+                            const uint64_t partitionId = (hash & mask) >> partitionShift;
+                            if(partitionId >= partitionBegin && partitionId < partitionEnd) {
+                                iterationHashes[i].push_back(hash);
+                                if(maxDiagonalDelta != 0) {
+                                    iterationOrdinals[i].push_back(uint32_t(j));
+                                }
+                            }
+                        }
+                    }
+                    if(j+1 == featureCount) {
+                        break;
+                    }
+                    rollingHash.roll(kmerIdsPointer[j+m], kmerIdsPointer[j]);
                 }
+
+                // Store them, grouped by iteration.
+                r.iterationBegin.resize(iterationCount + 1);
+                for(size_t i=0; i<iterationCount; i++) {
+                    r.iterationBegin[i] = uint32_t(r.hashes.size());
+                    r.hashes.insert(r.hashes.end(), iterationHashes[i].begin(), iterationHashes[i].end());
+                    r.ordinals.insert(r.ordinals.end(), iterationOrdinals[i].begin(), iterationOrdinals[i].end());
+                }
+                r.iterationBegin[iterationCount] = uint32_t(r.hashes.size());
             }
         }
     }
@@ -321,18 +759,53 @@ void LowHash::pass2ThreadFunction(size_t threadId)
 
 
 
-// Pass 3: inspect the buckets to find candidates.
+// Pass 2: count the entries of each bucket, one partition at a time.
+// Each bucket belongs to exactly one partition,
+// so no atomics are needed.
+void LowHash::pass2ThreadFunction(size_t threadId)
+{
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over partitions assigned to this batch.
+        for(uint64_t partitionId=partitionBegin+begin; partitionId!=partitionBegin+end; partitionId++) {
+
+            // Loop over the entries stored in this partition.
+            for(const PartitionEntry& entry: partitions[partitionId]) {
+                buckets.incrementCount(entry.bucketId - passBucketBegin);
+            }
+        }
+    }
+}
+
+
+
+// Pass 3: fill the buckets, one partition at a time.
 void LowHash::pass3ThreadFunction(size_t threadId)
 {
 
-    // The alignment candidates found at this iteration for a single read.
-    vector<Candidate> newCandidates;
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
 
-    // The merged candidates for a single readId0.
-    vector<Candidate> mergedCandidates;
+        // Loop over partitions assigned to this batch.
+        for(uint64_t partitionId=partitionBegin+begin; partitionId!=partitionBegin+end; partitionId++) {
+
+            // Loop over the entries stored in this partition.
+            for(const PartitionEntry& entry: partitions[partitionId]) {
+                buckets.store(entry.bucketId - passBucketBegin, entry.bucketEntry);
+            }
+        }
+    }
+}
 
-    ThreadStatistics& thisThreadStatistics = threadStatistics[threadId];
-    thisThreadStatistics.clear();
+
+
+// Pass 4: inspect the buckets to find candidates.
+void LowHash::pass4ThreadFunction(size_t threadId)
+{
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -340,7 +813,6 @@ void LowHash::pass3ThreadFunction(size_t threadId)
 
         // Loop over reads assigned to this batch.
         for(ReadId readId0=ReadId(begin); readId0!=ReadId(end); readId0++) {
-            newCandidates.clear();
 
             // Loop over two strands.
             for(Strand strand0=0; strand0<2; strand0++) {
@@ -349,15 +821,23 @@ void LowHash::pass3ThreadFunction(size_t threadId)
 
                 // Loop over the low hashes for this oriented read.
                 const vector<uint64_t>& orientedReadLowHashes = lowHashes[orientedReadIdInt0];
-                for(const uint64_t hash: orientedReadLowHashes) {
+                for(uint64_t i=0; i<orientedReadLowHashes.size(); i++) {
+                    const uint64_t hash = orientedReadLowHashes[i];
                     const uint32_t hashHighBits = uint32_t(hash >> 32);
 
                     // Loop over oriented read ids in the bucket corresponding to this hash.
                     const uint64_t bucketId = hash & mask;
-                    const MemoryAsContainer<BucketEntry> bucket = buckets[bucketId];
+                    const MemoryAsContainer<BucketEntry> bucket = buckets[bucketId - passBucketBegin];
                     if(bucket.size() > maxBucketSize) {
                         continue;   // The bucket is too big. Skip it.
                     }
+
+                    // Keep it for the diagonal consistency filter,
+                    // if it can generate hits.
+                    if(maxDiagonalDelta != 0 && bucket.size() > 1) {
+                        allLowHashes[orientedReadIdInt0].push_back(
+                            {hash, lowHashOrdinals[orientedReadIdInt0][i]});
+                    }
                     for(const BucketEntry& bucketEntry: bucket) {
                         if(bucketEntry.hashHighBits != hashHighBits) {
                             continue;   // Collision.
@@ -370,32 +850,87 @@ void LowHash::pass3ThreadFunction(size_t threadId)
                             continue;
                         }
 
-                        // Add it to our work area.
+                        // Add it to the candidate table for readId0.
                         const bool isSameStrand = orientedReadId1.getStrand() == strand0;
-                        newCandidates.push_back(Candidate(readId1, isSameStrand? 0 : 1));
+                        addCandidate(readId0, readId1, isSameStrand? 0 : 1, threadId);
                     }
                 }
             }
+        }
+    }
+}
+
+
+
+// Sampling runs: store the low hashes of the sampled reads
+// for the current iteration, sorted by bucket id.
+void LowHash::createSampledBuckets()
+{
+    vector< pair<uint64_t, BucketEntry> > entries;
+    const ReadId readCount = ReadId(candidates.size());
+    for(ReadId readId=0; readId<readCount; readId+=ReadId(readSampleStride)) {
+        for(Strand strand=0; strand<2; strand++) {
+            const OrientedReadId orientedReadId(readId, strand);
+            for(const uint64_t hash: lowHashes[orientedReadId.getValue()]) {
+                entries.push_back(make_pair(hash & mask, BucketEntry(orientedReadId, hash)));
+            }
+        }
+    }
+    sort(entries.begin(), entries.end(),
+        [](const pair<uint64_t, BucketEntry>& x, const pair<uint64_t, BucketEntry>& y)
+        {
+            return x.first < y.first;
+        });
+
+    sampledBuckets.clear();
+    sampledBucketEntries.clear();
+    for(uint64_t i=0; i<entries.size(); i++) {
+        const uint64_t bucketId = entries[i].first;
+        if(sampledBuckets.empty() || sampledBuckets.back().bucketId != bucketId) {
+            sampledBuckets.push_back({bucketId, i, i, 0});
+        }
+        sampledBucketEntries.push_back(entries[i].second);
+        ++sampledBuckets.back().end;
+    }
+}
 
-            // Sort the candidates found during this iteration.
-            sort(newCandidates.begin(), newCandidates.end());
 
-            // Merge the contents of the work area
-            // with the candidates previously stored.
-            vector<Candidate>& storedCandidates = candidates[readId0];
-            mergedCandidates.clear();
-            merge(storedCandidates, newCandidates, mergedCandidates);
 
-            // Store the merged candidates in place of the old ones.
-            storedCandidates.resize(mergedCandidates.size());
-            copy(mergedCandidates.begin(), mergedCandidates.end(), storedCandidates.begin());
+// Sampling runs: find a bucket that contains low hashes of sampled reads.
+// Returns 0 if there is no such bucket.
+LowHash::SampledBucket* LowHash::findSampledBucket(uint64_t bucketId)
+{
+    const auto it = lower_bound(sampledBuckets.begin(), sampledBuckets.end(), bucketId,
+        [](const SampledBucket& bucket, uint64_t bucketId)
+        {
+            return bucket.bucketId < bucketId;
+        });
+    if(it == sampledBuckets.end() || it->bucketId != bucketId) {
+        return 0;
+    }
+    return &*it;
+}
+
+
+
+// Sampling runs: count the low hashes of all reads
+// that fall in each of the sampled buckets.
+void LowHash::countSampledBucketsThreadFunction(size_t threadId)
+{
 
-            // Update thread statistics.
-            thisThreadStatistics.total += storedCandidates.size();
-            thisThreadStatistics.capacity += storedCandidates.capacity();
-            for(const Candidate& candidate: storedCandidates) {
-                if(candidate.frequency >= minFrequency) {
-                    ++thisThreadStatistics.highFrequency;
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over oriented reads assigned to this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            for(Strand strand=0; strand<2; strand++) {
+                const OrientedReadId orientedReadId(readId, strand);
+                for(const uint64_t hash: lowHashes[orientedReadId.getValue()]) {
+                    SampledBucket* bucket = findSampledBucket(hash & mask);
+                    if(bucket) {
+                        __sync_fetch_and_add(&bucket->size, 1ULL);
+                    }
                 }
             }
         }
@@ -404,93 +939,737 @@ void LowHash::pass3ThreadFunction(size_t threadId)
 
 
 
-// Merge two sorted vectors of candidates into a third one.
-// The input vectors can be sorted but can have duplicates.
-// During merging, when two candidates with the same readId1
-// and strand are found, they are combined, adding up their frequency.
-// This is used by pass4ThreadFunction.
-void LowHash::merge(
-    const vector<LowHash::Candidate>& x0,
-    const vector<LowHash::Candidate>& x1,
-    vector<LowHash::Candidate>& y
-    )
+// Sampling runs: update the histogram of bucket sizes
+// seen by the low hashes of the sampled reads.
+void LowHash::updateSampledBucketSizeHistogram()
 {
-    using Iterator = vector<LowHash::Candidate>::const_iterator;
-    Iterator begin0 = x0.begin();
-    Iterator begin1 = x1.begin();
-    Iterator end0 = x0.end();
-    Iterator end1 = x1.end();
+    for(const SampledBucket& bucket: sampledBuckets) {
+        if(bucket.size >= bucketSizeHistogram.size()) {
+            bucketSizeHistogram.resize(bucket.size + 1, 0);
+        }
+        bucketSizeHistogram[bucket.size] += bucket.end - bucket.begin;
+    }
+}
 
 
 
-    // Merge loop..
-    // At each step, we find the lowest of the two candidates
-    // currently pointed by the two iterators (ties allowed and are ok).
-    // If the merged vector is not empty and ends with an entry that compares equal,
-    // increment its frequency. Otherwise, just create a new entry in the merged vector.
-    Iterator it0 = begin0;
-    Iterator it1 = begin1;
-    while(true) {
+// Sampling runs: look up the low hashes of all oriented reads
+// in the sampled buckets to find the candidates of the sampled reads.
+// This is the equivalent of pass 4 for sampling runs,
+// with the roles of the two reads reversed.
+void LowHash::findSampledCandidatesThreadFunction(size_t threadId)
+{
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over reads assigned to this batch.
+        for(ReadId readId1=ReadId(begin); readId1!=ReadId(end); readId1++) {
+
+            // Loop over two strands.
+            for(Strand strand1=0; strand1<2; strand1++) {
+                const OrientedReadId orientedReadId1(readId1, strand1);
+                const OrientedReadId::Int orientedReadIdInt1 = orientedReadId1.getValue();
+
+                // Loop over the low hashes for this oriented read.
+                const vector<uint64_t>& orientedReadLowHashes = lowHashes[orientedReadIdInt1];
+                for(uint64_t i=0; i<orientedReadLowHashes.size(); i++) {
+                    const uint64_t hash = orientedReadLowHashes[i];
+                    const uint32_t hashHighBits = uint32_t(hash >> 32);
+
+                    const SampledBucket* bucket = findSampledBucket(hash & mask);
+                    if(!bucket) {
+                        continue;   // No sampled read in this bucket.
+                    }
+                    if(bucket->size > maxBucketSize) {
+                        continue;   // The bucket is too big. Skip it.
+                    }
 
-        // If we reached the end of x0, process the remaining portion of x1,
-        // then exit the merge loop.
-        if(it0 == end0) {
-            for(; it1!=end1; ++it1) {
-                if(!y.empty() && y.back() == *it1) {
-                    ++y.back().frequency = uint16_t(y.back().frequency + it1->frequency);
-                } else {
-                    y.push_back(*it1);
+                    // Keep it for the diagonal consistency filter,
+                    // if it can generate hits.
+                    if(maxDiagonalDelta != 0 && bucket->size > 1) {
+                        allLowHashes[orientedReadIdInt1].push_back(
+                            {hash, lowHashOrdinals[orientedReadIdInt1][i]});
+                    }
+
+                    // Loop over the sampled oriented reads in this bucket.
+                    for(uint64_t j=bucket->begin; j!=bucket->end; j++) {
+                        const BucketEntry& bucketEntry = sampledBucketEntries[j];
+                        if(bucketEntry.hashHighBits != hashHighBits) {
+                            continue;   // Collision.
+                        }
+                        const OrientedReadId orientedReadId0 = bucketEntry.orientedReadId;
+                        const ReadId readId0 = orientedReadId0.getReadId();
+                        if(readId0 == readId1) {
+                            continue;
+                        }
+
+                        // Add it to the candidate table for the sampled read.
+                        const bool isSameStrand = orientedReadId0.getStrand() == strand1;
+                        std::lock_guard<std::mutex> lock(sampledReadMutexes[readId0 / readSampleStride]);
+                        addCandidate(readId0, readId1, isSameStrand? 0 : 1, threadId);
+                    }
                 }
             }
+        }
+    }
+}
+
+
+
+// Find a candidate in the table of readId0, or insert
+// it with frequency 0 if not present, and increment its frequency.
+void LowHash::addCandidate(
+    ReadId readId0,
+    ReadId readId1,
+    Strand strand,
+    size_t threadId)
+{
+    CandidateTable& table = candidates[readId0];
+    ThreadStatistics& thisThreadStatistics = threadStatistics[threadId];
+
+    // If the table is full, move it to a new location with twice the capacity.
+    if(4 * (uint64_t(table.size) + 1ULL) > 3 * uint64_t(table.capacity)) {
+        const uint32_t newCapacity = (table.capacity == 0) ? 8 : 2 * table.capacity;
+        Candidate* newSlots = arenas[threadId].allocate(newCapacity);
+        const uint64_t newMask = newCapacity - 1;
+        for(uint32_t i=0; i<table.capacity; i++) {
+            const Candidate& candidate = table.slots[i];
+            if(candidate.frequency == 0) {
+                continue;
+            }
+            uint64_t j = hashCandidate(candidate.readId1, candidate.strand) & newMask;
+            while(newSlots[j].frequency != 0) {
+                j = (j + 1) & newMask;
+            }
+            newSlots[j] = candidate;
+        }
+        thisThreadStatistics.capacity += newCapacity - table.capacity;
+        if(table.capacity != 0) {
+            arenas[threadId].deallocate(table.slots, table.capacity);
+        }
+        table.slots = newSlots;
+        table.capacity = newCapacity;
+    }
+
+    // Look for this candidate, using linear probing.
+    const uint64_t tableMask = table.capacity - 1;
+    uint64_t j = hashCandidate(readId1, strand) & tableMask;
+    while(true) {
+        Candidate& candidate = table.slots[j];
+        if(candidate.frequency == 0) {
+            candidate = Candidate(readId1, strand);
+            ++table.size;
+            ++thisThreadStatistics.total;
             break;
         }
+        if(candidate.readId1 == readId1 && candidate.strand == strand) {
+            if(candidate.frequency < std::numeric_limits<uint16_t>::max()) {
+                ++candidate.frequency;
+            }
+            break;
+        }
+        j = (j + 1) & tableMask;
+    }
+    if(table.slots[j].frequency == max(minFrequency, size_t(1))) {
+        ++thisThreadStatistics.highFrequency;
+    }
+}
+
+
+
+// Allocate zero-initialized candidates from an arena.
+// n must be a power of 2.
+LowHash::Candidate* LowHash::Arena::allocate(uint64_t n)
+{
+    Candidate* slots = 0;
+
+    // If possible, reuse the slots of a table that was moved.
+    const uint64_t log2n = 63 - __builtin_clzl(n);
+    if(log2n < freeLists.size() && !freeLists[log2n].empty()) {
+        slots = freeLists[log2n].back();
+        freeLists[log2n].pop_back();
+    }
+
+    // Otherwise, allocate them at the end of the last chunk,
+    // creating a new chunk if necessary.
+    else {
+        if(chunks.empty() || chunkUsed + n > chunks.back()->size()) {
+            const string chunkName = name.empty() ? "" : (name + "-" + to_string(chunks.size()));
+            chunks.push_back(make_shared< MemoryMapped::Vector<Candidate> >());
+            chunks.back()->createNew(chunkName, pageSize, max(n, uint64_t(arenaChunkSize)));
+            chunkUsed = 0;
+        }
+        slots = chunks.back()->begin() + chunkUsed;
+        chunkUsed += n;
+    }
+
+    for(uint64_t i=0; i<n; i++) {
+        slots[i].frequency = 0;
+    }
+    return slots;
+}
+
+
+
+// Return to an arena the n slots of a table that was moved.
+// They are not necessarily slots that were allocated from this arena,
+// because the table of a given readId0 can be processed
+// by different threads at different iterations.
+// This is not a problem because all arenas are freed together.
+void LowHash::Arena::deallocate(Candidate* slots, uint64_t n)
+{
+    const uint64_t log2n = 63 - __builtin_clzl(n);
+    if(freeLists.size() <= log2n) {
+        freeLists.resize(log2n + 1);
+    }
+    freeLists[log2n].push_back(slots);
+}
+
+
+
+// Free all the memory of an arena.
+void LowHash::Arena::remove()
+{
+    for(const auto& chunk: chunks) {
+        if(chunk->isOpen) {
+            chunk->remove();
+        }
+    }
+    chunks.clear();
+    chunks.shrink_to_fit();
+    chunkUsed = 0;
+    freeLists.clear();
+    freeLists.shrink_to_fit();
+}
+
+
+
+// Count the candidates with sufficient frequency for each readId0.
+void LowHash::storeCandidatesPass1(size_t threadId)
+{
+    vector<int64_t> diagonals;
+    vector<Candidate> readCandidates;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId0=ReadId(begin); readId0!=ReadId(end); readId0++) {
 
-        // If we reached the end of x1, process the remaining portion of x0,
-        // then exit the merge loop.
-        if(it1 == end1) {
-            for(; it0!=end0; ++it0) {
-                if(!y.empty() && y.back() == *it0) {
-                    ++y.back().frequency = uint16_t(y.back().frequency + it0->frequency);
-                } else {
-                    y.push_back(*it0);
+            // If using more than one bucket pass, merge the spilled candidates.
+            if(bucketPassCount > 1) {
+                mergeSpilledCandidates(readId0, readCandidates);
+                uint64_t n = 0;
+                for(const Candidate& candidate: readCandidates) {
+                    if(candidate.frequency < max(minFrequency, size_t(1))) {
+                        continue;
+                    }
+                    if(maxDiagonalDelta != 0 &&
+                        countDiagonalConsistentHits(readId0, candidate.readId1, candidate.strand, diagonals)
+                        < minFrequency) {
+                        discardSpilledCandidate(readId0, candidate);
+                        ++threadStatistics[threadId].diagonalFilterDiscarded;
+                        continue;
+                    }
+                    ++n;
                 }
+                candidateAlignmentsOffset[readId0] = n;
+                continue;
             }
-            break;
+
+            const CandidateTable& table = candidates[readId0];
+            uint64_t n = 0;
+            for(uint32_t i=0; i<table.capacity; i++) {
+                Candidate& candidate = table.slots[i];
+                if(candidate.frequency >= max(minFrequency, size_t(1))) {
+
+                    // If using the diagonal consistency filter, discard
+                    // the candidate by setting its frequency to zero.
+                    // The table is no longer used for lookups, so this is safe.
+                    if(maxDiagonalDelta != 0 &&
+                        countDiagonalConsistentHits(readId0, candidate.readId1, candidate.strand, diagonals)
+                        < minFrequency) {
+                        candidate.frequency = 0;
+                        ++threadStatistics[threadId].diagonalFilterDiscarded;
+                        continue;
+                    }
+                    ++n;
+                }
+            }
+            candidateAlignmentsOffset[readId0] = n;
         }
+    }
+}
 
-        // If we get here, neither iterator is at its end.
-        // Both iterators can be safely dereferenced.
-        CZI_ASSERT(it0 != end0);
-        CZI_ASSERT(it1 != end1);
 
-        // If the current x1 entry is not less than the current x0 entry,
-        // process the current x0 entry.
-        if(!(*it1 < *it0)) {
-            if(!y.empty() && y.back() == *it0) {
-                y.back().frequency  = uint16_t(y.back().frequency + it0->frequency);
+
+// Store the candidates with sufficient frequency for each readId0,
+// sorted by readId1 and strand.
+void LowHash::storeCandidatesPass2(size_t threadId)
+{
+    vector<Candidate> readCandidates;
+    vector<OrientedReadPair> queueBatch;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId0=ReadId(begin); readId0!=ReadId(end); readId0++) {
+
+            // Gather the candidates with sufficient frequency,
+            // sorted by readId1 and strand.
+            if(bucketPassCount > 1) {
+                mergeSpilledCandidates(readId0, readCandidates);
+                uint64_t n = 0;
+                for(const Candidate& candidate: readCandidates) {
+                    if(candidate.frequency >= max(minFrequency, size_t(1))) {
+                        readCandidates[n++] = candidate;
+                    }
+                }
+                readCandidates.resize(n);
             } else {
-                y.push_back(*it0);
+                const CandidateTable& table = candidates[readId0];
+                readCandidates.clear();
+                for(uint32_t i=0; i<table.capacity; i++) {
+                    const Candidate& candidate = table.slots[i];
+                    if(candidate.frequency >= max(minFrequency, size_t(1))) {
+                        readCandidates.push_back(candidate);
+                    }
+                }
+                sort(readCandidates.begin(), readCandidates.end());
             }
-            ++it0;
+
+            // If using a queue, add them to the batch for this thread,
+            // and send the batch when it is large enough.
+            // The table of readId0 is no longer needed.
+            if(candidateQueue) {
+                for(const Candidate& candidate: readCandidates) {
+                    CZI_ASSERT(readId0 < candidate.readId1);
+                    queueBatch.push_back(OrientedReadPair(readId0, candidate.readId1, candidate.strand==0));
+                }
+                if(bucketPassCount == 1) {
+                    releaseCandidateTable(readId0);
+                }
+                if(queueBatch.size() >= queueBatchSize) {
+                    candidateQueue->push(queueBatch);
+                }
+                continue;
+            }
+
+            MemoryMapped::Vector<OrientedReadPair>& candidateAlignments = *candidateAlignmentsPointer;
+            OrientedReadPair* pointer = candidateAlignments.begin() + candidateAlignmentsOffset[readId0];
+            for(const Candidate& candidate: readCandidates) {
+                CZI_ASSERT(readId0 < candidate.readId1);
+                *pointer++ = OrientedReadPair(readId0, candidate.readId1, candidate.strand==0);
+            }
+            CZI_ASSERT(pointer == candidateAlignments.begin() + candidateAlignmentsOffset[readId0 + 1]);
         }
+    }
 
-        // If the current x0 entry is not less than the current x1 entry,
-        // process the current x1 entry.
-        else if(!(*it0 < *it1)) {
-            if(!y.empty() && y.back() == *it1) {
-                ++y.back().frequency = uint16_t(y.back().frequency + it1->frequency);
-            } else {
-                y.push_back(*it1);
+    // Send the last, partial batch.
+    if(candidateQueue && !queueBatch.empty()) {
+        candidateQueue->push(queueBatch);
+    }
+}
+
+
+
+// Before sending the candidates to a queue, count the tables
+// contained in each arena chunk, so each chunk can be removed
+// as soon as the candidates of all of its tables have been sent.
+// The slots of tables that were moved are on the free lists
+// and are not counted.
+void LowHash::prepareArenaChunkRelease()
+{
+    arenaChunks.clear();
+    for(Arena& arena: arenas) {
+        for(const auto& chunk: arena.chunks) {
+            ArenaChunkInfo info;
+            info.begin = chunk->begin();
+            info.chunk = chunk.get();
+            info.tableCount = 0;
+            arenaChunks.push_back(info);
+        }
+        arena.freeLists.clear();
+        arena.freeLists.shrink_to_fit();
+    }
+    sort(arenaChunks.begin(), arenaChunks.end());
+
+    for(const CandidateTable& table: candidates) {
+        if(table.slots) {
+            ++findArenaChunk(table.slots).tableCount;
+        }
+    }
+
+    // Remove the chunks that contain no tables.
+    for(ArenaChunkInfo& info: arenaChunks) {
+        if(info.tableCount == 0) {
+            info.chunk->remove();
+        }
+    }
+}
+
+
+
+// Find the arena chunk that contains the given slots.
+LowHash::ArenaChunkInfo& LowHash::findArenaChunk(const Candidate* slots)
+{
+    ArenaChunkInfo key;
+    key.begin = slots;
+    auto it = std::upper_bound(arenaChunks.begin(), arenaChunks.end(), key);
+    CZI_ASSERT(it != arenaChunks.begin());
+    --it;
+    CZI_ASSERT(slots < it->chunk->end());
+    return *it;
+}
+
+
+
+// Called after the candidates of readId0 have been gathered
+// for sending to the queue. If this was the last table
+// in its arena chunk, remove the chunk.
+void LowHash::releaseCandidateTable(ReadId readId0)
+{
+    CandidateTable& table = candidates[readId0];
+    if(table.slots) {
+        ArenaChunkInfo& info = findArenaChunk(table.slots);
+        table = CandidateTable();
+        if(__sync_sub_and_fetch(&info.tableCount, 1ULL) == 0ULL) {
+            info.chunk->remove();
+        }
+    }
+}
+
+
+
+// Write the candidates found during the current bucket pass
+// to a new MemoryMapped::VectorOfVectors, then free the candidate tables.
+// If using the diagonal consistency filter, do the same
+// for the low hashes in allLowHashes.
+void LowHash::spillCandidates()
+{
+    const ReadId readCount = ReadId(candidates.size());
+    const size_t batchSize = 10000;
+
+    const string name = largeDataFileNamePrefix.empty() ? "" :
+        (largeDataFileNamePrefix + "tmp-LowHash-Candidates-" + to_string(bucketPass));
+    spilledCandidates.push_back(make_shared< MemoryMapped::VectorOfVectors<Candidate, uint64_t> >());
+    spilledCandidates.back()->createNew(name, largeDataPageSize);
+    if(maxDiagonalDelta != 0) {
+        const string lowHashesName = largeDataFileNamePrefix.empty() ? "" :
+            (largeDataFileNamePrefix + "tmp-LowHash-LowHashes-" + to_string(bucketPass));
+        spilledLowHashes.push_back(
+            make_shared< MemoryMapped::VectorOfVectors<LowHashWithOrdinal, uint64_t> >());
+        spilledLowHashes.back()->createNew(lowHashesName, largeDataPageSize);
+        spilledLowHashes.back()->beginPass1(2 * readCount);
+    }
+
+    spilledCandidates.back()->beginPass1(readCount);
+    setupLoadBalancing(readCount, batchSize);
+    runThreads(&LowHash::spillCandidatesPass1, threadCount);
+    spilledCandidates.back()->beginPass2();
+    if(maxDiagonalDelta != 0) {
+        spilledLowHashes.back()->beginPass2();
+    }
+    setupLoadBalancing(readCount, batchSize);
+    runThreads(&LowHash::spillCandidatesPass2, threadCount);
+    spilledCandidates.back()->endPass2(false);
+    cout << "Bucket pass " << bucketPass << " stored " <<
+        spilledCandidates.back()->totalSize() << " candidates";
+    if(maxDiagonalDelta != 0) {
+        spilledLowHashes.back()->endPass2(false);
+        cout << " and " << spilledLowHashes.back()->totalSize() << " low hashes";
+    }
+    cout << "." << endl;
+
+    // Free the candidate tables.
+    // The statistics are not reset, so they accumulate over all passes.
+    fill(candidates.begin(), candidates.end(), CandidateTable());
+    for(Arena& arena: arenas) {
+        arena.remove();
+    }
+}
+
+
+
+void LowHash::spillCandidatesPass1(size_t threadId)
+{
+    MemoryMapped::VectorOfVectors<Candidate, uint64_t>& spilled = *spilledCandidates.back();
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId0=ReadId(begin); readId0!=ReadId(end); readId0++) {
+            spilled.incrementCount(readId0, candidates[readId0].size);
+            if(maxDiagonalDelta != 0) {
+                for(Strand strand=0; strand<2; strand++) {
+                    const OrientedReadId::Int orientedReadIdInt = OrientedReadId(readId0, strand).getValue();
+                    spilledLowHashes.back()->incrementCount(
+                        orientedReadIdInt, allLowHashes[orientedReadIdInt].size());
+                }
+            }
+        }
+    }
+}
+
+
+
+void LowHash::spillCandidatesPass2(size_t threadId)
+{
+    MemoryMapped::VectorOfVectors<Candidate, uint64_t>& spilled = *spilledCandidates.back();
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId0=ReadId(begin); readId0!=ReadId(end); readId0++) {
+            const CandidateTable& table = candidates[readId0];
+            Candidate* pointer = spilled.begin(readId0);
+            for(uint32_t i=0; i<table.capacity; i++) {
+                const Candidate& candidate = table.slots[i];
+                if(candidate.frequency != 0) {
+                    *pointer++ = candidate;
+                }
+            }
+            CZI_ASSERT(pointer == spilled.end(readId0));
+            sort(spilled.begin(readId0), spilled.end(readId0));
+
+            // Also spill the low hashes of the two oriented reads,
+            // sorted by hash, and free them.
+            if(maxDiagonalDelta != 0) {
+                MemoryMapped::VectorOfVectors<LowHashWithOrdinal, uint64_t>& spilledOrientedReadLowHashes =
+                    *spilledLowHashes.back();
+                for(Strand strand=0; strand<2; strand++) {
+                    const OrientedReadId::Int orientedReadIdInt = OrientedReadId(readId0, strand).getValue();
+                    vector<LowHashWithOrdinal>& v = allLowHashes[orientedReadIdInt];
+                    sort(v.begin(), v.end());
+                    copy(v.begin(), v.end(), spilledOrientedReadLowHashes.begin(orientedReadIdInt));
+                    v.clear();
+                    v.shrink_to_fit();
+                }
+            }
+        }
+    }
+}
+
+
+
+// Merge the candidates of readId0 spilled by all bucket passes,
+// adding up their frequencies.
+// On return, readCandidates contains the merged candidates
+// sorted by readId1 and strand.
+void LowHash::mergeSpilledCandidates(
+    ReadId readId0,
+    vector<Candidate>& readCandidates) const
+{
+    readCandidates.clear();
+    for(const auto& spilled: spilledCandidates) {
+        for(const Candidate& candidate: (*spilled)[readId0]) {
+            if(candidate.frequency != 0) {
+                readCandidates.push_back(candidate);
             }
-            ++it1;
         }
+    }
+    sort(readCandidates.begin(), readCandidates.end());
+
+    // Combine candidates for the same readId1 and strand.
+    auto output = readCandidates.begin();
+    for(auto it=readCandidates.begin(); it!=readCandidates.end(); ++it) {
+        if(output != readCandidates.begin() && *(output - 1) == *it) {
+            Candidate& candidate = *(output - 1);
+            candidate.frequency = uint16_t(min(
+                uint64_t(candidate.frequency) + uint64_t(it->frequency),
+                uint64_t(std::numeric_limits<uint16_t>::max())));
+        } else {
+            *output++ = *it;
+        }
+    }
+    readCandidates.resize(output - readCandidates.begin());
+}
 
-        // The above covers all cases.
-        else {
-            CZI_ASSERT(0);
+
+
+// Discard a merged candidate by setting to zero
+// the frequency of all of its spilled entries,
+// so mergeSpilledCandidates will no longer return it.
+void LowHash::discardSpilledCandidate(
+    ReadId readId0,
+    const Candidate& candidate)
+{
+    for(const auto& spilled: spilledCandidates) {
+        Candidate* begin = spilled->begin(readId0);
+        Candidate* end = spilled->end(readId0);
+        Candidate* it = std::lower_bound(begin, end, candidate);
+        if(it != end && *it == candidate) {
+            it->frequency = 0;
         }
+    }
+}
+
+
 
+// Sort the low hashes from all iterations of each oriented read,
+// for use by the diagonal consistency filter.
+void LowHash::sortAllLowHashesThreadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            vector<LowHashWithOrdinal>& v = allLowHashes[i];
+            sort(v.begin(), v.end());
+        }
     }
 }
 
 
+
+// Return the largest number of low hashes shared by readId0 and readId1
+// with diagonals within maxDiagonalDelta of each other.
+// Diagonals are computed for readId0 on strand 0. Low hashes
+// shared with readId0 on strand 1 have their diagonals converted accordingly.
+uint64_t LowHash::countDiagonalConsistentHits(
+    ReadId readId0,
+    ReadId readId1,
+    Strand strand,                  // 0=same strand, 1=opposite strands.
+    vector<int64_t>& diagonals) const
+{
+    const int64_t markerCount0 = int64_t(getMarkerCount(OrientedReadId(readId0, 0).getValue()));
+    const int64_t markerCount1 = int64_t(getMarkerCount(OrientedReadId(readId1, 0).getValue()));
+
+    // Gather the diagonals of the shared low hashes.
+    // When using more than one bucket pass, this is done
+    // separately for the low hashes spilled by each pass.
+    diagonals.clear();
+    for(Strand strand0=0; strand0<2; strand0++) {
+        const OrientedReadId::Int orientedReadIdInt0 = OrientedReadId(readId0, strand0).getValue();
+        const OrientedReadId::Int orientedReadIdInt1 = OrientedReadId(readId1, strand0 ^ strand).getValue();
+        if(bucketPassCount == 1) {
+            const vector<LowHashWithOrdinal>& v0 = allLowHashes[orientedReadIdInt0];
+            const vector<LowHashWithOrdinal>& v1 = allLowHashes[orientedReadIdInt1];
+            gatherDiagonals(
+                v0.data(), v0.data() + v0.size(),
+                v1.data(), v1.data() + v1.size(),
+                strand0, markerCount0, markerCount1, diagonals);
+        } else {
+            for(const auto& spilled: spilledLowHashes) {
+                gatherDiagonals(
+                    spilled->begin(orientedReadIdInt0), spilled->end(orientedReadIdInt0),
+                    spilled->begin(orientedReadIdInt1), spilled->end(orientedReadIdInt1),
+                    strand0, markerCount0, markerCount1, diagonals);
+            }
+        }
+    }
+
+    // Find the largest number of diagonals in a window of width maxDiagonalDelta.
+    sort(diagonals.begin(), diagonals.end());
+    uint64_t bestCount = 0;
+    uint64_t windowBegin = 0;
+    for(uint64_t windowEnd=0; windowEnd<diagonals.size(); windowEnd++) {
+        while(diagonals[windowEnd] - diagonals[windowBegin] > int64_t(maxDiagonalDelta)) {
+            ++windowBegin;
+        }
+        bestCount = max(bestCount, windowEnd + 1 - windowBegin);
+    }
+    return bestCount;
+}
+
+
+
+// Add to the diagonals the hits between two ranges of low hashes
+// of oriented reads (readId0, strand0) and readId1, sorted by hash,
+// by joining the two ranges.
+void LowHash::gatherDiagonals(
+    const LowHashWithOrdinal* begin0, const LowHashWithOrdinal* end0,
+    const LowHashWithOrdinal* begin1, const LowHashWithOrdinal* end1,
+    Strand strand0, int64_t markerCount0, int64_t markerCount1,
+    vector<int64_t>& diagonals) const
+{
+    const LowHashWithOrdinal* it0 = begin0;
+    const LowHashWithOrdinal* it1 = begin1;
+    while(it0!=end0 && it1!=end1) {
+        if(it0->hash < it1->hash) {
+            ++it0;
+        } else if(it1->hash < it0->hash) {
+            ++it1;
+        } else {
+
+            // Find the streaks with this hash and add all pairs.
+            const uint64_t hash = it0->hash;
+            const LowHashWithOrdinal* streakEnd0 = it0;
+            while(streakEnd0!=end0 && streakEnd0->hash==hash) {
+                ++streakEnd0;
+            }
+            const LowHashWithOrdinal* streakEnd1 = it1;
+            while(streakEnd1!=end1 && streakEnd1->hash==hash) {
+                ++streakEnd1;
+            }
+            for(const LowHashWithOrdinal* jt0=it0; jt0!=streakEnd0; ++jt0) {
+                for(const LowHashWithOrdinal* jt1=it1; jt1!=streakEnd1; ++jt1) {
+                    const int64_t diagonal = int64_t(jt0->ordinal) - int64_t(jt1->ordinal);
+                    diagonals.push_back(strand0==0 ?
+                        diagonal : (markerCount0 - markerCount1) - diagonal);
+                }
+            }
+            it0 = streakEnd0;
+            it1 = streakEnd1;
+        }
+    }
+}
+
+
+
+// Compare the speed of the two ways to hash LowHash features,
+// and check that the rolling hash gives the same hash
+// for the same feature at different positions.
+void ChanZuckerberg::shasta::testLowHashFeatureHash()
+{
+    const uint64_t n = 10000000;
+    std::mt19937 randomSource(231);
+    std::uniform_int_distribution<uint64_t> kmerIdDistribution(0, (1ULL << 20) - 1ULL);
+    vector<KmerId> kmerIds(n);
+    for(KmerId& kmerId: kmerIds) {
+        kmerId = KmerId(kmerIdDistribution(randomSource));
+    }
+    const uint64_t hashThreshold =
+        uint64_t(0.01 * double(std::numeric_limits<uint64_t>::max()));
+
+    for(const size_t m: {2, 4, 8, 16}) {
+        const size_t featureCount = n - m + 1;
+
+        // MurmurHash64A.
+        const int featureByteCount = int(m * sizeof(KmerId));
+        uint64_t murmurLowCount = 0;
+        const auto t0 = steady_clock::now();
+        for(size_t j=0; j<featureCount; j++) {
+            if(MurmurHash64A(&kmerIds[j], featureByteCount, 0) < hashThreshold) {
+                ++murmurLowCount;
+            }
+        }
+        const auto t1 = steady_clock::now();
+
+        // Rolling hash.
+        const uint64_t seed = LowHash::rollingHashSeed(0);
+        uint64_t rollingLowCount = 0;
+        LowHash::RollingFeatureHash rollingHash(m);
+        for(size_t j=0; j<m; j++) {
+            rollingHash.add(kmerIds[j]);
+        }
+        for(size_t j=0; ; j++) {
+            if(rollingHash.get(seed) < hashThreshold) {
+                ++rollingLowCount;
+            }
+            if(j+1 == featureCount) {
+                break;
+            }
+            rollingHash.roll(kmerIds[j+m], kmerIds[j]);
+        }
+        const auto t2 = steady_clock::now();
+
+        // The rolling hash of the last feature must not depend
+        // on the features that preceded it.
+        LowHash::RollingFeatureHash lastFeatureHash(m);
+        for(size_t j=featureCount-1; j<n; j++) {
+            lastFeatureHash.add(kmerIds[j]);
+        }
+        CZI_ASSERT(lastFeatureHash.get(seed) == rollingHash.get(seed));
+
+        cout << "m = " << m << ": MurmurHash64A " <<
+            1.e9 * seconds(t1 - t0) / double(featureCount) << " ns/feature, " <<
+            "low hash fraction " << double(murmurLowCount) / double(featureCount) << "; " <<
+            "rolling hash " <<
+            1.e9 * seconds(t2 - t1) / double(featureCount) << " ns/feature, " <<
+            "low hash fraction " << double(rollingLowCount) / double(featureCount) << "." << endl;
+    }
+}
@@ -3,15 +3,24 @@
 
 // Shasta
 #include "Marker.hpp"
+#include "Markers.hpp"
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "MultitreadedObject.hpp"
 #include "OrientedReadPair.hpp"
+#include "OrientedReadPairQueue.hpp"
 #include "ReadId.hpp"
 
+// Standard library.
+#include "memory.hpp"
+#include <mutex>
+
 namespace ChanZuckerberg {
     namespace shasta {
         class LowHash;
         class ReadFlags;
+
+        // Compare the speed of the two ways to hash LowHash features.
+        void testLowHashFeatureHash();
     }
 }
 
@@ -32,15 +41,108 @@ public:
         size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for minHash.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
+        bool useRollingHash,            // Use RollingFeatureHash instead of MurmurHash64A.
+        size_t maxDiagonalDelta,        // If not zero, require hits on a consistent diagonal.
+        size_t bucketPassCountArgument, // If greater than 1, process buckets in this number of passes.
+        size_t readSampleStride,        // If not zero, only measure candidates for one read in this many.
         size_t threadCount,
         const MemoryMapped::Vector<KmerInfo>& kmerTable,
         const MemoryMapped::Vector<ReadFlags>& readFlags,
-        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>&,
+        const Markers&,
         MemoryMapped::Vector<OrientedReadPair>&,
+        OrientedReadPairQueue*,         // If not null, send the candidates here instead.
+        size_t queueThreadCount,        // Number of threads sending to the queue (0 = threadCount).
         const string& largeDataFileNamePrefix,
         size_t largeDataPageSize
 );
 
+
+
+    // Results of a sampling run, when readSampleStride is not zero.
+    // In a sampling run, only the reads with readId multiple
+    // of readSampleStride are stored in buckets, and only their
+    // candidates are found. The candidates are not stored
+    // in the candidate alignments.
+    // This can be used to predict the number of candidates
+    // that a complete run would generate.
+    // The average number of candidate pairs per read
+    // estimated from the sampled reads.
+    double sampledCandidatesPerRead = 0.;
+    // For each low hash of the sampled reads, the size
+    // its bucket would have in a complete run, summed over all iterations.
+    // That is, the number of low hashes of the sampled reads
+    // that fall in buckets of each size.
+    vector<uint64_t> bucketSizeHistogram;
+
+
+
+    // Rolling hash of the m k-mer ids of a feature.
+    // By default, the hash of a feature is computed with MurmurHash64A
+    // over its m k-mer ids, which costs O(m) per feature.
+    // This is a cyclic polynomial (Buzhash) hash instead:
+    // each k-mer id is hashed once, and moving to the next
+    // feature requires O(1) operations regardless of m.
+    // The state of the rolling hash does not depend on the seed,
+    // which only enters a final mixing step, so the hashes
+    // for several seeds can be obtained from the same state.
+    class RollingFeatureHash {
+    public:
+        RollingFeatureHash(size_t m) :
+            outShift(m % 64), h(0) {}
+
+        // Add a k-mer id to the feature.
+        // This is used for the first m k-mer ids.
+        void add(KmerId kmerIdIn)
+        {
+            h = rotate(h, 1) ^ hashKmerId(kmerIdIn);
+        }
+
+        // Add a k-mer id to the feature and remove the one
+        // that was added m k-mer ids earlier.
+        void roll(KmerId kmerIdIn, KmerId kmerIdOut)
+        {
+            h = rotate(h, 1) ^ hashKmerId(kmerIdIn) ^ rotate(hashKmerId(kmerIdOut), outShift);
+        }
+
+        // Return the hash of the current feature for a given seed.
+        uint64_t get(uint64_t seed) const
+        {
+            return mix(h ^ seed);
+        }
+
+    private:
+        uint64_t outShift;
+        uint64_t h;
+
+        static uint64_t rotate(uint64_t x, uint64_t shift)
+        {
+            return shift == 0 ? x : ((x << shift) | (x >> (64 - shift)));
+        }
+
+        // The finalizer of MurmurHash3, a bijection with good avalanche.
+        static uint64_t mix(uint64_t x)
+        {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            x *= 0xc4ceb9fe1a85ec53ULL;
+            x ^= x >> 33;
+            return x;
+        }
+        // Multiplication by an odd constant is enough here
+        // because of the final mixing step.
+        static uint64_t hashKmerId(KmerId kmerId)
+        {
+            return (uint64_t(kmerId) + 1ULL) * 0x9e3779b97f4a7c15ULL;
+        }
+    };
+
+    // The seed used at each LowHash iteration by RollingFeatureHash.
+    static uint64_t rollingHashSeed(size_t iteration)
+    {
+        return uint64_t(iteration + 1) * 0x9e3779b97f4a7c15ULL;
+    }
+
 private:
 
     // Store some of the arguments passed to the constructor.
@@ -48,10 +150,16 @@ private:
     double hashFraction;
     size_t maxBucketSize;           // The maximum size for a bucket to be used.
     size_t minFrequency;            // Minimum number of minHash hits for a pair to be considered a candidate.
+    bool useRollingHash;
+    size_t maxDiagonalDelta;
+    size_t bucketPassCount;
+    size_t readSampleStride;
     size_t threadCount;
     const MemoryMapped::Vector<KmerInfo>& kmerTable;
     const MemoryMapped::Vector<ReadFlags>& readFlags;
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
+    const Markers& markers;
+    OrientedReadPairQueue* candidateQueue;
+    size_t queueThreadCount;
     const string& largeDataFileNamePrefix;
     size_t largeDataPageSize;
 
@@ -59,12 +167,17 @@ private:
     // for all oriented reads.
     // Indexed by OrientedReadId.getValue().
     // This is used to speed up the computation of hash functions.
+    // It is not created when using more than one bucket pass,
+    // to reduce memory usage. In that case, getKmerIds
+    // extracts the k-mer ids from the markers when needed.
     MemoryMapped::VectorOfVectors<KmerId, uint64_t> kmerIds;
     void createKmerIds();
     void createKmerIds(size_t threadId);
+    const KmerId* getKmerIds(OrientedReadId::Int, vector<KmerId>& buffer) const;
+    uint64_t getMarkerCount(OrientedReadId::Int) const;
 
     // The current MinHash iteration.
-    // This is used to compute a different MurmurHash function
+    // This is used to compute a different hash function
     // at each iteration.
     size_t iteration;
 
@@ -74,6 +187,60 @@ private:
     vector< vector<uint64_t> > lowHashes;
     void computeLowHashes(size_t threadId);
 
+    // When using the rolling hash, the low hashes for all iterations
+    // are computed in a single roll over the features of each oriented read,
+    // at the beginning of each bucket pass, because the state of the
+    // rolling hash does not depend on the seed.
+    // For each oriented read, the low hashes of all iterations,
+    // with the ordinal of the first marker of their feature,
+    // grouped by iteration. The low hashes of iteration i are in positions
+    // [iterationBegin[i], iterationBegin[i+1]).
+    // Indexed by OrientedReadId::getValue().
+    class RollingLowHashes {
+    public:
+        vector<uint64_t> hashes;
+        vector<uint32_t> ordinals;
+        vector<uint32_t> iterationBegin;
+    };
+    vector<RollingLowHashes> rollingLowHashes;
+    size_t iterationCount;
+    void computeRollingLowHashes(size_t threadId);
+
+    // Diagonal consistency filter, used if maxDiagonalDelta is not zero.
+    // For each low hash we also store the ordinal of the first marker
+    // of its feature, and we keep, for each oriented read,
+    // the low hashes from all iterations that fell in buckets
+    // that were not too big, sorted by hash.
+    // At the end, a candidate pair is only kept if at least minFrequency
+    // of the low hashes it shares have diagonals (difference
+    // of ordinals in the two oriented reads) within maxDiagonalDelta
+    // of each other. This discards most pairs found because they share
+    // features from repeats at inconsistent offsets.
+    // When using more than one bucket pass, allLowHashes only holds
+    // the low hashes of the current pass, and is spilled
+    // together with the candidates (see spilledLowHashes below).
+    // Indexed by OrientedReadId::getValue().
+    vector< vector<uint32_t> > lowHashOrdinals;
+    class LowHashWithOrdinal {
+    public:
+        uint64_t hash;
+        uint32_t ordinal;
+        bool operator<(const LowHashWithOrdinal& that) const
+        {
+            return hash < that.hash;
+        }
+    };
+    vector< vector<LowHashWithOrdinal> > allLowHashes;
+    void sortAllLowHashesThreadFunction(size_t threadId);
+    uint64_t countDiagonalConsistentHits(
+        ReadId readId0, ReadId readId1, Strand strand,
+        vector<int64_t>& diagonals) const;
+    void gatherDiagonals(
+        const LowHashWithOrdinal* begin0, const LowHashWithOrdinal* end0,
+        const LowHashWithOrdinal* begin1, const LowHashWithOrdinal* end1,
+        Strand strand0, int64_t markerCount0, int64_t markerCount1,
+        vector<int64_t>& diagonals) const;
+
     // The mask used to compute to compute the bucket
     // corresponding to a hash value.
     uint64_t mask;
@@ -94,6 +261,96 @@ private:
     };
     MemoryMapped::VectorOfVectors<BucketEntry, uint64_t> buckets;
 
+    // The buckets are not filled directly, because that would require
+    // two random atomic memory accesses into the bucket table for each low hash.
+    // Instead, during pass 1 the low hashes are appended
+    // to one of partitionCount vectors, based on the high bits of the bucket id.
+    // Each partition covers a contiguous range of buckets.
+    // Then, in pass 2 and 3, each partition is processed by a single thread,
+    // which counts and stores its bucket entries without atomics,
+    // accessing a small portion of the bucket table.
+    // The number of partitions is at most maxPartitionCount,
+    // to keep the number of output streams of pass 1 small.
+    // The partitions are freed as soon as pass 3 has used them,
+    // so they never coexist with the candidate tables growing in pass 4.
+    class PartitionEntry {
+    public:
+        uint32_t bucketId;
+        BucketEntry bucketEntry;
+    };
+    static_assert(sizeof(PartitionEntry) == 12, "Unexpected size of LowHash::PartitionEntry.");
+    static const uint64_t maxPartitionCount = 1024;
+    uint64_t partitionShift;
+    uint64_t partitionCount;
+    // Indexed by partitionId.
+    vector< vector<PartitionEntry> > partitions;
+    vector<std::mutex> partitionMutexes;
+    void freePartitions();
+
+    // Each thread first stores the entries of each partition in a small,
+    // fixed size staging area, and appends them to the partition,
+    // under the partition mutex, when the staging area is full.
+    // The staging areas are allocated once and reused for all iterations.
+    // Indexed by [threadId][partitionId * partitionStagingSize + i].
+    static const uint64_t partitionStagingSize = 64;
+    class PartitionStaging {
+    public:
+        vector<PartitionEntry> entries;
+        vector<uint32_t> sizes;     // Indexed by partitionId.
+    };
+    vector<PartitionStaging> partitionStaging;
+    void addPartitionEntry(size_t threadId, uint64_t partitionId, const PartitionEntry&);
+    void flushPartitionStaging(size_t threadId, uint64_t partitionId);
+
+    // To reduce memory usage for large numbers of reads, the buckets
+    // can be processed in more than one bucket pass.
+    // Each pass runs all LowHash iterations, but only uses low hashes
+    // that fall in partitions [partitionBegin, partitionEnd).
+    // The low hashes are recomputed at each pass, but the buckets
+    // and the candidate tables only hold the entries for the current pass.
+    // The buckets are indexed by bucketId - passBucketBegin,
+    // so their table of contents only covers the buckets of the current pass.
+    // All per-pass data are freed at the end of each pass,
+    // and the candidates and the low hashes kept for the diagonal
+    // consistency filter are spilled (see spillCandidates).
+    size_t bucketPass;
+    uint64_t partitionBegin;
+    uint64_t partitionEnd;
+    uint64_t passBucketBegin;
+    void freePassData();
+
+    // In a sampling run, the buckets only contain the low hashes
+    // of the sampled reads, and they are stored compactly,
+    // sorted by bucket id, for the current iteration.
+    // The low hashes of all reads are then looked up in these buckets,
+    // first to count the size each bucket would have in a complete run,
+    // then to find the candidates of the sampled reads, using
+    // the low hashes of all reads. This way, the diagonal consistency filter
+    // and maxBucketSize work as in a complete run,
+    // without storing the low hashes of all reads in buckets.
+    // The candidate table of a sampled read stores
+    // all of its partners, regardless of their read id,
+    // and is protected by a mutex because it can be
+    // updated by more than one thread.
+    class SampledBucket {
+    public:
+        uint64_t bucketId;
+        // The range of sampledBucketEntries for this bucket.
+        uint64_t begin;
+        uint64_t end;
+        // The number of low hashes of all reads in this bucket.
+        uint64_t size;
+    };
+    vector<SampledBucket> sampledBuckets;
+    vector<BucketEntry> sampledBucketEntries;
+    // Indexed by readId / readSampleStride.
+    vector<std::mutex> sampledReadMutexes;
+    void createSampledBuckets();
+    SampledBucket* findSampledBucket(uint64_t bucketId);
+    void updateSampledBucketSizeHistogram();
+    void countSampledBucketsThreadFunction(size_t threadId);
+    void findSampledCandidatesThreadFunction(size_t threadId);
+
 
 
     // Class used to store candidate pairs.
@@ -125,24 +382,115 @@ private:
 
 
 
-    // Merge two sorted vectors of candidates into a third one.
-    // The input vectors can be sorted but can have duplicates.
-    // During merging, when two candidates with the same readId1
-    // and strand are found, they are combined, adding up their frequency.
-    // This is used by pass4ThreadFunction.
-    static void merge(
-        const vector<Candidate>&,
-        const vector<Candidate>&,
-        vector<Candidate>&
-        );
+    // The alignment candidates for each read are stored in an
+    // open addressing hash table, keyed by readId1 and strand.
+    // An empty slot has frequency 0.
+    // Indexed by readId0, the read id of the lower numbered read in the pair.
+    // We only store pairs with readId1>readId0.
+    // Each table is only accessed by the thread processing its readId0,
+    // so no synchronization is needed.
+    // The capacity is a power of 2, and the table is moved
+    // to a new location with twice the capacity when
+    // its load factor would exceed 3/4.
+    class CandidateTable {
+    public:
+        Candidate* slots = 0;
+        uint32_t capacity = 0;
+        uint32_t size = 0;
+    };
+    vector<CandidateTable> candidates;
+
+    // Find a candidate in the table of readId0, or insert
+    // it with frequency 0 if not present, and increment its frequency.
+    void addCandidate(ReadId readId0, ReadId readId1, Strand strand, size_t threadId);
+    static uint64_t hashCandidate(ReadId readId1, Strand strand)
+    {
+        uint64_t x = (uint64_t(readId1) << 1ULL) | uint64_t(strand);
+        x *= 0x9e3779b97f4a7c15ULL;
+        return x ^ (x >> 32ULL);
+    }
 
+    // The candidate tables are allocated from per-thread arenas,
+    // each consisting of a sequence of fixed size chunks
+    // in MemoryMapped::Vector objects named using largeDataFileNamePrefix,
+    // so they can use huge pages or be backed by disk.
+    // When a table is moved, its old slots are added to the free list
+    // for their capacity (a power of 2) and reused for the next
+    // table of the same capacity allocated by the same thread.
+    // All arenas are freed at the end of each bucket pass
+    // and when LowHash completes.
+    static const uint64_t arenaChunkSize = 1ULL << 20ULL;
+    class Arena {
+    public:
+        string name;
+        size_t pageSize;
+        vector< shared_ptr< MemoryMapped::Vector<Candidate> > > chunks;
+        uint64_t chunkUsed = 0;
 
+        // Indexed by the base 2 log of the capacity.
+        vector< vector<Candidate*> > freeLists;
 
-    // The alignment candidates for each read.
-    // Indexed by readId0, the read id of the lower numbered read in the pair.
-    // We only store pairs with readId1>readId0.
-    // For each readId0, this is kept sorted.
-    vector< vector<Candidate> > candidates;
+        Candidate* allocate(uint64_t n);
+        void deallocate(Candidate*, uint64_t n);
+        void remove();
+    };
+    vector<Arena> arenas;
+
+    // When sending the candidates to a queue with a single bucket pass,
+    // each arena chunk is removed as soon as the candidates
+    // of all the tables it contains have been sent.
+    // This keeps the candidate tables from staying in memory
+    // while the alignments are computed.
+    class ArenaChunkInfo {
+    public:
+        const Candidate* begin;
+        MemoryMapped::Vector<Candidate>* chunk;
+        uint64_t tableCount;    // Number of tables not yet sent.
+        bool operator<(const ArenaChunkInfo& that) const
+        {
+            return begin < that.begin;
+        }
+    };
+    vector<ArenaChunkInfo> arenaChunks;     // Sorted by begin.
+    void prepareArenaChunkRelease();
+    ArenaChunkInfo& findArenaChunk(const Candidate*);
+    void releaseCandidateTable(ReadId readId0);
+
+    // When using more than one bucket pass, at the end of each pass
+    // the candidates are written, sorted by readId1 and strand,
+    // to a MemoryMapped::VectorOfVectors indexed by readId0,
+    // and the candidate tables and arenas are freed.
+    // If largeDataFileNamePrefix points to a disk-backed file system
+    // the spilled candidates can be paged out, so only the candidates
+    // of one pass need to fit in memory.
+    // At the end, the spilled candidates of each readId0 are merged,
+    // adding up their frequencies.
+    // If using the diagonal consistency filter, the low hashes
+    // in allLowHashes are also spilled at the end of each pass,
+    // sorted by hash, to a MemoryMapped::VectorOfVectors indexed
+    // by OrientedReadId::getValue(). Each pass uses a separate
+    // range of buckets, so a hash only occurs in one pass,
+    // and the diagonals of the hits of a pair of oriented reads
+    // can be gathered one pass at a time.
+    vector< shared_ptr< MemoryMapped::VectorOfVectors<Candidate, uint64_t> > > spilledCandidates;
+    vector< shared_ptr< MemoryMapped::VectorOfVectors<LowHashWithOrdinal, uint64_t> > > spilledLowHashes;
+    void spillCandidates();
+    void spillCandidatesPass1(size_t threadId);
+    void spillCandidatesPass2(size_t threadId);
+    void mergeSpilledCandidates(ReadId readId0, vector<Candidate>&) const;
+    void discardSpilledCandidate(ReadId readId0, const Candidate&);
+
+    // Store the candidates found in candidateAlignments,
+    // sorted by readId0, then readId1 and strand.
+    // This is done in parallel, in two passes.
+    vector<uint64_t> candidateAlignmentsOffset;
+    void storeCandidatesPass1(size_t threadId);
+    void storeCandidatesPass2(size_t threadId);
+    MemoryMapped::Vector<OrientedReadPair>* candidateAlignmentsPointer;
+
+    // When sending the candidates to a queue, each thread
+    // sends them in batches of at least this size.
+    static const uint64_t queueBatchSize = 1000;
 
 
 
@@ -152,6 +500,7 @@ private:
         uint64_t highFrequency;
         uint64_t total;
         uint64_t capacity;
+        uint64_t diagonalFilterDiscarded;
         ThreadStatistics()
         {
             clear();
@@ -161,6 +510,7 @@ private:
             highFrequency = 0;
             total = 0;
             capacity = 0;
+            diagonalFilterDiscarded = 0;
         }
 
     };
@@ -171,15 +521,18 @@ private:
     // Thread functions.
 
     // Pass1: compute the low hashes for each oriented read
-    // and prepare the buckets for filling.
+    // and store them in the partitions.
     void pass1ThreadFunction(size_t threadId);
 
-    // Pass 2: fill the buckets.
+    // Pass 2: count the entries of each bucket, one partition at a time.
     void pass2ThreadFunction(size_t threadId);
 
-    // Pass 3: inspect the buckets to find candidates.
+    // Pass 3: fill the buckets, one partition at a time.
     void pass3ThreadFunction(size_t threadId);
 
+    // Pass 4: inspect the buckets to find candidates.
+    void pass4ThreadFunction(size_t threadId);
+
 };
 
 #endif
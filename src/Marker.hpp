@@ -16,6 +16,10 @@ Because of the way markers are selected, the following is
 true for all permitted values of i, 0 <= i < 4^k:
 kmerTable[i].isMarker == kmerTable[kmerTable[i].reverseComplementKmerId].isMarker
 
+For large k, a table of 4^k entries is impractical, and markers
+can instead be selected by hashing canonical k-mer ids,
+without using a table. See class KmerHashSelection.
+
 *******************************************************************************/
 
 #include "Kmer.hpp"
@@ -82,11 +86,12 @@ public:
 
 
 // Markers in shared memory are stored using class CompressedMarker
-// which requires only 5 bytes per marker.
+// which requires only 7 bytes per marker
+// (11 when building with -DLONG_KMERS=ON).
 
 // For a run with 120 Gb of coverage and 10% of k-mers
 // used as markers, storing all the 24 G markers requires
-// 120 GB (we store markers for each read on both strands).
+// 168 GB (we store markers for each read on both strands).
 // This compares with 30 GB to store the reads
 // (we store reads on one strand only).
 
@@ -8,18 +8,22 @@ using namespace shasta;
 
 // Standard library.
 #include <chrono>
+#include <cmath>
 #include <limits>
+#include <random>
 
 
 MarkerFinder::MarkerFinder(
     size_t k,
     const MemoryMapped::Vector<KmerInfo>& kmerTable,
+    const KmerHashSelection* kmerHashSelection,
     LongBaseSequences& reads,
-    MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    Markers& markers,
     size_t threadCountArgument) :
     MultithreadedObject(*this),
     k(k),
     kmerTable(kmerTable),
+    kmerHashSelection(kmerHashSelection),
     reads(reads),
     markers(markers),
     threadCount(threadCountArgument)
@@ -34,16 +38,39 @@ MarkerFinder::MarkerFinder(
     }
     cout << "Using " << threadCount << " threads." << endl;
 
+    // Find the markers, storing them in per-thread buffers.
     const size_t batchSize = 100000;
-    markers.beginPass1(2 * reads.size());
-    setupLoadBalancing(reads.size(), batchSize);
-    pass = 1;
-    runThreads(&MarkerFinder::threadFunction, threadCount);
-    markers.beginPass2();
-    markers.endPass2(false);
+    threadBuffers.clear();
+    threadBuffers.resize(threadCount);
+    if(markers.compressed) {
+        markers.packedMarkers.beginPass1(reads.size());
+        markers.firstMarker.resize(reads.size() + 1);
+        markers.baseCount.resize(reads.size());
+    } else if(markers.strand0Only) {
+        markers.data.beginPass1(reads.size());
+        markers.baseCount.resize(reads.size());
+    } else {
+        markers.data.beginPass1(2 * reads.size());
+    }
     setupLoadBalancing(reads.size(), batchSize);
-    pass = 2;
-    runThreads(&MarkerFinder::threadFunction, threadCount);
+    runThreads(&MarkerFinder::threadFunction1, threadCount);
+
+    // Copy them to their final location.
+    // In compressed mode, firstMarker[readId+1] now contains the number
+    // of markers of read readId, and we turn it into a running sum.
+    if(markers.compressed) {
+        markers.firstMarker[0] = 0;
+        for(ReadId readId=0; readId<reads.size(); readId++) {
+            markers.firstMarker[readId + 1] += markers.firstMarker[readId];
+        }
+        markers.packedMarkers.beginPass2();
+        markers.packedMarkers.endPass2(false);
+    } else {
+        markers.data.beginPass2();
+        markers.data.endPass2(false);
+    }
+    runThreads(&MarkerFinder::threadFunction2, threadCount);
+    threadBuffers.clear();
 
     // Final message.
     const auto tEnd = std::chrono::steady_clock::now();
@@ -53,8 +80,16 @@ MarkerFinder::MarkerFinder(
 
 
 
-void MarkerFinder::threadFunction(size_t threadId)
+// Find the markers of the reads assigned to this thread,
+// storing the strand 0 markers in the buffer for this thread.
+// This uses the rolling k-mer ids of LongBaseSequenceKmerIds.
+// When using hashed k-mer selection, the id of the
+// reverse complemented k-mer is also used,
+// because the hash uses the canonical k-mer.
+void MarkerFinder::threadFunction1(size_t threadId)
 {
+    ThreadBuffer& buffer = threadBuffers[threadId];
+    const uint64_t km1 = k - 1ULL;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -62,64 +97,175 @@ void MarkerFinder::threadFunction(size_t threadId)
 
         // Loop over reads of this batch.
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
-
             const LongBaseSequenceView read = reads[readId];
-            size_t markerCount = 0; // For this read.
-            CompressedMarker* markerPointerStrand0 = 0;
-            CompressedMarker* markerPointerStrand1 = 0;
-            if(pass == 2) {
-                markerPointerStrand0 = markers.begin(OrientedReadId(readId, 0).getValue());
-                markerPointerStrand1 = markers.end(OrientedReadId(readId, 1).getValue()) - 1ULL;
-            }
-
-            if(read.baseCount >= k) {   // Avoid pathological case.
+            const uint64_t baseCount = read.baseCount;
+            const size_t markerBegin = buffer.markers.size();
 
-                // Loop over k-mers of this read.
-                Kmer kmer;
-                for(size_t position=0; position<k; position++) {
-                    kmer.set(position, read[position]);
+            // Loop over bases of this read.
+            LongBaseSequenceKmerIds kmerIds(read, k);
+            for(uint64_t position=0; position<baseCount; position++) {
+                kmerIds.addBase(position);
+                if(position < km1) {
+                    continue;
                 }
-                for(uint32_t position=0; /*The check is done later */; position++) {
-                    const KmerId kmerId = KmerId(kmer.id(k));
-                    if(kmerTable[kmerId].isMarker) {
-                        // This k-mer is a marker.
-
-                        if(pass == 1) {
-                            ++markerCount;
-                        } else {
-                            // Strand 0.
-                            markerPointerStrand0->kmerId = kmerId;
-                            markerPointerStrand0->position = position;
-                            ++markerPointerStrand0;
-
-                            // Strand 1.
-                            markerPointerStrand1->kmerId = kmerTable[kmerId].reverseComplementedKmerId;
-                            markerPointerStrand1->position = uint32_t(read.baseCount - k - position);
-                            --markerPointerStrand1;
-
-                        }
-                    }
-
-                    if(position+k == read.baseCount) {
-                        break;
-                    }
-
-                    // Update the k-mer.
-                    kmer.shiftLeft();
-                    kmer.set(k-1, read[position+k]);
+
+                // If this k-mer is a marker, store it.
+                const KmerId kmerId = KmerId(kmerIds.kmerId());
+                const bool isMarker = kmerHashSelection ?
+                    kmerHashSelection->isMarker(kmerId,
+                        KmerId(kmerIds.reverseComplementedKmerId())) :
+                    kmerTable[kmerId].isMarker;
+                if(isMarker) {
+                    CompressedMarker marker;
+                    marker.kmerId = kmerId;
+                    marker.position = uint32_t(position + 1 - k);
+                    buffer.markers.push_back(marker);
                 }
             }
 
-            if(pass == 1) {
-                markers.incrementCount(OrientedReadId(readId, 0).getValue(), markerCount);
-                markers.incrementCount(OrientedReadId(readId, 1).getValue(), markerCount);
+            const uint32_t markerCount = uint32_t(buffer.markers.size() - markerBegin);
+            buffer.reads.push_back(make_pair(readId, markerCount));
+            if(markers.compressed) {
+                const CompressedMarker* readMarkers = buffer.markers.data() + markerBegin;
+                markers.packedMarkers.incrementCount(readId,
+                    Markers::packedWordCount(readMarkers, readMarkers + markerCount, k));
+                markers.firstMarker[readId + 1] = markerCount;
+                markers.baseCount[readId] = uint32_t(baseCount);
+            } else if(markers.strand0Only) {
+                markers.data.incrementCount(readId, markerCount);
+                markers.baseCount[readId] = uint32_t(baseCount);
             } else {
-                CZI_ASSERT(markerPointerStrand0 ==
-                    markers.end(OrientedReadId(readId, 0).getValue()));
-                CZI_ASSERT(markerPointerStrand1 ==
-                    markers.begin(OrientedReadId(readId, 1).getValue()) - 1ULL);
+                markers.data.incrementCount(OrientedReadId(readId, 0).getValue(), markerCount);
+                markers.data.incrementCount(OrientedReadId(readId, 1).getValue(), markerCount);
             }
         }
     }
+}
+
+
+
+// Copy the markers found by this thread to their final location,
+// and generate the strand 1 markers.
+void MarkerFinder::threadFunction2(size_t threadId)
+{
+    const ThreadBuffer& buffer = threadBuffers[threadId];
+    const CompressedMarker* sourceMarker = buffer.markers.data();
+
+    for(const auto& p: buffer.reads) {
+        const ReadId readId = p.first;
+        const uint32_t markerCount = p.second;
+        const uint32_t baseCount = uint32_t(reads[readId].baseCount);
+
+        // In compressed mode, pack the markers.
+        if(markers.compressed) {
+            Markers::pack(sourceMarker, sourceMarker + markerCount, k,
+                markers.packedMarkers.begin(readId));
+            sourceMarker += markerCount;
+            continue;
+        }
+
+        // If storing strand 0 only, just copy the markers.
+        if(markers.strand0Only) {
+            copy(sourceMarker, sourceMarker + markerCount, markers.data.begin(readId));
+            sourceMarker += markerCount;
+            continue;
+        }
+
+        CompressedMarker* markerPointerStrand0 = markers.data.begin(OrientedReadId(readId, 0).getValue());
+        CompressedMarker* markerPointerStrand1 = markers.data.end(OrientedReadId(readId, 1).getValue()) - 1ULL;
+        for(uint32_t i=0; i<markerCount; i++, ++sourceMarker) {
+            const KmerId kmerId = sourceMarker->kmerId;
+            const uint32_t position = sourceMarker->position;
+
+            // Strand 0.
+            *markerPointerStrand0 = *sourceMarker;
+            ++markerPointerStrand0;
+
+            // Strand 1.
+            markerPointerStrand1->kmerId = kmerHashSelection ?
+                reverseComplementKmerId(kmerId, k) :
+                kmerTable[kmerId].reverseComplementedKmerId;
+            markerPointerStrand1->position = uint32_t(baseCount - k - position);
+            --markerPointerStrand1;
+        }
+        CZI_ASSERT(markerPointerStrand0 ==
+            markers.data.end(OrientedReadId(readId, 0).getValue()));
+        CZI_ASSERT(markerPointerStrand1 ==
+            markers.data.begin(OrientedReadId(readId, 1).getValue()) - 1ULL);
+    }
+    CZI_ASSERT(sourceMarker == buffer.markers.data() + buffer.markers.size());
+}
+
+
+
+// Check, for all values of k supported by this build,
+// that the rolling k-mer ids of LongBaseSequenceKmerIds
+// and reverseComplementKmerId agree with the ids computed using class Kmer,
+// and that KmerHashSelection selects a k-mer and its reverse complement
+// together, with approximately the requested probability.
+// Building with -DLONG_KMERS=ON extends this to k up to 32.
+void ChanZuckerberg::shasta::testKmerHashSelection()
+{
+    const uint64_t baseCount = 100000;
+    const double probability = 0.1;
+    const size_t pageSize = 4096;
+
+    // Create a random sequence.
+    std::mt19937 randomSource(231);
+    std::uniform_int_distribution<uint64_t> baseDistribution(0, 3);
+    vector<Base> bases(baseCount);
+    for(Base& base: bases) {
+        base = Base::fromInteger(baseDistribution(randomSource));
+    }
+    LongBaseSequences sequences;
+    sequences.createNew("", pageSize);
+    sequences.append(bases);
+    const LongBaseSequenceView sequence = sequences[0];
+
+    KmerHashSelection kmerHashSelection;
+    kmerHashSelection.set(probability, 231);
+
+    for(uint64_t k=1; k<=Kmer::capacity; k++) {
+        LongBaseSequenceKmerIds kmerIds(sequence, k);
+        uint64_t markerCount = 0;
+        for(uint64_t position=0; position<baseCount; position++) {
+            kmerIds.addBase(position);
+            if(position + 1 < k) {
+                continue;
+            }
+
+            // Compute the ids of this k-mer and of its reverse complement
+            // using class Kmer, and check the other ways to get them.
+            Kmer kmer;
+            const uint64_t kmerBegin = position + 1 - k;
+            for(uint64_t i=0; i<k; i++) {
+                kmer.set(i, bases[kmerBegin + i]);
+            }
+            const KmerId kmerId = KmerId(kmer.id(k));
+            const KmerId reverseComplementedKmerId = KmerId(kmer.reverseComplement(k).id(k));
+            if(KmerId(kmerIds.kmerId()) != kmerId ||
+                KmerId(kmerIds.reverseComplementedKmerId()) != reverseComplementedKmerId ||
+                reverseComplementKmerId(kmerId, k) != reverseComplementedKmerId ||
+                reverseComplementKmerId(reverseComplementedKmerId, k) != kmerId) {
+                throw runtime_error("K-mer id test failed for k " + to_string(k) +
+                    " at position " + to_string(kmerBegin));
+            }
+
+            const bool isMarker = kmerHashSelection.isMarker(kmerId, reverseComplementedKmerId);
+            CZI_ASSERT(isMarker == kmerHashSelection.isMarker(reverseComplementedKmerId, kmerId));
+            if(isMarker) {
+                ++markerCount;
+            }
+        }
+
+        // For short k-mers there are too few distinct k-mers
+        // for the fraction of markers to be close to the probability.
+        const double markerFraction = double(markerCount) / double(baseCount + 1 - k);
+        cout << "k = " << k << ": " << markerFraction << " of k-mers are markers." << endl;
+        if(k >= 10) {
+            CZI_ASSERT(std::abs(markerFraction - probability) < 0.01);
+        }
+    }
 
+    sequences.remove();
 }
@@ -3,7 +3,13 @@
 
 // shasta
 #include "Marker.hpp"
+#include "Markers.hpp"
 #include "MultitreadedObject.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "utility.hpp"
+#include "vector.hpp"
 
 namespace ChanZuckerberg {
     namespace shasta {
@@ -11,7 +17,6 @@ namespace ChanZuckerberg {
         class LongBaseSequences;
         namespace MemoryMapped {
             template<class T> class Vector;
-            template<class Int, class T> class VectorOfVectors;
         }
     }
 }
@@ -23,11 +28,14 @@ class ChanZuckerberg::shasta::MarkerFinder :
 public:
 
     // The constructor does all the work.
+    // If kmerHashSelection is not null, it is used to decide
+    // which k-mers are markers, and the k-mer table is not used.
     MarkerFinder(
         size_t k,
         const MemoryMapped::Vector<KmerInfo>& kmerTable,
+        const KmerHashSelection* kmerHashSelection,
         LongBaseSequences& reads,
-        MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        Markers& markers,
         size_t threadCount);
 
 private:
@@ -35,16 +43,34 @@ private:
     // The arguments passed to the constructor.
     size_t k;
     const MemoryMapped::Vector<KmerInfo>& kmerTable;
+    const KmerHashSelection* kmerHashSelection;
     LongBaseSequences& reads;
-    MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
+    Markers& markers;
     size_t threadCount;
 
-    void threadFunction(size_t threadId);
+    // The markers are found in a single pass over the reads.
+    // Each thread stores the strand 0 markers of the reads it processes
+    // in its own buffer, and also increments the marker counts
+    // for those reads.
+    // The markers are then copied (scattered) to their final
+    // location in a second, multithreaded step, which also
+    // generates the strand 1 markers, unless the markers
+    // are stored for strand 0 only. In compressed mode,
+    // the first step also computes the packed size of the markers
+    // of each read, and the second step packs them.
+    void threadFunction1(size_t threadId);
+    void threadFunction2(size_t threadId);
+    class ThreadBuffer {
+    public:
+        // The reads processed by this thread, in the order
+        // in which they were processed, and the number of markers
+        // found on each of them.
+        vector< pair<ReadId, uint32_t> > reads;
 
-    // In pass 1, we count the number of markers for each
-    // read and call reads.incrementCountMultithreaded.
-    // In pass 2, we store the markers.
-    size_t pass;
+        // The strand 0 markers of those reads.
+        vector<CompressedMarker> markers;
+    };
+    vector<ThreadBuffer> threadBuffers;
 
 };
 
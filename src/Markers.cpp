@@ -0,0 +1,425 @@
+#include "Markers.hpp"
+#include "LongBaseSequence.hpp"
+#include "MarkerFinder.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+#include "algorithm.hpp"
+#include "array.hpp"
+#include "iostream.hpp"
+#include "stdexcept.hpp"
+#include <chrono>
+#include <numeric>
+#include <random>
+
+
+
+void Markers::createNew(
+    const string& name,
+    size_t pageSize,
+    uint64_t kArgument,
+    bool storeStrand0Only,
+    bool compress)
+{
+    // In compressed mode, each marker is packed in a field
+    // of 2k bits for the k-mer id plus up to 24 bits
+    // for the offset of its position, which must fit in 64 bits.
+    if(compress && 2 * kArgument + 24 > 64) {
+        throw runtime_error("Compressed markers are only supported for k <= 20.");
+    }
+
+    k = kArgument;
+    compressed = compress;
+    strand0Only = storeStrand0Only || compressed;
+    if(compressed) {
+        if(name.empty()) {
+            packedMarkers.createNew("", pageSize);
+            firstMarker.createNew("", pageSize);
+            baseCount.createNew("", pageSize);
+        } else {
+            packedMarkers.createNew(name + "-Compressed", pageSize);
+            firstMarker.createNew(name + "-Compressed-FirstMarker", pageSize);
+            baseCount.createNew(name + "-Compressed-BaseCount", pageSize);
+        }
+    } else if(name.empty()) {
+        data.createNew("", pageSize);
+        if(strand0Only) {
+            baseCount.createNew("", pageSize);
+        }
+    } else if(strand0Only) {
+        data.createNew(name + "-Strand0", pageSize);
+        baseCount.createNew(name + "-Strand0-BaseCount", pageSize);
+    } else {
+        data.createNew(name, pageSize);
+    }
+}
+
+
+
+// Access existing markers, stored in any mode.
+void Markers::accessExistingReadOnly(const string& name, uint64_t kArgument)
+{
+    k = kArgument;
+    compressed = false;
+    try {
+        data.accessExistingReadOnly(name);
+        strand0Only = false;
+        return;
+    } catch(const runtime_error&) {
+    }
+    strand0Only = true;
+    try {
+        data.accessExistingReadOnly(name + "-Strand0");
+        baseCount.accessExistingReadOnly(name + "-Strand0-BaseCount");
+        CZI_ASSERT(baseCount.size() == data.size());
+        return;
+    } catch(const runtime_error&) {
+    }
+    compressed = true;
+    packedMarkers.accessExistingReadOnly(name + "-Compressed");
+    firstMarker.accessExistingReadOnly(name + "-Compressed-FirstMarker");
+    baseCount.accessExistingReadOnly(name + "-Compressed-BaseCount");
+    CZI_ASSERT(baseCount.size() == packedMarkers.size());
+    CZI_ASSERT(firstMarker.size() == packedMarkers.size() + 1);
+}
+
+
+
+void Markers::remove()
+{
+    if(compressed) {
+        packedMarkers.remove();
+        firstMarker.remove();
+    } else {
+        data.remove();
+    }
+    if(strand0Only) {
+        baseCount.remove();
+    }
+}
+
+
+
+// Return all markers of an oriented read as a contiguous range.
+MemoryAsContainer<const CompressedMarker> Markers::getSpan(
+    uint64_t orientedReadIdValue,
+    vector<CompressedMarker>& buffer) const
+{
+    const View view = (*this)[orientedReadIdValue];
+    if(!view.isReverseComplemented && !compressed) {
+        return MemoryAsContainer<const CompressedMarker>(view.data, view.data + view.markerCount);
+    }
+
+    // Get the strand 0 markers, then reverse complement them if necessary.
+    buffer.resize(view.markerCount);
+    if(compressed) {
+        unpack(view.words, k, view.markerCount, buffer.data());
+    } else {
+        copy(view.data, view.data + view.markerCount, buffer.begin());
+    }
+    if(view.isReverseComplemented) {
+        std::reverse(buffer.begin(), buffer.end());
+        for(CompressedMarker& marker: buffer) {
+            marker.kmerId = reverseComplementKmerId(marker.kmerId, k);
+            marker.position = uint32_t(view.baseCount - k - marker.position);
+        }
+    }
+    return MemoryAsContainer<const CompressedMarker>(buffer.data(), buffer.data() + buffer.size());
+}
+
+
+
+// Given a global marker id, return
+// the OrientedReadId value and ordinal.
+// In strand 0 only mode, the markers of read readId
+// have global marker ids in [2*begin, 2*end), where
+// [begin, end) is the range of the stored markers of the read.
+// So we can find the read by looking up markerId/2.
+pair<uint64_t, uint32_t> Markers::find(uint64_t markerId) const
+{
+    if(compressed) {
+        const uint64_t readId = uint64_t(std::upper_bound(
+            firstMarker.begin(), firstMarker.end(), markerId >> 1ULL) - firstMarker.begin()) - 1;
+        const uint64_t offset = firstMarker[readId];
+        const uint64_t markerCount = firstMarker[readId + 1] - offset;
+        uint64_t ordinal = markerId - 2 * offset;
+        uint64_t strand = 0;
+        if(ordinal >= markerCount) {
+            ordinal -= markerCount;
+            strand = 1;
+        }
+        CZI_ASSERT(ordinal < markerCount);
+        return make_pair(OrientedReadId(ReadId(readId), Strand(strand)).getValue(), uint32_t(ordinal));
+    } else if(strand0Only) {
+        const uint64_t readId = data.find(markerId >> 1ULL).first;
+        const uint64_t offset = uint64_t(data.begin(readId) - data.begin());
+        const uint64_t markerCount = data.size(readId);
+        uint64_t ordinal = markerId - 2 * offset;
+        uint64_t strand = 0;
+        if(ordinal >= markerCount) {
+            ordinal -= markerCount;
+            strand = 1;
+        }
+        CZI_ASSERT(ordinal < markerCount);
+        return make_pair(OrientedReadId(ReadId(readId), Strand(strand)).getValue(), uint32_t(ordinal));
+    } else {
+        const pair<uint64_t, uint64_t> p = data.find(markerId);
+        return make_pair(p.first, uint32_t(p.second));
+    }
+}
+
+
+
+// Return the total number of bytes used.
+uint64_t Markers::totalByteCount() const
+{
+    if(compressed) {
+        return
+            (packedMarkers.size() + 1) * sizeof(uint64_t) +
+            packedMarkers.totalSize() * sizeof(uint64_t) +
+            firstMarker.size() * sizeof(uint64_t) +
+            baseCount.size() * sizeof(uint32_t);
+    }
+    uint64_t byteCount =
+        (data.size() + 1) * sizeof(uint64_t) +
+        data.totalSize() * sizeof(CompressedMarker);
+    if(strand0Only) {
+        byteCount += baseCount.size() * sizeof(uint32_t);
+    }
+    return byteCount;
+}
+
+
+
+// Return the number of 64-bit words needed to pack
+// the markers of a read in compressed mode.
+uint64_t Markers::packedWordCount(
+    const CompressedMarker* begin,
+    const CompressedMarker* end,
+    uint64_t k)
+{
+    const uint64_t markerCount = uint64_t(end - begin);
+    const uint64_t blockCount = (markerCount + blockSize - 1) / blockSize;
+    uint64_t bitCount = 0;
+    for(const CompressedMarker* blockBegin=begin; blockBegin<end; blockBegin+=blockSize) {
+        const CompressedMarker* blockEnd = min(blockBegin + blockSize, end);
+        const uint64_t maxOffset = uint64_t(uint32_t((blockEnd-1)->position) - uint32_t(blockBegin->position));
+        const uint64_t w = maxOffset ? 64ULL - uint64_t(__builtin_clzll(maxOffset)) : 0ULL;
+        bitCount += uint64_t(blockEnd - blockBegin) * (2 * k + w);
+    }
+    return blockCount + (bitCount + 63) / 64;
+}
+
+
+
+// Pack the markers of a read in compressed mode.
+// The words must have been sized using packedWordCount.
+void Markers::pack(
+    const CompressedMarker* begin,
+    const CompressedMarker* end,
+    uint64_t k,
+    uint64_t* words)
+{
+    const uint64_t markerCount = uint64_t(end - begin);
+    const uint64_t blockCount = (markerCount + blockSize - 1) / blockSize;
+    const uint64_t wordCount = packedWordCount(begin, end, k);
+    std::fill(words, words + wordCount, 0ULL);
+
+    uint64_t bitOffset = 64 * blockCount;
+    uint64_t* header = words;
+    for(const CompressedMarker* blockBegin=begin; blockBegin<end; blockBegin+=blockSize, ++header) {
+        const CompressedMarker* blockEnd = min(blockBegin + blockSize, end);
+        const uint64_t blockPosition = uint32_t(blockBegin->position);
+        const uint64_t maxOffset = uint64_t(uint32_t((blockEnd-1)->position) - blockPosition);
+        const uint64_t w = maxOffset ? 64ULL - uint64_t(__builtin_clzll(maxOffset)) : 0ULL;
+        *header = blockPosition | (w << 24ULL) | (bitOffset << 30ULL);
+
+        for(const CompressedMarker* marker=blockBegin; marker!=blockEnd; ++marker) {
+            const uint64_t offset = uint64_t(uint32_t(marker->position)) - blockPosition;
+            const uint64_t field = uint64_t(marker->kmerId) | (offset << (2 * k));
+            uint64_t* p = words + (bitOffset >> 6ULL);
+            const uint64_t shift = bitOffset & 63ULL;
+            p[0] |= field << shift;
+            if(shift + 2 * k + w > 64) {
+                p[1] |= field >> (64ULL - shift);
+            }
+            bitOffset += 2 * k + w;
+        }
+    }
+    CZI_ASSERT((bitOffset + 63) / 64 <= wordCount);
+}
+
+
+
+// Unpack all the markers of a read in compressed mode.
+// This is faster than unpacking them one at a time,
+// because each block header is only decoded once.
+void Markers::unpack(
+    const uint64_t* words,
+    uint64_t k,
+    uint64_t markerCount,
+    CompressedMarker* markers)
+{
+    const uint64_t kmerIdMask = (1ULL << (2 * k)) - 1ULL;
+    for(uint64_t blockBegin=0; blockBegin<markerCount; blockBegin+=blockSize) {
+        const uint64_t header = words[blockBegin / blockSize];
+        const uint64_t blockPosition = header & 0xffffffULL;
+        const uint64_t w = (header >> 24ULL) & 63ULL;
+        const uint64_t offsetMask = (1ULL << w) - 1ULL;
+        const uint64_t fieldWidth = 2 * k + w;
+        uint64_t bitOffset = header >> 30ULL;
+        const uint64_t blockEnd = min(blockBegin + blockSize, markerCount);
+        for(uint64_t ordinal=blockBegin; ordinal!=blockEnd; ordinal++, bitOffset+=fieldWidth) {
+            const uint64_t* p = words + (bitOffset >> 6ULL);
+            const uint64_t shift = bitOffset & 63ULL;
+            uint64_t field = p[0] >> shift;
+            if(shift + fieldWidth > 64) {
+                field |= p[1] << (64ULL - shift);
+            }
+            CompressedMarker& marker = markers[ordinal];
+            marker.kmerId = KmerId(field & kmerIdMask);
+            marker.position = uint32_t(blockPosition + ((field >> (2 * k)) & offsetMask));
+        }
+    }
+}
+
+
+
+// Find markers in random reads, storing them in each of the three modes,
+// then check that all modes give the same markers and marker ids,
+// and write the memory used and the time to access the markers.
+// This is done for k=10 and, when building with -DLONG_KMERS=ON,
+// also for k=20 and for k=32, which compressed mode does not support.
+void ChanZuckerberg::shasta::testMarkers()
+{
+    const double probability = 0.1;
+    const uint64_t readCount = 2000;
+    const size_t pageSize = 4096;
+
+    // Compressed mode must reject a k for which
+    // the packed field of a marker does not fit in 64 bits.
+    {
+        Markers markers;
+        bool wasRejected = false;
+        try {
+            markers.createNew("", pageSize, 32, true, true);
+        } catch(const runtime_error&) {
+            wasRejected = true;
+        }
+        CZI_ASSERT(wasRejected);
+    }
+
+    // Create random reads without homopolymer runs,
+    // like the run-length reads used by the assembler.
+    std::mt19937 randomSource(231);
+    std::uniform_int_distribution<uint64_t> lengthDistribution(0, 20000);
+    std::uniform_int_distribution<uint64_t> baseDistribution(1, 3);
+    LongBaseSequences reads;
+    reads.createNew("", pageSize);
+    vector<Base> read;
+    for(uint64_t readId=0; readId<readCount; readId++) {
+        const uint64_t length = lengthDistribution(randomSource);
+        read.clear();
+        uint64_t base = 0;
+        for(uint64_t i=0; i<length; i++) {
+            base = (base + baseDistribution(randomSource)) & 3ULL;
+            read.push_back(Base::fromInteger(base));
+        }
+        reads.append(read);
+    }
+
+    // The values of k to test, each with the number of modes to test.
+    vector< pair<uint64_t, uint64_t> > kValues = {{10, 3}};
+#ifdef SHASTA_LONG_KMERS
+    kValues.push_back({20, 3});
+    kValues.push_back({32, 2});
+#endif
+
+    for(const auto& kValue: kValues) {
+        const uint64_t k = kValue.first;
+        const uint64_t modeCount = kValue.second;
+        cout << "Testing markers with k = " << k << "." << endl;
+
+        KmerHashSelection kmerHashSelection;
+        kmerHashSelection.set(probability, 231);
+        MemoryMapped::Vector<KmerInfo> kmerTable;
+        array<Markers, 3> allMarkers;
+        const array<string, 3> modeNames = {"Both strands", "Strand 0 only", "Compressed"};
+        for(uint64_t mode=0; mode<modeCount; mode++) {
+            Markers& markers = allMarkers[mode];
+            markers.createNew("", pageSize, k, mode > 0, mode == 2);
+            MarkerFinder(k, kmerTable, &kmerHashSelection, reads, markers, 0);
+        }
+
+        // Check that all modes give the same results.
+        const Markers& markers0 = allMarkers[0];
+        for(uint64_t mode=1; mode<modeCount; mode++) {
+            const Markers& markers = allMarkers[mode];
+            CZI_ASSERT(markers.size() == markers0.size());
+            CZI_ASSERT(markers.totalSize() == markers0.totalSize());
+            vector<CompressedMarker> buffer;
+            for(uint64_t i=0; i<markers.size(); i++) {
+                CZI_ASSERT(markers.size(i) == markers0.size(i));
+                const Markers::View view0 = markers0[i];
+                const Markers::View view = markers[i];
+                const auto span = markers.getSpan(i, buffer);
+                CZI_ASSERT(span.size() == view0.size());
+                for(uint64_t ordinal=0; ordinal<view0.size(); ordinal++) {
+                    const CompressedMarker marker0 = view0[ordinal];
+                    const CompressedMarker marker = view[ordinal];
+                    if(marker.kmerId != marker0.kmerId ||
+                        uint32_t(marker.position) != uint32_t(marker0.position) ||
+                        span[ordinal].kmerId != marker0.kmerId ||
+                        uint32_t(span[ordinal].position) != uint32_t(marker0.position)) {
+                        throw runtime_error("Markers test failed for " + modeNames[mode] +
+                            ", k " + to_string(k) +
+                            ", oriented read " + to_string(i) + ", ordinal " + to_string(ordinal));
+                    }
+                    const uint64_t markerId = markers.getMarkerId(i, ordinal);
+                    CZI_ASSERT(markerId == markers0.getMarkerId(i, ordinal));
+                    CZI_ASSERT(markers.find(markerId) == make_pair(i, uint32_t(ordinal)));
+                    CZI_ASSERT(markers.getMarker(markerId).kmerId == marker0.kmerId);
+                }
+            }
+        }
+
+        // Write the memory used and the time to access all markers,
+        // sequentially via getSpan and in random order via a View.
+        vector<uint64_t> orientedReadIds(markers0.size());
+        std::iota(orientedReadIds.begin(), orientedReadIds.end(), 0ULL);
+        std::shuffle(orientedReadIds.begin(), orientedReadIds.end(), randomSource);
+        const uint64_t markerCount = markers0.totalSize();
+        cout << "Found " << markerCount << " markers on " << markers0.size() << " oriented reads." << endl;
+        for(uint64_t mode=0; mode<modeCount; mode++) {
+            const Markers& markers = allMarkers[mode];
+            uint64_t sum = 0;
+            vector<CompressedMarker> buffer;
+            const auto t0 = std::chrono::steady_clock::now();
+            for(uint64_t i=0; i<markers.size(); i++) {
+                for(const CompressedMarker& marker: markers.getSpan(i, buffer)) {
+                    sum += marker.kmerId + uint32_t(marker.position);
+                }
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+            for(const uint64_t i: orientedReadIds) {
+                const Markers::View view = markers[i];
+                for(uint64_t ordinal=0; ordinal<view.size(); ordinal+=7) {
+                    sum += view[ordinal].kmerId;
+                }
+            }
+            const auto t2 = std::chrono::steady_clock::now();
+            const double t01 = 1.e-9 * double(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            const double t12 = 1.e-9 * double(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+            cout << modeNames[mode] << ": " <<
+                double(markers.totalByteCount()) / double(markerCount / 2) << " bytes per marker of strand 0, " <<
+                1.e9 * t01 / double(markerCount) << " ns per marker via getSpan, " <<
+                1.e9 * t12 / double(markerCount / 7) << " ns per marker via View. " <<
+                "Checksum " << sum << "." << endl;
+        }
+
+        for(uint64_t mode=0; mode<modeCount; mode++) {
+            allMarkers[mode].remove();
+        }
+    }
+    reads.remove();
+}
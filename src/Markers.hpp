@@ -0,0 +1,345 @@
+#ifndef CZI_SHASTA_MARKERS_HPP
+#define CZI_SHASTA_MARKERS_HPP
+
+/*******************************************************************************
+
+Class Markers stores the markers of all oriented reads,
+indexed by OrientedReadId::getValue().
+
+It can use one of three storage modes:
+
+- Both strands (the default). The markers of each oriented read
+  are stored explicitly, with strand 0 and strand 1 of each read
+  stored next to each other. This uses a
+  MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>.
+
+- Strand 0 only. Only the markers of strand 0 of each read are stored,
+  indexed by ReadId, together with the number of bases of each read.
+  The markers of strand 1 are computed on the fly when requested:
+  the marker with ordinal i on strand 1 corresponds to the marker
+  with ordinal n-1-i on strand 0, where n is the number of markers
+  in the read, with k-mer id replaced by the id of the reverse
+  complemented k-mer and position replaced by baseCount-k-position.
+  This uses half the memory.
+
+- Compressed. As strand 0 only, but the markers of each read
+  are stored in blocks of blockSize markers, packed in 64-bit words.
+  Each block begins with a 64-bit header containing the
+  position of the first marker of the block (24 bits),
+  the number of bits w used to store marker position offsets
+  in the block (6 bits), and the offset in bits, from the beginning
+  of the read, of the packed markers of the block (34 bits).
+  The headers of all blocks of a read come first, followed by
+  the packed markers. Each packed marker uses 2k+w bits:
+  the k-mer id, followed by the offset of the marker position
+  from the position of the first marker of the block.
+  Because w is the same for all markers of a block,
+  a marker can still be accessed by ordinal in constant time.
+  With k=10 and 10% of k-mers used as markers, this uses
+  about 3.9 bytes per marker, compared to 14 bytes
+  (7 bytes on each strand) for the default mode
+  and 7 bytes for strand 0 only mode (see testMarkers).
+  Access to each marker is slower, as it has to be unpacked.
+
+In all modes, global marker ids (MarkerId) are the same:
+the markers of oriented read (readId, strand) are assigned
+consecutive marker ids, in order of OrientedReadId::getValue().
+This means that in strand 0 only mode, the first marker of
+read readId on strand 0 has MarkerId 2*offset, where offset is
+the position of the first stored marker of readId,
+and the first marker of strand 1 has MarkerId 2*offset+n.
+The same is true in compressed mode, where offset is
+the number of strand 0 markers of all previous reads.
+
+Access to individual markers always returns a CompressedMarker
+by value, so the same code works for all storage modes.
+
+Access by global marker id (getMarker) requires a binary search
+in strand 0 only and compressed modes. Code that accesses many markers of the
+same oriented read should instead use getSpan, which
+computes (or, in compressed mode, unpacks) the markers
+of the oriented read only once,
+or a View if it already knows the oriented read and ordinal.
+
+*******************************************************************************/
+
+// Shasta.
+#include "Kmer.hpp"
+#include "Marker.hpp"
+#include "MemoryAsContainer.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class Markers;
+        class MarkerFinder;
+
+        void testMarkers();
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::Markers {
+public:
+
+    // Read-only view of the markers of a single oriented read.
+    class View {
+    public:
+        uint64_t size() const
+        {
+            return markerCount;
+        }
+        bool empty() const
+        {
+            return markerCount == 0;
+        }
+
+        CompressedMarker operator[](uint64_t ordinal) const
+        {
+            if(!isReverseComplemented) {
+                return words ? unpack(words, k, ordinal) : data[ordinal];
+            }
+            const uint64_t strand0Ordinal = markerCount - 1 - ordinal;
+            const CompressedMarker marker = words ?
+                unpack(words, k, strand0Ordinal) : data[strand0Ordinal];
+            CompressedMarker reverseComplementedMarker;
+            reverseComplementedMarker.kmerId = reverseComplementKmerId(marker.kmerId, k);
+            reverseComplementedMarker.position = uint32_t(baseCount - k - marker.position);
+            return reverseComplementedMarker;
+        }
+
+        // Minimal iterator support, so a View can be used
+        // in a range-based for loop.
+        class const_iterator {
+        public:
+            const_iterator(const View& view, uint64_t ordinal) :
+                view(view), ordinal(ordinal) {}
+            CompressedMarker operator*() const
+            {
+                return view[ordinal];
+            }
+            const_iterator& operator++()
+            {
+                ++ordinal;
+                return *this;
+            }
+            bool operator!=(const const_iterator& that) const
+            {
+                return ordinal != that.ordinal;
+            }
+        private:
+            const View& view;
+            uint64_t ordinal;
+        };
+        const_iterator begin() const
+        {
+            return const_iterator(*this, 0);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(*this, markerCount);
+        }
+
+    private:
+        const CompressedMarker* data;
+        const uint64_t* words;  // Only used in compressed mode.
+        uint64_t markerCount;
+        bool isReverseComplemented;
+        uint64_t k;
+        uint64_t baseCount;
+        friend class Markers;
+    };
+
+    // Create new, empty markers.
+    // In strand 0 only mode, the markers are stored as name-Strand0.
+    // In compressed mode, which implies strand 0 only,
+    // they are stored as name-Compressed, and k must be at most 20.
+    // An empty name creates the markers in anonymous memory.
+    void createNew(const string& name, size_t pageSize, uint64_t k,
+        bool storeStrand0Only, bool compress = false);
+
+    // Access existing markers, stored in any mode.
+    void accessExistingReadOnly(const string& name, uint64_t k);
+    void remove();
+
+    bool isOpen() const
+    {
+        return compressed ? packedMarkers.isOpen() : data.isOpen();
+    }
+    bool storesStrand0Only() const
+    {
+        return strand0Only;
+    }
+    bool isCompressed() const
+    {
+        return compressed;
+    }
+
+    // Return the number of oriented reads.
+    uint64_t size() const
+    {
+        if(compressed) {
+            return 2 * packedMarkers.size();
+        }
+        return strand0Only ? 2 * data.size() : data.size();
+    }
+
+    // Return the number of markers of an oriented read.
+    uint64_t size(uint64_t orientedReadIdValue) const
+    {
+        if(compressed) {
+            const ReadId readId = ReadId(orientedReadIdValue >> 1ULL);
+            return firstMarker[readId + 1] - firstMarker[readId];
+        }
+        return strand0Only ? data.size(orientedReadIdValue >> 1ULL) : data.size(orientedReadIdValue);
+    }
+
+    // Return the total number of markers on all oriented reads.
+    uint64_t totalSize() const
+    {
+        if(compressed) {
+            return 2 * firstMarker.back();
+        }
+        return strand0Only ? 2 * data.totalSize() : data.totalSize();
+    }
+
+    // Return a view of the markers of an oriented read.
+    View operator[](uint64_t orientedReadIdValue) const
+    {
+        View view;
+        view.k = k;
+        view.words = 0;
+        if(compressed) {
+            const ReadId readId = ReadId(orientedReadIdValue >> 1ULL);
+            view.data = 0;
+            view.words = packedMarkers.begin(readId);
+            view.markerCount = firstMarker[readId + 1] - firstMarker[readId];
+            view.isReverseComplemented = (orientedReadIdValue & 1ULL) == 1ULL;
+            view.baseCount = baseCount[readId];
+        } else if(strand0Only) {
+            const ReadId readId = ReadId(orientedReadIdValue >> 1ULL);
+            view.data = data.begin(readId);
+            view.markerCount = data.size(readId);
+            view.isReverseComplemented = (orientedReadIdValue & 1ULL) == 1ULL;
+            view.baseCount = baseCount[readId];
+        } else {
+            view.data = data.begin(orientedReadIdValue);
+            view.markerCount = data.size(orientedReadIdValue);
+            view.isReverseComplemented = false;
+            view.baseCount = 0;
+        }
+        return view;
+    }
+
+    // Return all markers of an oriented read as a contiguous range.
+    // If the markers of the oriented read are stored,
+    // the range points to the stored markers.
+    // Otherwise (strand 1 in strand 0 only mode, or compressed mode)
+    // the markers are computed and stored in the buffer,
+    // and the range points to the buffer.
+    MemoryAsContainer<const CompressedMarker> getSpan(
+        uint64_t orientedReadIdValue,
+        vector<CompressedMarker>& buffer) const;
+
+    // Return the global marker id of a marker
+    // given its oriented read and ordinal.
+    uint64_t getMarkerId(uint64_t orientedReadIdValue, uint64_t ordinal) const
+    {
+        if(compressed) {
+            const ReadId readId = ReadId(orientedReadIdValue >> 1ULL);
+            const uint64_t offset = firstMarker[readId];
+            const uint64_t strand = orientedReadIdValue & 1ULL;
+            return 2 * offset + strand * (firstMarker[readId + 1] - offset) + ordinal;
+        } else if(strand0Only) {
+            const ReadId readId = ReadId(orientedReadIdValue >> 1ULL);
+            const uint64_t offset = uint64_t(data.begin(readId) - data.begin());
+            const uint64_t strand = orientedReadIdValue & 1ULL;
+            return 2 * offset + strand * data.size(readId) + ordinal;
+        } else {
+            return uint64_t(data.begin(orientedReadIdValue) - data.begin()) + ordinal;
+        }
+    }
+
+    // Inverse of the above: given a global marker id, return
+    // the OrientedReadId value and ordinal.
+    // This requires a binary search in the table of contents.
+    pair<uint64_t, uint32_t> find(uint64_t markerId) const;
+
+    // Return a marker given its global marker id.
+    CompressedMarker getMarker(uint64_t markerId) const
+    {
+        if(strand0Only) {
+            const pair<uint64_t, uint32_t> p = find(markerId);
+            return (*this)[p.first][p.second];
+        } else {
+            return data.begin()[markerId];
+        }
+    }
+
+    // Return the total number of bytes used.
+    uint64_t totalByteCount() const;
+
+    // The number of markers in each block, in compressed mode.
+    static const uint64_t blockSize = 32;
+
+private:
+    bool strand0Only = false;
+    bool compressed = false;
+    uint64_t k;
+
+    // The markers. Indexed by OrientedReadId::getValue()
+    // or, in strand 0 only mode, by ReadId.
+    MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t> data;
+
+    // The number of bases of each read, used to compute
+    // the positions of strand 1 markers. Indexed by ReadId.
+    // Only used in strand 0 only and compressed modes.
+    MemoryMapped::Vector<uint32_t> baseCount;
+
+    // Compressed mode only: the packed markers of each read,
+    // indexed by ReadId, and the number of strand 0 markers of all
+    // previous reads, indexed by ReadId, with one extra entry at the end.
+    MemoryMapped::VectorOfVectors<uint64_t, uint64_t> packedMarkers;
+    MemoryMapped::Vector<uint64_t> firstMarker;
+
+    // Functions used to pack and unpack the markers of a read in compressed mode.
+    // The markers must be in order of increasing position.
+    static uint64_t packedWordCount(
+        const CompressedMarker* begin, const CompressedMarker* end, uint64_t k);
+    static void pack(
+        const CompressedMarker* begin, const CompressedMarker* end, uint64_t k,
+        uint64_t* words);
+    static void unpack(const uint64_t* words, uint64_t k, uint64_t markerCount,
+        CompressedMarker* markers);
+    static CompressedMarker unpack(const uint64_t* words, uint64_t k, uint64_t ordinal)
+    {
+        const uint64_t header = words[ordinal / blockSize];
+        const uint64_t w = (header >> 24ULL) & 63ULL;
+        const uint64_t fieldWidth = 2 * k + w;
+        const uint64_t bitOffset = (header >> 30ULL) + (ordinal % blockSize) * fieldWidth;
+        const uint64_t* p = words + (bitOffset >> 6ULL);
+        const uint64_t shift = bitOffset & 63ULL;
+        uint64_t field = p[0] >> shift;
+        if(shift + fieldWidth > 64) {
+            field |= p[1] << (64ULL - shift);
+        }
+        CompressedMarker marker;
+        marker.kmerId = KmerId(field & ((1ULL << (2 * k)) - 1ULL));
+        marker.position = uint32_t((header & 0xffffffULL) +
+            ((field >> (2 * k)) & ((1ULL << w) - 1ULL)));
+        return marker;
+    }
+
+    // MarkerFinder creates the markers.
+    friend class MarkerFinder;
+};
+
+#endif
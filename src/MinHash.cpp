@@ -24,7 +24,7 @@ MinHash::MinHash(
     size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
     size_t threadCountArgument,
     const MemoryMapped::Vector<KmerInfo>& kmerTable,
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const Markers& markers,
     MemoryMapped::Vector<OrientedReadPair>& candidateAlignments,
     const string& largeDataFileNamePrefix,
     size_t largeDataPageSize
@@ -3,6 +3,7 @@
 
 // shasta
 #include "Marker.hpp"
+#include "Markers.hpp"
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "MultitreadedObject.hpp"
 #include "OrientedReadPair.hpp"
@@ -32,7 +33,7 @@ public:
         size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
         size_t threadCount,
         const MemoryMapped::Vector<KmerInfo>& kmerTable,
-        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>&,
+        const Markers&,
         MemoryMapped::Vector<OrientedReadPair>&,
         const string& largeDataFileNamePrefix,
         size_t largeDataPageSize
@@ -46,7 +47,7 @@ private:
     size_t minFrequency;            // Minimum number of minHash hits for a pair to be considered a candidate.
     size_t threadCount;
     const MemoryMapped::Vector<KmerInfo>& kmerTable;
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
+    const Markers& markers;
     const string& largeDataFileNamePrefix;
     size_t largeDataPageSize;
 
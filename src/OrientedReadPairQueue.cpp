@@ -0,0 +1,70 @@
+#include "OrientedReadPairQueue.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+
+
+OrientedReadPairQueue::OrientedReadPairQueue(size_t maxBatchCount) :
+    maxBatchCount(maxBatchCount)
+{
+    CZI_ASSERT(maxBatchCount > 0);
+}
+
+
+
+// Add a batch to the queue, waiting if the queue is full.
+// On return, the batch is empty.
+void OrientedReadPairQueue::push(vector<OrientedReadPair>& batch)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        conditionVariable.wait(lock,
+            [this]{return batches.size() < maxBatchCount;});
+        CZI_ASSERT(!isClosed);
+        pairCount += batch.size();
+        batches.push_back(vector<OrientedReadPair>());
+        batches.back().swap(batch);
+    }
+    conditionVariable.notify_all();
+}
+
+
+
+// Get a batch from the queue, waiting if the queue is empty.
+// Returns false if the queue is empty and closed.
+bool OrientedReadPairQueue::pop(vector<OrientedReadPair>& batch)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        conditionVariable.wait(lock,
+            [this]{return isClosed || !batches.empty();});
+        if(batches.empty()) {
+            return false;
+        }
+        batch.swap(batches.front());
+        batches.pop_front();
+    }
+    conditionVariable.notify_all();
+    return true;
+}
+
+
+
+// Signal that no more batches will be pushed.
+void OrientedReadPairQueue::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isClosed = true;
+    }
+    conditionVariable.notify_all();
+}
+
+
+
+uint64_t OrientedReadPairQueue::pushedPairCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pairCount;
+}
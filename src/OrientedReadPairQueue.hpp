@@ -0,0 +1,69 @@
+#ifndef CZI_SHASTA_ORIENTED_READ_PAIR_QUEUE_HPP
+#define CZI_SHASTA_ORIENTED_READ_PAIR_QUEUE_HPP
+
+/*******************************************************************************
+
+Bounded queue used to pass batches of OrientedReadPair objects
+from producer threads to consumer threads.
+
+This is used to stream alignment candidates found by LowHash
+directly to the threads that compute alignments, without storing
+all alignment candidates.
+
+Producers call push, which waits while the queue contains
+the maximum number of batches. When all producers are done,
+close must be called. Consumers call pop, which waits while the queue
+is empty, and returns false when the queue is empty and closed.
+
+Batches are moved in and out of the queue by swapping vectors,
+so no copying takes place.
+
+*******************************************************************************/
+
+// Shasta.
+#include "OrientedReadPair.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "vector.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class OrientedReadPairQueue;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::OrientedReadPairQueue {
+public:
+
+    OrientedReadPairQueue(size_t maxBatchCount);
+
+    // Add a batch to the queue, waiting if the queue is full.
+    // On return, the batch is empty.
+    void push(vector<OrientedReadPair>& batch);
+
+    // Get a batch from the queue, waiting if the queue is empty.
+    // Returns false if the queue is empty and closed.
+    bool pop(vector<OrientedReadPair>& batch);
+
+    // Signal that no more batches will be pushed.
+    void close();
+
+    // Return the total number of pairs pushed.
+    uint64_t pushedPairCount();
+
+private:
+    size_t maxBatchCount;
+    bool isClosed = false;
+    uint64_t pairCount = 0;
+    std::deque< vector<OrientedReadPair> > batches;
+    std::mutex mutex;
+    std::condition_variable conditionVariable;
+};
+
+#endif
@@ -1,9 +1,12 @@
 #ifndef SHASTA_STATIC_EXECUTABLE
 
 // Shasta.
+#include "LazyAlignmentGraph.hpp"
 #include "Assembler.hpp"
 #include "Base.hpp"
 #include "CompactUndirectedGraph.hpp"
+#include "compressAlignment.hpp"
+#include "computeRunLengthRepresentation.hpp"
 #include "dset64Test.hpp"
 #include "LongBaseSequence.hpp"
 #include "mappedCopy.hpp"
@@ -58,12 +61,33 @@ PYBIND11_MODULE(shasta, module)
         // Reads
         .def("addReadsFromFasta",
             &Assembler::addReadsFromFasta,
-            "Add reads from a fasta file.",
+            "Add reads from a fasta or fastq file, possibly gzip-compressed.",
             arg("fileName"),
             arg("minReadLength"),
             arg("blockSize") = 2ULL * 1024ULL * 1024ULL * 1024ULL,
             arg("threadCountForReading") = 1,
-            arg("threadCountForProcessing") = 0)
+            arg("threadCountForProcessing") = 0,
+            arg("targetBaseCount") = 0)
+        .def("addReads",
+            &Assembler::addReads,
+            "Add reads from a list of fasta or fastq files, "
+            "processing several files at the same time.",
+            arg("fileNames"),
+            arg("minReadLength"),
+            arg("blockSize") = 2ULL * 1024ULL * 1024ULL * 1024ULL,
+            arg("concurrentFileCount") = 0,
+            arg("threadCount") = 0,
+            arg("targetBaseCount") = 0)
+        .def("compressReadRepeatCounts",
+            &Assembler::compressReadRepeatCounts,
+            "Store read repeat counts using about 4 bits per base. "
+            "No more reads can be added after this.",
+            arg("threadCount") = 0)
+        .def("compressReadNames",
+            &Assembler::compressReadNames,
+            "Store read names in a compact, tokenized representation. "
+            "If called before adding reads, names are encoded as reads are added.",
+            arg("threadCount") = 0)
         .def("histogramReadLength",
             &Assembler::histogramReadLength,
             "Create a histogram of read length and write it to a csv file.",
@@ -110,16 +134,33 @@ PYBIND11_MODULE(shasta, module)
             arg("k"),
             arg("probability"),
             arg("seed") = 231)
+        .def("selectKmersByHash",
+            &Assembler::selectKmersByHash,
+            arg("k"),
+            arg("probability"),
+            arg("seed") = 231)
+        .def("maskKmersByFrequency",
+            &Assembler::maskKmersByFrequency,
+            arg("minFrequency"),
+            arg("maxFrequency"),
+            arg("threadCount") = 0)
 
 
 
          // Markers.
         .def("accessMarkers",
             &Assembler::accessMarkers)
+        .def("computeSortedMarkers",
+            &Assembler::computeSortedMarkers,
+            arg("threadCount") = 0)
+        .def("accessSortedMarkers",
+            &Assembler::accessSortedMarkers)
         .def("findMarkers",
             &Assembler::findMarkers,
             "Find markers in reads.",
-            arg("threadCount") = 0)
+            arg("threadCount") = 0,
+            arg("storeMarkersForStrand0Only") = false,
+            arg("compressMarkers") = false)
         .def("writeMarkers",
             (
                 void (Assembler::*)
@@ -150,6 +191,10 @@ PYBIND11_MODULE(shasta, module)
             arg("log2MinHashBucketCount") = 0,
             arg("maxBucketSize"),
             arg("minFrequency"),
+            arg("useRollingHash") = false,
+            arg("maxDiagonalDelta") = 0,
+            arg("bucketPassCount") = 1,
+            arg("targetCandidatesPerRead") = 0.,
             arg("threadCount") = 0)
         .def("accessAlignmentCandidates",
             &Assembler::accessAlignmentCandidates)
@@ -198,11 +243,48 @@ PYBIND11_MODULE(shasta, module)
         // Compute an alignment for each alignment candidate.
         .def("computeAlignments",
             &Assembler::computeAlignments,
+            "Compute an alignment for each alignment candidate. "
+            "alignMethod 0 uses the alignment graph, "
+            "alignMethod 1 finds the same shortest path "
+            "without storing the edges of the alignment graph (experimental).",
+            arg("maxMarkerFrequency"),
+            arg("maxSkip"),
+            arg("minAlignedMarkerCount"),
+            arg("maxTrim"),
+            arg("alignMethod") = 0,
+            arg("bandHalfWidth") = 0,
+            arg("storeAlignments") = false,
+            arg("maxCandidatesPerRead") = 0,
+            arg("threadCount") = 0)
+        .def("findAlignmentCandidatesLowHashAndComputeAlignments",
+            &Assembler::findAlignmentCandidatesLowHashAndComputeAlignments,
+            "Pipelined findAlignmentCandidatesLowHash and computeAlignments. "
+            "alignMethod is as in computeAlignments.",
+            arg("m"),
+            arg("hashFraction"),
+            arg("minHashIterationCount"),
+            arg("log2MinHashBucketCount") = 0,
+            arg("maxBucketSize"),
+            arg("minFrequency"),
+            arg("useRollingHash") = false,
+            arg("maxDiagonalDelta") = 0,
+            arg("bucketPassCount") = 1,
+            arg("targetCandidatesPerRead") = 0.,
             arg("maxMarkerFrequency"),
             arg("maxSkip"),
             arg("minAlignedMarkerCount"),
             arg("maxTrim"),
+            arg("alignMethod") = 0,
+            arg("bandHalfWidth") = 0,
+            arg("storeAlignments") = false,
+            arg("sendThreadCount") = 0,
             arg("threadCount") = 0)
+        .def("compareAlignmentMethods",
+            &Assembler::compareAlignmentMethods,
+            arg("maxMarkerFrequency"),
+            arg("maxSkip"),
+            arg("bandHalfWidth") = 0,
+            arg("candidateCount") = 10000)
         .def("accessAlignmentData",
             &Assembler::accessAlignmentData)
 
@@ -472,6 +554,30 @@ PYBIND11_MODULE(shasta, module)
     module.def("testSplitRange",
         testSplitRange
         );
+    module.def("testCompressedRepeatCounts",
+        testCompressedRepeatCounts
+        );
+    module.def("testCompressAlignment",
+        testCompressAlignment
+        );
+    module.def("testLowHashFeatureHash",
+        testLowHashFeatureHash
+        );
+    module.def("testCompressedReadNames",
+        testCompressedReadNames
+        );
+    module.def("testMarkers",
+        testMarkers
+        );
+    module.def("testKmerHashSelection",
+        testKmerHashSelection
+        );
+    module.def("testLazyAlignmentGraph",
+        testLazyAlignmentGraph
+        );
+    module.def("testComputeRunLengthRepresentation",
+        testComputeRunLengthRepresentation
+        );
     module.def("testCompactUndirectedGraph1",
         testCompactUndirectedGraph1
         );
@@ -8,6 +8,7 @@ using namespace shasta;
 
 // Standard library.
 #include "tuple.hpp"
+#include <cstring>
 
 
 
@@ -22,17 +23,31 @@ ReadLoader::ReadLoader(
     size_t pageSize,
     LongBaseSequences& reads,
     MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
-    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts) :
+    CompressedReadNames& compressedReadNames,
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+    LongestReadsFilter* longestReadsFilter,
+    ostream& out,
+    vector<uint64_t>* readLengths) :
 
     MultithreadedObject(*this),
+    out(out),
+    reads(reads),
+    readNames(readNames),
+    compressedReadNames(compressedReadNames),
+    readRepeatCounts(readRepeatCounts),
+    readLengths(readLengths),
+    compressNames(compressedReadNames.isOpen()),
+    storeNamesInReadNames(readNames.isOpen()),
     minReadLength(minReadLength),
+    longestReadsFilter(longestReadsFilter),
     blockSize(blockSize),
     threadCountForReading(threadCountForReadingArgument),
     threadCountForProcessing(threadCountForProcessingArgument)
 {
-    cout << timestamp << "Loading reads from " << fileName << "." << endl;
-    cout << "Input file block size: " << blockSize << " bytes." << endl;
+    out << timestamp << "Loading reads from " << fileName << "." << endl;
+    out << "Input file block size: " << blockSize << " bytes." << endl;
     const auto tBegin = std::chrono::steady_clock::now();
+    CZI_ASSERT(storeNamesInReadNames || compressNames);
 
     // Adjust the numbers of threads, if necessary.
     if(threadCountForReading == 0) {
@@ -41,27 +56,41 @@ ReadLoader::ReadLoader(
     if(threadCountForProcessing == 0) {
         threadCountForProcessing = std::thread::hardware_concurrency();
     }
-    cout << "Using " << threadCountForReading << " threads for reading and ";
-    cout << threadCountForProcessing << " threads for processing." << endl;
-
-    // Allocate space to keep a block of the file.
-    buffer.reserve(blockSize);
+    out << "Using " << threadCountForReading << " threads for reading and ";
+    out << threadCountForProcessing << " threads for processing." << endl;
 
     // Open the input file.
-    fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    // A file name of "-" means standard input.
+    if(fileName == "-") {
+        fileDescriptor = ::dup(STDIN_FILENO);
+    } else {
+        fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    }
     if(fileDescriptor == -1) {
         throw runtime_error("Error opening " + fileName + " for read.");
     }
 
     // Find the size of the input file.
     getFileSize();
-    cout << "Input file size is " << fileSize << " bytes." << endl;
+
+    // Decide whether to use streaming input.
+    const string gzExtension = ".gz";
+    const bool isGzip =
+        fileName.size() > gzExtension.size() &&
+        fileName.compare(fileName.size()-gzExtension.size(), gzExtension.size(), gzExtension) == 0;
+    isStreaming = isGzip || !isRegularFile;
+    if(isStreaming) {
+        out << "Input file will be read in streaming mode." << endl;
+    } else {
+        out << "Input file size is " << fileSize << " bytes." << endl;
+    }
 
     // Allocate space for the data structures where
     // each thread stores the reads it found and their names.
     threadReadNames.resize(threadCountForProcessing);
     threadReads.resize(threadCountForProcessing);
     threadReadRepeatCounts.resize(threadCountForProcessing);
+    threadReadLengths.resize(threadCountForProcessing);
     for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
         threadReadNames[threadId] = make_shared< MemoryMapped::VectorOfVectors<char, uint64_t> >();
         threadReadNames[threadId]->createNew(
@@ -74,82 +103,358 @@ ReadLoader::ReadLoader(
             threadDataName(dataNamePrefix, threadId, "ReadRepeatCounts"), pageSize);
     }
 
+    // Read and process the input file, one block at a time.
+    if(isStreaming) {
+        processStreamingInput(fileName);
+    } else {
+        processRegularFile(fileName);
+    }
+    out << timestamp << "Done processing input file." << endl;
+
+    // Remove the temporary data used for thread storage.
+    for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
+        threadReadNames[threadId]->remove();
+        threadReads[threadId]->remove();
+        threadReadRepeatCounts[threadId]->remove();
+    }
+
+    // At this point, blockBegin is the total number of input bytes processed.
+    const auto tEnd = std::chrono::steady_clock::now();
+    const double tTotal = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tBegin)).count());
+    out << "Processed " << blockBegin << " bytes in " << tTotal;
+    out << "s, " << double(blockBegin)/tTotal << " bytes/s." << endl;
+    out << "Stored " << readCount << " reads." << endl;
+    out << timestamp << "Done loading reads." << endl;
+}
+
+
+
+// Read and process a regular file.
+// Each block is read directly from the file,
+// possibly using multiple threads.
+void ReadLoader::processRegularFile(const string& fileName)
+{
+    // Allocate space to keep a block of the file.
+    buffer.reserve(blockSize);
 
     // Main loop over blocks in the input file.
     for(blockBegin=0; blockBegin<fileSize; ) {
 
         // Read this block.
         blockEnd = min(blockBegin+blockSize, fileSize);
-        cout << timestamp << "Reading " << fileName << " block " << blockBegin << " " << blockEnd << ", " << blockEnd-blockBegin << " bytes." << endl;
+        out << timestamp << "Reading " << fileName << " block " << blockBegin << " " << blockEnd << ", " << blockEnd-blockBegin << " bytes." << endl;
         const auto t0 = std::chrono::steady_clock::now();
         readBlock(threadCountForReading);
         const auto t1 = std::chrono::steady_clock::now();
         const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
-        cout << "Block read in " << t01 << " s at " << double(blockEnd-blockBegin)/t01 << " bytes/s." << endl;
+        out << "Block read in " << t01 << " s at " << double(blockEnd-blockBegin)/t01 << " bytes/s." << endl;
         // cout << leftOver.size() << " characters in this block will be processed with the next block." << endl;
 
-        // Process this block in parallel.
-        // This does not use load balancing. Each thread is assigned a predetermined
-        // portion of this block. This way, we store the reads in the same
-        // order as they appear in the input file.
-        cout << "Processing " << buffer.size() << " input characters." << endl;
-        const auto t2 = std::chrono::steady_clock::now();
-        runThreads(&ReadLoader::processThreadFunction, threadCountForProcessing);
-        const auto t3 = std::chrono::steady_clock::now();
-        const double t23 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2)).count());
-        cout << "Block processed in " << t23 << " s." << endl;
-
-        // Permanently store the reads found by each thread.
-        // We could speed this up by just making space in single threaded code,
-        // then copying the data in multi threaded code.
-        // cout << timestamp << "Storing reads for this block." << endl;
-        const auto t4 = std::chrono::steady_clock::now();
-        for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
-            MemoryMapped::VectorOfVectors<char, uint64_t>& thisThreadReadNames = *(threadReadNames[threadId]);
-            LongBaseSequences& thisThreadReads = *(threadReads[threadId]);
-            const size_t n = thisThreadReadNames.size();
-            CZI_ASSERT(thisThreadReads.size() == n);
-            MemoryMapped::VectorOfVectors<uint8_t, uint64_t>* thisThreadReadRepeatCounts = 0;
-            thisThreadReadRepeatCounts = threadReadRepeatCounts[threadId].get();
-            CZI_ASSERT(thisThreadReadRepeatCounts->size() == n);
-            for(size_t i=0; i<n; i++) {
-                readNames.appendVector(thisThreadReadNames.begin(i), thisThreadReadNames.end(i));
-                reads.append(thisThreadReads[i]);
-                const size_t j = readRepeatCounts.size();
-                readRepeatCounts.appendVector(thisThreadReadRepeatCounts->size(i));
-                copy(
-                    thisThreadReadRepeatCounts->begin(i),
-                    thisThreadReadRepeatCounts->end(i),
-                    readRepeatCounts.begin(j));
-            }
-            thisThreadReadNames.clear();
-            thisThreadReads.clear();
-            thisThreadReadRepeatCounts->clear();
-        }
-        const auto t5 = std::chrono::steady_clock::now();
-        const double t45 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t5 - t4)).count());
-        cout << "Reads for this block stored in " << t45 << " s." << endl;
+        // Process this block in parallel and store the reads it contains.
+        processBlock();
+        storeReads();
 
         // Prepare to process the next block.
         blockBegin = blockEnd;
     }
-    cout << timestamp << "Done processing fasta file." << endl;
-
 
     // Close the input file.
     ::close(fileDescriptor);
+    fileDescriptor = -1;
+}
 
-    // Remove the temporary data used for thread storage.
+
+
+// Process the block currently in the buffer, in parallel.
+// This does not use load balancing. Each thread is assigned a predetermined
+// portion of this block. This way, we store the reads in the same
+// order as they appear in the input file.
+void ReadLoader::processBlock()
+{
+    out << "Processing " << buffer.size() << " input characters." << endl;
+    const auto t2 = std::chrono::steady_clock::now();
+    runThreads(&ReadLoader::processThreadFunction, threadCountForProcessing);
+    const auto t3 = std::chrono::steady_clock::now();
+    const double t23 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2)).count());
+    out << "Block processed in " << t23 << " s." << endl;
+}
+
+
+
+// Permanently store the reads found by each thread.
+// Space for all the reads is made at the end first,
+// then each thread copies its reads to their final position.
+void ReadLoader::storeReads()
+{
+    // cout << timestamp << "Storing reads for this block." << endl;
+    const auto t4 = std::chrono::steady_clock::now();
+
+    // Update the length cutoff, if we are keeping only the longest reads,
+    // and store the read lengths, if requested.
     for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
-        threadReadNames[threadId]->remove();
-        threadReads[threadId]->remove();
-        threadReadRepeatCounts[threadId]->remove();
+        vector<uint64_t>& thisThreadReadLengths = threadReadLengths[threadId];
+        if(longestReadsFilter) {
+            longestReadsFilter->add(thisThreadReadLengths);
+        }
+        if(readLengths) {
+            readLengths->insert(readLengths->end(),
+                thisThreadReadLengths.begin(), thisThreadReadLengths.end());
+        }
+        thisThreadReadLengths.clear();
+    }
+
+    // Find the index at which each thread stores its first read.
+    threadFirstReadIndex.resize(threadCountForProcessing + 1);
+    threadFirstReadIndex[0] = reads.size();
+    for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
+        threadFirstReadIndex[threadId + 1] = threadFirstReadIndex[threadId] + threadReads[threadId]->size();
+    }
+
+    // Make space for the reads.
+    for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
+        LongBaseSequences& thisThreadReads = *(threadReads[threadId]);
+        const MemoryMapped::VectorOfVectors<char, uint64_t>& thisThreadReadNames = *(threadReadNames[threadId]);
+        for(size_t i=0; i<thisThreadReads.size(); i++) {
+            const uint64_t baseCount = thisThreadReads[i].baseCount;
+            reads.append(size_t(baseCount));
+            readRepeatCounts.appendVector(baseCount);
+            if(storeNamesInReadNames) {
+                readNames.appendVector(thisThreadReadNames.size(i));
+            } else {
+                compressedReadNames.appendEncoded(thisThreadReadNames.size(i));
+            }
+        }
+    }
+
+    // Copy the reads to their final position.
+    runThreads(&ReadLoader::storeThreadFunction, threadCountForProcessing);
+    readCount += threadFirstReadIndex.back() - threadFirstReadIndex.front();
+
+    const auto t5 = std::chrono::steady_clock::now();
+    const double t45 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t5 - t4)).count());
+    out << "Reads for this block stored in " << t45 << " s." << endl;
+}
+
+
+
+// Copy the reads found by this thread to their final position,
+// then clear them.
+void ReadLoader::storeThreadFunction(size_t threadId)
+{
+    MemoryMapped::VectorOfVectors<char, uint64_t>& thisThreadReadNames = *(threadReadNames[threadId]);
+    LongBaseSequences& thisThreadReads = *(threadReads[threadId]);
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& thisThreadReadRepeatCounts =
+        *(threadReadRepeatCounts[threadId]);
+    const size_t n = thisThreadReads.size();
+    CZI_ASSERT(thisThreadReadNames.size() == n);
+    CZI_ASSERT(thisThreadReadRepeatCounts.size() == n);
+
+    uint64_t readIndex = threadFirstReadIndex[threadId];
+    for(size_t i=0; i<n; i++, readIndex++) {
+        const LongBaseSequenceView source = thisThreadReads[i];
+        const LongBaseSequenceView destination = reads[readIndex];
+        CZI_ASSERT(destination.baseCount == source.baseCount);
+        copy(
+            source.begin,
+            source.begin + LongBaseSequenceView::wordCount(source.baseCount),
+            destination.begin);
+        copy(
+            thisThreadReadRepeatCounts.begin(i),
+            thisThreadReadRepeatCounts.end(i),
+            readRepeatCounts.begin(readIndex));
+        if(storeNamesInReadNames) {
+            copy(
+                thisThreadReadNames.begin(i),
+                thisThreadReadNames.end(i),
+                readNames.begin(readIndex));
+        } else {
+            compressedReadNames.storeEncoded(readIndex,
+                reinterpret_cast<const uint8_t*>(thisThreadReadNames.begin(i)),
+                reinterpret_cast<const uint8_t*>(thisThreadReadNames.end(i)));
+        }
+    }
+
+    thisThreadReadNames.clear();
+    thisThreadReads.clear();
+    thisThreadReadRepeatCounts.clear();
+}
+
+
+
+// Read and process a gzip-compressed file, standard input, a pipe,
+// or any other input that cannot be read with random access.
+// A separate thread decompresses the input into a ring of
+// streamingBlockCount blocks, while this thread
+// processes blocks as they become available.
+// This way, decompression overlaps with processing,
+// and the uncompressed input is never written to disk.
+// Uncompressed input is also accepted and passed through
+// unchanged by zlib.
+void ReadLoader::processStreamingInput(const string& fileName)
+{
+    // From now on the file descriptor is owned by gzipFile
+    // and will be closed by gzclose.
+    gzipFile = ::gzdopen(fileDescriptor, "rb");
+    if(!gzipFile) {
+        throw runtime_error("Error opening " + fileName + " for streaming input.");
+    }
+    fileDescriptor = -1;
+    ::gzbuffer(gzipFile, 1024 * 1024);
+
+    // Each block in the ring gets a fraction of the block size,
+    // so the total memory used for streaming stays under control.
+    streamingBlockSize = max(size_t(1), blockSize / streamingBlockCount);
+    out << "Using " << streamingBlockCount << " streaming blocks of " <<
+        streamingBlockSize << " bytes each." << endl;
+    streamingBlocks.resize(streamingBlockCount);
+    filledStreamingBlockCount = 0;
+    streamingErrorMessage.clear();
+
+    // Start the thread that decompresses the input into the ring of blocks.
+    stopStreaming = false;
+    std::thread decompressThread(&ReadLoader::decompressThreadFunction, this);
+
+    // If anything fails, stop the decompression thread and wait for it
+    // before rethrowing, so it is not destroyed while still joinable.
+    try {
+        processStreamingBlocks(fileName);
+    } catch(...) {
+        {
+            std::lock_guard<std::mutex> lock(streamingMutex);
+            stopStreaming = true;
+        }
+        streamingConditionVariable.notify_all();
+        decompressThread.join();
+        ::gzclose(gzipFile);
+        gzipFile = 0;
+        throw;
+    }
+
+    decompressThread.join();
+    ::gzclose(gzipFile);
+    gzipFile = 0;
+}
+
+
+
+// The main loop of processStreamingInput. It processes the blocks
+// in the same circular order used by decompressThreadFunction.
+void ReadLoader::processStreamingBlocks(const string& fileName)
+{
+    blockBegin = 0;
+    for(size_t i=0; ; i=(i+1)%streamingBlockCount) {
+
+        // Wait for this block to be filled.
+        const auto t0 = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(streamingMutex);
+            streamingConditionVariable.wait(lock,
+                [this]{return filledStreamingBlockCount > 0;});
+        }
+        StreamingBlock& block = streamingBlocks[i];
+        if(block.isLast && !streamingErrorMessage.empty()) {
+            throw runtime_error("Error reading " + fileName + ": " + streamingErrorMessage);
+        }
+
+        // Copy the leftOver data and then this block to the buffer.
+        blockEnd = blockBegin + block.data.size();
+        buffer.resize(leftOver.size() + block.data.size());
+        copy(leftOver.begin(), leftOver.end(), buffer.begin());
+        copy(block.data.begin(), block.data.end(), buffer.begin() + leftOver.size());
+        leftOver.clear();
+        const bool isLastBlock = block.isLast;
+
+        // Give the block back to decompressThreadFunction.
+        {
+            std::lock_guard<std::mutex> lock(streamingMutex);
+            --filledStreamingBlockCount;
+        }
+        streamingConditionVariable.notify_all();
+        const auto t1 = std::chrono::steady_clock::now();
+        const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
+        out << timestamp << "Streaming block " << blockBegin << " " << blockEnd << ", " <<
+            blockEnd-blockBegin << " bytes, available after " << t01 << " s." << endl;
+
+        // Process this block and store the reads it contains.
+        if(!buffer.empty()) {
+            checkBufferBegin();
+            if(!isLastBlock) {
+                moveLastReadToLeftOver();
+            }
+            processBlock();
+            storeReads();
+        }
+
+        // Prepare to process the next block.
+        blockBegin = blockEnd;
+        if(isLastBlock) {
+            break;
+        }
+    }
+}
+
+
+
+// The function run by the thread that decompresses streaming input.
+// It fills the blocks of the ring in circular order,
+// waiting when all blocks are full.
+// The last block filled has isLast set.
+void ReadLoader::decompressThreadFunction()
+{
+    for(size_t i=0; ; i=(i+1)%streamingBlockCount) {
+
+        // Wait for a block to become available.
+        {
+            std::unique_lock<std::mutex> lock(streamingMutex);
+            streamingConditionVariable.wait(lock,
+                [this]{return filledStreamingBlockCount < streamingBlockCount || stopStreaming;});
+            if(stopStreaming) {
+                return;
+            }
+        }
+
+        // Fill this block.
+        // gzread only returns fewer bytes than requested at end of file.
+        StreamingBlock& block = streamingBlocks[i];
+        block.isLast = false;
+        block.data.resize(streamingBlockSize);
+        size_t byteCount = 0;
+        while(byteCount < streamingBlockSize) {
+            const unsigned int bytesToRead =
+                unsigned(min(streamingBlockSize - byteCount, size_t(1) << 30));
+            const int n = ::gzread(gzipFile, block.data.data() + byteCount, bytesToRead);
+            if(n < 0) {
+                int errorNumber;
+                streamingErrorMessage = ::gzerror(gzipFile, &errorNumber);
+                block.isLast = true;
+                break;
+            }
+            if(n == 0) {
+                // End of file. Check for a truncated gzip stream.
+                int errorNumber;
+                const char* errorMessage = ::gzerror(gzipFile, &errorNumber);
+                if(errorNumber != Z_OK) {
+                    streamingErrorMessage = errorMessage;
+                }
+                block.isLast = true;
+                break;
+            }
+            byteCount += size_t(n);
+        }
+        block.data.resize(byteCount);
+        const bool isLastBlock = block.isLast;
+
+        // Hand the block to the processing thread.
+        {
+            std::lock_guard<std::mutex> lock(streamingMutex);
+            ++filledStreamingBlockCount;
+        }
+        streamingConditionVariable.notify_all();
+
+        if(isLastBlock) {
+            return;
+        }
     }
-    const auto tEnd = std::chrono::steady_clock::now();
-    const double tTotal = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tBegin)).count());
-    cout << "Processed " << fileSize << " bytes in " << tTotal;
-    cout << "s, " << double(fileSize)/tTotal << " bytes/s." << endl;
-    cout << timestamp << "Done loading reads." << endl;
 }
 
 
@@ -180,6 +485,7 @@ void ReadLoader::getFileSize()
         throw runtime_error("Error from fstat.");
     }
     fileSize = buffer.st_size;
+    isRegularFile = S_ISREG(buffer.st_mode);
 }
 
 
@@ -205,30 +511,52 @@ void ReadLoader::readBlock(size_t threadCount)
         readBlockParallel(threadCount);
     }
 
-    if(buffer.front() != '>') {
-        throw runtime_error("Expected '>' at beginning of a block.");
+    checkBufferBegin();
+    if(blockEnd != fileSize) {
+        moveLastReadToLeftOver();
     }
+}
 
-    if(blockEnd != fileSize) {
-        // Go back to the beginning of the last read in the buffer.
-        size_t bufferIndex=buffer.size()-1;
-        for(; bufferIndex>0; bufferIndex--) {
-            if(readBeginsHere(bufferIndex)) {
-                break;
-            }
-        }
-        CZI_ASSERT(buffer[bufferIndex]=='>' && (bufferIndex==0 || buffer[bufferIndex-1]=='\n'));
 
-        // Throw away what follows, store it as leftover.
-        leftOver.clear();
-        leftOver.resize(buffer.size() - bufferIndex);
-        copy(buffer.begin()+bufferIndex, buffer.end(), leftOver.begin());
-        buffer.resize(bufferIndex);
+
+// Check that the buffer begins with the character that introduces a read.
+// For the first block, also use the first character to
+// determine the file format.
+void ReadLoader::checkBufferBegin()
+{
+    if(blockBegin == 0) {
+        setFileFormat();
+    }
+    if(buffer.front() != readBeginCharacter()) {
+        throw runtime_error(string("Expected '") + readBeginCharacter() +
+            "' at beginning of a block.");
     }
 }
 
 
 
+// Move to the leftOver data the final, possibly partial,
+// read in the buffer.
+void ReadLoader::moveLastReadToLeftOver()
+{
+    // Go back to the beginning of the last read in the buffer.
+    size_t bufferIndex=buffer.size()-1;
+    for(; bufferIndex>0; bufferIndex--) {
+        if(readBeginsHere(bufferIndex)) {
+            break;
+        }
+    }
+    CZI_ASSERT(buffer[bufferIndex]==readBeginCharacter() && (bufferIndex==0 || buffer[bufferIndex-1]=='\n'));
+
+    // Throw away what follows, store it as leftover.
+    leftOver.clear();
+    leftOver.resize(buffer.size() - bufferIndex);
+    copy(buffer.begin()+bufferIndex, buffer.end(), leftOver.begin());
+    buffer.resize(bufferIndex);
+}
+
+
+
 void ReadLoader::readBlockSequential()
 {
 
@@ -281,58 +609,51 @@ void ReadLoader::processThreadFunction(size_t threadId)
     LongBaseSequences& thisThreadReads = *(threadReads[threadId]);
     MemoryMapped::VectorOfVectors<uint8_t, uint64_t>* thisThreadReadRepeatCounts = 0;
     thisThreadReadRepeatCounts = threadReadRepeatCounts[threadId].get();
+    vector<uint64_t>& thisThreadReadLengths = threadReadLengths[threadId];
+    const bool storeReadLengths = longestReadsFilter || readLengths;
 
     // Main loop over the buffer slice assigned to this thread.
     string readName;
-    vector<Base> read;
-    vector<Base> runLengthRead;
+    size_t sequenceBegin;
+    size_t sequenceLength;
+    vector<uint64_t> runLengthRead;
+    uint64_t runLengthBaseCount;
     vector<uint8_t> readRepeatCount;
+    vector<uint32_t> runBegins;
+    vector<uint8_t> encodedName;
     while(bufferIndex < sliceEnd) {
 
-        // Skip the '>' that introduces the new read.
-        if(buffer[bufferIndex++] != '>')
-        {
-            throw runtime_error("The sequence of each read must be on a "
-                "single line of the input fasta file.");
-        }
-
-        // Extract the read name and discard the rest of the line.
-        readName.clear();
-        bool blankFound = false;
-        while(bufferIndex < buffer.size()) {
-            const char c = buffer[bufferIndex++];
-            if(c == '\n') {
-                break;
-            }
-            if(c==' ') {
-                blankFound = true;
-            }
-            if(!blankFound) {
-                readName.push_back(c);
-            }
-        }
-        // cout << readName << endl;
-
-
-        // Read the base characters.
-        read.clear();
-        while(bufferIndex < buffer.size()) {
-            const char c = buffer[bufferIndex++];
-            if(c == '\n') {
-                break;
-            }
-            read.push_back(Base::fromCharacter(c));
+        // Parse the read name and locate its bases.
+        if(fileFormat == FileFormat::fastq) {
+            parseFastqRead(bufferIndex, readName, sequenceBegin, sequenceLength);
+        } else {
+            parseFastaRead(bufferIndex, readName, sequenceBegin, sequenceLength);
         }
 
         // If the read is too short, skip it.
-        if(read.size() < minReadLength) {
+        if(sequenceLength < minReadLength) {
+            continue;
+        }
+        if(longestReadsFilter && sequenceLength < longestReadsFilter->getLengthCutoff()) {
             continue;
         }
 
         // Store the read bases.
-        if(computeRunLengthRead(read, runLengthRead, readRepeatCount)) {
-            thisThreadReadNames.appendVector(readName.begin(), readName.end());
-            thisThreadReads.append(runLengthRead);
+        const char* sequence = buffer.data() + sequenceBegin;
+        if(computeRunLengthRead(sequence, sequence + sequenceLength,
+            runLengthRead, runLengthBaseCount, readRepeatCount, runBegins)) {
+            if(storeReadLengths) {
+                thisThreadReadLengths.push_back(sequenceLength);
+            }
+            const char* nameBegin = readName.data();
+            const char* nameEnd = nameBegin + readName.size();
+            if(compressNames) {
+                compressedReadNames.encode(nameBegin, nameEnd, encodedName);
+                nameBegin = reinterpret_cast<const char*>(encodedName.data());
+                nameEnd = nameBegin + encodedName.size();
+            }
+            thisThreadReadNames.appendVector(nameBegin, nameEnd);
+            thisThreadReads.append(LongBaseSequenceView(runLengthRead.data(), runLengthBaseCount));
             thisThreadReadRepeatCounts->appendVector(readRepeatCount);
         }
     }
@@ -348,7 +669,7 @@ void ReadLoader::readThreadFunction(size_t threadId)
 
     // Read all the data in the slice.
     size_t bytesToRead = sliceEnd - sliceBegin;
-    char* bufferPointer = buffer.data() + leftOver.size() + sliceBegin;
+    char* bufferPointer = buffer.data() + leftOver.size() + (sliceBegin - blockBegin);
     size_t offset = sliceBegin;
     while(bytesToRead) {
         const ssize_t byteCount = ::pread(fileDescriptor, bufferPointer, bytesToRead, offset);
@@ -363,9 +684,34 @@ void ReadLoader::readThreadFunction(size_t threadId)
 
 
 
+// Determine the format of the input file from the
+// first character of the first block.
+void ReadLoader::setFileFormat()
+{
+    CZI_ASSERT(!buffer.empty());
+    switch(buffer.front()) {
+    case '>':
+        fileFormat = FileFormat::fasta;
+        out << "Input file is in fasta format." << endl;
+        break;
+    case '@':
+        fileFormat = FileFormat::fastq;
+        out << "Input file is in fastq format." << endl;
+        break;
+    default:
+        throw runtime_error("Input file does not begin with '>' (fasta) or '@' (fastq).");
+    }
+}
+
+
+
 // Return true if a read begins at this position in the buffer.
 bool ReadLoader::readBeginsHere(size_t bufferIndex) const
 {
+    if(fileFormat == FileFormat::fastq) {
+        return fastqReadBeginsHere(bufferIndex);
+    }
+
     const char c = buffer[bufferIndex];
     if(bufferIndex == 0) {
         CZI_ASSERT(c == '>');
@@ -377,16 +723,170 @@ bool ReadLoader::readBeginsHere(size_t bufferIndex) const
 
 
 
-// Given the raw representation of a read, compute its
+// For fastq, a quality line can begin with '@'.
+// So, to decide whether a fastq record begins at a given position,
+// we also check that the line two lines later begins with '+'.
+// A quality line beginning with '@' is followed by the name line
+// and then by the sequence line of the next record,
+// and a sequence line never begins with '+'.
+// This returns false if that line is not in the buffer.
+bool ReadLoader::fastqReadBeginsHere(size_t bufferIndex) const
+{
+    if(buffer[bufferIndex] != '@') {
+        return false;
+    }
+    if(bufferIndex>0 && buffer[bufferIndex-1]!='\n') {
+        return false;
+    }
+
+    // Skip the name line and the sequence line.
+    size_t newLineCount = 0;
+    for(++bufferIndex; bufferIndex<buffer.size(); ++bufferIndex) {
+        if(buffer[bufferIndex] == '\n') {
+            ++newLineCount;
+            if(newLineCount == 2) {
+                break;
+            }
+        }
+    }
+    ++bufferIndex;
+    if(bufferIndex >= buffer.size()) {
+        return false;
+    }
+    return buffer[bufferIndex] == '+';
+}
+
+
+
+// Skip to the beginning of the next line.
+void ReadLoader::skipLine(size_t& bufferIndex) const
+{
+    while(bufferIndex < buffer.size()) {
+        if(buffer[bufferIndex++] == '\n') {
+            break;
+        }
+    }
+}
+
+
+
+// Extract the read name from the current line and
+// discard the rest of the line.
+void ReadLoader::parseReadName(size_t& bufferIndex, string& readName) const
+{
+    readName.clear();
+    bool blankFound = false;
+    while(bufferIndex < buffer.size()) {
+        const char c = buffer[bufferIndex++];
+        if(c == '\n') {
+            break;
+        }
+        if(c==' ') {
+            blankFound = true;
+        }
+        if(!blankFound) {
+            readName.push_back(c);
+        }
+    }
+}
+
+
+
+void ReadLoader::parseFastaRead(
+    size_t& bufferIndex,
+    string& readName,
+    size_t& sequenceBegin,
+    size_t& sequenceLength) const
+{
+    // Skip the '>' that introduces the new read.
+    if(buffer[bufferIndex++] != '>')
+    {
+        throw runtime_error("The sequence of each read must be on a "
+            "single line of the input fasta file.");
+    }
+
+    // Extract the read name and discard the rest of the line.
+    parseReadName(bufferIndex, readName);
+
+    // Locate the base characters.
+    parseSequence(bufferIndex, sequenceBegin, sequenceLength);
+}
+
+
+
+void ReadLoader::parseFastqRead(
+    size_t& bufferIndex,
+    string& readName,
+    size_t& sequenceBegin,
+    size_t& sequenceLength) const
+{
+    // Skip the '@' that introduces the new read.
+    if(buffer[bufferIndex++] != '@')
+    {
+        throw runtime_error("Each read of the input fastq file must "
+            "consist of exactly 4 lines.");
+    }
+
+    // Extract the read name and discard the rest of the line.
+    parseReadName(bufferIndex, readName);
+
+    // Locate the base characters.
+    parseSequence(bufferIndex, sequenceBegin, sequenceLength);
+
+    // Skip the '+' line.
+    if(bufferIndex==buffer.size() || buffer[bufferIndex] != '+') {
+        throw runtime_error("Each read of the input fastq file must "
+            "consist of exactly 4 lines.");
+    }
+    skipLine(bufferIndex);
+
+    // Skip the quality line.
+    // We don't look for a newline in the first sequenceLength characters,
+    // so it does not matter what characters are used for quality values.
+    bufferIndex = min(bufferIndex + sequenceLength, buffer.size());
+    skipLine(bufferIndex);
+}
+
+
+
+// Locate the base characters of a read, which extend
+// to the end of the current line.
+// On return, bufferIndex points to the beginning of the next line.
+void ReadLoader::parseSequence(
+    size_t& bufferIndex,
+    size_t& sequenceBegin,
+    size_t& sequenceLength) const
+{
+    sequenceBegin = bufferIndex;
+    const char* begin = buffer.data() + bufferIndex;
+    const char* newLine = static_cast<const char*>(
+        std::memchr(begin, '\n', buffer.size() - bufferIndex));
+    if(newLine) {
+        sequenceLength = size_t(newLine - begin);
+        bufferIndex += sequenceLength + 1;
+    } else {
+        sequenceLength = buffer.size() - bufferIndex;
+        bufferIndex = buffer.size();
+    }
+}
+
+
+
+// Given the base characters of a read, compute its
 // run-length representation.
+// See computeRunLengthRepresentation.hpp.
 // This returns false if the read contains a homopolymer run
 // of more than 255 bases, which cannot be represented
 // with a one-byte repeat count.
 bool ReadLoader::computeRunLengthRead(
-    const vector<Base>& read,
-    vector<Base>& runLengthRead,
-    vector<uint8_t>& readRepeatCount)
+    const char* begin,
+    const char* end,
+    vector<uint64_t>& runLengthRead,
+    uint64_t& runLengthBaseCount,
+    vector<uint8_t>& readRepeatCount,
+    vector<uint32_t>& runBegins)
 {
-    return computeRunLengthRepresentation(read, runLengthRead, readRepeatCount);
+    return computeRunLengthRepresentation(
+        begin, end, runLengthRead, runLengthBaseCount, readRepeatCount, runBegins);
 }
 
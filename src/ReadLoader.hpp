@@ -2,13 +2,22 @@
 #define CZI_SHASTA_READ_LOADER_HPP
 
 // shasta
+#include "CompressedReadNames.hpp"
 #include "LongBaseSequence.hpp"
+#include "LongestReadsFilter.hpp"
 #include "MemoryMappedObject.hpp"
 #include "MultitreadedObject.hpp"
 
+// zlib, used for streaming input.
+#include <zlib.h>
+
 // Standard library.
+#include "iostream.hpp"
 #include "memory.hpp"
 #include "string.hpp"
+#include "vector.hpp"
+#include <condition_variable>
+#include <mutex>
 
 namespace ChanZuckerberg {
     namespace shasta {
@@ -18,12 +27,38 @@ namespace ChanZuckerberg {
 
 
 
-// Class used to load reads from a fasta file.
+// Class used to load reads from a fasta or fastq file.
+// The format is detected from the first character of the file
+// ('>' for fasta, '@' for fastq).
+// For fasta, the sequence of each read must be on a single line.
+// For fastq, each read must be a 4-line record
+// (name, sequence, '+' line, quality line).
+// Quality values are skipped.
+// Gzip-compressed files (extension .gz), standard input
+// (file name "-"), and pipes or other non-regular files
+// are read in streaming mode, without ever storing
+// the uncompressed input on disk.
+//
+// The reads are appended to the data structures passed
+// to the constructor, in the order in which they appear
+// in the input file. Several ReadLoaders can run concurrently
+// as long as each of them stores its reads in separate
+// data structures.
+//
+// If the CompressedReadNames passed to the constructor are open,
+// each processing thread encodes the names of the reads it finds,
+// so the uncompressed names are never stored.
+// The encoded names are stored in readNames, if it is open,
+// and in compressedReadNames otherwise.
 class ChanZuckerberg::shasta::ReadLoader :
     public MultithreadedObject<ReadLoader>{
 public:
 
     // The constructor does all the work.
+    // Messages are written to out.
+    // If readLengths is not zero, the number of bases
+    // (before run-length encoding) of each read stored
+    // is appended to it.
     ReadLoader(
         const string& fileName,
         size_t minReadLength,
@@ -34,19 +69,58 @@ public:
         size_t pageSize,
         LongBaseSequences& reads,
         MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
-        MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts);
+        CompressedReadNames& compressedReadNames,
+        MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+        LongestReadsFilter* longestReadsFilter = 0,
+        ostream& out = cout,
+        vector<uint64_t>* readLengths = 0);
+
 private:
 
+    ostream& out;
+
+    // Where the reads are stored. See the constructor.
+    LongBaseSequences& reads;
+    MemoryMapped::VectorOfVectors<char, uint64_t>& readNames;
+    CompressedReadNames& compressedReadNames;
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts;
+    vector<uint64_t>* readLengths;
+    bool compressNames;
+    bool storeNamesInReadNames;
+    uint64_t readCount = 0;
+
     // The file descriptor for the input file.
     int fileDescriptor = -1;
 
     // The size, in bytes, of the input file.
+    // Only meaningful if isRegularFile is true.
     size_t fileSize;
+    bool isRegularFile = false;
     void getFileSize();
 
+    // The format of the input file, determined from its first character.
+    enum class FileFormat {
+        fasta,
+        fastq
+    };
+    FileFormat fileFormat = FileFormat::fasta;
+    void setFileFormat();
+
+    // The character that introduces a read in the input file:
+    // '>' for fasta, '@' for fastq.
+    char readBeginCharacter() const
+    {
+        return (fileFormat == FileFormat::fastq) ? '@' : '>';
+    }
+
     // The minimum read length. Shorter reads are not stored.
     size_t minReadLength;
 
+    // If not zero, reads shorter than the length cutoff of this filter
+    // are also not stored, and the lengths of the reads stored
+    // are entered in the filter after processing each block.
+    LongestReadsFilter* longestReadsFilter;
+
     // The block size we are using.
     size_t blockSize;
 
@@ -75,6 +149,67 @@ private:
     void readBlockSequential();
     void readBlockParallel(size_t threadCount);
 
+    // Check that the buffer begins with the character that introduces a read.
+    // For the first block, this also sets the file format.
+    void checkBufferBegin();
+
+    // Move to the leftOver data the final, possibly partial,
+    // read in the buffer.
+    void moveLastReadToLeftOver();
+
+    // Process the block in the buffer using threadCountForProcessing threads,
+    // then permanently store the reads found by each thread.
+    // storeReads first makes space for them at the end,
+    // then each thread copies its reads to their final position.
+    void processBlock();
+    void storeReads();
+    void storeThreadFunction(size_t threadId);
+
+    // Read and process a regular file, reading blocks
+    // directly from the file.
+    void processRegularFile(const string& fileName);
+
+
+
+    // Streaming input.
+    // A dedicated thread decompresses the input (via zlib,
+    // which also passes uncompressed input through unchanged)
+    // into a bounded ring of blocks.
+    // The main thread copies each block to the buffer as soon as
+    // it is filled and processes it with the usual processThreadFunction,
+    // while the decompression thread moves on to the next block.
+    bool isStreaming = false;
+    gzFile gzipFile = 0;
+    class StreamingBlock {
+    public:
+        vector<char> data;
+        bool isLast = false;
+    };
+    static const size_t streamingBlockCount = 4;
+    size_t streamingBlockSize = 0;
+    vector<StreamingBlock> streamingBlocks;
+
+    // The number of blocks filled by the decompression thread
+    // and not yet consumed by the main thread.
+    // Blocks are filled and consumed in circular order.
+    // Protected by streamingMutex.
+    size_t filledStreamingBlockCount = 0;
+    std::mutex streamingMutex;
+    std::condition_variable streamingConditionVariable;
+
+    // Set by the decompression thread if an error occurs.
+    string streamingErrorMessage;
+
+    // Set by the main thread, if processing a block fails,
+    // to tell the decompression thread to stop.
+    // Protected by streamingMutex.
+    bool stopStreaming = false;
+
+    void processStreamingInput(const string& fileName);
+    void processStreamingBlocks(const string& fileName);
+    void decompressThreadFunction();
+
+
     // Functions called by each thread.
     void readThreadFunction(size_t threadId);
     void processThreadFunction(size_t threadId);
@@ -82,21 +217,61 @@ private:
     // Return true if a read begins at this position in the buffer.
     bool readBeginsHere(size_t bufferIndex) const;
 
+    // For fastq, a quality line can begin with '@'.
+    // So, to decide whether a fastq record begins at a given position,
+    // we also check that the line two lines later begins with '+'.
+    // This returns false if that line is not in the buffer.
+    bool fastqReadBeginsHere(size_t bufferIndex) const;
+
+    // Parse a read beginning at the given position in the buffer,
+    // storing its name and returning the position and length
+    // of its base characters in the buffer.
+    // The base characters are not checked here:
+    // this is done by computeRunLengthRead, and only for reads
+    // that are not discarded because they are too short.
+    // On return, bufferIndex points to the beginning of the next read.
+    void parseFastaRead(size_t& bufferIndex, string& readName,
+        size_t& sequenceBegin, size_t& sequenceLength) const;
+    void parseFastqRead(size_t& bufferIndex, string& readName,
+        size_t& sequenceBegin, size_t& sequenceLength) const;
+    void parseSequence(size_t& bufferIndex,
+        size_t& sequenceBegin, size_t& sequenceLength) const;
+
+    // Extract the read name from the current line and
+    // discard the rest of the line.
+    // On entry, bufferIndex points to the character immediately following
+    // the '>' or '@' that introduces the read.
+    void parseReadName(size_t& bufferIndex, string& readName) const;
+
+    // Skip to the beginning of the next line.
+    void skipLine(size_t& bufferIndex) const;
+
     // Vectors where each thread stores the reads it found.
+    // If compressing names, threadReadNames contains the encoded names.
     // Indexed by threadId.
     vector< shared_ptr<MemoryMapped::VectorOfVectors<char, uint64_t> > > threadReadNames;
     vector< shared_ptr<LongBaseSequences> > threadReads;
     vector< shared_ptr<MemoryMapped::VectorOfVectors<uint8_t, uint64_t> > > threadReadRepeatCounts;
+    vector< vector<uint64_t> > threadReadLengths;  // Only used with a LongestReadsFilter or readLengths.
+
+    // The index at which each thread stores its first read
+    // for the current block. Has one more entry than the number of threads.
+    vector<uint64_t> threadFirstReadIndex;
 
-    // Given the raw representation of a read, compute its
-    // run-length representation.
+    // Given the base characters of a read, compute its
+    // run-length representation, with the bases stored
+    // as in LongBaseSequenceView.
     // This returns false if the read contains a homopolymer run
     // of more than 255 bases, which cannot be represented
     // with a one-byte repeat count.
+    // The last argument is work space.
     static bool computeRunLengthRead(
-        const vector<Base>& read,
-        vector<Base>& runLengthRead,
-        vector<uint8_t>& readRepeatCount);
+        const char* begin,
+        const char* end,
+        vector<uint64_t>& runLengthRead,
+        uint64_t& runLengthBaseCount,
+        vector<uint8_t>& readRepeatCount,
+        vector<uint32_t>& runBegins);
 
     // Create the name to be used for a MemoryMapped
     // object to be used by a thread.
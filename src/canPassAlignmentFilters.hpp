@@ -0,0 +1,76 @@
+#ifndef CZI_SHASTA_CAN_PASS_ALIGNMENT_FILTERS_HPP
+#define CZI_SHASTA_CAN_PASS_ALIGNMENT_FILTERS_HPP
+
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Return false if a marker alignment of two oriented reads
+        // provably has fewer than minAlignedMarkerCount markers
+        // or more than maxTrim left or right trim, using only
+        // the vertices of the alignment computation:
+        // the pairs of markers with the same k-mer in the two oriented reads.
+        // Each marker in the alignment corresponds to a distinct vertex,
+        // so the alignment has at most as many markers as there are vertices.
+        // The first and last markers of the alignment are also vertices,
+        // so the left and right trim of the alignment are no less than
+        // the smallest left and right trim of a vertex.
+        // This is used by both AlignmentGraph and LazyAlignmentGraph.
+        // The vertices are in [begin, end), and getOrdinals
+        // must return the ordinals of a vertex in the two oriented reads.
+        template<class Iterator, class GetOrdinals> bool canPassAlignmentFilters(
+            Iterator begin,
+            Iterator end,
+            uint64_t vertexCount,
+            const GetOrdinals& getOrdinals,
+            uint32_t markerCount0,
+            uint32_t markerCount1,
+            size_t minAlignedMarkerCount,
+            size_t maxTrim);
+
+    }
+}
+
+
+
+template<class Iterator, class GetOrdinals>
+    bool ChanZuckerberg::shasta::canPassAlignmentFilters(
+    Iterator begin,
+    Iterator end,
+    uint64_t vertexCount,
+    const GetOrdinals& getOrdinals,
+    uint32_t markerCount0,
+    uint32_t markerCount1,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim)
+{
+    if(vertexCount < minAlignedMarkerCount) {
+        return false;
+    }
+
+    bool leftTrimCanPass = false;
+    bool rightTrimCanPass = false;
+    for(Iterator it=begin; it!=end; ++it) {
+        const auto& ordinals = getOrdinals(*it);
+        const uint64_t ordinal0 = ordinals[0];
+        const uint64_t ordinal1 = ordinals[1];
+        const uint64_t leftTrim = min(ordinal0, ordinal1);
+        const uint64_t rightTrim = min(
+            markerCount0 - 1 - ordinal0,
+            markerCount1 - 1 - ordinal1);
+        if(leftTrim <= maxTrim) {
+            leftTrimCanPass = true;
+        }
+        if(rightTrim <= maxTrim) {
+            rightTrimCanPass = true;
+        }
+        if(leftTrimCanPass && rightTrimCanPass) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include "compressAlignment.hpp"
+#include "Alignment.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+#include "iostream.hpp"
+#include <random>
+
+
+
+// Zigzag encoding maps signed integers to unsigned integers
+// so that numbers of small absolute value stay small:
+// 0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...
+static inline uint32_t zigzagEncode(int32_t n)
+{
+    return (uint32_t(n) << 1) ^ uint32_t(n >> 31);
+}
+static inline int32_t zigzagDecode(uint32_t n)
+{
+    return int32_t(n >> 1) ^ -int32_t(n & 1);
+}
+
+
+
+static inline void appendVarint(uint32_t n, vector<uint8_t>& v)
+{
+    while(n >= 0x80) {
+        v.push_back(uint8_t(n | 0x80));
+        n >>= 7;
+    }
+    v.push_back(uint8_t(n));
+}
+static inline uint32_t getVarint(const uint8_t*& p, const uint8_t* end)
+{
+    uint32_t n = 0;
+    for(uint32_t shift=0; ; shift+=7) {
+        CZI_ASSERT(p != end);
+        const uint8_t byte = *p++;
+        n |= uint32_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return n;
+        }
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::compressAlignment(
+    const Alignment& alignment,
+    vector<uint8_t>& v)
+{
+    v.clear();
+    array<uint32_t, 2> previousOrdinals = {0, 0};
+    for(const array<uint32_t, 2>& ordinals: alignment.ordinals) {
+        for(size_t i=0; i<2; i++) {
+            appendVarint(zigzagEncode(int32_t(ordinals[i] - previousOrdinals[i])), v);
+        }
+        previousOrdinals = ordinals;
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::decompressAlignment(
+    const uint8_t* begin,
+    const uint8_t* end,
+    Alignment& alignment)
+{
+    alignment.ordinals.clear();
+    array<uint32_t, 2> ordinals = {0, 0};
+    const uint8_t* p = begin;
+    while(p != end) {
+        for(size_t i=0; i<2; i++) {
+            ordinals[i] += uint32_t(zigzagDecode(getVarint(p, end)));
+        }
+        alignment.ordinals.push_back(ordinals);
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::testCompressAlignment()
+{
+    // Generate random alignments, with ordinals mostly increasing
+    // by small amounts, but with occasional large jumps
+    // and steps backward.
+    std::mt19937 randomSource(231);
+    std::geometric_distribution<uint32_t> stepDistribution(0.5);
+    std::uniform_int_distribution<uint32_t> uniformDistribution(0, 99);
+    vector<uint8_t> v;
+    Alignment alignment;
+    Alignment decompressedAlignment;
+    uint64_t totalPairCount = 0;
+    uint64_t totalByteCount = 0;
+    for(size_t i=0; i<100; i++) {
+        alignment.ordinals.clear();
+        array<uint32_t, 2> ordinals = {uint32_t(i * 1000), uint32_t(i * 10)};
+        for(size_t j=0; j<i*20; j++) {
+            for(size_t k=0; k<2; k++) {
+                const uint32_t r = uniformDistribution(randomSource);
+                if(r == 0) {
+                    ordinals[k] += 100000;
+                } else if(r == 1 && ordinals[k] > 0) {
+                    --ordinals[k];
+                } else {
+                    ordinals[k] += 1 + stepDistribution(randomSource);
+                }
+            }
+            alignment.ordinals.push_back(ordinals);
+        }
+
+        compressAlignment(alignment, v);
+        decompressAlignment(v.data(), v.data() + v.size(), decompressedAlignment);
+        CZI_ASSERT(decompressedAlignment.ordinals == alignment.ordinals);
+        totalPairCount += alignment.ordinals.size();
+        totalByteCount += v.size();
+    }
+    cout << "Stored " << totalPairCount << " aligned marker pairs using " <<
+        totalByteCount << " bytes." << endl;
+}
@@ -0,0 +1,42 @@
+#ifndef CZI_SHASTA_COMPRESS_ALIGNMENT_HPP
+#define CZI_SHASTA_COMPRESS_ALIGNMENT_HPP
+
+/*******************************************************************************
+
+Compact encoding of the marker ordinals of an Alignment,
+used to store the alignments found by computeAlignments.
+
+For each pair of aligned markers, we store the difference
+of each of its two ordinals from the corresponding ordinal
+of the previous pair (or from 0 for the first pair).
+Each difference is zigzag encoded, so the occasional negative
+difference is also supported, and then stored as a varint
+(7 bits per byte, with the most significant bit set
+in all bytes except the last).
+
+In a typical alignment most differences are small,
+so most pairs use 2 bytes instead of the 8 bytes
+of the uncompressed representation.
+
+*******************************************************************************/
+
+#include "cstdint.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        class Alignment;
+
+        // Encode the ordinals of an alignment, replacing
+        // the previous contents of the output vector.
+        void compressAlignment(const Alignment&, vector<uint8_t>&);
+
+        // Decode an alignment encoded by compressAlignment.
+        void decompressAlignment(const uint8_t* begin, const uint8_t* end, Alignment&);
+
+        void testCompressAlignment();
+    }
+}
+
+#endif
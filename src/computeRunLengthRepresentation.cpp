@@ -1,7 +1,16 @@
 #include "computeRunLengthRepresentation.hpp"
+#include "chrono.hpp"
+#include "LongBaseSequence.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard library.
+#include "iostream.hpp"
+#include "string.hpp"
+#include <cstring>
+#include <limits>
+#include <random>
+
 
 
 // Given the raw representation of a sequence, compute its
@@ -37,3 +46,253 @@ bool ChanZuckerberg::shasta::computeRunLengthRepresentation(
     return true;
 
 }
+
+
+
+// Character version of computeRunLengthRepresentation,
+// used when loading reads.
+// The characters are processed 8 at a time, using word-parallel
+// operations on 64-bit words:
+// - After setting the lower case bit, a run of identical bases
+//   is a run of identical bytes, so the run boundaries are the
+//   non-zero bytes of the xor of each word with itself shifted by one byte.
+// - The base value of each byte is computed from bits 1 and 2
+//   of the lower case character (a=0, c=1, t=2, g=3, with
+//   t and g then swapped to get the Base encoding).
+// - All characters are checked to be valid bases by comparing
+//   each word against a, c, g, t in all bytes.
+// The position and base of the first character of each run are then
+// stored without branches, and the repeat counts and the
+// LongBaseSequenceView representation are computed from them
+// in separate, sequential passes.
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Return a word with the high bit set for each byte of x that is zero.
+        inline uint64_t zeroBytes(uint64_t x)
+        {
+            const uint64_t lowBits = 0x7f7f7f7f7f7f7f7fULL;
+            return ~((((x & lowBits) + lowBits) | x) | lowBits);
+        }
+
+    }
+}
+bool ChanZuckerberg::shasta::computeRunLengthRepresentation(
+    const char* begin,
+    const char* end,
+    vector<uint64_t>& runLengthSequence,
+    uint64_t& runLengthBaseCount,
+    vector<uint8_t>& repeatCount,
+    vector<uint32_t>& runBegins)
+{
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+        "computeRunLengthRepresentation assumes a little endian platform.");
+
+    const uint64_t n = uint64_t(end - begin);
+    runLengthBaseCount = 0;
+    if(n == 0) {
+        runLengthSequence.clear();
+        repeatCount.clear();
+        return true;
+    }
+
+    // Make space for the worst case, when there are no repeats.
+    // Until the repeat counts are computed, we use repeatCount
+    // to store the base value of each run.
+    runBegins.resize(n + 1);
+    repeatCount.resize(n);
+    uint32_t* runBegin = runBegins.data();
+    uint8_t* runBase = repeatCount.data();
+
+    // Locate the runs, 8 characters at a time.
+    // A lower case character is never zero, so the first
+    // character always begins a run.
+    // At each character we store its position and base value,
+    // but only advance runLengthBaseCount if it begins a run.
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highBits = 0x8080808080808080ULL;
+    const uint64_t lowerCaseBits = 0x2020202020202020ULL;
+    uint64_t previousCharacter = 0;
+    uint64_t validBytes = highBits;
+    uint64_t position = 0;
+    for(; position+8 <= n; position+=8) {
+        uint64_t w;
+        std::memcpy(&w, begin + position, 8);
+        w |= lowerCaseBits;
+        validBytes &=
+            zeroBytes(w ^ (ones * uint64_t('a'))) |
+            zeroBytes(w ^ (ones * uint64_t('c'))) |
+            zeroBytes(w ^ (ones * uint64_t('g'))) |
+            zeroBytes(w ^ (ones * uint64_t('t')));
+        const uint64_t boundaries =
+            (~zeroBytes(w ^ ((w << 8ULL) | previousCharacter)) & highBits) >> 7ULL;
+        previousCharacter = w >> 56ULL;
+        uint64_t values = (w >> 1ULL) & (ones * 3ULL);
+        values ^= (values >> 1ULL) & ones;
+        for(uint64_t j=0; j<8; j++) {
+            runBegin[runLengthBaseCount] = uint32_t(position + j);
+            runBase[runLengthBaseCount] = uint8_t(values >> (j << 3ULL));
+            runLengthBaseCount += (boundaries >> (j << 3ULL)) & 1ULL;
+        }
+    }
+    if(validBytes != highBits) {
+        for(const char* it=begin; it!=begin+position; ++it) {
+            Base::fromCharacter(*it);     // Throws with an appropriate message.
+        }
+    }
+
+    // Process the remaining characters one at a time.
+    for(; position<n; position++) {
+        const char c = begin[position];
+        const uint64_t lowerCaseCharacter = uint64_t(uint8_t(c)) | 0x20ULL;
+        runBegin[runLengthBaseCount] = uint32_t(position);
+        runBase[runLengthBaseCount] = Base::fromCharacter(c).value;
+        runLengthBaseCount += (lowerCaseCharacter != previousCharacter);
+        previousCharacter = lowerCaseCharacter;
+    }
+    runBegin[runLengthBaseCount] = uint32_t(n);
+
+    // Store the bases, 64 at a time.
+    runLengthSequence.resize(LongBaseSequenceView::wordCount(runLengthBaseCount));
+    uint64_t* words = runLengthSequence.data();
+    for(uint64_t i=0; i<runLengthBaseCount; i+=64) {
+        const uint64_t m = min(uint64_t(64), runLengthBaseCount - i);
+        uint64_t word0 = 0;
+        uint64_t word1 = 0;
+        for(uint64_t j=0; j<m; j++) {
+            const uint64_t value = runBase[i + j];
+            word0 |= (value & 1ULL) << (63ULL - j);
+            word1 |= (value >> 1ULL) << (63ULL - j);
+        }
+        *words++ = word0;
+        *words++ = word1;
+    }
+
+    // Compute the repeat counts, overwriting the bases.
+    uint8_t* counts = repeatCount.data();
+    uint64_t runIsTooLong = 0;
+    for(uint64_t i=0; i<runLengthBaseCount; i++) {
+        const uint64_t runLength = runBegin[i + 1] - runBegin[i];
+        runIsTooLong |= (runLength > 255);
+        counts[i] = uint8_t(runLength);
+    }
+    repeatCount.resize(runLengthBaseCount);
+
+    return runIsTooLong == 0;
+}
+
+
+
+void ChanZuckerberg::shasta::testComputeRunLengthRepresentation()
+{
+    // Generate a random sequence with homopolymer runs
+    // distributed roughly as in nanopore reads,
+    // using both upper and lower case characters.
+    const string characters = "ACGTacgt";
+    std::mt19937 randomSource(231);
+    std::uniform_int_distribution<int> baseDistribution(0, 3);
+    std::uniform_int_distribution<int> caseDistribution(0, 9);
+    std::geometric_distribution<int> runLengthDistribution(0.6);
+    const size_t n = 100 * 1000 * 1000;
+    string sequence;
+    sequence.reserve(n);
+    int previousBase = -1;
+    while(sequence.size() < n) {
+        int base = baseDistribution(randomSource);
+        if(base == previousBase) {
+            continue;
+        }
+        previousBase = base;
+        const size_t runLength = min(n - sequence.size(), size_t(1 + runLengthDistribution(randomSource)));
+        for(size_t i=0; i<runLength; i++) {
+            sequence.push_back(characters[base + 4 * (caseDistribution(randomSource) == 0)]);
+        }
+    }
+
+    // Check that the two versions agree on
+    // subsequences of all lengths from 0 to 300,
+    // starting at all alignments.
+    vector<Base> bases;
+    vector<Base> runLengthBases;
+    vector<uint8_t> repeatCount0;
+    vector<uint64_t> runLengthSequence;
+    uint64_t runLengthBaseCount;
+    vector<uint8_t> repeatCount1;
+    vector<uint32_t> runBegins;
+    for(size_t length=0; length<=300; length++) {
+        for(size_t offset=0; offset<8; offset++) {
+            const char* begin = sequence.data() + 1000 * length + offset;
+            bases.clear();
+            for(size_t i=0; i<length; i++) {
+                bases.push_back(Base::fromCharacter(begin[i]));
+            }
+            CZI_ASSERT(computeRunLengthRepresentation(bases, runLengthBases, repeatCount0));
+            CZI_ASSERT(computeRunLengthRepresentation(begin, begin + length,
+                runLengthSequence, runLengthBaseCount, repeatCount1, runBegins));
+            CZI_ASSERT(runLengthBaseCount == runLengthBases.size());
+            CZI_ASSERT(repeatCount1 == repeatCount0);
+            const LongBaseSequenceView view(runLengthSequence.data(), runLengthBaseCount);
+            for(size_t i=0; i<runLengthBaseCount; i++) {
+                CZI_ASSERT(view[i] == runLengthBases[i]);
+            }
+        }
+    }
+
+    // Check long runs and invalid characters.
+    const string longRun = "AC" + string(255, 'G') + "T";
+    CZI_ASSERT(computeRunLengthRepresentation(&longRun.front(), &longRun.front() + longRun.size(),
+        runLengthSequence, runLengthBaseCount, repeatCount1, runBegins));
+    CZI_ASSERT(runLengthBaseCount == 4);
+    CZI_ASSERT(repeatCount1[2] == 255);
+    const string tooLongRun = "AC" + string(256, 'g') + "T";
+    CZI_ASSERT(!computeRunLengthRepresentation(&tooLongRun.front(), &tooLongRun.front() + tooLongRun.size(),
+        runLengthSequence, runLengthBaseCount, repeatCount1, runBegins));
+    const string invalid = "ACGTACGTACGTN";
+    bool exceptionWasThrown = false;
+    try {
+        computeRunLengthRepresentation(&invalid.front(), &invalid.front() + invalid.size(),
+            runLengthSequence, runLengthBaseCount, repeatCount1, runBegins);
+    } catch(const runtime_error&) {
+        exceptionWasThrown = true;
+    }
+    CZI_ASSERT(exceptionWasThrown);
+
+    // Time the conversion of the entire sequence, split into reads
+    // of 50 Kb, using a single thread, with the code used by ReadLoader
+    // before and after the word-parallel version was introduced.
+    // Each version is run a few times and the best time is reported.
+    const size_t readLength = 50000;
+    const size_t repetitionCount = 5;
+    double bestTime0 = std::numeric_limits<double>::max();
+    double bestTime1 = std::numeric_limits<double>::max();
+    uint64_t totalRunLengthBaseCount = 0;
+    for(size_t repetition=0; repetition<repetitionCount; repetition++) {
+        const auto t0 = steady_clock::now();
+        for(size_t readBegin=0; readBegin<n; readBegin+=readLength) {
+            const size_t readEnd = min(n, readBegin + readLength);
+            bases.clear();
+            for(size_t i=readBegin; i!=readEnd; i++) {
+                bases.push_back(Base::fromCharacter(sequence[i]));
+            }
+            computeRunLengthRepresentation(bases, runLengthBases, repeatCount0);
+            const LongBaseSequence longBaseSequence(runLengthBases);
+        }
+        const auto t1 = steady_clock::now();
+        totalRunLengthBaseCount = 0;
+        for(size_t readBegin=0; readBegin<n; readBegin+=readLength) {
+            const size_t readEnd = min(n, readBegin + readLength);
+            computeRunLengthRepresentation(&sequence[readBegin], &sequence[readBegin] + (readEnd - readBegin),
+                runLengthSequence, runLengthBaseCount, repeatCount1, runBegins);
+            totalRunLengthBaseCount += runLengthBaseCount;
+        }
+        const auto t2 = steady_clock::now();
+        bestTime0 = min(bestTime0, seconds(t1 - t0));
+        bestTime1 = min(bestTime1, seconds(t2 - t1));
+    }
+
+    const double gigabytes = double(n) / 1.e9;
+    cout << "Run-length encoding of " << n << " characters into " <<
+        totalRunLengthBaseCount << " run-length bases." << endl;
+    cout << "Base by base: " << gigabytes / bestTime0 << " GB/s per core." << endl;
+    cout << "Word-parallel: " << gigabytes / bestTime1 << " GB/s per core." << endl;
+}
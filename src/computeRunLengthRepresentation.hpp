@@ -17,6 +17,27 @@ namespace ChanZuckerberg {
         vector<Base>& runLengthSequence,
         vector<uint8_t>& repeatCount);
 
+    // Same as above, but starting from the base characters
+    // of the sequence (upper or lower case),
+    // and storing the run-length sequence directly in the
+    // two words per 64 bases representation used by LongBaseSequenceView.
+    // This is used when loading reads and processes the input
+    // 8 characters at a time, using word-parallel operations.
+    // Throws if a character is not a valid base.
+    // The last argument is work space, which the caller can
+    // reuse to avoid memory allocation.
+    bool computeRunLengthRepresentation(
+        const char* begin,
+        const char* end,
+        vector<uint64_t>& runLengthSequence,
+        uint64_t& runLengthBaseCount,
+        vector<uint8_t>& repeatCount,
+        vector<uint32_t>& runBegins);
+
+    // Check that the two versions of computeRunLengthRepresentation
+    // agree, and compare their speed.
+    void testComputeRunLengthRepresentation();
+
     }
 }
 
@@ -0,0 +1,152 @@
+#include "findAlignmentDiagonal.hpp"
+#include "utility.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+
+
+// Compute the histogram of the diagonals of all pairs of markers
+// with the same k-mer, skipping high frequency k-mers.
+// The histogram is indexed by diagonal + markerCount0,
+// so all possible diagonals are covered.
+static void computeDiagonalHistogram(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    vector<uint32_t>& histogram)
+{
+    const vector<MarkerWithOrdinal>& markers0 = markers[0];
+    const vector<MarkerWithOrdinal>& markers1 = markers[1];
+    const int32_t markerCount0 = int32_t(markers0.size());
+    const int32_t markerCount1 = int32_t(markers1.size());
+
+    histogram.clear();
+    histogram.resize(markerCount0 + markerCount1, 0);
+
+    // Joint loop over the markers, looking for common k-mer ids,
+    // as in AlignmentGraph::createVertices.
+    using MarkerIterator = vector<MarkerWithOrdinal>::const_iterator;
+    const MarkerIterator end0 = markers0.end();
+    const MarkerIterator end1 = markers1.end();
+    MarkerIterator it0 = markers0.begin();
+    MarkerIterator it1 = markers1.begin();
+    while(it0!=end0 && it1!=end1) {
+        if(it0->kmerId < it1->kmerId) {
+            ++it0;
+        } else if(it1->kmerId < it0->kmerId) {
+            ++it1;
+        } else {
+            const KmerId kmerId = it0->kmerId;
+            MarkerIterator it0End = it0;
+            MarkerIterator it1End = it1;
+            while(it0End!=end0 && it0End->kmerId==kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->kmerId==kmerId) {
+                ++it1End;
+            }
+            if(size_t(it0End - it0) <= maxMarkerFrequency && size_t(it1End - it1) <= maxMarkerFrequency) {
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                        ++histogram[int32_t(jt1->ordinal) - int32_t(jt0->ordinal) + markerCount0];
+                    }
+                }
+            }
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+}
+
+
+
+// Find the window of 2*bandHalfWidth+1 consecutive diagonals
+// with the most pairs. In case of ties, the first one wins.
+// Return the diagonal at the center of the window
+// and the number of pairs in the window.
+static pair<int32_t, uint64_t> findBestWindow(
+    const vector<uint32_t>& histogram,
+    int32_t markerCount0,
+    uint32_t bandHalfWidth)
+{
+    const int32_t histogramSize = int32_t(histogram.size());
+    const int32_t windowSize = int32_t(2 * bandHalfWidth + 1);
+    uint64_t windowCount = 0;
+    uint64_t bestWindowCount = 0;
+    int32_t bestDiagonal = 0;
+    for(int32_t i=0; i<histogramSize; i++) {
+        windowCount += histogram[i];
+        if(i >= windowSize) {
+            windowCount -= histogram[i - windowSize];
+        }
+        if(windowCount > bestWindowCount) {
+            bestWindowCount = windowCount;
+
+            // The window covers histogram indexes
+            // [i-windowSize+1, i], centered at i-bandHalfWidth.
+            bestDiagonal = i - int32_t(bandHalfWidth) - markerCount0;
+        }
+    }
+    return make_pair(bestDiagonal, bestWindowCount);
+}
+
+
+
+int32_t ChanZuckerberg::shasta::findAlignmentDiagonal(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    uint32_t bandHalfWidth,
+    vector<uint32_t>& histogram)
+{
+    computeDiagonalHistogram(markers, maxMarkerFrequency, histogram);
+    return findBestWindow(histogram, int32_t(markers[0].size()), bandHalfWidth).first;
+}
+
+
+
+uint64_t ChanZuckerberg::shasta::countAlignmentMarkerPairs(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    uint32_t bandHalfWidth,
+    vector<uint32_t>& histogram)
+{
+    // For a banded alignment, count the pairs in the band.
+    if(bandHalfWidth > 0) {
+        computeDiagonalHistogram(markers, maxMarkerFrequency, histogram);
+        return findBestWindow(histogram, int32_t(markers[0].size()), bandHalfWidth).second;
+    }
+
+    // Otherwise, count all pairs, without computing the histogram.
+    const vector<MarkerWithOrdinal>& markers0 = markers[0];
+    const vector<MarkerWithOrdinal>& markers1 = markers[1];
+    using MarkerIterator = vector<MarkerWithOrdinal>::const_iterator;
+    const MarkerIterator end0 = markers0.end();
+    const MarkerIterator end1 = markers1.end();
+    MarkerIterator it0 = markers0.begin();
+    MarkerIterator it1 = markers1.begin();
+    uint64_t pairCount = 0;
+    while(it0!=end0 && it1!=end1) {
+        if(it0->kmerId < it1->kmerId) {
+            ++it0;
+        } else if(it1->kmerId < it0->kmerId) {
+            ++it1;
+        } else {
+            const KmerId kmerId = it0->kmerId;
+            MarkerIterator it0End = it0;
+            MarkerIterator it1End = it1;
+            while(it0End!=end0 && it0End->kmerId==kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->kmerId==kmerId) {
+                ++it1End;
+            }
+            const uint64_t streakLength0 = uint64_t(it0End - it0);
+            const uint64_t streakLength1 = uint64_t(it1End - it1);
+            if(streakLength0 <= maxMarkerFrequency && streakLength1 <= maxMarkerFrequency) {
+                pairCount += streakLength0 * streakLength1;
+            }
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+    return pairCount;
+}
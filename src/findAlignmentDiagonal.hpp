@@ -0,0 +1,50 @@
+#ifndef CZI_SHASTA_FIND_ALIGNMENT_DIAGONAL_HPP
+#define CZI_SHASTA_FIND_ALIGNMENT_DIAGONAL_HPP
+
+#include "Marker.hpp"
+
+#include "array.hpp"
+#include "cstdint.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Estimate the dominant diagonal of a marker alignment
+        // of two oriented reads, used for banded alignments.
+        // The diagonal of a pair of markers with the same k-mer
+        // is ordinal1 - ordinal0. We compute a histogram of the diagonals
+        // of all pairs of markers with the same k-mer, skipping k-mers
+        // that appear more than maxMarkerFrequency times in either
+        // oriented read, as the alignment does.
+        // This returns the diagonal d that maximizes the number of pairs
+        // with diagonal in [d-bandHalfWidth, d+bandHalfWidth],
+        // or 0 if there are no such pairs.
+        int32_t findAlignmentDiagonal(
+
+            // Markers of the two oriented reads, sorted by KmerId.
+            const array<vector<MarkerWithOrdinal>, 2>& markers,
+
+            uint32_t maxMarkerFrequency,
+            uint32_t bandHalfWidth,
+
+            // Work area, reused to reduce memory allocation activity.
+            vector<uint32_t>& histogram);
+
+        // Return the number of pairs of markers with the same k-mer
+        // that an alignment computed with the same maxMarkerFrequency
+        // and bandHalfWidth would use as vertices.
+        // This is an upper bound on the number of markers in the alignment,
+        // and is much cheaper to compute than the alignment itself.
+        // The arguments are as for findAlignmentDiagonal,
+        // and bandHalfWidth can be zero for an unbanded alignment.
+        uint64_t countAlignmentMarkerPairs(
+            const array<vector<MarkerWithOrdinal>, 2>& markers,
+            uint32_t maxMarkerFrequency,
+            uint32_t bandHalfWidth,
+            vector<uint32_t>& histogram);
+
+    }
+}
+
+#endif
@@ -2,7 +2,7 @@
 #define CZI_SHASTA_FIND_MARKER_ID_HPP
 
 #include "Marker.hpp"
-#include "MemoryMappedVectorOfVectors.hpp"
+#include "Markers.hpp"
 #include "ReadId.hpp"
 
 #include "cstdint.hpp"
@@ -14,10 +14,11 @@ namespace ChanZuckerberg {
 
         // Given a global marker id in the global marker table,
         // return the corresponding OrientedReadId and ordinal.
-        // This requires a binary search in the markers toc.
+        // This requires a binary search in the markers toc
+        // (see Markers::find).
         inline pair<OrientedReadId, uint32_t> findMarkerId(
             MarkerId,
-            const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers);
+            const Markers& markers);
 
     }
 }
@@ -26,7 +27,7 @@ namespace ChanZuckerberg {
 inline std::pair<ChanZuckerberg::shasta::OrientedReadId, uint32_t>
     ChanZuckerberg::shasta::findMarkerId(
     MarkerId markerId,
-    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers)
+    const Markers& markers)
 {
     OrientedReadId::Int orientedReadIdValue;
     uint32_t ordinal;
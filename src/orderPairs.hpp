@@ -4,6 +4,8 @@
 
 // Classes to sort pairs using various criteria.
 
+#include "utility.hpp"
+
 namespace ChanZuckerberg {
     namespace shasta {
 